@@ -0,0 +1,25 @@
+# generated automatically by aclocal 1.16.5 -*- Autoconf -*-
+
+# Copyright (C) 1996-2021 Free Software Foundation, Inc.
+
+# This file is free software; the Free Software Foundation
+# gives unlimited permission to copy and/or distribute it,
+# with or without modifications, as long as this notice is preserved.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY, to the extent permitted by law; without
+# even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+# PARTICULAR PURPOSE.
+
+m4_ifndef([AC_CONFIG_MACRO_DIRS], [m4_defun([_AM_CONFIG_MACRO_DIRS], [])m4_defun([AC_CONFIG_MACRO_DIRS], [_AM_CONFIG_MACRO_DIRS($@)])])
+m4_include([m4/ax_pthread.m4])
+m4_include([m4/cmmsg.m4])
+m4_include([m4/compression.m4])
+m4_include([m4/dns.m4])
+m4_include([m4/gettid.m4])
+m4_include([m4/misc.m4])
+m4_include([m4/openssl.m4])
+m4_include([m4/sendfile.m4])
+m4_include([m4/tcl.m4])
+m4_include([m4/usermgt.m4])
+m4_include([m4/zlib.m4])
@@ -79,6 +79,7 @@
 #define NS_CONN_ZIPACCEPTED         0x10000u /* The request accepts zip compression */
 #define NS_CONN_BROTLIACCEPTED      0x20000u /* The request accept brotli compression */
 #define NS_CONN_CONTINUE            0x40000u /* The request got "Expect: 100-continue" */
+#define NS_CONN_ZSTDACCEPTED        0x80000u /* The request accepts zstd compression */
 #define NS_CONN_ENTITYTOOLARGE    0x0100000u /* The sent entity was too large */
 #define NS_CONN_REQUESTURITOOLONG 0x0200000u /* Request-URI too long */
 #define NS_CONN_LINETOOLONG       0x0400000u /* Request header line too long */
@@ -253,8 +254,10 @@ typedef enum {
  */
 
 typedef struct Ns_CacheSearch {
-    Ns_Time        now;
-    Tcl_HashSearch hsearch;
+    Ns_Time          now;
+    Tcl_HashSearch   hsearch;
+    struct Ns_Cache *cache;      /* searched cache */
+    int              partition;  /* currently searched partition */
 } Ns_CacheSearch;
 
 typedef struct Ns_Cache         Ns_Cache;
@@ -301,6 +304,18 @@ typedef enum {
     Preserve, ToLower, ToUpper
 } Ns_HeaderCaseDisposition;
 
+/*
+ * The following enum lists the eviction policies of caches
+ * (default: NS_CACHE_LRU).
+ */
+
+typedef enum {
+    NS_CACHE_LRU,
+    NS_CACHE_CLOCK,
+    NS_CACHE_TINYLFU,
+    NS_CACHE_GDSF
+} Ns_CachePolicy;
+
 /*
  * Global variables:
  *
@@ -842,6 +857,19 @@ Ns_CacheCreateEx(const char *name, int keys, time_t ttl, size_t maxSize,
                  Ns_FreeProc *freeProc)
     NS_GNUC_NONNULL(1);
 
+NS_EXTERN Ns_Cache *
+Ns_CacheCreatePartitioned(const char *name, int keys, size_t maxSize, Ns_FreeProc *freeProc,
+                          int npartitions)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN Ns_Cache *
+Ns_CachePartition(Ns_Cache *cache, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_RETURNS_NONNULL;
+
+NS_EXTERN int
+Ns_CacheGetPartitions(const Ns_Cache *cache)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
 NS_EXTERN void
 Ns_CacheDestroy(Ns_Cache *cache)
     NS_GNUC_NONNULL(1);
@@ -884,6 +912,10 @@ NS_EXTERN size_t
 Ns_CacheGetReuse(const Ns_Entry *entry)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
 
+NS_EXTERN int
+Ns_CacheGetCost(const Ns_Entry *entry)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
 NS_EXTERN size_t
 Ns_CacheGetSize(const Ns_Entry *entry)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
@@ -892,6 +924,26 @@ NS_EXTERN const Ns_Time *
 Ns_CacheGetExpirey(const Ns_Entry *entry)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
 
+NS_EXTERN void
+Ns_CacheSetRevalidate(Ns_Entry *entry, const Ns_Time *timePtr)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN const Ns_Time *
+Ns_CacheGetRevalidate(const Ns_Entry *entry)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+NS_EXTERN uintptr_t
+Ns_CacheGetGeneration(const Ns_Cache *cache)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN bool
+Ns_CacheIsStale(const Ns_Entry *entry, const Ns_Time *nowPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_PURE;
+
+NS_EXTERN bool
+Ns_CacheTryRevalidate(Ns_Entry *entry)
+    NS_GNUC_NONNULL(1);
+
 NS_EXTERN uintptr_t
 Ns_CacheGetTransactionEpoch(const Ns_Entry *entry)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
@@ -998,6 +1050,30 @@ NS_EXTERN void
 Ns_CacheSetMaxSize(Ns_Cache *cache, size_t maxSize)
     NS_GNUC_NONNULL(1);
 
+NS_EXTERN void
+Ns_CacheEnableLockFreeReads(Ns_Cache *cache)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN bool
+Ns_CacheFindValueLockFree(Ns_Cache *cache, const char *key, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+NS_EXTERN void
+Ns_CacheEnableNearHits(Ns_Cache *cache)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN void
+Ns_CacheRecordNearHit(Ns_Cache *cache, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+NS_EXTERN Ns_CachePolicy
+Ns_CacheGetPolicy(const Ns_Cache *cache)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+NS_EXTERN void
+Ns_CacheSetPolicy(Ns_Cache *cache, Ns_CachePolicy policy)
+    NS_GNUC_NONNULL(1);
+
 NS_EXTERN TCL_SIZE_T
 Ns_CacheGetNrUncommittedEntries(const Ns_Cache *cache)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
@@ -1025,12 +1101,21 @@ NS_EXTERN void Ns_ClsSet(const Ns_Cls *clsPtr, Ns_Conn *conn, void *value);
  * compress.c:
  */
 
+typedef enum {
+    NS_COMPRESS_GZIP,
+    NS_COMPRESS_BROTLI,
+    NS_COMPRESS_ZSTD
+} Ns_CompressEncoding;
+
+#define NS_COMPRESS_NR_ENCODINGS 3
+
 typedef struct Ns_CompressStream {
 
 #ifdef HAVE_ZLIB_H
     z_stream   z;
 #endif
     unsigned int flags;
+    void        *encoderPtr;   /* Brotli or zstd encoder of the current stream */
 
 } Ns_CompressStream;
 
@@ -1052,6 +1137,26 @@ NS_EXTERN Ns_ReturnCode
 Ns_CompressGzip(const char *buf, int len, Tcl_DString *dsPtr, int level)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
 
+NS_EXTERN Ns_ReturnCode
+Ns_CompressBufs(Ns_CompressStream *cStream, Ns_CompressEncoding encoding,
+                struct iovec *bufs, int nbufs, Ns_DString *dsPtr, int level, bool flush)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(5);
+
+NS_EXTERN Ns_CompressStream *
+Ns_CompressStreamGet(Ns_CompressEncoding encoding);
+
+NS_EXTERN void
+Ns_CompressStreamRelease(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+
+NS_EXTERN bool
+Ns_CompressEncodingAvailable(Ns_CompressEncoding encoding)
+    NS_GNUC_CONST;
+
+NS_EXTERN const char *
+Ns_CompressEncodingName(Ns_CompressEncoding encoding)
+    NS_GNUC_CONST NS_GNUC_RETURNS_NONNULL;
+
 NS_EXTERN Ns_ReturnCode
 Ns_InflateInit(Ns_CompressStream *cStream)
     NS_GNUC_NONNULL(1);
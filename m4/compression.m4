@@ -0,0 +1,109 @@
+#------------------------------------------------------------------------
+# AX_CHECK_BROTLI, AX_CHECK_ZSTD --
+#
+#       Check for the optional brotli and zstd encoder libraries used
+#       for on-the-fly compression of responses, possibly using a
+#       special directory.
+#
+# Arguments:
+#       none
+#
+# Results:
+#
+#       Adds the following arguments to configure:
+#               --with-brotli=[dir]
+#               --with-zstd=[dir]
+#
+#       Defines the following vars:
+#               BROTLI_INCLUDES, ZSTD_INCLUDES
+#                               Full path to the directory containing
+#                               the header files if a directory was
+#                               specified.
+#               BROTLI_LIBS, ZSTD_LIBS
+#                               Linker line for the encoder library,
+#                               empty when the library is not available.
+#------------------------------------------------------------------------
+
+AC_DEFUN([AX_CHECK_BROTLI], [
+AC_ARG_WITH([brotli],
+  AS_HELP_STRING(--with-brotli=DIR,Build and link with the brotli encoder (default: when available)),
+  [ac_brotli=$withval], [ac_brotli=check])
+
+BROTLI_INCLUDES=""
+BROTLI_LIBS=""
+if test "${ac_brotli}" != "no" ; then
+  ac_brotli_libs="-lbrotlienc"
+  if test -d "${ac_brotli}" ; then
+    BROTLI_INCLUDES="-I${ac_brotli}/include"
+    ac_brotli_libs="-L${ac_brotli}/lib -lbrotlienc"
+  fi
+  save_CPPFLAGS="$CPPFLAGS"
+  save_LIBS="$LIBS"
+  CPPFLAGS="$BROTLI_INCLUDES $CPPFLAGS"
+  LIBS="$LIBS $ac_brotli_libs"
+
+  AC_CHECK_HEADER([brotli/encode.h], [ac_brotli_header=yes], [ac_brotli_header=no])
+  AC_MSG_CHECKING([for BrotliEncoderCreateInstance])
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#include <brotli/encode.h>]],
+                                  [[BrotliEncoderDestroyInstance(BrotliEncoderCreateInstance(0, 0, 0));]])],
+                 [ac_brotli_lib=yes], [ac_brotli_lib=no])
+  AC_MSG_RESULT([$ac_brotli_lib])
+
+  if test "${ac_brotli_header}" = "yes" -a "${ac_brotli_lib}" = "yes" ; then
+    BROTLI_LIBS="$ac_brotli_libs"
+    AC_DEFINE([HAVE_BROTLI_ENCODE_H], [1], [Define to 1 if the brotli encoder is available.])
+  elif test "${ac_brotli}" != "check" ; then
+    AC_MSG_ERROR([Brotli compression support requested but not available])
+  fi
+
+  CPPFLAGS="$save_CPPFLAGS"
+  LIBS="$save_LIBS"
+fi
+
+AC_SUBST([BROTLI_INCLUDES])
+AC_SUBST([BROTLI_LIBS])
+])
+
+AC_DEFUN([AX_CHECK_ZSTD], [
+AC_ARG_WITH([zstd],
+  AS_HELP_STRING(--with-zstd=DIR,Build and link with the zstd encoder (default: when available)),
+  [ac_zstd=$withval], [ac_zstd=check])
+
+ZSTD_INCLUDES=""
+ZSTD_LIBS=""
+if test "${ac_zstd}" != "no" ; then
+  ac_zstd_libs="-lzstd"
+  if test -d "${ac_zstd}" ; then
+    ZSTD_INCLUDES="-I${ac_zstd}/include"
+    ac_zstd_libs="-L${ac_zstd}/lib -lzstd"
+  fi
+  save_CPPFLAGS="$CPPFLAGS"
+  save_LIBS="$LIBS"
+  CPPFLAGS="$ZSTD_INCLUDES $CPPFLAGS"
+  LIBS="$LIBS $ac_zstd_libs"
+
+  AC_CHECK_HEADER([zstd.h], [ac_zstd_header=yes], [ac_zstd_header=no])
+  AC_MSG_CHECKING([for ZSTD_compressStream2])
+  AC_LINK_IFELSE([AC_LANG_PROGRAM([[#include <zstd.h>]],
+                                  [[ZSTD_CCtx *c = ZSTD_createCCtx();
+                                    ZSTD_inBuffer in = {0, 0, 0};
+                                    ZSTD_outBuffer out = {0, 0, 0};
+                                    (void)ZSTD_compressStream2(c, &out, &in, ZSTD_e_end);
+                                    ZSTD_freeCCtx(c);]])],
+                 [ac_zstd_lib=yes], [ac_zstd_lib=no])
+  AC_MSG_RESULT([$ac_zstd_lib])
+
+  if test "${ac_zstd_header}" = "yes" -a "${ac_zstd_lib}" = "yes" ; then
+    ZSTD_LIBS="$ac_zstd_libs"
+    AC_DEFINE([HAVE_ZSTD_H], [1], [Define to 1 if the zstd encoder is available.])
+  elif test "${ac_zstd}" != "check" ; then
+    AC_MSG_ERROR([Zstd compression support requested but not available])
+  fi
+
+  CPPFLAGS="$save_CPPFLAGS"
+  LIBS="$save_LIBS"
+fi
+
+AC_SUBST([ZSTD_INCLUDES])
+AC_SUBST([ZSTD_LIBS])
+])
@@ -100,6 +100,8 @@ ns_section ns/parameters {
     #
     #ns_param   tclinitlock         true     ;# default: false
     #ns_param   concurrentinterpcreate false ;# default: true
+    #ns_param   interpwarmup        true     ;# default: false; report ready after minthreads interps are initialized
+    #ns_param   interpwarmupconcurrency 4    ;# default: number of CPUs; concurrent interp initializations at startup
     #ns_param   mutexlocktrace      true     ;# default false; print durations of long mutex calls to stderr
 
     #
@@ -384,6 +386,7 @@ ns_section ns/server/default {
     ns_param    connsperthread      1000  ;# default: 0; number of connections (requests) handled per thread
     ns_param    minthreads          5     ;# default: 1; minimal number of connection threads
     ns_param    maxthreads          100   ;# default: 10; maximal number of connection threads
+    #ns_param   maxinterps          20    ;# default: 0; maximal number of connection threads keeping an interp
     #ns_param    maxconnections     100   ;# default: 100; number of allocated connection structures
     ns_param    rejectoverrun       true  ;# default: false; send 503 when thread pool queue overruns
     #ns_param   threadtimeout       2m    ;# default: 2m; timeout for idle connection threads
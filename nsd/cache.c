@@ -17,13 +17,27 @@
  */
 
 #include "nsd.h"
+#include <float.h>
 
 struct Cache;
+struct Version;
+
+/*
+ * Lock-free reads of cache values require atomic operations, which are
+ * provided by GCC and clang via builtins. For other compilers,
+ * Ns_CacheEnableLockFreeReads() has no effect.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define CACHE_LOCKFREE_READS 1
+#endif
 
 /*
  * An Entry is a node in a linked list as well as being a
  * hash table entry. The linked list is there to keep track of
- * usage for the purposes of cache pruning.
+ * usage for the purposes of cache pruning. With the LRU policy, the
+ * list is kept in the order of the last usage; with the CLOCK and
+ * TINYLFU policies, it is kept in insertion order and a hit sets
+ * only the reference bit of the entry.
  */
 
 typedef struct Entry {
@@ -32,19 +46,74 @@ typedef struct Entry {
     struct Cache   *cachePtr;
     Tcl_HashEntry  *hPtr;
     Ns_Time         expires;          /* Absolute TTL timeout. */
+    Ns_Time         revalidate;       /* Absolute time, after which the value is stale */
     size_t          size;
     int             cost;             /* cost to compute a single entry */
     size_t          count;            /* reuse count of this entry */
     void           *value;            /* Will appear NULL for concurrent updates. */
     void           *uncommittedValue; /* Used for transactional mode */
     uintptr_t       transactionEpoch; /* Used for identifying transaction */
+    bool            referenced;       /* Reference bit for CLOCK and TINYLFU */
+    struct Version *versionPtr;       /* Published version for lock-free reads */
+    bool            refreshing;       /* Stale value is being revalidated */
+    double          priority;         /* GDSF priority */
+    size_t          heapIndex;        /* Position in the GDSF heap + 1, 0 when not in the heap */
 } Entry;
 
 /*
- * The following structure defines a cache
+ * A Version is an immutable copy of a committed entry value published for
+ * lock-free readers in a slot of the cache. Replaced or removed versions
+ * are retired and freed, when no reader can access it anymore (epoch based
+ * reclamation).
+ */
+
+typedef struct Version {
+    struct Version *nextPtr;          /* Next retired version */
+    Entry          *entryPtr;         /* Entry of the version, NULL when retired */
+    uintptr_t       retireEpoch;      /* Global epoch at retirement */
+    unsigned int    hash;
+    int             referenced;       /* Set by lock-free hits */
+    int             cost;
+    Ns_Time         expires;
+    size_t          size;
+    char           *value;
+    char            key[1];
+} Version;
+
+/*
+ * Every thread performing lock-free reads is registered as a reader. The
+ * epoch of a reader is the global epoch at the begin of its current read
+ * operation or 0, when the reader is not active.
+ */
+
+typedef struct Reader {
+    struct Reader *nextPtr;
+    uintptr_t      epoch;
+} Reader;
+
+#define LOCKFREE_SLOTS 4096u
+
+/*
+ * Number of rows and the minimum and maximum width of the count-min sketch
+ * used for estimating access frequencies by the TINYLFU policy.
+ */
+#define SKETCH_DEPTH     4
+#define SKETCH_MIN_WIDTH 1024u
+#define SKETCH_MAX_WIDTH (1024u * 1024u)
+
+/*
+ * The following structure defines a cache. A partitioned cache consists of
+ * a container cache holding the partitions, where each partition is a
+ * cache with its own lock, hash table, LRU list and size budget. The key
+ * based operations are performed on the partition determined by the hash
+ * value of the key; the operations on the whole cache are performed on all
+ * partitions.
  */
 
 typedef struct Cache {
+    struct Cache  *parentPtr;     /* container of a partition, or NULL */
+    struct Cache **partitions;    /* partitions of a container, or NULL */
+    int            npartitions;
     Entry         *firstEntryPtr;
     Entry         *lastEntryPtr;
     int            keys;
@@ -56,6 +125,31 @@ typedef struct Cache {
     Tcl_HashTable  entriesTable;
     uintptr_t      transactionEpoch;
     Tcl_HashTable  uncommittedTable;
+    Ns_CachePolicy policy;
+    uintptr_t      generation;    /* Bumped on every change of a committed value */
+    Entry         *rejectedPtr;   /* New entry not admitted, evicted on unlock */
+    struct {
+        Version      **slots;     /* Published versions, indexed by hash */
+        unsigned int   nslots;    /* Power of 2, 0 when disabled */
+        Version       *retiredPtr;/* Versions waiting for reclamation */
+        unsigned long  nhit;      /* Lock-free hits, updated atomically */
+        uint64_t       saved;     /* Cost of lock-free hits, updated atomically */
+    } lockfree;
+    struct {
+        unsigned int  *counts;    /* Hits in near caches, indexed by hash, updated atomically */
+        unsigned int   ncounts;   /* Power of 2, 0 when disabled */
+    } near;
+    struct {
+        unsigned char *counters;  /* SKETCH_DEPTH rows of 4-bit counters */
+        unsigned int   width;     /* number of counters per row, power of 2 */
+        unsigned long  additions; /* additions since last aging */
+    } sketch;
+    struct {
+        Entry        **entries;   /* Min-heap of the entries by priority */
+        size_t         size;
+        size_t         capacity;
+        double         inflation; /* Priority of the last evicted entry */
+    } gdsf;
     struct {
         unsigned long   nhit;      /* Successful gets. */
         unsigned long   nmiss;     /* Unsuccessful gets. */
@@ -64,6 +158,8 @@ typedef struct Cache {
         unsigned long   npruned;   /* Evictions due to size constraint. */
         unsigned long   ncommit;   /* number of commits. */
         unsigned long   nrollback; /* number of rollback operations. */
+        unsigned long   nrejected; /* New entries not admitted by TINYLFU or GDSF. */
+        uint64_t        saved;     /* Computing time (microseconds) saved by hits. */
     } stats;
 
     char name[1];
@@ -88,6 +184,116 @@ static unsigned long
 CacheTransaction(Cache *cachePtr, uintptr_t epoch, bool commit)
     NS_GNUC_NONNULL(1);
 
+static Cache *CacheCreate(const char *name, int keys, size_t maxSize, Ns_FreeProc *freeProc)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+
+static Cache *GetPartition(const Cache *cachePtr, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_RETURNS_NONNULL;
+
+static Ns_Entry *FirstEntry(Ns_CacheSearch *search, const Ns_CacheTransactionStack *transactionStackPtr)
+    NS_GNUC_NONNULL(1);
+
+static unsigned int HashKey(int keys, const char *key)
+    NS_GNUC_NONNULL(2) NS_GNUC_PURE;
+
+static void Touch(Cache *cachePtr, Entry *ePtr, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void Prune(Cache *cachePtr, Entry *ePtr, size_t maxSize)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void EvictRejected(Cache *cachePtr)
+    NS_GNUC_NONNULL(1);
+
+static Entry *ClockVictim(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void SketchIncrement(Cache *cachePtr, unsigned int hash)
+    NS_GNUC_NONNULL(1);
+
+static unsigned int SketchFrequency(const Cache *cachePtr, unsigned int hash)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
+static unsigned int TakeReference(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void Changed(Cache *cachePtr)
+    NS_GNUC_NONNULL(1);
+
+static void GdsfInsert(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void GdsfRemove(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void GdsfUpdate(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void GdsfSift(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void GdsfSwap(Cache *cachePtr, size_t i, size_t j)
+    NS_GNUC_NONNULL(1);
+
+static void Publish(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void Unpublish(Cache *cachePtr, Entry *ePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+#ifdef CACHE_LOCKFREE_READS
+static void Retire(Cache *cachePtr, Version *versionPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void Reclaim(Cache *cachePtr, bool all)
+    NS_GNUC_NONNULL(1);
+
+static Reader *GetReader(void)
+    NS_GNUC_RETURNS_NONNULL;
+
+static Ns_TlsCleanup FreeReader;
+#endif
+
+static const char *const policyNames[] = {"lru", "clock", "tinylfu", "gdsf"};
+
+/*
+ * Static variables defined in this file.
+ */
+
+#ifdef CACHE_LOCKFREE_READS
+static Ns_Tls     readerTls;
+static Ns_Mutex   readersLock = NULL;
+static Reader    *firstReaderPtr = NULL;
+static uintptr_t  globalEpoch = 1u;
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitCache --
+ *
+ *      Initialize the registry of lock-free cache readers.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitCache(void)
+{
+#ifdef CACHE_LOCKFREE_READS
+    Ns_MutexInit(&readersLock);
+    Ns_MutexSetName(&readersLock, "ns:cache:readers");
+    Ns_TlsAlloc(&readerTls, FreeReader);
+#endif
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -107,6 +313,145 @@ CacheTransaction(Cache *cachePtr, uintptr_t epoch, bool commit)
 
 Ns_Cache *
 Ns_CacheCreateSz(const char *name, int keys, size_t maxSize, Ns_FreeProc *freeProc)
+{
+    NS_NONNULL_ASSERT(name != NULL);
+
+    return (Ns_Cache *) CacheCreate(name, keys, maxSize, freeProc);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheCreatePartitioned --
+ *
+ *      Create a new size limited cache with the specified number of
+ *      partitions. The keys are distributed over the partitions, each of
+ *      it having its own lock and a share of the maximum size. This
+ *      reduces the lock contention on caches heavily used from multiple
+ *      threads.
+ *
+ * Results:
+ *      A pointer to the new cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_Cache *
+Ns_CacheCreatePartitioned(const char *name, int keys, size_t maxSize, Ns_FreeProc *freeProc,
+                          int npartitions)
+{
+    Cache *cachePtr;
+
+    NS_NONNULL_ASSERT(name != NULL);
+
+    cachePtr = CacheCreate(name, keys, maxSize, freeProc);
+
+    if (npartitions > 1) {
+        Tcl_DString ds;
+        int         i;
+
+        Tcl_DStringInit(&ds);
+        cachePtr->npartitions = npartitions;
+        cachePtr->partitions = ns_calloc((size_t)npartitions, sizeof(Cache *));
+        for (i = 0; i < npartitions; i++) {
+            Cache *partitionPtr = CacheCreate(name, keys, maxSize / (size_t)npartitions, freeProc);
+
+            /*
+             * Name the mutex of every partition individually, such that
+             * the lock contention can be distinguished in the statistics.
+             */
+            Tcl_DStringSetLength(&ds, 0);
+            Ns_DStringPrintf(&ds, "%s:%d", name, i);
+            Ns_MutexSetName2(&partitionPtr->lock, "ns:cache", ds.string);
+
+            partitionPtr->parentPtr = cachePtr;
+            cachePtr->partitions[i] = partitionPtr;
+        }
+        Tcl_DStringFree(&ds);
+    }
+
+    return (Ns_Cache *) cachePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CachePartition --
+ *
+ *      Return the partition of a cache, which is responsible for the
+ *      provided key. When the cache has no partitions, the cache itself is
+ *      returned. Operations on single keys should lock only the returned
+ *      partition instead of the whole cache.
+ *
+ * Results:
+ *      A pointer to a cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_Cache *
+Ns_CachePartition(Ns_Cache *cache, const char *key)
+{
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    return (Ns_Cache *) GetPartition((Cache *) cache, key);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheGetPartitions --
+ *
+ *      Return the number of partitions of a cache.
+ *
+ * Results:
+ *      Number of partitions, 1 for a cache without partitions.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Ns_CacheGetPartitions(const Ns_Cache *cache)
+{
+    const Cache *cachePtr = (const Cache *) cache;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    return cachePtr->npartitions > 1 ? cachePtr->npartitions : 1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheCreate --
+ *
+ *      Allocate and initialize a cache structure.
+ *
+ * Results:
+ *      A pointer to the new cache.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Cache *
+CacheCreate(const char *name, int keys, size_t maxSize, Ns_FreeProc *freeProc)
 {
     Cache *cachePtr;
     size_t nameLength;
@@ -129,6 +474,7 @@ Ns_CacheCreateSz(const char *name, int keys, size_t maxSize, Ns_FreeProc *freePr
     cachePtr->stats.npruned   = 0u;
     cachePtr->stats.ncommit   = 0u;
     cachePtr->stats.nrollback = 0u;
+    cachePtr->generation      = 1u;
 
     Ns_MutexInit(&cachePtr->lock);
     Ns_MutexSetName2(&cachePtr->lock, "ns:cache", name);
@@ -137,7 +483,93 @@ Ns_CacheCreateSz(const char *name, int keys, size_t maxSize, Ns_FreeProc *freePr
     Tcl_InitHashTable(&cachePtr->entriesTable, keys);
     Tcl_InitHashTable(&cachePtr->uncommittedTable, TCL_ONE_WORD_KEYS);
 
-    return (Ns_Cache *) cachePtr;
+    return cachePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetPartition --
+ *
+ *      Determine the partition for a key via its hash value.
+ *
+ * Results:
+ *      The partition, or the cache itself when it has no partitions.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Cache *
+GetPartition(const Cache *cachePtr, const char *key)
+{
+    Cache *result;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    if (likely(cachePtr->npartitions == 0)) {
+        result = (Cache *)cachePtr;
+
+    } else {
+        result = cachePtr->partitions[HashKey(cachePtr->keys, key) % (unsigned int)cachePtr->npartitions];
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HashKey --
+ *
+ *      Compute a hash value for a key of a cache, depending on the key
+ *      type of the cache.
+ *
+ * Results:
+ *      Hash value.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+HashKey(int keys, const char *key)
+{
+    unsigned int hash = 0u;
+
+    NS_NONNULL_ASSERT(key != NULL);
+
+    if (keys == TCL_STRING_KEYS) {
+        const unsigned char *p;
+
+        for (p = (const unsigned char *)key; *p != '\0'; p++) {
+            hash += (hash << 3) + *p;
+        }
+    } else if (keys == TCL_ONE_WORD_KEYS) {
+        hash = (unsigned int)((uintptr_t)key >> 3);
+    } else {
+        const unsigned char *p = (const unsigned char *)key;
+        size_t               i, length = (size_t)keys * sizeof(int);
+
+        for (i = 0u; i < length; i++) {
+            hash += (hash << 3) + p[i];
+        }
+    }
+    /*
+     * Mix the bits, since the low bits of the hash value above are
+     * weakly distributed for similar keys.
+     */
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bu;
+    hash ^= hash >> 16;
+
+    return hash;
 }
 
 
@@ -164,11 +596,36 @@ Ns_CacheDestroy(Ns_Cache *cache)
 
     NS_NONNULL_ASSERT(cache != NULL);
 
+    if (cachePtr->npartitions > 0) {
+        int i;
+
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            Ns_CacheDestroy((Ns_Cache *) cachePtr->partitions[i]);
+        }
+        ns_free(cachePtr->partitions);
+        cachePtr->partitions = NULL;
+        cachePtr->npartitions = 0;
+    }
     (void) Ns_CacheFlush(cache);
     Ns_MutexDestroy(&cachePtr->lock);
     Ns_CondDestroy(&cachePtr->cond);
     Tcl_DeleteHashTable(&cachePtr->entriesTable);
     Tcl_DeleteHashTable(&cachePtr->uncommittedTable);
+    if (cachePtr->sketch.counters != NULL) {
+        ns_free(cachePtr->sketch.counters);
+    }
+    if (cachePtr->gdsf.entries != NULL) {
+        ns_free(cachePtr->gdsf.entries);
+    }
+#ifdef CACHE_LOCKFREE_READS
+    if (cachePtr->lockfree.slots != NULL) {
+        Reclaim(cachePtr, NS_TRUE);
+        ns_free(cachePtr->lockfree.slots);
+    }
+    if (cachePtr->near.counts != NULL) {
+        ns_free(cachePtr->near.counts);
+    }
+#endif
     ns_free(cachePtr);
 }
 
@@ -198,13 +655,15 @@ Ns_CacheFindEntry(Ns_Cache *cache, const char *key)
 Ns_Entry *
 Ns_CacheFindEntryT(Ns_Cache *cache, const char *key, const Ns_CacheTransactionStack *transactionStackPtr)
 {
-    Cache               *cachePtr = (Cache *) cache;
+    Cache               *cachePtr;
     const Tcl_HashEntry *hPtr;
     Ns_Entry            *result = NULL;
 
     NS_NONNULL_ASSERT(cache != NULL);
     NS_NONNULL_ASSERT(key != NULL);
 
+    cachePtr = GetPartition((Cache *) cache, key);
+
     hPtr = Tcl_FindHashEntry(&cachePtr->entriesTable, key);
     if (unlikely(hPtr == NULL)) {
         /*
@@ -246,9 +705,11 @@ Ns_CacheFindEntryT(Ns_Cache *cache, const char *key, const Ns_CacheTransactionSt
                  * Entry is valid.
                  */
                 ++cachePtr->stats.nhit;
-                Remove(ePtr);
+                if (ePtr->value != NULL) {
+                    cachePtr->stats.saved += (uint64_t)ePtr->cost;
+                }
                 ePtr->count ++;
-                Push(ePtr);
+                Touch(cachePtr, ePtr, key);
                 result = (Ns_Entry *) ePtr;
             }
         }
@@ -277,7 +738,7 @@ Ns_CacheFindEntryT(Ns_Cache *cache, const char *key, const Ns_CacheTransactionSt
 Ns_Entry *
 Ns_CacheCreateEntry(Ns_Cache *cache, const char *key, int *newPtr)
 {
-    Cache         *cachePtr = (Cache *) cache;
+    Cache         *cachePtr;
     Tcl_HashEntry *hPtr;
     Entry         *ePtr;
     int            isNew;
@@ -286,6 +747,8 @@ Ns_CacheCreateEntry(Ns_Cache *cache, const char *key, int *newPtr)
     NS_NONNULL_ASSERT(key != NULL);
     NS_NONNULL_ASSERT(newPtr != NULL);
 
+    cachePtr = GetPartition((Cache *) cache, key);
+
     hPtr = Tcl_CreateHashEntry(&cachePtr->entriesTable, key, &isNew);
     if (isNew != 0) {
         ePtr = ns_calloc(1u, sizeof(Entry));
@@ -294,6 +757,13 @@ Ns_CacheCreateEntry(Ns_Cache *cache, const char *key, int *newPtr)
         Tcl_SetHashValue(hPtr, ePtr);
         cachePtr->currentSize += (sizeof(Entry) + sizeof(Tcl_HashEntry) + strlen(key));
         ++cachePtr->stats.nmiss;
+        if (cachePtr->policy == NS_CACHE_TINYLFU) {
+            SketchIncrement(cachePtr, HashKey(cachePtr->keys, key));
+        }
+        Push(ePtr);
+        if (cachePtr->policy == NS_CACHE_GDSF) {
+            GdsfInsert(cachePtr, ePtr);
+        }
     } else {
         ePtr = Tcl_GetHashValue(hPtr);
         if (Expired(ePtr, NULL)) {
@@ -303,10 +773,12 @@ Ns_CacheCreateEntry(Ns_Cache *cache, const char *key, int *newPtr)
         } else {
             ePtr->count ++;
             ++cachePtr->stats.nhit;
+            if (ePtr->value != NULL) {
+                cachePtr->stats.saved += (uint64_t)ePtr->cost;
+            }
         }
-        Remove(ePtr);
+        Touch(cachePtr, ePtr, key);
     }
-    Push(ePtr);
     *newPtr = isNew;
 
     return (Ns_Entry *) ePtr;
@@ -349,6 +821,11 @@ Ns_CacheWaitCreateEntryT(Ns_Cache *cache, const char *key, int *newPtr,
     NS_NONNULL_ASSERT(key != NULL);
     NS_NONNULL_ASSERT(newPtr != NULL);
 
+    /*
+     * Wait on the partition of the key, which is signaled when the entry
+     * is updated.
+     */
+    cache = (Ns_Cache *) GetPartition((Cache *) cache, key);
     entry = Ns_CacheCreateEntry(cache, key, &isNew);
 
     if (isNew == 0 && Ns_CacheGetValueT(entry, transactionStackPtr) == NULL) {
@@ -437,7 +914,7 @@ Ns_CacheKey(const Ns_Entry *entry)
  *----------------------------------------------------------------------
  *
  * Ns_CacheGetValue, Ns_CacheGetSize, Ns_CacheGetExpirey,
- * Ns_CacheGetTransactionEpoch, Ns_CacheGetReuse --
+ * Ns_CacheGetTransactionEpoch, Ns_CacheGetReuse, Ns_CacheGetCost --
  *
  *      Get the bare components of a cache entry via API.
  *
@@ -464,6 +941,13 @@ Ns_CacheGetReuse(const Ns_Entry *entry)
     return ((const Entry *) entry)->count;
 }
 
+int
+Ns_CacheGetCost(const Ns_Entry *entry)
+{
+    NS_NONNULL_ASSERT(entry != NULL);
+    return ((const Entry *) entry)->cost;
+}
+
 size_t
 Ns_CacheGetSize(const Ns_Entry *entry)
 {
@@ -478,20 +962,117 @@ Ns_CacheGetTransactionEpoch(const Ns_Entry *entry)
     return ((const Entry *) entry)->transactionEpoch;
 }
 
-void *
-Ns_CacheGetValue(const Ns_Entry *entry)
-{
-    NS_NONNULL_ASSERT(entry != NULL);
-    return ((const Entry *) entry)->value;
-}
 
-
 /*
  *----------------------------------------------------------------------
  *
- * Ns_CacheGetValueT --
+ * Ns_CacheSetRevalidate, Ns_CacheGetRevalidate --
  *
- *      Get the value a cache entry, respecting the cache transaction
+ *      Set the time after which the value of an entry is stale. A stale
+ *      value is still valid until the entry expires, but should be
+ *      recomputed (stale-while-revalidate). A NULL or zero time means
+ *      that the value never becomes stale. Setting the time ends a
+ *      pending revalidation.
+ *
+ * Results:
+ *      Ns_CacheGetRevalidate() returns the time, zero when not set.
+ *
+ * Side effects:
+ *      Published value for lock-free readers is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CacheSetRevalidate(Ns_Entry *entry, const Ns_Time *timePtr)
+{
+    Entry *ePtr;
+
+    NS_NONNULL_ASSERT(entry != NULL);
+
+    ePtr = (Entry *) entry;
+    if (timePtr != NULL) {
+        ePtr->revalidate = *timePtr;
+    } else {
+        ePtr->revalidate.sec = ePtr->revalidate.usec = 0;
+    }
+    ePtr->refreshing = NS_FALSE;
+    if (ePtr->versionPtr != NULL) {
+        Publish(ePtr->cachePtr, ePtr);
+    }
+    Changed(ePtr->cachePtr);
+}
+
+
+const Ns_Time *
+Ns_CacheGetRevalidate(const Ns_Entry *entry)
+{
+    NS_NONNULL_ASSERT(entry != NULL);
+    return &((const Entry *) entry)->revalidate;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheIsStale, Ns_CacheTryRevalidate --
+ *
+ *      Check whether the value of an entry is stale at the given
+ *      time, or claim the revalidation of a stale value. Only the
+ *      first caller claiming the revalidation succeeds until
+ *      Ns_CacheSetRevalidate() or a new value ends it.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects:
+ *      Ns_CacheTryRevalidate() marks the entry as being refreshed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+Ns_CacheIsStale(const Ns_Entry *entry, const Ns_Time *nowPtr)
+{
+    const Entry *ePtr;
+
+    NS_NONNULL_ASSERT(entry != NULL);
+    NS_NONNULL_ASSERT(nowPtr != NULL);
+
+    ePtr = (const Entry *) entry;
+    return (ePtr->value != NULL
+            && ePtr->revalidate.sec > 0
+            && Ns_DiffTime(&ePtr->revalidate, nowPtr, NULL) < 0);
+}
+
+bool
+Ns_CacheTryRevalidate(Ns_Entry *entry)
+{
+    Entry *ePtr;
+    bool   success;
+
+    NS_NONNULL_ASSERT(entry != NULL);
+
+    ePtr = (Entry *) entry;
+    success = !ePtr->refreshing;
+    ePtr->refreshing = NS_TRUE;
+    return success;
+}
+
+void *
+Ns_CacheGetValue(const Ns_Entry *entry)
+{
+    NS_NONNULL_ASSERT(entry != NULL);
+    return ((const Entry *) entry)->value;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheGetValueT --
+ *
+ *      Get the value a cache entry, respecting the cache transaction
  *      stack. The function returns either the bare stack value (if present) or
  *      the uncommitted value, when called from within a cache transaction.
  *
@@ -565,6 +1146,15 @@ Ns_CacheGetNrUncommittedEntries(const Ns_Cache *cache)
     NS_NONNULL_ASSERT(cache != NULL);
 
     cachePtr = (const Cache *)cache;
+    if (cachePtr->npartitions > 0) {
+        TCL_SIZE_T result = 0;
+        int        i;
+
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            result += cachePtr->partitions[i]->uncommittedTable.numEntries;
+        }
+        return result;
+    }
     return cachePtr->uncommittedTable.numEntries;
 }
 
@@ -645,6 +1235,26 @@ Ns_CacheSetValueExpires(Ns_Entry *entry, void *value, size_t size,
     }
     cachePtr->currentSize += size;
 
+    if (transactionEpoch == 0u) {
+        if (cachePtr->lockfree.nslots > 0u) {
+            Publish(cachePtr, ePtr);
+        }
+        Changed(cachePtr);
+    }
+    if (ePtr->heapIndex > 0u) {
+        GdsfUpdate(cachePtr, ePtr);
+    }
+
+    if (maxSize > 0u && cachePtr->parentPtr != NULL) {
+        /*
+         * The provided maxSize refers to the whole cache, each partition
+         * has its share.
+         */
+        maxSize = maxSize / (size_t)cachePtr->parentPtr->npartitions;
+        if (maxSize == 0u) {
+            maxSize = 1u;
+        }
+    }
     if (maxSize == 0u) {
         /*
          * Use the maxSize setting as configured in cPtr
@@ -658,20 +1268,7 @@ Ns_CacheSetValueExpires(Ns_Entry *entry, void *value, size_t size,
     }
 
     if (maxSize > 0u) {
-        /*
-         * Make space for the new entry, but don't delete the current
-         * entry, and don't delete other newborn entries (with a value
-         * of NULL) of some other threads which are concurrently
-         * created.  There might be concurrent updates, since
-         * e.g. nscache_eval releases its mutex.
-         */
-        while (cachePtr->currentSize > maxSize
-               && cachePtr->lastEntryPtr != ePtr
-               && cachePtr->lastEntryPtr->value != NULL
-               ) {
-            Ns_CacheDeleteEntry((Ns_Entry *) cachePtr->lastEntryPtr);
-            ++cachePtr->stats.npruned;
-        }
+        Prune(cachePtr, ePtr, maxSize);
     }
     return result;
 }
@@ -706,6 +1303,7 @@ Ns_CacheUnsetValue(Ns_Entry *entry)
     if (ePtr->value != NULL || ePtr->uncommittedValue != NULL) {
         Cache *cachePtr;
         void  *value;
+        bool   committed;
 
         /*
          * In case, the freeProc() wants to allocate itself
@@ -718,15 +1316,28 @@ Ns_CacheUnsetValue(Ns_Entry *entry)
         if (likely(ePtr->value != NULL)) {
             value = ePtr->value;
             ePtr->value = NULL;
+            committed = NS_TRUE;
         } else {
             value = ePtr->uncommittedValue;
             ePtr->uncommittedValue = NULL;
+            committed = NS_FALSE;
         }
 
         cachePtr = ePtr->cachePtr;
         cachePtr->currentSize -= ePtr->size;
         ePtr->size = 0u;
         ePtr->expires.sec = ePtr->expires.usec = 0;
+        ePtr->revalidate.sec = ePtr->revalidate.usec = 0;
+        ePtr->refreshing = NS_FALSE;
+        if (ePtr->versionPtr != NULL) {
+            Unpublish(cachePtr, ePtr);
+        }
+        if (ePtr->heapIndex > 0u) {
+            GdsfUpdate(cachePtr, ePtr);
+        }
+        if (committed) {
+            Changed(cachePtr);
+        }
 
         if (cachePtr->freeProc != NULL) {
             (*cachePtr->freeProc)(value);
@@ -775,10 +1386,26 @@ Ns_CacheDeleteEntry(Ns_Entry *entry)
     NS_NONNULL_ASSERT(entry != NULL);
 
     ePtr = (Entry *) entry;
+    if (ePtr->cachePtr->rejectedPtr == ePtr) {
+        ePtr->cachePtr->rejectedPtr = NULL;
+    }
     key = Tcl_GetHashKey(&ePtr->cachePtr->entriesTable, ePtr->hPtr);
     ePtr->cachePtr->currentSize -= (sizeof(Entry) + sizeof(Tcl_HashEntry) + strlen(key));
+#ifdef CACHE_LOCKFREE_READS
+    if (ePtr->cachePtr->near.counts != NULL) {
+        /*
+         * Don't credit the near cache hits to a later entry of the key.
+         */
+        __atomic_store_n(&ePtr->cachePtr->near.counts[HashKey(ePtr->cachePtr->keys, key)
+                                                      & (ePtr->cachePtr->near.ncounts - 1u)],
+                         0u, __ATOMIC_RELAXED);
+    }
+#endif
     Ns_CacheUnsetValue(entry);
     Remove(ePtr);
+    if (ePtr->heapIndex > 0u) {
+        GdsfRemove(ePtr->cachePtr, ePtr);
+    }
     Tcl_DeleteHashEntry(ePtr->hPtr);
 
     hPtr = Tcl_FindHashEntry(&ePtr->cachePtr->uncommittedTable, (const char *)ePtr);
@@ -816,6 +1443,11 @@ Ns_CacheFlush(Ns_Cache *cache)
 
     NS_NONNULL_ASSERT(cache != NULL);
 
+    /*
+     * The search covers all partitions of a partitioned cache. The flush
+     * is counted only once in the container, since the stats sum up the
+     * partitions.
+     */
     cachePtr = (Cache *) cache;
     entry = Ns_CacheFirstEntry(cache, &search);
     while (entry != NULL) {
@@ -854,27 +1486,72 @@ Ns_CacheFirstEntry(Ns_Cache *cache, Ns_CacheSearch *search)
 Ns_Entry *
 Ns_CacheFirstEntryT(Ns_Cache *cache, Ns_CacheSearch *search, const Ns_CacheTransactionStack *transactionStackPtr)
 {
-    Cache               *cachePtr = (Cache *) cache;
-    const Tcl_HashEntry *hPtr;
-    Ns_Entry            *result = NULL;
-
     NS_NONNULL_ASSERT(cache != NULL);
     NS_NONNULL_ASSERT(search != NULL);
 
     Ns_GetTime(&search->now);
-    hPtr = Tcl_FirstHashEntry(&cachePtr->entriesTable, &search->hsearch);
-    while (hPtr != NULL) {
-        Ns_Entry  *entry = Tcl_GetHashValue(hPtr);
+    search->cache = cache;
+    search->partition = 0;
 
-        if (Ns_CacheGetValueT(entry, transactionStackPtr) != NULL) {
-            if (!Expired((Entry *) entry, &search->now)) {
-                result = entry;
-                break;
+    return FirstEntry(search, transactionStackPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FirstEntry --
+ *
+ *      Return the first valid entry of the cache or partition of the
+ *      search, continuing with the following partitions of a partitioned
+ *      cache.
+ *
+ * Results:
+ *      A pointer to said entry, or NULL if no valid entries.
+ *
+ * Side effects:
+ *      Expired entries are flushed, concurrent updates are skipped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_Entry *
+FirstEntry(Ns_CacheSearch *search, const Ns_CacheTransactionStack *transactionStackPtr)
+{
+    const Cache *containerPtr = (const Cache *) search->cache;
+    Ns_Entry    *result = NULL;
+
+    NS_NONNULL_ASSERT(search != NULL);
+
+    while (result == NULL
+           && (containerPtr->npartitions == 0 || search->partition < containerPtr->npartitions)) {
+        Cache               *cachePtr;
+        const Tcl_HashEntry *hPtr;
+
+        cachePtr = (containerPtr->npartitions == 0)
+            ? (Cache *) containerPtr
+            : containerPtr->partitions[search->partition];
+
+        hPtr = Tcl_FirstHashEntry(&cachePtr->entriesTable, &search->hsearch);
+        while (hPtr != NULL) {
+            Ns_Entry  *entry = Tcl_GetHashValue(hPtr);
+
+            if (Ns_CacheGetValueT(entry, transactionStackPtr) != NULL) {
+                if (!Expired((Entry *) entry, &search->now)) {
+                    result = entry;
+                    break;
+                }
+                ++cachePtr->stats.nexpired;
+                Ns_CacheDeleteEntry(entry);
             }
-            ++cachePtr->stats.nexpired;
-            Ns_CacheDeleteEntry(entry);
+            hPtr = Tcl_NextHashEntry(&search->hsearch);
+        }
+        if (containerPtr->npartitions == 0) {
+            break;
+        }
+        if (result == NULL) {
+            search->partition++;
         }
-        hPtr = Tcl_NextHashEntry(&search->hsearch);
     }
     return result;
 }
@@ -905,8 +1582,17 @@ Ns_CacheCommitEntries(Ns_Cache *cache, uintptr_t epoch)
     NS_NONNULL_ASSERT(cache != NULL);
 
     cachePtr = (Cache *) cache;
-    result = CacheTransaction(cachePtr, epoch, NS_TRUE);
-    cachePtr->stats.ncommit += result;
+    if (cachePtr->npartitions > 0) {
+        int i;
+
+        result = 0u;
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            result += Ns_CacheCommitEntries((Ns_Cache *) cachePtr->partitions[i], epoch);
+        }
+    } else {
+        result = CacheTransaction(cachePtr, epoch, NS_TRUE);
+        cachePtr->stats.ncommit += result;
+    }
 
     return result;
 }
@@ -936,8 +1622,17 @@ Ns_CacheRollbackEntries(Ns_Cache *cache, uintptr_t epoch)
     NS_NONNULL_ASSERT(cache != NULL);
 
     cachePtr = (Cache *) cache;
-    result = CacheTransaction(cachePtr, epoch, NS_FALSE);
-    cachePtr->stats.nrollback += result;
+    if (cachePtr->npartitions > 0) {
+        int i;
+
+        result = 0u;
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            result += Ns_CacheRollbackEntries((Ns_Cache *) cachePtr->partitions[i], epoch);
+        }
+    } else {
+        result = CacheTransaction(cachePtr, epoch, NS_FALSE);
+        cachePtr->stats.nrollback += result;
+    }
 
     return result;
 }
@@ -978,6 +1673,13 @@ CacheTransaction(Cache *cachePtr, uintptr_t epoch, bool commit)
                 e->value = e->uncommittedValue;
                 e->uncommittedValue = NULL;
                 e->transactionEpoch = 0u;
+                if (cachePtr->lockfree.nslots > 0u) {
+                    Publish(cachePtr, e);
+                }
+                if (e->heapIndex > 0u) {
+                    GdsfUpdate(cachePtr, e);
+                }
+                Changed(cachePtr);
 
                 Tcl_DeleteHashEntry(hPtr);
             } else {
@@ -1039,6 +1741,15 @@ Ns_CacheNextEntryT(Ns_CacheSearch *search, const Ns_CacheTransactionStack *trans
         }
         hPtr = Tcl_NextHashEntry(&search->hsearch);
     }
+    if (result == NULL
+        && search->cache != NULL
+        && search->partition + 1 < ((const Cache *) search->cache)->npartitions) {
+        /*
+         * Continue with the next partition.
+         */
+        search->partition++;
+        result = FirstEntry(search, transactionStackPtr);
+    }
     return result;
 }
 
@@ -1048,7 +1759,8 @@ Ns_CacheNextEntryT(Ns_CacheSearch *search, const Ns_CacheTransactionStack *trans
  *
  * Ns_CacheLock --
  *
- *      Lock the cache.
+ *      Lock the cache. For a partitioned cache, all partitions are
+ *      locked in ascending order.
  *
  * Results:
  *      None.
@@ -1063,9 +1775,13 @@ void
 Ns_CacheLock(Ns_Cache *cache)
 {
     Cache *cachePtr = (Cache *) cache;
+    int    i;
 
     NS_NONNULL_ASSERT(cache != NULL);
     Ns_MutexLock(&cachePtr->lock);
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        Ns_MutexLock(&cachePtr->partitions[i]->lock);
+    }
 }
 
 
@@ -1088,10 +1804,29 @@ Ns_CacheLock(Ns_Cache *cache)
 Ns_ReturnCode
 Ns_CacheTryLock(Ns_Cache *cache)
 {
-    Cache *cachePtr = (Cache *) cache;
+    Cache         *cachePtr = (Cache *) cache;
+    Ns_ReturnCode  status;
 
     NS_NONNULL_ASSERT(cache != NULL);
-    return Ns_MutexTryLock(&cachePtr->lock);
+    status = Ns_MutexTryLock(&cachePtr->lock);
+    if (status == NS_OK && cachePtr->npartitions > 0) {
+        int i;
+
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            if (Ns_MutexTryLock(&cachePtr->partitions[i]->lock) != NS_OK) {
+                /*
+                 * Release the locks acquired so far.
+                 */
+                while (--i >= 0) {
+                    Ns_MutexUnlock(&cachePtr->partitions[i]->lock);
+                }
+                Ns_MutexUnlock(&cachePtr->lock);
+                status = NS_TIMEOUT;
+                break;
+            }
+        }
+    }
+    return status;
 }
 
 
@@ -1100,13 +1835,15 @@ Ns_CacheTryLock(Ns_Cache *cache)
  *
  * Ns_CacheUnlock --
  *
- *      Unlock the cache.
+ *      Unlock the cache. A new entry, which was not admitted by the
+ *      eviction policy, is evicted now, since the caller is done with
+ *      the entry.
  *
  * Results:
  *      None.
  *
  * Side effects:
- *      None.
+ *      An entry might be deleted.
  *
  *----------------------------------------------------------------------
  */
@@ -1115,8 +1852,14 @@ void
 Ns_CacheUnlock(Ns_Cache *cache)
 {
     Cache *cachePtr = (Cache *) cache;
+    int    i;
 
     NS_NONNULL_ASSERT(cache != NULL);
+    for (i = cachePtr->npartitions - 1; i >= 0; i--) {
+        EvictRejected(cachePtr->partitions[i]);
+        Ns_MutexUnlock(&cachePtr->partitions[i]->lock);
+    }
+    EvictRejected(cachePtr);
     Ns_MutexUnlock(&cachePtr->lock);
 }
 
@@ -1127,7 +1870,9 @@ Ns_CacheUnlock(Ns_Cache *cache)
  * Ns_CacheWait, Ns_CacheTimedWait --
  *
  *      Wait for the cache's condition variable to be signaled or for
- *      the given absolute timeout if timePtr is not NULL.
+ *      the given absolute timeout if timePtr is not NULL. Waiting for
+ *      updates of a key of a partitioned cache has to be performed on
+ *      the partition returned by Ns_CachePartition().
  *
  * Results:
  *      NS_OK or NS_TIMEOUT if timeout specified.
@@ -1179,9 +1924,13 @@ void
 Ns_CacheSignal(Ns_Cache *cache)
 {
     Cache *cachePtr = (Cache *) cache;
+    int    i;
 
     NS_NONNULL_ASSERT(cache != NULL);
     Ns_CondSignal(&cachePtr->cond);
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        Ns_CondSignal(&cachePtr->partitions[i]->cond);
+    }
 }
 
 
@@ -1206,9 +1955,13 @@ void
 Ns_CacheBroadcast(Ns_Cache *cache)
 {
     Cache *cachePtr = (Cache *) cache;
+    int    i;
 
     NS_NONNULL_ASSERT(cache != NULL);
     Ns_CondBroadcast(&cachePtr->cond);
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        Ns_CondBroadcast(&cachePtr->partitions[i]->cond);
+    }
 }
 
 
@@ -1217,7 +1970,9 @@ Ns_CacheBroadcast(Ns_Cache *cache)
  *
  * Ns_CacheStats --
  *
- *      Append statistics about cache usage to Tcl_DString.
+ *      Append statistics about cache usage to Tcl_DString. The
+ *      statistics of a partitioned cache are the sums over all
+ *      partitions.
  *
  * Results:
  *      Pointer to current string value.
@@ -1232,17 +1987,49 @@ char *
 Ns_CacheStats(Ns_Cache *cache, Ns_DString *dest)
 {
     const Cache    *cachePtr;
+    Cache           sum;
     unsigned long   count;
     const Entry    *ePtr;
     Ns_CacheSearch  search;
     double          savedCost = 0.0, hitrate;
+    uint64_t        savedTime;
+    int             i;
 
     NS_NONNULL_ASSERT(cache != NULL);
     NS_NONNULL_ASSERT(dest != NULL);
 
     cachePtr = (Cache *)cache;
-    count = cachePtr->stats.nhit + cachePtr->stats.nmiss;
-    hitrate = ((count != 0u) ? ((double)cachePtr->stats.nhit * 100.0) / (double)count : 0.0);
+    sum.maxSize = cachePtr->maxSize;
+    sum.currentSize = cachePtr->currentSize;
+    sum.entriesTable.numEntries = cachePtr->entriesTable.numEntries;
+    sum.stats = cachePtr->stats;
+#ifdef CACHE_LOCKFREE_READS
+    sum.stats.nhit += __atomic_load_n(&cachePtr->lockfree.nhit, __ATOMIC_RELAXED);
+    sum.stats.saved += __atomic_load_n(&cachePtr->lockfree.saved, __ATOMIC_RELAXED);
+#endif
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        const Cache *partitionPtr = cachePtr->partitions[i];
+
+#ifdef CACHE_LOCKFREE_READS
+        sum.stats.nhit += __atomic_load_n(&partitionPtr->lockfree.nhit, __ATOMIC_RELAXED);
+        sum.stats.saved += __atomic_load_n(&partitionPtr->lockfree.saved, __ATOMIC_RELAXED);
+#endif
+        sum.currentSize += partitionPtr->currentSize;
+        sum.entriesTable.numEntries += partitionPtr->entriesTable.numEntries;
+        sum.stats.nhit += partitionPtr->stats.nhit;
+        sum.stats.nmiss += partitionPtr->stats.nmiss;
+        sum.stats.nexpired += partitionPtr->stats.nexpired;
+        sum.stats.nflushed += partitionPtr->stats.nflushed;
+        sum.stats.npruned += partitionPtr->stats.npruned;
+        sum.stats.ncommit += partitionPtr->stats.ncommit;
+        sum.stats.nrollback += partitionPtr->stats.nrollback;
+        sum.stats.nrejected += partitionPtr->stats.nrejected;
+        sum.stats.saved += partitionPtr->stats.saved;
+    }
+    savedTime = sum.stats.saved;
+
+    count = sum.stats.nhit + sum.stats.nmiss;
+    hitrate = ((count != 0u) ? ((double)sum.stats.nhit * 100.0) / (double)count : 0.0);
 
     ePtr = (Entry *)Ns_CacheFirstEntry(cache, &search);
     while (ePtr != NULL) {
@@ -1252,14 +2039,16 @@ Ns_CacheStats(Ns_Cache *cache, Ns_DString *dest)
 
     return Ns_DStringPrintf(dest, "maxsize %lu size %lu entries %" PRITcl_Size
                " flushed %lu hits %lu missed %lu hitrate %.2f"
-               " expired %lu pruned %lu commit %lu rollback %lu saved %.6f",
-               (unsigned long) cachePtr->maxSize,
-               (unsigned long) cachePtr->currentSize,
-               cachePtr->entriesTable.numEntries, cachePtr->stats.nflushed,
-               cachePtr->stats.nhit, cachePtr->stats.nmiss, hitrate,
-                            cachePtr->stats.nexpired, cachePtr->stats.npruned,
-                            cachePtr->stats.ncommit, cachePtr->stats.nrollback,
-                            savedCost);
+               " expired %lu pruned %lu commit %lu rollback %lu saved %.6f"
+               " policy %s rejected %lu savedtime %" PRIu64 ".%06" PRIu64,
+               (unsigned long) sum.maxSize,
+               (unsigned long) sum.currentSize,
+               sum.entriesTable.numEntries, sum.stats.nflushed,
+               sum.stats.nhit, sum.stats.nmiss, hitrate,
+                            sum.stats.nexpired, sum.stats.npruned,
+                            sum.stats.ncommit, sum.stats.nrollback,
+                            savedCost, policyNames[cachePtr->policy], sum.stats.nrejected,
+                            savedTime / 1000000u, savedTime % 1000000u);
 }
 
 
@@ -1283,9 +2072,21 @@ void
 Ns_CacheResetStats(Ns_Cache *cache)
 {
     Cache *cachePtr = (Cache *) cache;
+    int    i;
 
     NS_NONNULL_ASSERT(cache != NULL);
     memset(&cachePtr->stats, 0, sizeof(cachePtr->stats));
+#ifdef CACHE_LOCKFREE_READS
+    __atomic_store_n(&cachePtr->lockfree.nhit, 0u, __ATOMIC_RELAXED);
+    __atomic_store_n(&cachePtr->lockfree.saved, 0u, __ATOMIC_RELAXED);
+#endif
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        memset(&cachePtr->partitions[i]->stats, 0, sizeof(cachePtr->stats));
+#ifdef CACHE_LOCKFREE_READS
+        __atomic_store_n(&cachePtr->partitions[i]->lockfree.nhit, 0u, __ATOMIC_RELAXED);
+        __atomic_store_n(&cachePtr->partitions[i]->lockfree.saved, 0u, __ATOMIC_RELAXED);
+#endif
+    }
 }
 
 
@@ -1294,7 +2095,8 @@ Ns_CacheResetStats(Ns_Cache *cache)
  *
  * Ns_CacheSetMaxSize, Ns_CacheGetMaxSize --
  *
- *      Set/get maxsize of the specified cache
+ *      Set/get maxsize of the specified cache. The maxsize of a
+ *      partitioned cache is shared evenly between its partitions.
  *
  * Results:
  *      Ns_CacheGetMaxSize() returns the maxsize.
@@ -1308,9 +2110,15 @@ Ns_CacheResetStats(Ns_Cache *cache)
 void
 Ns_CacheSetMaxSize(Ns_Cache *cache, size_t maxSize)
 {
+    Cache *cachePtr = (Cache *) cache;
+    int    i;
+
     NS_NONNULL_ASSERT(cache != NULL);
 
-    ((Cache *) cache)->maxSize = maxSize;
+    cachePtr->maxSize = maxSize;
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        cachePtr->partitions[i]->maxSize = maxSize / (size_t)cachePtr->npartitions;
+    }
 }
 
 size_t
@@ -1322,6 +2130,1189 @@ Ns_CacheGetMaxSize(const Ns_Cache *cache)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheSetPolicy, Ns_CacheGetPolicy --
+ *
+ *      Set/get the eviction policy of the specified cache.
+ *
+ *      NS_CACHE_LRU evicts the least recently used entry; every hit
+ *      moves the entry to the front of the LRU list.
+ *
+ *      NS_CACHE_CLOCK approximates LRU: a hit sets only the reference
+ *      bit of the entry, the eviction gives referenced entries a second
+ *      chance. This avoids updates of the list on every hit.
+ *
+ *      NS_CACHE_TINYLFU uses the CLOCK ordering together with an
+ *      admission filter based on a count-min sketch of the access
+ *      frequencies: a new entry evicts an entry only when it was
+ *      requested more frequently than the eviction candidate. This
+ *      keeps frequently used entries in the cache under scan-heavy
+ *      access patterns.
+ *
+ *      NS_CACHE_GDSF (GreedyDual-Size-Frequency) evicts the entry with
+ *      the lowest priority "inflation + frequency * cost / size", where
+ *      cost is the time to compute the value. Expensive and small
+ *      entries are kept preferentially over cheap and large ones. The
+ *      inflation value is raised to the priority of every evicted entry,
+ *      such that entries, which are not accessed anymore, age out.
+ *
+ *      The policy can be changed at any time, the existing entries
+ *      are kept.
+ *
+ * Results:
+ *      Ns_CacheGetPolicy() returns the policy.
+ *
+ * Side effects:
+ *      For NS_CACHE_TINYLFU, the frequency sketch is allocated, sized
+ *      for the maximum number of entries fitting into the cache. For
+ *      NS_CACHE_GDSF, the priority heap is built.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CacheSetPolicy(Ns_Cache *cache, Ns_CachePolicy policy)
+{
+    Cache *cachePtr = (Cache *) cache;
+    int    i;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    cachePtr->policy = policy;
+    if (policy == NS_CACHE_TINYLFU && cachePtr->npartitions == 0) {
+        if (cachePtr->sketch.counters == NULL) {
+            size_t       maxEntries = cachePtr->maxSize / (sizeof(Entry) + sizeof(Tcl_HashEntry));
+            unsigned int width = SKETCH_MIN_WIDTH;
+
+            while (width < maxEntries && width < SKETCH_MAX_WIDTH) {
+                width *= 2u;
+            }
+            cachePtr->sketch.width = width;
+            cachePtr->sketch.counters = ns_calloc(SKETCH_DEPTH, width);
+        }
+    } else if (cachePtr->sketch.counters != NULL) {
+        ns_free(cachePtr->sketch.counters);
+        cachePtr->sketch.counters = NULL;
+        cachePtr->sketch.width = 0u;
+    }
+    if (cachePtr->npartitions == 0) {
+        Entry *ePtr;
+
+        if (policy == NS_CACHE_GDSF && cachePtr->gdsf.entries == NULL) {
+            cachePtr->gdsf.inflation = 0.0;
+            for (ePtr = cachePtr->firstEntryPtr; ePtr != NULL; ePtr = ePtr->nextPtr) {
+                GdsfInsert(cachePtr, ePtr);
+            }
+        } else if (policy != NS_CACHE_GDSF && cachePtr->gdsf.entries != NULL) {
+            for (ePtr = cachePtr->firstEntryPtr; ePtr != NULL; ePtr = ePtr->nextPtr) {
+                ePtr->heapIndex = 0u;
+            }
+            ns_free(cachePtr->gdsf.entries);
+            cachePtr->gdsf.entries = NULL;
+            cachePtr->gdsf.size = cachePtr->gdsf.capacity = 0u;
+        }
+    }
+    for (i = 0; i < cachePtr->npartitions; i++) {
+        Ns_CacheSetPolicy((Ns_Cache *) cachePtr->partitions[i], policy);
+    }
+}
+
+Ns_CachePolicy
+Ns_CacheGetPolicy(const Ns_Cache *cache)
+{
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    return ((const Cache *) cache)->policy;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheGetGeneration --
+ *
+ *      Return the generation of a cache or a partition of a cache. The
+ *      generation is incremented on every change of a committed value
+ *      (including deletions, flushes and evictions) and can be read
+ *      without locking the cache. A copy of a value obtained under the
+ *      cache lock together with the generation is valid, as long the
+ *      generation does not change. For a partitioned cache, the sum of
+ *      the generations of its partitions is returned.
+ *
+ * Results:
+ *      Generation number, or 0 when atomic operations are not
+ *      supported.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+uintptr_t
+Ns_CacheGetGeneration(const Ns_Cache *cache)
+{
+    uintptr_t    result = 0u;
+#ifdef CACHE_LOCKFREE_READS
+    const Cache *cachePtr = (const Cache *) cache;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    if (cachePtr->npartitions > 0) {
+        int i;
+
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            result += __atomic_load_n(&cachePtr->partitions[i]->generation, __ATOMIC_ACQUIRE);
+        }
+    } else {
+        result = __atomic_load_n(&cachePtr->generation, __ATOMIC_ACQUIRE);
+    }
+#else
+    NS_NONNULL_ASSERT(cache != NULL);
+#endif
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheEnableLockFreeReads --
+ *
+ *      Enable lock-free reads via Ns_CacheFindValueLockFree() for a cache
+ *      with string keys. Every committed value is published additionally
+ *      as an immutable copy, so the values of the cache must be byte
+ *      strings of the size provided to Ns_CacheSetValueSz() or
+ *      Ns_CacheSetValueExpires(). This is intended for read-mostly
+ *      caches, since every update requires a copy and the reclamation of
+ *      the previous version. The function has to be called before
+ *      entries are added to the cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Slot table is allocated. Without support for atomic operations,
+ *      the function does nothing.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CacheEnableLockFreeReads(Ns_Cache *cache)
+{
+#ifdef CACHE_LOCKFREE_READS
+    Cache *cachePtr = (Cache *) cache;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    if (cachePtr->keys != TCL_STRING_KEYS) {
+        Ns_Log(Warning, "cache %s: lock-free reads require string keys", cachePtr->name);
+
+    } else if (cachePtr->npartitions > 0) {
+        unsigned int nslots = 256u;
+        int          i;
+
+        while (nslots * (unsigned int)cachePtr->npartitions < LOCKFREE_SLOTS) {
+            nslots *= 2u;
+        }
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            Cache *partitionPtr = cachePtr->partitions[i];
+
+            partitionPtr->lockfree.nslots = nslots;
+            partitionPtr->lockfree.slots = ns_calloc(nslots, sizeof(Version *));
+        }
+
+    } else if (cachePtr->lockfree.slots == NULL) {
+        cachePtr->lockfree.nslots = LOCKFREE_SLOTS;
+        cachePtr->lockfree.slots = ns_calloc(LOCKFREE_SLOTS, sizeof(Version *));
+    }
+#else
+    NS_NONNULL_ASSERT(cache != NULL);
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheFindValueLockFree --
+ *
+ *      Lookup the committed value of the provided key without locking
+ *      the cache, and append a copy of it to the provided Tcl_DString.
+ *      Only values published via lock-free reads are found, so a
+ *      negative result requires a regular lookup via
+ *      Ns_CacheFindEntry() under the cache lock. Hits are counted, but
+ *      do not update the LRU list; instead, the entry gets a second
+ *      chance on pruning.
+ *
+ * Results:
+ *      NS_TRUE, if the value was found.
+ *
+ * Side effects:
+ *      Thread is registered as a lock-free reader on first use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+Ns_CacheFindValueLockFree(Ns_Cache *cache, const char *key, Tcl_DString *dsPtr)
+{
+    bool     success = NS_FALSE;
+#ifdef CACHE_LOCKFREE_READS
+    Cache   *cachePtr;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    cachePtr = GetPartition((Cache *) cache, key);
+    if (cachePtr->lockfree.slots != NULL) {
+        Reader        *readerPtr = GetReader();
+        unsigned int   hash = HashKey(cachePtr->keys, key);
+        Version       *versionPtr;
+        int            cost = 0;
+
+        /*
+         * Announce the current epoch before accessing the slot; versions
+         * retired in this or a later epoch are not freed until the epoch
+         * of the reader is reset.
+         */
+        __atomic_store_n(&readerPtr->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST),
+                         __ATOMIC_SEQ_CST);
+
+        versionPtr = __atomic_load_n(&cachePtr->lockfree.slots[hash & (cachePtr->lockfree.nslots - 1u)],
+                                     __ATOMIC_SEQ_CST);
+        if (versionPtr != NULL
+            && versionPtr->hash == hash
+            && strcmp(versionPtr->key, key) == 0) {
+            bool expired = NS_FALSE;
+
+            if (versionPtr->expires.sec > 0) {
+                Ns_Time now;
+
+                Ns_GetTime(&now);
+                expired = (Ns_DiffTime(&versionPtr->expires, &now, NULL) < 0);
+            }
+            if (!expired) {
+                Tcl_DStringAppend(dsPtr, versionPtr->value, (TCL_SIZE_T)versionPtr->size);
+                cost = versionPtr->cost;
+                if (__atomic_load_n(&versionPtr->referenced, __ATOMIC_RELAXED) == 0) {
+                    __atomic_store_n(&versionPtr->referenced, 1, __ATOMIC_RELAXED);
+                }
+                success = NS_TRUE;
+            }
+        }
+        __atomic_store_n(&readerPtr->epoch, 0u, __ATOMIC_RELEASE);
+
+        if (success) {
+            __atomic_fetch_add(&cachePtr->lockfree.nhit, 1u, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&cachePtr->lockfree.saved, (uint64_t)cost, __ATOMIC_RELAXED);
+        }
+    }
+#else
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+#endif
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheEnableNearHits --
+ *
+ *      Prepare a cache for recording hits via Ns_CacheRecordNearHit(),
+ *      which are served from copies of the values outside the cache
+ *      (e.g. the near caches of Tcl interpreters). The function has to
+ *      be called before entries are added to the cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Table of hit counters is allocated. Without support for atomic
+ *      operations, the function does nothing.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CacheEnableNearHits(Ns_Cache *cache)
+{
+#ifdef CACHE_LOCKFREE_READS
+    Cache *cachePtr = (Cache *) cache;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+
+    if (cachePtr->npartitions > 0) {
+        unsigned int ncounts = 256u;
+        int          i;
+
+        while (ncounts * (unsigned int)cachePtr->npartitions < LOCKFREE_SLOTS) {
+            ncounts *= 2u;
+        }
+        for (i = 0; i < cachePtr->npartitions; i++) {
+            Cache *partitionPtr = cachePtr->partitions[i];
+
+            partitionPtr->near.ncounts = ncounts;
+            partitionPtr->near.counts = ns_calloc(ncounts, sizeof(unsigned int));
+        }
+
+    } else if (cachePtr->near.counts == NULL) {
+        cachePtr->near.ncounts = LOCKFREE_SLOTS;
+        cachePtr->near.counts = ns_calloc(LOCKFREE_SLOTS, sizeof(unsigned int));
+    }
+#else
+    NS_NONNULL_ASSERT(cache != NULL);
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CacheRecordNearHit --
+ *
+ *      Record a hit of the provided key, which was served from a copy
+ *      of the value outside the cache. The hit is counted in the cache
+ *      statistics and is accounted by the eviction policy like a
+ *      regular hit, when the entry is considered for eviction. The
+ *      cache does not have to be locked, when Ns_CacheEnableNearHits()
+ *      was called for it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Hit counters are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Ns_CacheRecordNearHit(Ns_Cache *cache, const char *key)
+{
+    Cache *cachePtr;
+
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    cachePtr = GetPartition((Cache *) cache, key);
+#ifdef CACHE_LOCKFREE_READS
+    if (cachePtr->near.counts != NULL) {
+        unsigned int hash = HashKey(cachePtr->keys, key);
+
+        __atomic_fetch_add(&cachePtr->near.counts[hash & (cachePtr->near.ncounts - 1u)], 1u,
+                           __ATOMIC_RELAXED);
+        __atomic_fetch_add(&cachePtr->lockfree.nhit, 1u, __ATOMIC_RELAXED);
+        return;
+    }
+#endif
+    /*
+     * Without the counters, perform a regular lookup, which records
+     * the hit.
+     */
+    Ns_CacheLock((Ns_Cache *) cachePtr);
+    (void) Ns_CacheFindEntry((Ns_Cache *) cachePtr, key);
+    Ns_CacheUnlock((Ns_Cache *) cachePtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Changed --
+ *
+ *      Increment the generation of the cache after a change of a
+ *      committed value. Called with the cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Near caches of the cache are invalidated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Changed(Cache *cachePtr)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+
+#ifdef CACHE_LOCKFREE_READS
+    __atomic_fetch_add(&cachePtr->generation, 1u, __ATOMIC_RELEASE);
+#else
+    cachePtr->generation++;
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TakeReference --
+ *
+ *      Return and clear the reference bit of an entry, including the
+ *      reference bit set by lock-free hits and the hits recorded via
+ *      Ns_CacheRecordNearHit(). The near cache hits are added to the
+ *      frequency sketch of the TINYLFU policy. Since the near cache
+ *      hits are counted per hash slot, colliding keys share their
+ *      counts.
+ *
+ * Results:
+ *      Number of references, 0 if the entry was not referenced.
+ *
+ * Side effects:
+ *      Reference bits and near hit counters are cleared.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned int
+TakeReference(Cache *cachePtr, Entry *ePtr)
+{
+    unsigned int result = ePtr->referenced ? 1u : 0u;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    ePtr->referenced = NS_FALSE;
+#ifdef CACHE_LOCKFREE_READS
+    if (ePtr->versionPtr != NULL
+        && __atomic_exchange_n(&ePtr->versionPtr->referenced, 0, __ATOMIC_RELAXED) != 0) {
+        result++;
+    }
+    if (cachePtr->near.counts != NULL) {
+        unsigned int hash = HashKey(cachePtr->keys, Tcl_GetHashKey(&cachePtr->entriesTable, ePtr->hPtr));
+        unsigned int nhits = __atomic_exchange_n(&cachePtr->near.counts[hash & (cachePtr->near.ncounts - 1u)],
+                                                 0u, __ATOMIC_RELAXED);
+
+        if (nhits > 0u) {
+            unsigned int i;
+
+            if (cachePtr->policy == NS_CACHE_TINYLFU) {
+                /*
+                 * The 4-bit counters of the sketch saturate at 15.
+                 */
+                for (i = 0u; i < nhits && i < 15u; i++) {
+                    SketchIncrement(cachePtr, hash);
+                }
+            }
+            result += nhits;
+        }
+    }
+#endif
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Publish, Unpublish --
+ *
+ *      Publish a copy of the committed value of an entry for lock-free
+ *      readers, or remove the published copy. A version occupying the
+ *      slot of the new version (hash collision) is replaced. Replaced
+ *      and removed versions are retired. Called with the cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory allocated or retired.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Publish(Cache *cachePtr, Entry *ePtr)
+{
+#ifdef CACHE_LOCKFREE_READS
+    Version     *versionPtr, *oldPtr;
+    const char  *key;
+    size_t       keyLength;
+    unsigned int hash;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (ePtr->versionPtr != NULL) {
+        Unpublish(cachePtr, ePtr);
+    }
+    key = Tcl_GetHashKey(&cachePtr->entriesTable, ePtr->hPtr);
+    keyLength = strlen(key);
+    hash = HashKey(cachePtr->keys, key);
+
+    versionPtr = ns_malloc(sizeof(Version) + keyLength + ePtr->size + 1u);
+    versionPtr->nextPtr = NULL;
+    versionPtr->entryPtr = ePtr;
+    versionPtr->retireEpoch = 0u;
+    versionPtr->hash = hash;
+    versionPtr->referenced = 0;
+    versionPtr->cost = ePtr->cost;
+    /*
+     * Stale values are not returned by lock-free reads, such that the
+     * revalidation is triggered under the cache lock.
+     */
+    versionPtr->expires = (ePtr->revalidate.sec > 0 ? ePtr->revalidate : ePtr->expires);
+    versionPtr->size = ePtr->size;
+    memcpy(versionPtr->key, key, keyLength + 1u);
+    versionPtr->value = versionPtr->key + keyLength + 1u;
+    memcpy(versionPtr->value, ePtr->value, ePtr->size);
+    versionPtr->value[ePtr->size] = '\0';
+
+    ePtr->versionPtr = versionPtr;
+    oldPtr = __atomic_exchange_n(&cachePtr->lockfree.slots[hash & (cachePtr->lockfree.nslots - 1u)],
+                                 versionPtr, __ATOMIC_SEQ_CST);
+    if (oldPtr != NULL) {
+        /*
+         * Hash collision; the other entry is just readable under the
+         * cache lock.
+         */
+        oldPtr->entryPtr->versionPtr = NULL;
+        Retire(cachePtr, oldPtr);
+    }
+#else
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+#endif
+}
+
+static void
+Unpublish(Cache *cachePtr, Entry *ePtr)
+{
+#ifdef CACHE_LOCKFREE_READS
+    Version *versionPtr = ePtr->versionPtr;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (versionPtr != NULL) {
+        Version **slotPtr = &cachePtr->lockfree.slots[versionPtr->hash & (cachePtr->lockfree.nslots - 1u)];
+
+        /*
+         * Slots are only modified under the cache lock.
+         */
+        if (*slotPtr == versionPtr) {
+            __atomic_store_n(slotPtr, NULL, __ATOMIC_SEQ_CST);
+        }
+        ePtr->versionPtr = NULL;
+        Retire(cachePtr, versionPtr);
+    }
+#else
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+#endif
+}
+
+
+#ifdef CACHE_LOCKFREE_READS
+/*
+ *----------------------------------------------------------------------
+ *
+ * Retire, Reclaim --
+ *
+ *      Retire a version, which is not accessible via the slots anymore,
+ *      and free the retired versions, which are not used by any reader.
+ *      A version retired in epoch E might be used by readers which
+ *      announced an epoch less or equal E. Called with the cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Global epoch advanced, memory freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Retire(Cache *cachePtr, Version *versionPtr)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(versionPtr != NULL);
+
+    versionPtr->entryPtr = NULL;
+    versionPtr->retireEpoch = __atomic_fetch_add(&globalEpoch, 1u, __ATOMIC_SEQ_CST);
+    versionPtr->nextPtr = cachePtr->lockfree.retiredPtr;
+    cachePtr->lockfree.retiredPtr = versionPtr;
+
+    Reclaim(cachePtr, NS_FALSE);
+}
+
+static void
+Reclaim(Cache *cachePtr, bool all)
+{
+    uintptr_t  minEpoch = UINTPTR_MAX;
+    Version  **versionPtrPtr;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+
+    if (!all) {
+        const Reader *readerPtr;
+
+        Ns_MutexLock(&readersLock);
+        for (readerPtr = firstReaderPtr; readerPtr != NULL; readerPtr = readerPtr->nextPtr) {
+            uintptr_t epoch = __atomic_load_n(&readerPtr->epoch, __ATOMIC_SEQ_CST);
+
+            if (epoch != 0u && epoch < minEpoch) {
+                minEpoch = epoch;
+            }
+        }
+        Ns_MutexUnlock(&readersLock);
+    }
+
+    versionPtrPtr = &cachePtr->lockfree.retiredPtr;
+    while (*versionPtrPtr != NULL) {
+        Version *versionPtr = *versionPtrPtr;
+
+        if (all || versionPtr->retireEpoch < minEpoch) {
+            *versionPtrPtr = versionPtr->nextPtr;
+            ns_free(versionPtr);
+        } else {
+            versionPtrPtr = &versionPtr->nextPtr;
+        }
+    }
+    if (all) {
+        unsigned int i;
+
+        for (i = 0u; i < cachePtr->lockfree.nslots; i++) {
+            if (cachePtr->lockfree.slots[i] != NULL) {
+                ns_free(cachePtr->lockfree.slots[i]);
+                cachePtr->lockfree.slots[i] = NULL;
+            }
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetReader, FreeReader --
+ *
+ *      Get the reader structure of the current thread, registering it on
+ *      first use, and unregister it on thread exit.
+ *
+ * Results:
+ *      GetReader() returns the reader.
+ *
+ * Side effects:
+ *      Reader registry updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Reader *
+GetReader(void)
+{
+    Reader *readerPtr = Ns_TlsGet(&readerTls);
+
+    if (unlikely(readerPtr == NULL)) {
+        readerPtr = ns_calloc(1u, sizeof(Reader));
+        Ns_MutexLock(&readersLock);
+        readerPtr->nextPtr = firstReaderPtr;
+        firstReaderPtr = readerPtr;
+        Ns_MutexUnlock(&readersLock);
+        Ns_TlsSet(&readerTls, readerPtr);
+    }
+    return readerPtr;
+}
+
+static void
+FreeReader(void *arg)
+{
+    Reader  *readerPtr = arg;
+    Reader **readerPtrPtr;
+
+    Ns_MutexLock(&readersLock);
+    for (readerPtrPtr = &firstReaderPtr; *readerPtrPtr != NULL; readerPtrPtr = &(*readerPtrPtr)->nextPtr) {
+        if (*readerPtrPtr == readerPtr) {
+            *readerPtrPtr = readerPtr->nextPtr;
+            break;
+        }
+    }
+    Ns_MutexUnlock(&readersLock);
+    ns_free(readerPtr);
+}
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Touch --
+ *
+ *      Record a hit on a cache entry according to the policy of the
+ *      cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      LRU: the entry is moved to the front of the list; GDSF: the
+ *      priority of the entry is updated; otherwise, the reference bit of
+ *      an entry with a value is set and the frequency sketch is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Touch(Cache *cachePtr, Entry *ePtr, const char *key)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    if (cachePtr->policy == NS_CACHE_LRU) {
+        Remove(ePtr);
+        Push(ePtr);
+    } else if (cachePtr->policy == NS_CACHE_GDSF) {
+        if (ePtr->heapIndex > 0u) {
+            GdsfUpdate(cachePtr, ePtr);
+        }
+    } else if (ePtr->value != NULL) {
+        /*
+         * Entries without a value are just being computed, the access
+         * was already recorded on creation.
+         */
+        ePtr->referenced = NS_TRUE;
+        if (cachePtr->policy == NS_CACHE_TINYLFU) {
+            SketchIncrement(cachePtr, HashKey(cachePtr->keys, key));
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Prune --
+ *
+ *      Make space for the entry ePtr, until the cache size is below
+ *      maxSize. The entry ePtr itself and newborn entries (with a value
+ *      of NULL) of other threads are not evicted, since these are
+ *      concurrently created (e.g. ns_cache_eval releases its mutex).
+ *
+ *      With the TINYLFU policy, a new entry that is less frequently
+ *      requested than the eviction candidate is not admitted: instead
+ *      of evicting the candidate, the new entry is placed at the end of
+ *      the list and evicted by Ns_CacheUnlock(), when the caller is done
+ *      with it. The same holds for the GDSF policy, when the new entry
+ *      has the lowest priority.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries might be deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Prune(Cache *cachePtr, Entry *ePtr, size_t maxSize)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (cachePtr->policy == NS_CACHE_LRU) {
+        TCL_SIZE_T nchances = cachePtr->entriesTable.numEntries;
+
+        while (cachePtr->currentSize > maxSize
+               && cachePtr->lastEntryPtr != ePtr
+               && cachePtr->lastEntryPtr->value != NULL
+               ) {
+            Entry *victimPtr = cachePtr->lastEntryPtr;
+
+            if ((victimPtr->versionPtr != NULL || cachePtr->near.counts != NULL)
+                && nchances-- > 0
+                && TakeReference(cachePtr, victimPtr) > 0u) {
+                /*
+                 * Lock-free and near cache hits cannot relink the LRU
+                 * list, therefore entries with such hits get a second
+                 * chance.
+                 */
+                Remove(victimPtr);
+                Push(victimPtr);
+                continue;
+            }
+            Ns_CacheDeleteEntry((Ns_Entry *) victimPtr);
+            ++cachePtr->stats.npruned;
+        }
+    } else if (cachePtr->policy == NS_CACHE_GDSF) {
+        TCL_SIZE_T nchances = cachePtr->entriesTable.numEntries;
+
+        while (cachePtr->currentSize > maxSize && cachePtr->gdsf.size > 0u) {
+            Entry       *victimPtr = cachePtr->gdsf.entries[0];
+            unsigned int nrefs;
+
+            if (victimPtr->value == NULL) {
+                /*
+                 * Only entries being computed are left.
+                 */
+                break;
+            } else if (victimPtr == ePtr) {
+                cachePtr->rejectedPtr = ePtr;
+                ++cachePtr->stats.nrejected;
+                break;
+            } else if ((victimPtr->versionPtr != NULL || cachePtr->near.counts != NULL)
+                       && nchances-- > 0
+                       && (nrefs = TakeReference(cachePtr, victimPtr)) > 0u) {
+                /*
+                 * Lock-free and near cache hits do not update the
+                 * priority, account these now.
+                 */
+                victimPtr->count += nrefs;
+                GdsfUpdate(cachePtr, victimPtr);
+                continue;
+            }
+            cachePtr->gdsf.inflation = victimPtr->priority;
+            Ns_CacheDeleteEntry((Ns_Entry *) victimPtr);
+            ++cachePtr->stats.npruned;
+        }
+    } else {
+        unsigned int hash = 0u;
+
+        if (cachePtr->policy == NS_CACHE_TINYLFU && cachePtr->currentSize > maxSize) {
+            hash = HashKey(cachePtr->keys, Tcl_GetHashKey(&cachePtr->entriesTable, ePtr->hPtr));
+        }
+        while (cachePtr->currentSize > maxSize) {
+            Entry *victimPtr = ClockVictim(cachePtr, ePtr);
+
+            if (victimPtr == NULL) {
+                break;
+            }
+            if (cachePtr->policy == NS_CACHE_TINYLFU
+                && SketchFrequency(cachePtr, hash)
+                   < SketchFrequency(cachePtr, HashKey(cachePtr->keys,
+                                                       Tcl_GetHashKey(&cachePtr->entriesTable,
+                                                                      victimPtr->hPtr)))
+                ) {
+                /*
+                 * Don't admit the new entry. Move it to the end of the
+                 * list, where it is the next eviction candidate.
+                 */
+                Remove(ePtr);
+                ePtr->prevPtr = cachePtr->lastEntryPtr;
+                if (cachePtr->lastEntryPtr != NULL) {
+                    cachePtr->lastEntryPtr->nextPtr = ePtr;
+                } else {
+                    cachePtr->firstEntryPtr = ePtr;
+                }
+                cachePtr->lastEntryPtr = ePtr;
+                ePtr->referenced = NS_FALSE;
+                cachePtr->rejectedPtr = ePtr;
+                ++cachePtr->stats.nrejected;
+                break;
+            }
+            Ns_CacheDeleteEntry((Ns_Entry *) victimPtr);
+            ++cachePtr->stats.npruned;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EvictRejected --
+ *
+ *      Evict the new entry, which was not admitted by Prune(), as long
+ *      as the cache is still above its maximum size. Must be called
+ *      with the cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      An entry might be deleted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EvictRejected(Cache *cachePtr)
+{
+    Entry *ePtr;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+
+    ePtr = cachePtr->rejectedPtr;
+    if (ePtr != NULL) {
+        cachePtr->rejectedPtr = NULL;
+        if (ePtr->value != NULL
+            && cachePtr->maxSize > 0u
+            && cachePtr->currentSize > cachePtr->maxSize) {
+            Ns_CacheDeleteEntry((Ns_Entry *) ePtr);
+            ++cachePtr->stats.npruned;
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ClockVictim --
+ *
+ *      Determine the next entry to be evicted by the CLOCK algorithm:
+ *      starting from the end of the list, referenced entries get a
+ *      second chance by clearing their reference bit and moving them
+ *      to the front of the list.
+ *
+ * Results:
+ *      The entry to be evicted, or NULL, when no entry can be evicted.
+ *
+ * Side effects:
+ *      Reference bits are cleared, the list is reordered.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Entry *
+ClockVictim(Cache *cachePtr, Entry *ePtr)
+{
+    Entry     *victimPtr;
+    bool       skipped = NS_FALSE;
+    TCL_SIZE_T nchances = cachePtr->entriesTable.numEntries;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    for (;;) {
+        victimPtr = cachePtr->lastEntryPtr;
+
+        if (victimPtr == NULL || victimPtr->value == NULL) {
+            victimPtr = NULL;
+            break;
+
+        } else if (victimPtr == ePtr) {
+            if (ePtr->prevPtr == NULL || skipped) {
+                /*
+                 * Either the only entry, or all other entries were
+                 * visited already.
+                 */
+                victimPtr = NULL;
+                break;
+            }
+            /*
+             * Skip the entry to make space for.
+             */
+            skipped = NS_TRUE;
+
+        } else if (nchances-- <= 0 || TakeReference(cachePtr, victimPtr) == 0u) {
+            /*
+             * Unreferenced entry, or concurrent lock-free hits keep
+             * setting the reference bits.
+             */
+            break;
+        }
+        Remove(victimPtr);
+        Push(victimPtr);
+    }
+    return victimPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GdsfInsert, GdsfRemove, GdsfUpdate, GdsfSift --
+ *
+ *      Maintain the min-heap of the GDSF policy. GdsfUpdate() recomputes
+ *      the priority of an entry "inflation + frequency * cost / size"
+ *      and restores the heap order via GdsfSift(). The reuse count of the entry is
+ *      used as frequency, the cost is at least 1 microsecond and the
+ *      size includes the overhead of the entry. Entries without a
+ *      (committed) value are never evicted and get the highest
+ *      priority.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Heap modified, might be reallocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GdsfInsert(Cache *cachePtr, Entry *ePtr)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (cachePtr->gdsf.size == cachePtr->gdsf.capacity) {
+        cachePtr->gdsf.capacity = (cachePtr->gdsf.capacity == 0u) ? 64u : cachePtr->gdsf.capacity * 2u;
+        cachePtr->gdsf.entries = ns_realloc(cachePtr->gdsf.entries,
+                                            cachePtr->gdsf.capacity * sizeof(Entry *));
+    }
+    cachePtr->gdsf.entries[cachePtr->gdsf.size++] = ePtr;
+    ePtr->heapIndex = cachePtr->gdsf.size;
+    GdsfUpdate(cachePtr, ePtr);
+}
+
+static void
+GdsfRemove(Cache *cachePtr, Entry *ePtr)
+{
+    size_t i;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    i = ePtr->heapIndex - 1u;
+    ePtr->heapIndex = 0u;
+    if (--cachePtr->gdsf.size > i) {
+        Entry *lastPtr = cachePtr->gdsf.entries[cachePtr->gdsf.size];
+
+        cachePtr->gdsf.entries[i] = lastPtr;
+        lastPtr->heapIndex = i + 1u;
+        GdsfSift(cachePtr, lastPtr);
+    }
+}
+
+static void
+GdsfUpdate(Cache *cachePtr, Entry *ePtr)
+{
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    if (ePtr->value == NULL) {
+        ePtr->priority = DBL_MAX;
+    } else {
+        ePtr->priority = cachePtr->gdsf.inflation
+            + ((double)ePtr->count * (double)(ePtr->cost > 0 ? ePtr->cost : 1))
+            / (double)(ePtr->size + sizeof(Entry));
+    }
+    GdsfSift(cachePtr, ePtr);
+}
+
+static void
+GdsfSift(Cache *cachePtr, Entry *ePtr)
+{
+    size_t i;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+    NS_NONNULL_ASSERT(ePtr != NULL);
+
+    i = ePtr->heapIndex - 1u;
+    while (i > 0u && cachePtr->gdsf.entries[(i - 1u) / 2u]->priority > ePtr->priority) {
+        GdsfSwap(cachePtr, i, (i - 1u) / 2u);
+        i = (i - 1u) / 2u;
+    }
+    for (;;) {
+        size_t left = 2u * i + 1u, smallest = i;
+
+        if (left < cachePtr->gdsf.size
+            && cachePtr->gdsf.entries[left]->priority < cachePtr->gdsf.entries[smallest]->priority) {
+            smallest = left;
+        }
+        if (left + 1u < cachePtr->gdsf.size
+            && cachePtr->gdsf.entries[left + 1u]->priority < cachePtr->gdsf.entries[smallest]->priority) {
+            smallest = left + 1u;
+        }
+        if (smallest == i) {
+            break;
+        }
+        GdsfSwap(cachePtr, i, smallest);
+        i = smallest;
+    }
+}
+
+static void
+GdsfSwap(Cache *cachePtr, size_t i, size_t j)
+{
+    Entry *ePtr = cachePtr->gdsf.entries[i];
+
+    cachePtr->gdsf.entries[i] = cachePtr->gdsf.entries[j];
+    cachePtr->gdsf.entries[i]->heapIndex = i + 1u;
+    cachePtr->gdsf.entries[j] = ePtr;
+    ePtr->heapIndex = j + 1u;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SketchIncrement, SketchFrequency --
+ *
+ *      Update and query the count-min sketch of the TINYLFU policy. The
+ *      sketch consists of SKETCH_DEPTH rows of saturating 4-bit
+ *      counters. When the number of additions reaches 10 times the
+ *      width, all counters are halved to age out old accesses. The
+ *      width of the sketch is determined by Ns_CacheSetPolicy().
+ *
+ * Results:
+ *      SketchFrequency() returns the estimated frequency.
+ *
+ * Side effects:
+ *      Counters updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SketchIncrement(Cache *cachePtr, unsigned int hash)
+{
+    unsigned int i;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+
+    if (cachePtr->sketch.counters == NULL) {
+        return;
+    }
+    for (i = 0u; i < SKETCH_DEPTH; i++) {
+        unsigned int   h = (hash + i * 0x9e3779b9u) * 0x85ebca6bu;
+        unsigned char *counterPtr;
+
+        counterPtr = &cachePtr->sketch.counters[i * cachePtr->sketch.width
+                                                + ((h ^ (h >> 15)) & (cachePtr->sketch.width - 1u))];
+        if (*counterPtr < 15u) {
+            (*counterPtr)++;
+        }
+    }
+    if (++cachePtr->sketch.additions >= 10u * (unsigned long)cachePtr->sketch.width) {
+        size_t j, length = SKETCH_DEPTH * (size_t)cachePtr->sketch.width;
+
+        for (j = 0u; j < length; j++) {
+            cachePtr->sketch.counters[j] >>= 1;
+        }
+        cachePtr->sketch.additions /= 2u;
+    }
+}
+
+static unsigned int
+SketchFrequency(const Cache *cachePtr, unsigned int hash)
+{
+    unsigned int i, result = 15u;
+
+    NS_NONNULL_ASSERT(cachePtr != NULL);
+
+    if (cachePtr->sketch.counters == NULL) {
+        return 0u;
+    }
+    for (i = 0u; i < SKETCH_DEPTH; i++) {
+        unsigned int h = (hash + i * 0x9e3779b9u) * 0x85ebca6bu;
+        unsigned int value;
+
+        value = cachePtr->sketch.counters[i * cachePtr->sketch.width
+                                          + ((h ^ (h >> 15)) & (cachePtr->sketch.width - 1u))];
+        if (value < result) {
+            result = value;
+        }
+    }
+    return result;
+}
+
+
 
 /*
  *----------------------------------------------------------------------
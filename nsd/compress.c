@@ -12,20 +12,102 @@
 /*
  * compress.c --
  *
- *      Support for gzip compression using Zlib.
+ *      Support for gzip compression using Zlib and, when available,
+ *      for brotli and zstd compression.
  */
 
 #include "nsd.h"
 
-#ifdef HAVE_ZLIB_H
+#ifdef HAVE_BROTLI_ENCODE_H
+# include <brotli/encode.h>
+#endif
+#ifdef HAVE_ZSTD_H
+# include <zstd.h>
+#endif
 
-# define COMPRESS_SENT_HEADER 0x01u
+/*
+ * Flag of a compression stream indicating that the stream was started,
+ * i.e. the gzip header was written or the encoder level was set.
+ */
 
+#define COMPRESS_SENT_HEADER 0x01u
+
+/*
+ * The following structure defines the encoder state of a brotli or
+ * zstd compression stream. It is created on the first call of
+ * Ns_CompressBufs() for a stream or when the stream is obtained via
+ * Ns_CompressStreamGet(). Zstd encoders are reset and kept for
+ * subsequent streams, brotli encoders cannot be reset and are freed
+ * when the stream is finished.
+ */
+
+typedef struct Encoder {
+    Ns_CompressEncoding  encoding;
+#ifdef HAVE_BROTLI_ENCODE_H
+    BrotliEncoderState  *brotliPtr;
+#endif
+#ifdef HAVE_ZSTD_H
+    ZSTD_CCtx           *zstdPtr;
+#endif
+} Encoder;
+
+/*
+ * The following structure defines the pool of idle compression
+ * streams, which are ready for reuse. Streams are pooled per encoding,
+ * since the expensive part of a stream is the state of its encoder
+ * (e.g. ~400KB for zlib with the settings below).
+ */
+
+typedef struct StreamPool {
+    Ns_CompressStream **idle;       /* Array of maxIdle idle streams */
+    int                 nrIdle;     /* Number of idle streams */
+    unsigned long       gets;       /* Number of requested streams */
+    unsigned long       hits;       /* Number of requests served from the pool */
+    unsigned long       discarded;  /* Number of streams freed since the pool was full */
+} StreamPool;
+
+static struct {
+    Ns_Mutex    lock;
+    int         maxIdle;            /* Max number of idle streams per encoding */
+    StreamPool  pools[NS_COMPRESS_NR_ENCODINGS];
+} streamPool;
 
 /*
  * Static functions defined in this file.
  */
 
+static Ns_ReturnCode StreamInit(Ns_CompressStream *cStream, Ns_CompressEncoding encoding)
+    NS_GNUC_NONNULL(1);
+
+static int StreamReset(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+
+static void EncoderFree(Ns_CompressStream *cStream)
+    NS_GNUC_NONNULL(1);
+
+static Encoder *EncoderCreate(Ns_CompressEncoding encoding);
+
+#if defined(HAVE_BROTLI_ENCODE_H) || defined(HAVE_ZSTD_H)
+static Encoder *EncoderGet(Ns_CompressStream *cStream, Ns_CompressEncoding encoding, int level)
+    NS_GNUC_NONNULL(1);
+#endif
+
+#ifdef HAVE_BROTLI_ENCODE_H
+static Ns_ReturnCode CompressBufsBrotli(Ns_CompressStream *cStream, struct iovec *bufs, int nbufs,
+                                        Ns_DString *dsPtr, int level, bool flush)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(4);
+static void *BrotliAlloc(void *UNUSED(opaque), size_t size);
+static void BrotliFree(void *UNUSED(opaque), void *address);
+#endif
+
+#ifdef HAVE_ZSTD_H
+static Ns_ReturnCode CompressBufsZstd(Ns_CompressStream *cStream, struct iovec *bufs, int nbufs,
+                                      Ns_DString *dsPtr, int level, bool flush)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(4);
+#endif
+
+#ifdef HAVE_ZLIB_H
+
 static void DeflateOrAbort(z_stream *z, int flushFlags);
 static voidpf ZAlloc(voidpf UNUSED(arg), uInt items, uInt size);
 static void ZFree(voidpf UNUSED(arg), voidpf address);
@@ -55,6 +137,7 @@ Ns_CompressInit(Ns_CompressStream *cStream)
     Ns_ReturnCode status = NS_OK;
 
     cStream->flags = 0u;
+    cStream->encoderPtr = NULL;
     z->zalloc = ZAlloc;
     z->zfree = ZFree;
     z->opaque = Z_NULL;
@@ -103,8 +186,10 @@ Ns_CompressFree(Ns_CompressStream *cStream)
                    status, zError(status), (z->msg != NULL) ? z->msg : "(unknown)");
         }
     }
+    EncoderFree(cStream);
 }
 
+
 /*
  *----------------------------------------------------------------------
  *
@@ -311,18 +396,21 @@ Ns_CompressBufsGzip(Ns_CompressStream *cStream, struct iovec *bufs, int nbufs,
 Ns_ReturnCode
 Ns_CompressGzip(const char *buf, int len, Ns_DString *dsPtr, int level)
 {
-    Ns_CompressStream  cStream;
-    struct iovec       iov;
+    Ns_CompressStream *cStream;
     Ns_ReturnCode      status;
 
     NS_NONNULL_ASSERT(buf != NULL);
     NS_NONNULL_ASSERT(dsPtr != NULL);
 
-    status = Ns_CompressInit(&cStream);
-    if (status == NS_OK) {
+    cStream = Ns_CompressStreamGet(NS_COMPRESS_GZIP);
+    if (cStream == NULL) {
+        status = NS_ERROR;
+    } else {
+        struct iovec iov;
+
         (void)Ns_SetVec(&iov, 0, buf, (size_t)len);
-        status = Ns_CompressBufsGzip(&cStream, &iov, 1, dsPtr, level, NS_TRUE);
-        Ns_CompressFree(&cStream);
+        status = Ns_CompressBufsGzip(cStream, &iov, 1, dsPtr, level, NS_TRUE);
+        Ns_CompressStreamRelease(cStream);
     }
 
     return status;
@@ -396,15 +484,17 @@ ZFree(voidpf UNUSED(arg), voidpf address)
 #else /* ! HAVE_ZLIB_H */
 
 Ns_ReturnCode
-Ns_CompressInit(Ns_CompressStream *UNUSED(cStream))
+Ns_CompressInit(Ns_CompressStream *cStream)
 {
+    cStream->flags = 0u;
+    cStream->encoderPtr = NULL;
     return NS_ERROR;
 }
 
 void
-Ns_CompressFree(Ns_CompressStream *UNUSED(cStream))
+Ns_CompressFree(Ns_CompressStream *cStream)
 {
-    return;
+    EncoderFree(cStream);
 }
 
 Ns_ReturnCode
@@ -446,6 +536,805 @@ Ns_InflateEnd(Ns_CompressStream *UNUSED(cStream))
 
 #endif
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CompressBufs --
+ *
+ *      Compress a vector of bufs with the specified content encoding
+ *      and append the result to the dstring. The semantics of the
+ *      arguments are the same as for Ns_CompressBufsGzip(): the stream
+ *      is finished, when "flush" is true, otherwise the output is
+ *      flushed such that the client can decode everything sent so far.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, when the encoding is not supported by this
+ *      binary or the encoder failed.
+ *
+ * Side effects:
+ *      Might allocate or free the encoder of the stream.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_CompressBufs(Ns_CompressStream *cStream, Ns_CompressEncoding encoding,
+                struct iovec *bufs, int nbufs, Ns_DString *dsPtr, int level, bool flush)
+{
+    Ns_ReturnCode status;
+
+    NS_NONNULL_ASSERT(cStream != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    switch (encoding) {
+    case NS_COMPRESS_BROTLI:
+#ifdef HAVE_BROTLI_ENCODE_H
+        status = CompressBufsBrotli(cStream, bufs, nbufs, dsPtr, level, flush);
+#else
+        status = NS_ERROR;
+#endif
+        break;
+
+    case NS_COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD_H
+        status = CompressBufsZstd(cStream, bufs, nbufs, dsPtr, level, flush);
+#else
+        status = NS_ERROR;
+#endif
+        break;
+
+    case NS_COMPRESS_GZIP:
+    default:
+        status = Ns_CompressBufsGzip(cStream, bufs, nbufs, dsPtr, level, flush);
+        break;
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CompressEncodingAvailable, Ns_CompressEncodingName --
+ *
+ *      Check, whether the specified content encoding is supported by
+ *      this binary, and return its name as used in the
+ *      "Content-Encoding" and "Accept-Encoding" header fields.
+ *
+ * Results:
+ *      Boolean value or name of the encoding.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+Ns_CompressEncodingAvailable(Ns_CompressEncoding encoding)
+{
+    bool result;
+
+    switch (encoding) {
+    case NS_COMPRESS_GZIP:
+#ifdef HAVE_ZLIB_H
+        result = NS_TRUE;
+#else
+        result = NS_FALSE;
+#endif
+        break;
+
+    case NS_COMPRESS_BROTLI:
+#ifdef HAVE_BROTLI_ENCODE_H
+        result = NS_TRUE;
+#else
+        result = NS_FALSE;
+#endif
+        break;
+
+    case NS_COMPRESS_ZSTD:
+#ifdef HAVE_ZSTD_H
+        result = NS_TRUE;
+#else
+        result = NS_FALSE;
+#endif
+        break;
+
+    default:
+        result = NS_FALSE;
+        break;
+    }
+    return result;
+}
+
+const char *
+Ns_CompressEncodingName(Ns_CompressEncoding encoding)
+{
+    const char *result;
+
+    switch (encoding) {
+    case NS_COMPRESS_BROTLI: result = "br";   break;
+    case NS_COMPRESS_ZSTD:   result = "zstd"; break;
+    case NS_COMPRESS_GZIP:
+    default:                 result = "gzip"; break;
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsCompressEncodingFromName --
+ *
+ *      Map the name of a content encoding ("gzip", "br" or "zstd") to
+ *      its value. For convenience, "brotli" is accepted as well.
+ *
+ * Results:
+ *      NS_TRUE, when the name is known.
+ *
+ * Side effects:
+ *      Sets *encodingPtr on success.
+ *
+ *----------------------------------------------------------------------
+ */
+
+bool
+NsCompressEncodingFromName(const char *name, Ns_CompressEncoding *encodingPtr)
+{
+    bool success = NS_TRUE;
+
+    NS_NONNULL_ASSERT(name != NULL);
+    NS_NONNULL_ASSERT(encodingPtr != NULL);
+
+    if (STREQ(name, "gzip")) {
+        *encodingPtr = NS_COMPRESS_GZIP;
+    } else if (STREQ(name, "br") || STREQ(name, "brotli")) {
+        *encodingPtr = NS_COMPRESS_BROTLI;
+    } else if (STREQ(name, "zstd")) {
+        *encodingPtr = NS_COMPRESS_ZSTD;
+    } else {
+        success = NS_FALSE;
+    }
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EncoderCreate, EncoderGet, EncoderFree --
+ *
+ *      EncoderCreate() creates a brotli or zstd encoder. EncoderGet()
+ *      returns the encoder of a compression stream, creates it when
+ *      necessary and sets the compression level, when a new stream
+ *      starts. EncoderFree() releases the encoder of a stream.
+ *
+ * Results:
+ *      Encoder or NULL, when the encoder could not be created.
+ *
+ * Side effects:
+ *      Memory allocation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Encoder *
+EncoderCreate(Ns_CompressEncoding encoding)
+{
+    Encoder *encoderPtr;
+    bool     success = NS_FALSE;
+
+    encoderPtr = ns_calloc(1u, sizeof(Encoder));
+    encoderPtr->encoding = encoding;
+
+#ifdef HAVE_BROTLI_ENCODE_H
+    if (encoding == NS_COMPRESS_BROTLI) {
+        encoderPtr->brotliPtr = BrotliEncoderCreateInstance(BrotliAlloc, BrotliFree, NULL);
+        success = (encoderPtr->brotliPtr != NULL);
+    }
+#endif
+#ifdef HAVE_ZSTD_H
+    if (encoding == NS_COMPRESS_ZSTD) {
+        encoderPtr->zstdPtr = ZSTD_createCCtx();
+        success = (encoderPtr->zstdPtr != NULL);
+    }
+#endif
+    if (!success) {
+        Ns_Log(Error, "compress: could not create %s encoder",
+               Ns_CompressEncodingName(encoding));
+        ns_free(encoderPtr);
+        encoderPtr = NULL;
+    }
+
+    return encoderPtr;
+}
+
+#if defined(HAVE_BROTLI_ENCODE_H) || defined(HAVE_ZSTD_H)
+static Encoder *
+EncoderGet(Ns_CompressStream *cStream, Ns_CompressEncoding encoding, int level)
+{
+    Encoder *encoderPtr = cStream->encoderPtr;
+
+    if (encoderPtr != NULL && encoderPtr->encoding != encoding) {
+        EncoderFree(cStream);
+        encoderPtr = NULL;
+    }
+    if (encoderPtr == NULL) {
+        encoderPtr = EncoderCreate(encoding);
+        cStream->encoderPtr = encoderPtr;
+        cStream->flags = 0u;
+    }
+
+    if (encoderPtr != NULL && (cStream->flags & COMPRESS_SENT_HEADER) == 0u) {
+        cStream->flags |= COMPRESS_SENT_HEADER;
+#ifdef HAVE_BROTLI_ENCODE_H
+        if (encoding == NS_COMPRESS_BROTLI) {
+            (void) BrotliEncoderSetParameter(encoderPtr->brotliPtr, BROTLI_PARAM_QUALITY,
+                                             (uint32_t)MIN(MAX(level, BROTLI_MIN_QUALITY),
+                                                           BROTLI_MAX_QUALITY));
+        }
+#endif
+#ifdef HAVE_ZSTD_H
+        if (encoding == NS_COMPRESS_ZSTD) {
+            (void) ZSTD_CCtx_setParameter(encoderPtr->zstdPtr, ZSTD_c_compressionLevel,
+                                          MIN(MAX(level, 1), ZSTD_maxCLevel()));
+        }
+#endif
+    }
+
+    return encoderPtr;
+}
+#endif
+
+static void
+EncoderFree(Ns_CompressStream *cStream)
+{
+    Encoder *encoderPtr = cStream->encoderPtr;
+
+    if (encoderPtr != NULL) {
+#ifdef HAVE_BROTLI_ENCODE_H
+        if (encoderPtr->brotliPtr != NULL) {
+            BrotliEncoderDestroyInstance(encoderPtr->brotliPtr);
+        }
+#endif
+#ifdef HAVE_ZSTD_H
+        if (encoderPtr->zstdPtr != NULL) {
+            (void) ZSTD_freeCCtx(encoderPtr->zstdPtr);
+        }
+#endif
+        ns_free(encoderPtr);
+        cStream->encoderPtr = NULL;
+    }
+}
+
+#ifdef HAVE_BROTLI_ENCODE_H
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompressBufsBrotli --
+ *
+ *      Compress a vector of bufs with brotli (RFC 7932) and append the
+ *      result to the dstring. The output of the encoder is taken
+ *      directly from its internal buffer, so no output size has to be
+ *      estimated.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      The encoder is freed, when the stream is finished, since brotli
+ *      encoders cannot be reset.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+CompressBufsBrotli(Ns_CompressStream *cStream, struct iovec *bufs, int nbufs,
+                   Ns_DString *dsPtr, int level, bool flush)
+{
+    Encoder           *encoderPtr;
+    Ns_ReturnCode      status = NS_OK;
+
+    encoderPtr = EncoderGet(cStream, NS_COMPRESS_BROTLI, level);
+    if (encoderPtr == NULL) {
+        status = NS_ERROR;
+
+    } else {
+        BrotliEncoderState *s = encoderPtr->brotliPtr;
+        int                 i = 0;
+
+        /*
+         * Process at least one (maybe empty) buffer, such that a flush
+         * or finish operation is performed also when nbufs is 0.
+         */
+        do {
+            const uint8_t         *nextIn = NULL;
+            size_t                 availIn = 0u;
+            BrotliEncoderOperation op;
+
+            if (i < nbufs) {
+                nextIn = (const uint8_t *)bufs[i].iov_base;
+                availIn = bufs[i].iov_len;
+            }
+            if (i < nbufs - 1) {
+                op = BROTLI_OPERATION_PROCESS;
+            } else {
+                op = flush ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+            }
+
+            for (;;) {
+                size_t   availOut = 0u;
+                uint8_t *nextOut = NULL;
+
+                if (BrotliEncoderCompressStream(s, op, &availIn, &nextIn,
+                                                &availOut, &nextOut, NULL) == BROTLI_FALSE) {
+                    Ns_Log(Error, "compress: brotli encoder failed");
+                    status = NS_ERROR;
+                    break;
+                }
+                while (BrotliEncoderHasMoreOutput(s) == BROTLI_TRUE) {
+                    size_t         size = 0u;
+                    const uint8_t *output = BrotliEncoderTakeOutput(s, &size);
+
+                    Tcl_DStringAppend(dsPtr, (const char *)output, (TCL_SIZE_T)size);
+                }
+                if (availIn == 0u
+                    && (op != BROTLI_OPERATION_FINISH || BrotliEncoderIsFinished(s) == BROTLI_TRUE)) {
+                    break;
+                }
+            }
+            i++;
+        } while (i < nbufs && status == NS_OK);
+
+        if (flush || status != NS_OK) {
+            EncoderFree(cStream);
+            cStream->flags = 0u;
+        }
+    }
+
+    return status;
+}
+
+static void *
+BrotliAlloc(void *UNUSED(opaque), size_t size)
+{
+    return ns_malloc(size);
+}
+
+static void
+BrotliFree(void *UNUSED(opaque), void *address)
+{
+    ns_free(address);
+}
+#endif /* HAVE_BROTLI_ENCODE_H */
+
+#ifdef HAVE_ZSTD_H
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompressBufsZstd --
+ *
+ *      Compress a vector of bufs with zstd (RFC 8878) and append the
+ *      result to the dstring.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      When the stream is finished, the encoder is kept for the next
+ *      frame; on errors, it is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+CompressBufsZstd(Ns_CompressStream *cStream, struct iovec *bufs, int nbufs,
+                 Ns_DString *dsPtr, int level, bool flush)
+{
+    Encoder           *encoderPtr;
+    Ns_ReturnCode      status = NS_OK;
+
+    encoderPtr = EncoderGet(cStream, NS_COMPRESS_ZSTD, level);
+    if (encoderPtr == NULL) {
+        status = NS_ERROR;
+
+    } else {
+        ZSTD_CCtx *cctx = encoderPtr->zstdPtr;
+        int        i = 0;
+
+        do {
+            ZSTD_inBuffer     in = {NULL, 0u, 0u};
+            ZSTD_EndDirective mode;
+            bool              finished;
+
+            if (i < nbufs) {
+                in.src = bufs[i].iov_base;
+                in.size = bufs[i].iov_len;
+            }
+            if (i < nbufs - 1) {
+                mode = ZSTD_e_continue;
+            } else {
+                mode = flush ? ZSTD_e_end : ZSTD_e_flush;
+            }
+
+            do {
+                TCL_SIZE_T     offset = dsPtr->length;
+                size_t         remaining, chunk;
+                ZSTD_outBuffer out;
+
+                /*
+                 * Reserve space for the worst case of the pending input
+                 * plus some block and frame overhead; further rounds
+                 * are performed, when the encoder has more to say.
+                 */
+                chunk = ZSTD_compressBound(in.size - in.pos) + 64u;
+                Tcl_DStringSetLength(dsPtr, offset + (TCL_SIZE_T)chunk);
+                out.dst = dsPtr->string + offset;
+                out.size = chunk;
+                out.pos = 0u;
+
+                remaining = ZSTD_compressStream2(cctx, &out, &in, mode);
+                Tcl_DStringSetLength(dsPtr, offset + (TCL_SIZE_T)out.pos);
+
+                if (ZSTD_isError(remaining) != 0u) {
+                    Ns_Log(Error, "compress: zstd encoder failed: %s",
+                           ZSTD_getErrorName(remaining));
+                    status = NS_ERROR;
+                    break;
+                }
+                finished = (mode == ZSTD_e_continue) ? (in.pos == in.size) : (remaining == 0u);
+            } while (!finished);
+            i++;
+        } while (i < nbufs && status == NS_OK);
+
+        if (status != NS_OK) {
+            EncoderFree(cStream);
+            cStream->flags = 0u;
+        } else if (flush) {
+            cStream->flags = 0u;
+        }
+    }
+
+    return status;
+}
+#endif /* HAVE_ZSTD_H */
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsConfigCompress --
+ *
+ *      Configure the pool of compression streams.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Allocates the arrays for the idle streams.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsConfigCompress(void)
+{
+    const char *path = NS_GLOBAL_CONFIG_PARAMETERS;
+    int         e;
+
+    Ns_MutexInit(&streamPool.lock);
+    Ns_MutexSetName(&streamPool.lock, "ns:compresspool");
+
+    streamPool.maxIdle = Ns_ConfigIntRange(path, "compresspoolsize", 16, 0, INT_MAX);
+    if (streamPool.maxIdle > 0) {
+        for (e = 0; e < NS_COMPRESS_NR_ENCODINGS; e++) {
+            streamPool.pools[e].idle = ns_calloc((size_t)streamPool.maxIdle,
+                                                 sizeof(Ns_CompressStream *));
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_CompressStreamGet, Ns_CompressStreamRelease --
+ *
+ *      Obtain a compression stream for the specified encoding from the
+ *      pool of idle streams, or create a new one. A released stream is
+ *      reset and returned to the pool, when the pool is not full,
+ *      otherwise it is freed. A stream, which was not finished (e.g.
+ *      due to an aborted response), can be released as well.
+ *
+ * Results:
+ *      Ns_CompressStreamGet() returns a ready stream or NULL, when the
+ *      encoding is not available or its encoder could not be created.
+ *
+ * Side effects:
+ *      Updates the pool statistics.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_CompressStream *
+Ns_CompressStreamGet(Ns_CompressEncoding encoding)
+{
+    Ns_CompressStream *cStream = NULL;
+    StreamPool        *poolPtr;
+
+    assert((int)encoding >= 0 && (int)encoding < NS_COMPRESS_NR_ENCODINGS);
+    poolPtr = &streamPool.pools[encoding];
+
+    Ns_MutexLock(&streamPool.lock);
+    poolPtr->gets++;
+    if (poolPtr->nrIdle > 0) {
+        cStream = poolPtr->idle[--poolPtr->nrIdle];
+        poolPtr->hits++;
+    }
+    Ns_MutexUnlock(&streamPool.lock);
+
+    if (cStream == NULL) {
+        cStream = ns_calloc(1u, sizeof(Ns_CompressStream));
+        if (StreamInit(cStream, encoding) != NS_OK) {
+            Ns_CompressFree(cStream);
+            ns_free(cStream);
+            cStream = NULL;
+        }
+    }
+
+    return cStream;
+}
+
+void
+Ns_CompressStreamRelease(Ns_CompressStream *cStream)
+{
+    int  kind;
+    bool pooled = NS_FALSE;
+
+    NS_NONNULL_ASSERT(cStream != NULL);
+
+    kind = StreamReset(cStream);
+    if (kind >= 0) {
+        StreamPool *poolPtr = &streamPool.pools[kind];
+
+        Ns_MutexLock(&streamPool.lock);
+        if (poolPtr->nrIdle < streamPool.maxIdle) {
+            poolPtr->idle[poolPtr->nrIdle++] = cStream;
+            pooled = NS_TRUE;
+        } else {
+            poolPtr->discarded++;
+        }
+        Ns_MutexUnlock(&streamPool.lock);
+    }
+    if (!pooled) {
+        Ns_CompressFree(cStream);
+        ns_free(cStream);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsCompressPoolFill --
+ *
+ *      Fill the pool of idle streams for the specified encoding up to
+ *      its maximum size. This is used for the "compresspreinit"
+ *      parameter to allocate the compression buffers at startup.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Allocates compression streams.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsCompressPoolFill(Ns_CompressEncoding encoding)
+{
+    StreamPool *poolPtr;
+    bool        full = NS_FALSE;
+
+    assert((int)encoding >= 0 && (int)encoding < NS_COMPRESS_NR_ENCODINGS);
+    poolPtr = &streamPool.pools[encoding];
+
+    while (!full) {
+        Ns_CompressStream *cStream;
+
+        Ns_MutexLock(&streamPool.lock);
+        full = (poolPtr->nrIdle >= streamPool.maxIdle);
+        Ns_MutexUnlock(&streamPool.lock);
+
+        if (!full) {
+            cStream = ns_calloc(1u, sizeof(Ns_CompressStream));
+            if (StreamInit(cStream, encoding) != NS_OK
+                || StreamReset(cStream) != (int)encoding) {
+                /*
+                 * The encoding is not available or cannot be pooled.
+                 */
+                Ns_CompressFree(cStream);
+                ns_free(cStream);
+                break;
+            }
+            Ns_MutexLock(&streamPool.lock);
+            if (poolPtr->nrIdle < streamPool.maxIdle) {
+                poolPtr->idle[poolPtr->nrIdle++] = cStream;
+                cStream = NULL;
+            }
+            Ns_MutexUnlock(&streamPool.lock);
+            if (cStream != NULL) {
+                Ns_CompressFree(cStream);
+                ns_free(cStream);
+            }
+        }
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StreamInit --
+ *
+ *      Initialize a new compression stream for the specified
+ *      encoding.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR.
+ *
+ * Side effects:
+ *      Allocates the state of the encoder.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+StreamInit(Ns_CompressStream *cStream, Ns_CompressEncoding encoding)
+{
+    Ns_ReturnCode status;
+
+    if (encoding == NS_COMPRESS_GZIP) {
+        status = Ns_CompressInit(cStream);
+    } else if (Ns_CompressEncodingAvailable(encoding)) {
+        cStream->flags = 0u;
+        cStream->encoderPtr = EncoderCreate(encoding);
+        status = (cStream->encoderPtr != NULL) ? NS_OK : NS_ERROR;
+    } else {
+        status = NS_ERROR;
+    }
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StreamReset --
+ *
+ *      Reset a compression stream such that it can be used for a new
+ *      response. Brotli encoders cannot be reset and are freed.
+ *
+ * Results:
+ *      Encoding of the pool, into which the stream can be put, or -1
+ *      when the stream holds no reusable state.
+ *
+ * Side effects:
+ *      Resets the state of the encoder.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+StreamReset(Ns_CompressStream *cStream)
+{
+    int            kind = -1;
+    const Encoder *encoderPtr = cStream->encoderPtr;
+
+    if (encoderPtr != NULL) {
+#ifdef HAVE_ZSTD_H
+        if (encoderPtr->encoding == NS_COMPRESS_ZSTD) {
+            if (cStream->flags != 0u) {
+                (void) ZSTD_CCtx_reset(encoderPtr->zstdPtr, ZSTD_reset_session_only);
+            }
+            kind = (int)NS_COMPRESS_ZSTD;
+        }
+#endif
+        if (kind == -1) {
+            EncoderFree(cStream);
+        }
+    }
+#ifdef HAVE_ZLIB_H
+    if (cStream->z.zalloc != NULL) {
+        if (cStream->flags != 0u) {
+            (void) deflateReset(&cStream->z);
+        }
+        if (kind == -1) {
+            kind = (int)NS_COMPRESS_GZIP;
+        }
+    }
+#endif
+    cStream->flags = 0u;
+
+    return kind;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCompressStatsObjCmd --
+ *
+ *      Implements "ns_compress_stats". Returns the statistics of the
+ *      pool of compression streams for every available encoding.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Resets the statistics, when "-reset" is specified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclCompressStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    int         reset = (int)NS_FALSE, result = TCL_OK;
+    Ns_ObjvSpec opts[] = {
+        {"-reset", Ns_ObjvBool, &reset, INT2PTR(NS_TRUE)},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, NULL, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_Obj *resultObj = Tcl_NewDictObj();
+        int      e;
+
+        Ns_MutexLock(&streamPool.lock);
+        for (e = 0; e < NS_COMPRESS_NR_ENCODINGS; e++) {
+            StreamPool *poolPtr = &streamPool.pools[e];
+            Tcl_Obj    *dictObj;
+
+            if (!Ns_CompressEncodingAvailable((Ns_CompressEncoding)e)) {
+                continue;
+            }
+            dictObj = Tcl_NewDictObj();
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("idle", 4),
+                           Tcl_NewIntObj(poolPtr->nrIdle));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("maxidle", 7),
+                           Tcl_NewIntObj(e == (int)NS_COMPRESS_BROTLI ? 0 : streamPool.maxIdle));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("gets", 4),
+                           Tcl_NewWideIntObj((Tcl_WideInt)poolPtr->gets));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("hits", 4),
+                           Tcl_NewWideIntObj((Tcl_WideInt)poolPtr->hits));
+            Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("discarded", 9),
+                           Tcl_NewWideIntObj((Tcl_WideInt)poolPtr->discarded));
+            Tcl_DictObjPut(NULL, resultObj,
+                           Tcl_NewStringObj(Ns_CompressEncodingName((Ns_CompressEncoding)e), -1),
+                           dictObj);
+            if (reset != 0) {
+                poolPtr->gets = 0u;
+                poolPtr->hits = 0u;
+                poolPtr->discarded = 0u;
+            }
+        }
+        Ns_MutexUnlock(&streamPool.lock);
+
+        Tcl_SetObjResult(interp, resultObj);
+    }
+    return result;
+}
+
 /*
  * Local Variables:
  * mode: c
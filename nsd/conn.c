@@ -2463,6 +2463,9 @@ NsTclConnObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_
             if ((connPtr->flags & NS_CONN_BROTLIACCEPTED) != 0u) {
                 Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("brotli", 6));
             }
+            if ((connPtr->flags & NS_CONN_ZSTDACCEPTED) != 0u) {
+                Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("zstd", 4));
+            }
             if ((connPtr->flags & NS_CONN_ZIPACCEPTED) != 0u) {
                 Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj("gzip", 4));
             }
@@ -49,7 +49,10 @@ static Ns_ReturnCode ConnCopy(const Ns_Conn *conn, size_t toCopy, Tcl_Channel ch
 static bool CheckKeep(const Conn *connPtr)
     NS_GNUC_NONNULL(1);
 
-static int CheckCompress(const Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned int ioflags)
+static int CheckCompress(Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned int ioflags)
+    NS_GNUC_NONNULL(1);
+
+static int CompressLevel(const Conn *connPtr, Ns_CompressEncoding encoding, int defaultLevel)
     NS_GNUC_NONNULL(1);
 
 static bool HdrEq(const Ns_Set *set, const char *name, const char *value)
@@ -138,13 +141,30 @@ Ns_ConnWriteVChars(Ns_Conn *conn, struct iovec *bufs, int nbufs, unsigned int fl
         ) {
         bool flush = ((flags & NS_CONN_STREAM) == 0u);
 
-        if (Ns_CompressBufsGzip(&connPtr->cStream, bufs, nbufs, &gzDs,
-                                connPtr->compress, flush) == NS_OK) {
+        if (connPtr->cStreamPtr == NULL) {
+            /*
+             * A further response after a finished stream.
+             */
+            connPtr->cStreamPtr = Ns_CompressStreamGet(connPtr->compressEncoding);
+        }
+        if (connPtr->cStreamPtr == NULL) {
+            Ns_Log(Warning, "compress: no %s compression stream available",
+                   Ns_CompressEncodingName(connPtr->compressEncoding));
+
+        } else if (Ns_CompressBufs(connPtr->cStreamPtr, connPtr->compressEncoding,
+                            bufs, nbufs, &gzDs, connPtr->compress, flush) == NS_OK) {
             /* NB: Compression will always succeed. */
             (void)Ns_SetVec(&iov, 0, gzDs.string, (size_t)gzDs.length);
             bufs = &iov;
             nbufs = 1;
         }
+        if (flush && connPtr->cStreamPtr != NULL) {
+            /*
+             * The stream is finished, return it to the pool.
+             */
+            Ns_CompressStreamRelease(connPtr->cStreamPtr);
+            connPtr->cStreamPtr = NULL;
+        }
     }
 
     status = Ns_ConnWriteVData(conn, bufs, nbufs, flags);
@@ -162,21 +182,25 @@ Ns_ConnWriteVChars(Ns_Conn *conn, struct iovec *bufs, int nbufs, unsigned int fl
  *
  * CheckCompress --
  *
- *      Is compression enabled, and at what level.
+ *      Is compression enabled, and at what level. The content
+ *      encoding is the first of the configured encodings accepted by
+ *      the client, which is not disabled for the MIME type of the
+ *      response.
  *
  * Results:
- *      compress level 0-9
+ *      compress level, 0 for no compression.
  *
  * Side effects:
- *      May set the Content-Encoding and Vary headers.
+ *      May set the Content-Encoding and Vary headers and the encoding
+ *      of the connection.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-CheckCompress(const Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned int ioflags)
+CheckCompress(Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned int ioflags)
 {
-    const Ns_Conn  *conn = (Ns_Conn *) connPtr;
+    Ns_Conn        *conn = (Ns_Conn *) connPtr;
     const NsServer *servPtr;
     int             configuredCompressionLevel, compressionLevel = 0;
 
@@ -202,11 +226,42 @@ CheckCompress(const Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned
              */
             if (((connPtr->flags & NS_CONN_SENTHDRS) == 0u)
                 && ((connPtr->flags & NS_CONN_SKIPBODY) == 0u)) {
+                int e;
+
                 Ns_ConnSetHeaders(conn, "Vary", "Accept-Encoding");
 
-                if ((connPtr->flags & NS_CONN_ZIPACCEPTED) != 0u) {
-                    Ns_ConnSetHeaders(conn, "Content-Encoding", "gzip");
-                    compressionLevel = configuredCompressionLevel;
+                for (e = 0; e < servPtr->compress.nrEncodings; e++) {
+                    Ns_CompressEncoding encoding = servPtr->compress.encodings[e];
+                    unsigned int        acceptFlag;
+                    int                 level;
+
+                    switch (encoding) {
+                    case NS_COMPRESS_BROTLI: acceptFlag = NS_CONN_BROTLIACCEPTED; break;
+                    case NS_COMPRESS_ZSTD:   acceptFlag = NS_CONN_ZSTDACCEPTED; break;
+                    case NS_COMPRESS_GZIP:
+                    default:                 acceptFlag = NS_CONN_ZIPACCEPTED; break;
+                    }
+                    if ((connPtr->flags & acceptFlag) == 0u) {
+                        continue;
+                    }
+                    level = CompressLevel(connPtr, encoding,
+                                          encoding == NS_COMPRESS_GZIP
+                                          ? configuredCompressionLevel
+                                          : servPtr->compress.levels[encoding]);
+                    if (level > 0) {
+                        if (connPtr->cStreamPtr != NULL) {
+                            Ns_CompressStreamRelease(connPtr->cStreamPtr);
+                        }
+                        connPtr->cStreamPtr = Ns_CompressStreamGet(encoding);
+                        if (connPtr->cStreamPtr == NULL) {
+                            continue;
+                        }
+                        Ns_ConnSetHeaders(conn, "Content-Encoding",
+                                          Ns_CompressEncodingName(encoding));
+                        connPtr->compressEncoding = encoding;
+                        compressionLevel = level;
+                        break;
+                    }
                 }
             }
         }
@@ -214,6 +269,64 @@ CheckCompress(const Conn *connPtr, const struct iovec *bufs, int nbufs, unsigned
     return compressionLevel;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompressLevel --
+ *
+ *      Determine the compression level for the specified encoding
+ *      based on the MIME type of the response and the configured
+ *      "compresslevels". The first matching pattern defining a level
+ *      for the encoding wins.
+ *
+ * Results:
+ *      Compression level, 0 when the encoding is disabled for the MIME
+ *      type.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompressLevel(const Conn *connPtr, Ns_CompressEncoding encoding, int defaultLevel)
+{
+    const NsServer *servPtr = connPtr->poolPtr->servPtr;
+    int             level = defaultLevel;
+
+    if (servPtr->compress.nrMimeLevels > 0) {
+        const char *type = Ns_SetIGet(connPtr->outputheaders, "Content-Type");
+
+        if (type != NULL) {
+            Tcl_DString ds;
+            const char *semicolon;
+            int         i;
+
+            /*
+             * Match the MIME type without parameters like "charset".
+             */
+            Tcl_DStringInit(&ds);
+            semicolon = strchr(type, INTCHAR(';'));
+            if (semicolon != NULL) {
+                type = Tcl_DStringAppend(&ds, type, (TCL_SIZE_T)(semicolon - type));
+            }
+            for (i = 0; i < servPtr->compress.nrMimeLevels; i++) {
+                const NsCompressMimeLevels *mimePtr = &servPtr->compress.mimeLevels[i];
+
+                if (mimePtr->levels[encoding] != -1
+                    && Tcl_StringCaseMatch(type, mimePtr->pattern, 1) != 0) {
+                    level = mimePtr->levels[encoding];
+                    break;
+                }
+            }
+            Tcl_DStringFree(&ds);
+        }
+    }
+    return level;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -4448,17 +4448,17 @@ EndOfHeader(Sock *sockPtr)
      *
      * Clear compression accepted flag
      */
-    sockPtr->flags &= ~(NS_CONN_ZIPACCEPTED|NS_CONN_BROTLIACCEPTED);
+    sockPtr->flags &= ~(NS_CONN_ZIPACCEPTED|NS_CONN_BROTLIACCEPTED|NS_CONN_ZSTDACCEPTED);
 
     s = Ns_SetIGet(reqPtr->headers, "Accept-Encoding");
     if (s != NULL) {
-        bool gzipAccept, brotliAccept;
+        bool gzipAccept, brotliAccept, zstdAccept;
 
         /*
          * Get allowed compression formats from "accept-encoding" headers.
          */
-        NsParseAcceptEncoding(reqPtr->request.version, s, &gzipAccept, &brotliAccept);
-        if (gzipAccept || brotliAccept) {
+        NsParseAcceptEncoding(reqPtr->request.version, s, &gzipAccept, &brotliAccept, &zstdAccept);
+        if (gzipAccept || brotliAccept || zstdAccept) {
             /*
              * Don't allow compression formats for Range requests.
              */
@@ -4470,6 +4470,9 @@ EndOfHeader(Sock *sockPtr)
                 if (brotliAccept) {
                     sockPtr->flags |= NS_CONN_BROTLIACCEPTED;
                 }
+                if (zstdAccept) {
+                    sockPtr->flags |= NS_CONN_ZSTDACCEPTED;
+                }
             }
         }
     }
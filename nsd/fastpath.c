@@ -23,6 +23,16 @@
 
 #include "nsd.h"
 
+/*
+ * On Linux, the results of stat() calls for static files can be cached
+ * in the stat cache, which is invalidated by inotify events on the
+ * directories containing the cached files and on all their ancestors.
+ */
+#if defined(__linux__)
+# include <sys/inotify.h>
+# define FASTPATH_STATCACHE 1
+#endif
+
 /*
  * The following structure defines the contents of a file
  * stored in the file cache.
@@ -37,6 +47,19 @@ typedef struct {
     char   bytes[1];  /* Grown to actual file size. */
 } File;
 
+#ifdef FASTPATH_STATCACHE
+/*
+ * The following structure defines the value of an entry in the stat
+ * cache. The value is copied for lock-free readers, so it must not
+ * contain pointers.
+ */
+
+typedef struct StatInfo {
+    struct stat st;
+    int         exists;   /* 0 for cached ENOENT results */
+} StatInfo;
+#endif
+
 
 /*
  * Local functions defined in this file
@@ -72,6 +95,28 @@ CheckStaticCompressedDelivery(
 ) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5) NS_GNUC_NONNULL(6) NS_GNUC_NONNULL(7);
 
 
+static bool FastStat(const char *path, struct stat *stPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+#ifdef FASTPATH_STATCACHE
+static bool StatCacheFill(const char *path, struct stat *stPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static bool WatchAncestors(const char *path)
+    NS_GNUC_NONNULL(1);
+
+static bool WatchDirectory(const char *dir)
+    NS_GNUC_NONNULL(1);
+
+static void FlushPrefix(const char *prefix)
+    NS_GNUC_NONNULL(1);
+
+static void WatchEvent(const struct inotify_event *eventPtr)
+    NS_GNUC_NONNULL(1);
+
+static Ns_ThreadProc WatchThread;
+#endif
+
 static Ns_Callback FreeEntry;
 static Ns_ServerInitProc ConfigServerFastpath;
 
@@ -88,6 +133,16 @@ static bool      useGzipRefresh = NS_FALSE;   /* Update outdated gzip files auto
 static bool      useBrotli = NS_FALSE;        /* Use brotli delivery if possible                      */
 static bool      useBrotliRefresh = NS_FALSE; /* Update outdated brotli files automatically via ::ns_brotlifile */
 
+#ifdef FASTPATH_STATCACHE
+static Ns_Cache     *statCache = NULL;        /* Cache of stat() results, NULL when disabled.       */
+static int           watchFd = NS_INVALID_FD; /* The inotify instance.                              */
+static Ns_Mutex      watchLock = NULL;        /* Lock for the tables of watched directories.        */
+static Tcl_HashTable watchDirs;               /* Watch descriptors keyed by directory name.         */
+static Tcl_HashTable watchDescriptors;        /* Directory names keyed by watch descriptor.         */
+static unsigned long statCacheEpoch = 0u;     /* Incremented on every event, under the cache lock.  */
+static bool          watchFailed = NS_FALSE;  /* Events are not read anymore, under the cache lock. */
+#endif
+
 
 
 /*
@@ -124,6 +179,30 @@ NsConfigFastpath(void)
         cache = Ns_CacheCreateSz("ns:fastpath", TCL_STRING_KEYS, size, FreeEntry);
         maxentry = (int)Ns_ConfigMemUnitRange(path, "cachemaxentry", "8KB", 8192, 8, INT_MAX);
     }
+
+    if (Ns_ConfigBool(path, "statcache", NS_FALSE)) {
+#ifdef FASTPATH_STATCACHE
+        watchFd = inotify_init1(IN_CLOEXEC);
+        if (watchFd == NS_INVALID_FD) {
+            Ns_Log(Warning, "fastpath: inotify_init1() failed, stat cache disabled: %s",
+                   strerror(errno));
+        } else {
+            size_t size = (size_t)Ns_ConfigMemUnitRange(path, "statcachemaxsize", "1MB",
+                                                        1024*1024, 1024, INT_MAX);
+
+            Tcl_InitHashTable(&watchDirs, TCL_STRING_KEYS);
+            Tcl_InitHashTable(&watchDescriptors, TCL_ONE_WORD_KEYS);
+            Ns_MutexInit(&watchLock);
+            Ns_MutexSetName2(&watchLock, "ns:fastpath", "watch");
+
+            statCache = Ns_CacheCreateSz("ns:fastpath:stat", TCL_STRING_KEYS, size, ns_free);
+            Ns_CacheEnableLockFreeReads(statCache);
+            Ns_ThreadCreate(WatchThread, NULL, 0, NULL);
+        }
+#else
+        Ns_Log(Warning, "fastpath: stat cache requires inotify, parameter 'statcache' ignored");
+#endif
+    }
     /*
      * Register the fastpath initialization for every server.
      */
@@ -333,7 +412,7 @@ Ns_FastPathProc(const void *UNUSED(arg), Ns_Conn *conn)
     Ns_DStringInit(&ds);
 
     if ((NsUrlToFile(&ds, servPtr, url) != NS_OK)
-        || (Ns_Stat(ds.string, &connPtr->fileInfo) == NS_FALSE)) {
+        || (FastStat(ds.string, &connPtr->fileInfo) == NS_FALSE)) {
         goto notfound;
     }
 
@@ -361,7 +440,7 @@ Ns_FastPathProc(const void *UNUSED(arg), Ns_Conn *conn)
             }
             Ns_DStringVarAppend(&ds, "/", servPtr->fastpath.dirv[i], (char *)0L);
 
-            if ((stat(ds.string, &connPtr->fileInfo) == 0)
+            if (FastStat(ds.string, &connPtr->fileInfo)
                 && S_ISREG(connPtr->fileInfo.st_mode)
                 ) {
                 Ns_Log(Debug, "FastPathProc checks [%" PRITcl_Size "] '%s' -> found",
@@ -478,7 +557,7 @@ UrlIs(const char *server, const char *url, bool isDir)
 
     Ns_DStringInit(&ds);
     if (Ns_UrlToFile(&ds, server, url) == NS_OK
-        && stat(ds.string, &st) == 0
+        && FastStat(ds.string, &st)
         && ((isDir && S_ISDIR(st.st_mode))
             || (!isDir && S_ISREG(st.st_mode)))) {
         is = NS_TRUE;
@@ -616,7 +695,7 @@ CheckStaticCompressedDelivery(
     //fprintf(stderr, "=== check compressed file <%s> compressed <%s>\n", fileName, compressedFileName);
 
 
-    if (Ns_Stat(compressedFileName, &gzStat)) {
+    if (FastStat(compressedFileName, &gzStat)) {
         Ns_ConnCondSetHeaders(conn, "Vary", "Accept-Encoding");
         //fprintf(stderr, "=== we have the file <%s> compressed <%s>\n", fileName, compressedFileName);
 
@@ -924,6 +1003,468 @@ Ns_Stat(const char *path, struct stat *stPtr)
     return success;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FastStat --
+ *
+ *      Stat a static file like Ns_Stat(), but use the stat cache if
+ *      enabled. Cached results are valid until an inotify event
+ *      reports a change in the directory of the file, so hits do not
+ *      require any system call.
+ *
+ * Results:
+ *      NS_TRUE if the file exists, NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      Stat cache might be updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+FastStat(const char *path, struct stat *stPtr)
+{
+    bool success;
+
+    NS_NONNULL_ASSERT(path != NULL);
+    NS_NONNULL_ASSERT(stPtr != NULL);
+
+#ifdef FASTPATH_STATCACHE
+    if (statCache != NULL) {
+        StatInfo    info;
+        Tcl_DString ds;
+        bool        found;
+
+        Tcl_DStringInit(&ds);
+        found = (Ns_CacheFindValueLockFree(statCache, path, &ds)
+                 && ds.length == (TCL_SIZE_T)sizeof(info));
+        if (found) {
+            memcpy(&info, ds.string, sizeof(info));
+        } else {
+            const Ns_Entry *entry;
+
+            Ns_CacheLock(statCache);
+            entry = Ns_CacheFindEntry(statCache, path);
+            if (entry != NULL) {
+                memcpy(&info, Ns_CacheGetValue(entry), sizeof(info));
+                found = NS_TRUE;
+            }
+            Ns_CacheUnlock(statCache);
+        }
+        Tcl_DStringFree(&ds);
+
+        if (found) {
+            if (info.exists != 0) {
+                *stPtr = info.st;
+            }
+            success = (info.exists != 0);
+        } else {
+            success = StatCacheFill(path, stPtr);
+        }
+    } else {
+        success = Ns_Stat(path, stPtr);
+    }
+#else
+    success = Ns_Stat(path, stPtr);
+#endif
+
+    return success;
+}
+
+#ifdef FASTPATH_STATCACHE
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StatCacheFill --
+ *
+ *      Stat a file and add the result to the stat cache. The result is
+ *      only cached, when all directories on the path of the file are
+ *      watched and no inotify event was processed in the meantime.
+ *      Symbolic links and files below symbolically linked directories
+ *      are not cached, since changes of their targets are not reported.
+ *
+ * Results:
+ *      NS_TRUE if the file exists, NS_FALSE otherwise.
+ *
+ * Side effects:
+ *      Directory might be watched, stat cache might be updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+StatCacheFill(const char *path, struct stat *stPtr)
+{
+    StatInfo       info;
+    unsigned long  epoch;
+    bool           cacheable;
+
+    NS_NONNULL_ASSERT(path != NULL);
+    NS_NONNULL_ASSERT(stPtr != NULL);
+
+    Ns_CacheLock(statCache);
+    epoch = statCacheEpoch;
+    Ns_CacheUnlock(statCache);
+
+    /*
+     * Watch the directories before calling stat(), such that every
+     * later change is reported.
+     */
+    cacheable = WatchAncestors(path);
+
+    memset(&info, 0, sizeof(info));
+    if (lstat(path, &info.st) == 0) {
+        info.exists = 1;
+        if (S_ISLNK(info.st.st_mode)) {
+            info.exists = Ns_Stat(path, &info.st) ? 1 : 0;
+            cacheable = NS_FALSE;
+        }
+    } else {
+        if (errno != ENOENT) {
+            if (errno != EACCES && errno != ENOTDIR) {
+                Ns_Log(Error, "fastpath: stat(%s) failed: %s",
+                       path, strerror(errno));
+            }
+            cacheable = NS_FALSE;
+        }
+    }
+
+    if (cacheable) {
+        Ns_CacheLock(statCache);
+        if (epoch == statCacheEpoch && !watchFailed) {
+            Ns_Entry *entry;
+            StatInfo *infoPtr;
+            int       isNew;
+
+            infoPtr = ns_malloc(sizeof(StatInfo));
+            *infoPtr = info;
+            entry = Ns_CacheCreateEntry(statCache, path, &isNew);
+            Ns_CacheSetValueSz(entry, infoPtr, sizeof(StatInfo));
+        }
+        Ns_CacheUnlock(statCache);
+    }
+
+    if (info.exists != 0) {
+        *stPtr = info.st;
+    }
+    return (info.exists != 0);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchAncestors --
+ *
+ *      Make sure, all directories on the path of the provided file,
+ *      starting from the root directory, are watched by the inotify
+ *      instance. A rename or replacement of any of these directories
+ *      changes the file reached via the path, but is reported only to
+ *      the watch of the directory containing the renamed entry.
+ *
+ * Results:
+ *      NS_TRUE if all directories are watched.
+ *
+ * Side effects:
+ *      Might add inotify watches.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+WatchAncestors(const char *path)
+{
+    const char  *slash, *last;
+    Tcl_DString  ds;
+    bool         success;
+
+    NS_NONNULL_ASSERT(path != NULL);
+
+    last = strrchr(path, INTCHAR('/'));
+    if (*path != '/' || last[1] == '\0') {
+        return NS_FALSE;
+    }
+
+    Tcl_DStringInit(&ds);
+    success = WatchDirectory("/");
+    for (slash = strchr(path + 1, INTCHAR('/'));
+         success && slash != NULL && slash <= last;
+         slash = strchr(slash + 1, INTCHAR('/'))) {
+        Tcl_DStringSetLength(&ds, 0);
+        Tcl_DStringAppend(&ds, path, (TCL_SIZE_T)(slash - path));
+        success = WatchDirectory(ds.string);
+    }
+    Tcl_DStringFree(&ds);
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchDirectory --
+ *
+ *      Make sure, the provided directory is watched by the inotify
+ *      instance. Symbolic links are not followed: the watch of a
+ *      symbolically linked directory would report changes of the
+ *      target, but not the replacement of the link.
+ *
+ * Results:
+ *      NS_TRUE if the directory is watched.
+ *
+ * Side effects:
+ *      Might add an inotify watch.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static bool
+WatchDirectory(const char *dir)
+{
+    Tcl_HashEntry *hPtr;
+    bool           success = NS_FALSE;
+
+    NS_NONNULL_ASSERT(dir != NULL);
+
+    Ns_MutexLock(&watchLock);
+    hPtr = Tcl_FindHashEntry(&watchDirs, dir);
+    if (hPtr != NULL) {
+        success = NS_TRUE;
+    } else {
+        int wd = inotify_add_watch(watchFd, dir,
+                                   IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE
+                                   | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+                                   | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW);
+        if (wd < 0) {
+            Ns_Log(Debug, "fastpath: cannot watch directory %s: %s", dir, strerror(errno));
+        } else {
+            int isNew;
+
+            /*
+             * The same directory might be reachable via different paths,
+             * but inotify returns the same watch descriptor for it. Only
+             * the first path is watched.
+             */
+            hPtr = Tcl_CreateHashEntry(&watchDescriptors, INT2PTR(wd), &isNew);
+            if (isNew != 0) {
+                Tcl_HashEntry *dirPtr = Tcl_CreateHashEntry(&watchDirs, dir, &isNew);
+
+                Tcl_SetHashValue(dirPtr, INT2PTR(wd));
+                Tcl_SetHashValue(hPtr, Tcl_GetHashKey(&watchDirs, dirPtr));
+                success = NS_TRUE;
+            }
+        }
+    }
+    Ns_MutexUnlock(&watchLock);
+
+    return success;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchThread --
+ *
+ *      Thread reading the inotify events of the watched directories
+ *      and invalidating the affected entries of the stat cache.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries of the stat cache are flushed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WatchThread(void *UNUSED(arg))
+{
+    union {
+        struct inotify_event event;
+        char                 buf[4096];
+    } u;
+
+    Ns_ThreadSetName("-fastpath:watch-");
+    Ns_Log(Notice, "fastpath: stat cache watcher starting");
+
+    for (;;) {
+        ssize_t     n = read(watchFd, u.buf, sizeof(u.buf));
+        const char *p;
+
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            Ns_Log(Error, "fastpath: read from inotify failed, stat cache disabled: %s",
+                   strerror(errno));
+            break;
+        }
+        for (p = u.buf; p < u.buf + n; ) {
+            const struct inotify_event *eventPtr = (const struct inotify_event *)(const void *)p;
+
+            WatchEvent(eventPtr);
+            p += sizeof(struct inotify_event) + eventPtr->len;
+        }
+    }
+
+    /*
+     * Without events, cached entries cannot be trusted anymore. Keep
+     * the cache, but never add entries again.
+     */
+    Ns_CacheLock(statCache);
+    watchFailed = NS_TRUE;
+    (void) Ns_CacheFlush(statCache);
+    ++statCacheEpoch;
+    Ns_CacheUnlock(statCache);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WatchEvent --
+ *
+ *      Process a single inotify event. Changes of a file flush its
+ *      entry. When a directory entry is created, deleted, or renamed,
+ *      which is a directory or a watched path, all entries below it are
+ *      flushed, and the watch of the old directory does not refer to
+ *      this path anymore. When a watched directory itself is removed
+ *      or renamed, the whole stat cache is flushed.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries of the stat cache are flushed, watches might be removed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WatchEvent(const struct inotify_event *eventPtr)
+{
+    Tcl_DString    ds;
+    Tcl_HashEntry *hPtr;
+    bool           flushAll, flushBelow = NS_FALSE;
+
+    NS_NONNULL_ASSERT(eventPtr != NULL);
+
+    flushAll = ((eventPtr->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) != 0u);
+
+    Tcl_DStringInit(&ds);
+    Ns_MutexLock(&watchLock);
+    hPtr = Tcl_FindHashEntry(&watchDescriptors, INT2PTR(eventPtr->wd));
+    if (hPtr != NULL) {
+        const char *dir = Tcl_GetHashValue(hPtr);
+
+        if ((eventPtr->mask & (IN_IGNORED | IN_MOVE_SELF)) != 0u) {
+            /*
+             * The watch is gone or refers to a directory with a
+             * different path now.
+             */
+            Tcl_DeleteHashEntry(Tcl_FindHashEntry(&watchDirs, dir));
+            Tcl_DeleteHashEntry(hPtr);
+            if ((eventPtr->mask & IN_MOVE_SELF) != 0u) {
+                (void) inotify_rm_watch(watchFd, eventPtr->wd);
+            }
+        } else if (eventPtr->len > 0u) {
+            Tcl_DStringAppend(&ds, dir, TCL_INDEX_NONE);
+            if (ds.length > 1) {
+                Tcl_DStringAppend(&ds, "/", 1);
+            }
+            Tcl_DStringAppend(&ds, eventPtr->name, TCL_INDEX_NONE);
+
+            if ((eventPtr->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) != 0u) {
+                Tcl_HashEntry *dirPtr = Tcl_FindHashEntry(&watchDirs, ds.string);
+
+                if (dirPtr != NULL) {
+                    /*
+                     * The path refers to a different directory (or a
+                     * symbolic link) now; it has to be watched again.
+                     */
+                    Tcl_HashEntry *wdPtr = Tcl_FindHashEntry(&watchDescriptors, Tcl_GetHashValue(dirPtr));
+
+                    (void) inotify_rm_watch(watchFd, PTR2INT(Tcl_GetHashValue(dirPtr)));
+                    if (wdPtr != NULL) {
+                        Tcl_DeleteHashEntry(wdPtr);
+                    }
+                    Tcl_DeleteHashEntry(dirPtr);
+                    flushBelow = NS_TRUE;
+                } else if ((eventPtr->mask & IN_ISDIR) != 0u) {
+                    flushBelow = NS_TRUE;
+                }
+            }
+        }
+    }
+    Ns_MutexUnlock(&watchLock);
+
+    Ns_CacheLock(statCache);
+    if (flushAll) {
+        (void) Ns_CacheFlush(statCache);
+    } else if (ds.length > 0) {
+        if (flushBelow) {
+            Tcl_DStringAppend(&ds, "/", 1);
+            FlushPrefix(ds.string);
+            Tcl_DStringSetLength(&ds, ds.length - 1);
+        }
+
+        Ns_Entry *entry = Ns_CacheFindEntry(statCache, ds.string);
+
+        if (entry != NULL) {
+            Ns_CacheFlushEntry(entry);
+        }
+    }
+    ++statCacheEpoch;
+    Ns_CacheUnlock(statCache);
+
+    Tcl_DStringFree(&ds);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FlushPrefix --
+ *
+ *      Flush all entries of the stat cache for paths starting with the
+ *      provided prefix. Must be called with the stat cache locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Entries of the stat cache are flushed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FlushPrefix(const char *prefix)
+{
+    Ns_CacheSearch  search;
+    Ns_Entry       *entry;
+    size_t          length;
+
+    NS_NONNULL_ASSERT(prefix != NULL);
+
+    length = strlen(prefix);
+    entry = Ns_CacheFirstEntry(statCache, &search);
+    while (entry != NULL) {
+        Ns_Entry *nextEntry = Ns_CacheNextEntry(&search);
+
+        if (strncmp(Ns_CacheKey(entry), prefix, length) == 0) {
+            Ns_CacheFlushEntry(entry);
+        }
+        entry = nextEntry;
+    }
+}
+#endif
+
 
 /*
  *----------------------------------------------------------------------
@@ -1019,6 +1560,8 @@ FreeEntry(void *arg)
  *      Implements "ns_fastpath_cache_stats".  The command returns
  *      stats on a cache. The size and expiry time of each entry in
  *      the cache is also appended if the -contents switch is given.
+ *      When the -statcache switch is given, the stats of the stat
+ *      cache are returned instead of the stats of the file cache.
  *
  * Results:
  *      Tcl result.
@@ -1031,29 +1574,39 @@ FreeEntry(void *arg)
 int
 NsTclFastPathCacheStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    int         contents = (int)NS_FALSE, reset = (int)NS_FALSE, result = TCL_OK;
+    int         contents = (int)NS_FALSE, reset = (int)NS_FALSE, statcache = (int)NS_FALSE, result = TCL_OK;
+    Ns_Cache   *cachePtr = cache;
     Ns_ObjvSpec opts[] = {
-        {"-contents", Ns_ObjvBool,  &contents, INT2PTR(NS_TRUE)},
-        {"-reset",    Ns_ObjvBool,  &reset,    INT2PTR(NS_TRUE)},
-        {"--",        Ns_ObjvBreak, NULL,      NULL},
+        {"-contents",  Ns_ObjvBool,  &contents,  INT2PTR(NS_TRUE)},
+        {"-reset",     Ns_ObjvBool,  &reset,     INT2PTR(NS_TRUE)},
+        {"-statcache", Ns_ObjvBool,  &statcache, INT2PTR(NS_TRUE)},
+        {"--",         Ns_ObjvBreak, NULL,       NULL},
         {NULL, NULL, NULL, NULL}
     };
 
     if (Ns_ParseObjv(opts, NULL, interp, 1, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
-    } else if (cache != NULL) {
+    } else if (statcache != 0) {
+#ifdef FASTPATH_STATCACHE
+        cachePtr = statCache;
+#else
+        cachePtr = NULL;
+#endif
+    }
+
+    if (result == TCL_OK && cachePtr != NULL) {
         Ns_DString      ds;
         Ns_CacheSearch  search;
 
         Ns_DStringInit(&ds);
-        Ns_CacheLock(cache);
+        Ns_CacheLock(cachePtr);
 
         if (contents != 0) {
             const Ns_Entry *entry;
 
             Tcl_DStringStartSublist(&ds);
-            entry = Ns_CacheFirstEntry(cache, &search);
+            entry = Ns_CacheFirstEntry(cachePtr, &search);
             while (entry != NULL) {
                 size_t         size    = Ns_CacheGetSize(entry);
                 const Ns_Time *timePtr = Ns_CacheGetExpirey(entry);
@@ -1069,12 +1622,12 @@ NsTclFastPathCacheStatsObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
             }
             Tcl_DStringEndSublist(&ds);
         } else {
-            (void)Ns_CacheStats(cache, &ds);
+            (void)Ns_CacheStats(cachePtr, &ds);
         }
         if (reset != 0) {
-            Ns_CacheResetStats(cache);
+            Ns_CacheResetStats(cachePtr);
         }
-        Ns_CacheUnlock(cache);
+        Ns_CacheUnlock(cachePtr);
 
         Tcl_DStringResult(interp, &ds);
     }
@@ -29,8 +29,27 @@ typedef struct Filter {
     const char    *url;
     Ns_FilterType  when;
     void          *arg;
+    long           order;       /* Position in the filter list */
 } Filter;
 
+/*
+ * To avoid matching every filter against every request, the filters are
+ * indexed per filter type in a tree of path segments. A filter is added
+ * to the node reached by the complete path segments of the literal
+ * prefix of its URL pattern (up to the first glob character). The last
+ * segment of a pattern without glob characters is complete as well,
+ * e.g., "/foo/bar/x*.tcl" and "/foo/bar" are added to the node "foo" ->
+ * "bar", "/foo/ba*" to the node "foo", and "*.tcl" to the root node.
+ * Only the filters of the nodes along the path of the requested URL can
+ * match.
+ * Within a node, the filters are kept in list order.
+ */
+
+typedef struct FilterNode {
+    Tcl_HashTable  children;    /* Child nodes keyed by path segment */
+    Ns_DList       filters;     /* Filters of this node in list order */
+} FilterNode;
+
 typedef struct Trace {
     struct Trace    *nextPtr;
     Ns_TraceProc    *proc;
@@ -52,6 +71,21 @@ static void *RegisterCleanup(NsServer *servPtr, Ns_TraceProc *proc, void *arg)
 static void FilterLock(NsServer *servPtr, NS_RW rw)
     NS_GNUC_NONNULL(1);
 
+static int FilterTypeIndex(Ns_FilterType when)
+    NS_GNUC_CONST;
+
+static FilterNode *FilterNodeNew(void)
+    NS_GNUC_RETURNS_NONNULL;
+
+static void FilterIndexAdd(NsServer *servPtr, Filter *fPtr, bool first)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void FilterIndexCollect(FilterNode *rootPtr, const char *url, Ns_DList *dlPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static int CmpFilterOrder(const void *leftPtrPtr, const void *rightPtrPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_PURE;
+
 static void FilterUnlock(NsServer *servPtr)
     NS_GNUC_NONNULL(1);
 
@@ -151,6 +185,7 @@ Ns_RegisterFilter(const char *server, const char *method, const char *url,
          * Prepend element at the start of the list.
          */
         fPtr->nextPtr = servPtr->filter.firstFilterPtr;
+        fPtr->order = --servPtr->filter.firstOrder;
         servPtr->filter.firstFilterPtr = fPtr;
     } else {
         Filter **fPtrPtr;
@@ -159,12 +194,14 @@ Ns_RegisterFilter(const char *server, const char *method, const char *url,
          * Append element at the end of the list.
          */
         fPtr->nextPtr = NULL;
+        fPtr->order = ++servPtr->filter.lastOrder;
         fPtrPtr = &servPtr->filter.firstFilterPtr;
         while (*fPtrPtr != NULL) {
             fPtrPtr = &((*fPtrPtr)->nextPtr);
         }
         *fPtrPtr = fPtr;
     }
+    FilterIndexAdd(servPtr, fPtr, first);
     FilterUnlock(servPtr);
 
     return (void *) fPtr;
@@ -175,7 +212,10 @@ Ns_RegisterFilter(const char *server, const char *method, const char *url,
  *----------------------------------------------------------------------
  * NsRunFilters --
  *
- *      Execute each registered filter function in the Filter list.
+ *      Execute each registered filter function in the Filter list,
+ *      which matches the method and URL of the request. The
+ *      candidate filters are obtained from the index of the filter
+ *      type and are executed in list order.
  *
  * Results:
  *      Returns the status returned from the registered filter function.
@@ -190,7 +230,6 @@ Ns_ReturnCode
 NsRunFilters(Ns_Conn *conn, Ns_FilterType why)
 {
     NsServer      *servPtr;
-    const Filter  *fPtr;
     Ns_ReturnCode  status;
 
     NS_NONNULL_ASSERT(conn != NULL);
@@ -198,17 +237,27 @@ NsRunFilters(Ns_Conn *conn, Ns_FilterType why)
 
     status = NS_OK;
     if ((conn->request.method != NULL) && (conn->request.url != NULL)) {
-        Ns_ReturnCode filter_status = NS_OK;
+        Ns_ReturnCode     filter_status = NS_OK;
+        FilterNode       *rootPtr;
 
         FilterLock(servPtr, NS_READ);
-        fPtr = servPtr->filter.firstFilterPtr;
-        while (fPtr != NULL && filter_status == NS_OK) {
-            if (unlikely(fPtr->when == why)
-                && (Tcl_StringMatch(conn->request.method, fPtr->method) != 0)
-                && (Tcl_StringMatch(conn->request.url, fPtr->url) != 0)) {
-                filter_status = (*fPtr->proc)(fPtr->arg, conn, why);
+        rootPtr = servPtr->filter.index[FilterTypeIndex(why)];
+        if (rootPtr != NULL) {
+            Ns_DList candidates;
+            size_t   i;
+
+            Ns_DListInit(&candidates);
+            FilterIndexCollect(rootPtr, conn->request.url, &candidates);
+
+            for (i = 0u; i < candidates.size && filter_status == NS_OK; i++) {
+                const Filter *fPtr = candidates.data[i];
+
+                if ((Tcl_StringMatch(conn->request.method, fPtr->method) != 0)
+                    && (Tcl_StringMatch(conn->request.url, fPtr->url) != 0)) {
+                    filter_status = (*fPtr->proc)(fPtr->arg, conn, why);
+                }
             }
-            fPtr = fPtr->nextPtr;
+            Ns_DListFree(&candidates);
         }
         FilterUnlock(servPtr);
         if (filter_status == NS_FILTER_BREAK ||
@@ -233,6 +282,228 @@ NsRunFilters(Ns_Conn *conn, Ns_FilterType why)
     return status;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ * FilterTypeIndex --
+ *
+ *      Map a filter type to the index of its filter tree.
+ *
+ * Results:
+ *      Index in the range [0..3], or -1 for a combination of filter
+ *      types. Such filters are never executed.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+FilterTypeIndex(Ns_FilterType when)
+{
+    int result;
+
+    switch (when) {
+    case NS_FILTER_PRE_AUTH:   result = 0; break;
+    case NS_FILTER_POST_AUTH:  result = 1; break;
+    case NS_FILTER_TRACE:      result = 2; break;
+    case NS_FILTER_VOID_TRACE: result = 3; break;
+    default:                   result = -1; break;
+    }
+    return result;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ * FilterNodeNew --
+ *
+ *      Create a node of the filter index.
+ *
+ * Results:
+ *      New node.
+ *
+ * Side effects:
+ *      Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static FilterNode *
+FilterNodeNew(void)
+{
+    FilterNode *nodePtr = ns_malloc(sizeof(FilterNode));
+
+    Tcl_InitHashTable(&nodePtr->children, TCL_STRING_KEYS);
+    Ns_DListInit(&nodePtr->filters);
+
+    return nodePtr;
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ * FilterIndexAdd --
+ *
+ *      Add a filter to the index of its filter type. The node is
+ *      determined by the complete path segments of the literal prefix
+ *      of the URL pattern. A segment is complete, when it is
+ *      terminated by a slash or by the end of a pattern without glob
+ *      characters. Must be called with the filters locked for
+ *      writing.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Nodes of the index might be created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FilterIndexAdd(NsServer *servPtr, Filter *fPtr, bool first)
+{
+    int         idx = FilterTypeIndex(fPtr->when);
+    FilterNode *nodePtr;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(fPtr != NULL);
+
+    if (idx < 0) {
+        return;
+    }
+    if (servPtr->filter.index[idx] == NULL) {
+        servPtr->filter.index[idx] = FilterNodeNew();
+    }
+    nodePtr = servPtr->filter.index[idx];
+
+    if (*fPtr->url == '/') {
+        const char  *segment = fPtr->url + 1;
+        Tcl_DString  ds;
+
+        Tcl_DStringInit(&ds);
+        for (;;) {
+            const char    *p = segment;
+            Tcl_HashEntry *hPtr;
+            int            isNew;
+
+            while (*p != '\0' && *p != '/' && strchr("*?[\\", *p) == NULL) {
+                p++;
+            }
+            if (*p != '\0' && *p != '/') {
+                /*
+                 * Glob character, the segment is incomplete.
+                 */
+                break;
+            }
+            Tcl_DStringSetLength(&ds, 0);
+            Tcl_DStringAppend(&ds, segment, (TCL_SIZE_T)(p - segment));
+            hPtr = Tcl_CreateHashEntry(&nodePtr->children, ds.string, &isNew);
+            if (isNew != 0) {
+                Tcl_SetHashValue(hPtr, FilterNodeNew());
+            }
+            nodePtr = Tcl_GetHashValue(hPtr);
+            if (*p == '\0') {
+                break;
+            }
+            segment = p + 1;
+        }
+        Tcl_DStringFree(&ds);
+    }
+
+    Ns_DListAppend(&nodePtr->filters, fPtr);
+    if (first) {
+        /*
+         * The filter has the smallest order, move it to the front.
+         */
+        memmove(&nodePtr->filters.data[1], &nodePtr->filters.data[0],
+                (nodePtr->filters.size - 1u) * sizeof(nodePtr->filters.data[0]));
+        nodePtr->filters.data[0] = fPtr;
+    }
+}
+
+
+
+/*
+ *----------------------------------------------------------------------
+ * FilterIndexCollect --
+ *
+ *      Collect the filters of the nodes along the path of the URL in
+ *      list order. These are the only filters, which might match the
+ *      URL. Must be called with the filters locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Filters are appended to the provided Ns_DList.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FilterIndexCollect(FilterNode *rootPtr, const char *url, Ns_DList *dlPtr)
+{
+    FilterNode       *nodePtr = rootPtr;
+    size_t            i, nnodes = 0u;
+
+    NS_NONNULL_ASSERT(rootPtr != NULL);
+    NS_NONNULL_ASSERT(url != NULL);
+    NS_NONNULL_ASSERT(dlPtr != NULL);
+
+    for (;;) {
+        if (nodePtr->filters.size > 0u) {
+            for (i = 0u; i < nodePtr->filters.size; i++) {
+                Ns_DListAppend(dlPtr, nodePtr->filters.data[i]);
+            }
+            nnodes++;
+        }
+        if (*url != '/' || nodePtr->children.numEntries == 0) {
+            break;
+        } else {
+            const char          *segment = url + 1, *end = strchr(segment, INTCHAR('/'));
+            const Tcl_HashEntry *hPtr;
+            Tcl_DString          ds;
+
+            if (end == NULL) {
+                end = segment + strlen(segment);
+            }
+            Tcl_DStringInit(&ds);
+            Tcl_DStringAppend(&ds, segment, (TCL_SIZE_T)(end - segment));
+            hPtr = Tcl_FindHashEntry(&nodePtr->children, ds.string);
+            Tcl_DStringFree(&ds);
+
+            if (hPtr == NULL) {
+                break;
+            }
+            nodePtr = Tcl_GetHashValue(hPtr);
+            url = end;
+        }
+    }
+
+    /*
+     * The filters of each node are in list order, merging is only
+     * needed, when more than one node contributed.
+     */
+    if (nnodes > 1u) {
+        qsort(dlPtr->data, dlPtr->size, sizeof(dlPtr->data[0]), CmpFilterOrder);
+    }
+}
+
+static int
+CmpFilterOrder(const void *leftPtrPtr, const void *rightPtrPtr)
+{
+    long left = (*(const Filter **)leftPtrPtr)->order;
+    long right = (*(const Filter **)rightPtrPtr)->order;
+
+    return (left > right) - (left < right);
+}
+
+
 
 /*
  *----------------------------------------------------------------------
@@ -871,6 +871,21 @@ NsTclInfoObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_
             Tcl_DictObjPut(NULL, dictObj,
                            Tcl_NewStringObj("tcl", 3),
                            Tcl_NewStringObj(TCL_PATCH_LEVEL, -1));
+            /*
+             * Content encodings available for on-the-fly compression.
+             */
+            {
+                Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+                int      e;
+
+                for (e = 0; e < NS_COMPRESS_NR_ENCODINGS; e++) {
+                    if (Ns_CompressEncodingAvailable((Ns_CompressEncoding)e)) {
+                        Tcl_ListObjAppendElement(NULL, listObj,
+                                                 Tcl_NewStringObj(Ns_CompressEncodingName((Ns_CompressEncoding)e), -1));
+                    }
+                }
+                Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("compression", 11), listObj);
+            }
 
             Tcl_SetObjResult(interp, dictObj);
             Tcl_DStringFree(&ds);
@@ -57,6 +57,8 @@ Nsd_LibInit(void)
         Ns_CondInit(&nsconf.state.cond);
 
         NsInitSls();
+        NsInitCache();
+        NsInitUrlSpace();
         NsInitCallbacks();
         NsInitConf(); /* <- Server marked 'started' during library load. */
         NsInitLog();
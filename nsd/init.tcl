@@ -169,6 +169,12 @@ proc __ns_sourcemodule {modname} {
 #     This mode is defined by setting the config option
 #     ns/server/[ns_info server]/tcl/lazyloader to true.
 #
+#  In mode a., the proc definitions can be kept in a shared
+#  server-level store instead of the blueprint script by setting
+#  the config option ns/server/[ns_info server]/tcl/lazyprocs to
+#  true. The interps receive then only lightweight stub commands,
+#  which define the actual procs on their first invocation.
+#
 
 source [file join [ns_library shared] nstrace.tcl]
 
@@ -586,8 +592,10 @@ if {$use_trace_inits} {
             # TCL_ERROR: Dump this interp to avoid proc pollution.
             ns_ictl markfordelete
         } else {
-            # Save this interp's namespaces for others.
-            ns_ictl save [nstrace::statescript]
+            # Save the changed units of this interp's namespaces for
+            # others, such that these have to evaluate only the
+            # changed parts of the blueprint.
+            ns_ictl saveunits -complete [nstrace::unitscripts]
         }
 
         return -code $code $result
@@ -662,7 +670,12 @@ if {$use_trace_inits} {
     ns_cleanup
 
     nstrace::disablestate
-    ns_ictl save [nstrace::statescript]
+    if {[ns_config -bool -set ns/server/[ns_info server]/tcl lazyprocs false]} {
+        ns_ictl save -units [nstrace::unitscripts] -procs [nstrace::procdefs] \
+            [nstrace::statescript "" 0]
+    } else {
+        ns_ictl save -units [nstrace::unitscripts] [nstrace::statescript]
+    }
 }
 
 #
@@ -94,9 +94,10 @@ NsGetRequestLimits(NsServer *servPtr, const char *method, const char *url)
     NS_NONNULL_ASSERT(method != NULL);
     NS_NONNULL_ASSERT(url != NULL);
 
-    Ns_MutexLock(&lock);
+    /*
+     * Limits are never freed, so the lock-free lookup is sufficient.
+     */
     limitsPtr = NsUrlSpecificGet(servPtr, method, url, limid, 0u, NS_URLSPACE_DEFAULT, NULL, NULL, NULL);
-    Ns_MutexUnlock(&lock);
 
     return ((limitsPtr != NULL) ? limitsPtr : defLimitsPtr);
 }
@@ -104,6 +104,7 @@ NsConfUpdate(void)
     NsConfigMimeTypes();
     NsConfigProgress();
     NsConfigDNS();
+    NsConfigCompress();
     NsConfigRedirects();
     NsConfigVhost();
     NsConfigEncodings();
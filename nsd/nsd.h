@@ -189,7 +189,9 @@ struct nsconf {
     struct {
         const char *sharedlibrary;
         const char *version;
+        int         warmupconcurrency;
         bool        lockoninit;
+        bool        warmup;
     } tcl;
 
     struct {
@@ -620,9 +622,10 @@ typedef struct Conn {
     NsWriterSock *strWriter;
     int rateLimit;          /* -1 undefined, 0 unlimited, otherwise KB/s */
 
-    Ns_CompressStream cStream;
+    Ns_CompressStream *cStreamPtr;  /* pooled stream of a compressed response */
     int requestCompress;
     int compress;
+    Ns_CompressEncoding compressEncoding;
 
     Ns_Set *query;
     Ns_Set *formData;
@@ -712,6 +715,19 @@ typedef struct ConnPool {
         int       creating;
     } threads;
 
+    /*
+     * The following struct maintains the number of interps kept by the
+     * connection threads of the pool (protected by the threads lock).
+     * When "max" is set, a connection thread releases its interp after
+     * a request when more than "max" interps are kept, such that the
+     * interp memory does not scale with the number of threads.
+     */
+
+    struct {
+        int       max;
+        int       current;
+    } interps;
+
     /*
      * The following struct maintains the state of the thread
      * connection queue.  "nextPtr" points to the next available
@@ -753,6 +769,17 @@ typedef struct ConnPool {
 
 } ConnPool;
 
+/*
+ * The following structure defines the compression levels for
+ * responses with a MIME type matching a pattern. A level of -1 means
+ * the default level of the encoding, 0 disables the encoding.
+ */
+
+typedef struct NsCompressMimeLevels {
+    const char *pattern;
+    int         levels[NS_COMPRESS_NR_ENCODINGS];
+} NsCompressMimeLevels;
+
 /*
  * The following structure is allocated for each virtual server.
  */
@@ -771,6 +798,8 @@ typedef struct NsServer {
         ConnPool *firstPtr;
         ConnPool *defaultPtr;
         Ns_Thread joinThread;
+        Ns_Cond warmupcond;
+        int warmup;
         bool shutdown;
     } pools;
 
@@ -849,6 +878,9 @@ typedef struct NsServer {
 
     struct {
         struct Filter *firstFilterPtr;
+        struct FilterNode *index[4];    /* Per filter type index of filters */
+        long firstOrder;
+        long lastOrder;
         struct Trace *firstTracePtr;
         struct Trace *firstCleanupPtr;
         union {
@@ -880,12 +912,42 @@ typedef struct NsServer {
         Ns_RWLock         lock;
         const char       *script;
         TCL_SIZE_T        length;
-        int               epoch;
+        uint64_t          epoch;
+        uint64_t          fullEpoch;   /* epoch of last full blueprint save */
+        Tcl_HashTable     units;       /* named blueprint units (procs, vars, ...) */
+        unsigned long     unitSeq;     /* ordering of unit updates */
+        struct LazyProcs *procs;       /* proc definitions materialized lazily */
+        struct Blueprint *blueprint;   /* preparsed blueprint script */
+        bool              preparse;    /* preparse the blueprint script */
+        Ns_Mutex          footprintLock;
+        Tcl_HashTable     footprints;  /* sampled footprints of the interps */
+        int               sampleInterval;  /* deallocations between samples */
+        Tcl_WideInt       maxMemory;   /* limits for recycling interps */
+        int               maxGlobals;
+        int               maxNamespaces;
         Tcl_Obj          *modules;
         Tcl_HashTable     runTable;
         const char      **errorLogHeaders;
         Tcl_HashTable     caches;
         Ns_RWLock         cachelock;
+        struct {
+            Ns_Mutex             lock;
+            Ns_Cond              cond;      /* signaled, when the refresher thread exits */
+            Ns_Thread            thread;    /* last started refresher thread, or NULL */
+            struct CacheRefresh *firstPtr;  /* queued refreshes of stale values */
+            bool                 running;   /* refresher thread is running */
+            bool                 stop;      /* server is shutting down */
+        } cacheRefresh;
+        const char      **cacheSnapshotv;    /* names of caches persisted at shutdown */
+        TCL_SIZE_T        cacheSnapshotc;
+        const char       *cacheSnapshotDir;  /* directory of the snapshot files */
+        struct {
+            Ns_Mutex             lock;
+            Ns_Cond              cond;      /* signaled, when a loader thread exits */
+            struct SnapshotLoad *firstPtr;  /* started loader threads */
+            int                  running;   /* number of running loader threads */
+            bool                 stop;      /* server is shutting down */
+        } cacheSnapshotLoad;
         uintptr_t         transactionEpoch;
 
         /*
@@ -933,6 +995,11 @@ typedef struct NsServer {
         int  minsize;   /* min size of response to compress, in bytes */
         bool enable;    /* on/off */
         bool preinit;   /* initialize the compression stream buffers in advance */
+        int  nrEncodings;                             /* number of entries in encodings */
+        Ns_CompressEncoding encodings[NS_COMPRESS_NR_ENCODINGS]; /* in order of preference */
+        int  levels[NS_COMPRESS_NR_ENCODINGS];        /* default level per encoding */
+        int  nrMimeLevels;                            /* number of entries in mimeLevels */
+        NsCompressMimeLevels *mimeLevels;             /* levels per MIME type pattern */
     } compress;
 
     /*
@@ -943,7 +1010,10 @@ typedef struct NsServer {
     struct {
         struct Bucket *buckets;
         int nbuckets;
+        int snapshotSize;
         bool rwlocks;
+        struct NsvJournal *journalPtr;
+        Ns_Time migrateThreshold;
     } nsv;
 
     /*
@@ -979,6 +1049,19 @@ typedef struct NsServer {
     Tcl_HashTable hosts;
 } NsServer;
 
+/*
+ * The following structure maintains the sampled footprint of an interp.
+ */
+
+typedef struct NsInterpFootprint {
+    Tcl_WideInt    memory;      /* bytes allocated by the thread, -1 when unknown */
+    int            globals;     /* number of global variables */
+    int            namespaces;  /* number of namespaces */
+    unsigned long  uses;        /* number of deallocations of the interp */
+    Ns_Time        sampled;     /* time of the last sample */
+    char           thread[NS_THREAD_NAMESIZE];
+} NsInterpFootprint;
+
 /*
  * The following structure is allocated for each interp.
  */
@@ -987,7 +1070,8 @@ typedef struct NsInterp {
 
     Tcl_Interp *interp;
     NsServer   *servPtr;
-    int         epoch;         /* Run the update script if != to server epoch */
+    ConnPool   *poolPtr;       /* Connection pool accounting this interp */
+    uint64_t    epoch;         /* Run the update script if != to server epoch */
     int         refcnt;        /* Counts recursive allocations of cached interp */
 
     /*
@@ -1066,9 +1150,31 @@ typedef struct NsInterp {
 
     Ns_CacheTransactionStack cacheTransactionStack;
 
+    /*
+     * The following table maintains the near caches of ns_caches,
+     * keyed by the cache.
+     */
+    Tcl_HashTable nearCaches;
+
+    /*
+     * The following table caches materialized typed nsv values.
+     */
+    Tcl_HashTable nsvCache;
+
+    /*
+     * The following table keeps references to nsv counters and the
+     * counter shard used by this interpreter (plus one, 0 means
+     * unassigned).
+     */
+    Tcl_HashTable nsvCounters;
+    int nsvCounterShard;
+
     Ns_TclTraceType currentTrace;
     bool deleteInterp;  /* Interp should be deleted on next deallocation */
 
+    NsInterpFootprint footprint;   /* last sampled footprint */
+    bool footprintRegistered;      /* footprint is listed in the server */
+
 } NsInterp;
 
 
@@ -1209,14 +1315,18 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclCacheAppendObjCmd,
     NsTclCacheConfigureObjCmd,
     NsTclCacheCreateObjCmd,
+    NsTclCacheEvalManyObjCmd,
     NsTclCacheEvalObjCmd,
     NsTclCacheExistsObjCmd,
     NsTclCacheFlushObjCmd,
+    NsTclCacheGetManyObjCmd,
     NsTclCacheGetObjCmd,
     NsTclCacheIncrObjCmd,
     NsTclCacheKeysObjCmd,
     NsTclCacheLappendObjCmd,
     NsTclCacheNamesObjCmd,
+    NsTclCacheSetManyObjCmd,
+    NsTclCacheSnapshotObjCmd,
     NsTclCacheStatsObjCmd,
     NsTclCacheTransactionBeginObjCmd,
     NsTclCacheTransactionCommitObjCmd,
@@ -1229,6 +1339,7 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclConfigObjCmd,
     NsTclConfigSectionObjCmd,
     NsTclConfigSectionsObjCmd,
+    NsTclCompressStatsObjCmd,
     NsTclConnChanObjCmd,
     NsTclConnObjCmd,
     NsTclConnSendFpObjCmd,
@@ -1292,11 +1403,15 @@ NS_EXTERN TCL_OBJCMDPROC_T
     NsTclNsvAppendObjCmd,
     NsTclNsvArrayObjCmd,
     NsTclNsvBucketObjCmd,
+    NsTclNsvContentionObjCmd,
+    NsTclNsvCounterObjCmd,
     NsTclNsvDictObjCmd,
     NsTclNsvExistsObjCmd,
     NsTclNsvGetObjCmd,
     NsTclNsvIncrObjCmd,
+    NsTclNsvJournalObjCmd,
     NsTclNsvLappendObjCmd,
+    NsTclNsvMigrateObjCmd,
     NsTclNsvNamesObjCmd,
     NsTclNsvSetObjCmd,
     NsTclNsvUnsetObjCmd,
@@ -1414,6 +1529,7 @@ NS_EXTERN const char *nsBuildDate;
  * Libnsd initialization routines.
  */
 NS_EXTERN void NsInitBinder(void);
+NS_EXTERN void NsInitCache(void);
 NS_EXTERN void NsInitCallbacks(void);
 NS_EXTERN void NsInitConf(void);
 NS_EXTERN void NsInitDNS(void);
@@ -1438,12 +1554,14 @@ NS_EXTERN void NsInitTask(void);
 NS_EXTERN void NsInitTcl(void);
 NS_EXTERN void NsInitTclEnv(void);
 NS_EXTERN void NsInitUrl2File(void);
+NS_EXTERN void NsInitUrlSpace(void);
 
 NS_EXTERN void NsConfigAdp(void);
 NS_EXTERN void NsConfigLog(void);
 NS_EXTERN void NsConfigFastpath(void);
 NS_EXTERN void NsConfigMimeTypes(void);
 NS_EXTERN void NsConfigDNS(void);
+NS_EXTERN void NsConfigCompress(void);
 NS_EXTERN void NsConfigRedirects(void);
 NS_EXTERN void NsConfigVhost(void);
 NS_EXTERN void NsConfigEncodings(void);
@@ -1462,9 +1580,10 @@ NS_EXTERN NsServer *NsGetInitServer(void) NS_GNUC_PURE;
 NS_EXTERN NsServer *NsGetServer(const char *server);
 NS_EXTERN void NsStartServers(void);
 NS_EXTERN void NsStopServers(const Ns_Time *toPtr) NS_GNUC_NONNULL(1);
-NS_EXTERN void NsStartServer(const NsServer *servPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsStartServer(NsServer *servPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsStopServer(NsServer *servPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsWaitServer(NsServer *servPtr, const Ns_Time *toPtr) NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+NS_EXTERN void NsWaitServerWarmup(NsServer *servPtr) NS_GNUC_NONNULL(1);
 NS_EXTERN void NsWakeupDriver(const Driver *drvPtr) NS_GNUC_NONNULL(1);
 
 /*
@@ -1594,6 +1713,14 @@ NS_EXTERN Ns_ConnLocationProc NsTclConnLocation;
 NS_EXTERN Ns_SchedProc NsTclSchedProc;
 NS_EXTERN Ns_ServerRootProc NsTclServerRoot;
 NS_EXTERN Ns_ThreadProc NsTclThread NS_GNUC_NORETURN;
+NS_EXTERN Ns_ShutdownProc NsTclCacheSnapshotShutdown;
+NS_EXTERN Ns_ShutdownProc NsTclCacheRefreshShutdown;
+NS_EXTERN void NsTclCacheFreeNearCaches(NsInterp *itPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsTclNsvFreeCache(NsInterp *itPtr) NS_GNUC_NONNULL(1);
+NS_EXTERN void NsTclNsvInitJournal(NsServer *servPtr, const char *section)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+NS_EXTERN void NsTclNsvInitMigration(NsServer *servPtr, const char *section)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 NS_EXTERN Ns_ArgProc NsTclThreadArgProc;
 NS_EXTERN Ns_SockProc NsTclSockProc;
 NS_EXTERN Ns_ArgProc NsTclSockArgProc;
@@ -1668,9 +1795,12 @@ NS_EXTERN void NsInitStaticModules(const char *server);
 NS_EXTERN Tcl_Interp *NsTclCreateInterp(void)            NS_GNUC_RETURNS_NONNULL;
 NS_EXTERN Tcl_Interp *NsTclAllocateInterp(NsServer *servPtr) NS_GNUC_RETURNS_NONNULL;
 NS_EXTERN NsInterp *NsGetInterpData(Tcl_Interp *interp)  NS_GNUC_NONNULL(1);
+NS_EXTERN void NsTclAppendFootprints(NsServer *servPtr, const char *pattern, Tcl_Obj *listObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
 NS_EXTERN void NsFreeConnInterp(Conn *connPtr)           NS_GNUC_NONNULL(1);
 
 NS_EXTERN void NsIdleCallback(NsServer *servPtr)        NS_GNUC_NONNULL(1);
+NS_EXTERN void NsTclWarmupInterp(ConnPool *poolPtr)     NS_GNUC_NONNULL(1);
 
 
 NS_EXTERN struct Bucket *NsTclCreateBuckets(const NsServer *servPtr, int nbuckets) NS_GNUC_NONNULL(1);
@@ -1726,6 +1856,14 @@ NS_EXTERN int NsConnParseRange(Ns_Conn *conn, const char *type,
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2)
     NS_GNUC_NONNULL(7) NS_GNUC_NONNULL(8);
 
+/*
+ * compress.c
+ */
+NS_EXTERN void NsCompressPoolFill(Ns_CompressEncoding encoding);
+
+NS_EXTERN bool NsCompressEncodingFromName(const char *name, Ns_CompressEncoding *encodingPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
 /*
  * conn.c
  */
@@ -1744,8 +1882,9 @@ NS_EXTERN Ns_ReturnCode NsConnRequire(Tcl_Interp *interp, unsigned int flags, Ns
 /*
  * request parsing
  */
-NS_EXTERN void NsParseAcceptEncoding(double version, const char *hdr, bool *gzipAcceptPtr, bool *brotliAcceptPtr)
-    NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+NS_EXTERN void NsParseAcceptEncoding(double version, const char *hdr,
+                                     bool *gzipAcceptPtr, bool *brotliAcceptPtr, bool *zstdAcceptPtr)
+    NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5);
 
 /*
  * encoding.c
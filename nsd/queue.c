@@ -1193,10 +1193,8 @@ ServerMappedObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp, TCL_OBJC_T
             op = NS_URLSPACE_DEFAULT;
         }
 
-        Ns_MutexLock(&servPtr->urlspace.lock);
         mappedPoolPtr = (ConnPool *)NsUrlSpecificGet(servPtr,  method, url, poolid, flags, op,
                                                      NULL, NULL, NULL);
-        Ns_MutexUnlock(&servPtr->urlspace.lock);
         if (mappedPoolPtr == NULL) {
             mappedPoolPtr = servPtr->pools.defaultPtr;
         }
@@ -1723,12 +1721,29 @@ NsTclServerObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tc
         break;
 
     case SThreadsIdx:
-        Ns_MutexLock(&poolPtr->threads.lock);
-        Ns_TclPrintfResult(interp,
-                           "min %d max %d current %d idle %d stopping 0",
-                           poolPtr->threads.min, poolPtr->threads.max,
-                           poolPtr->threads.current, poolPtr->threads.idle);
-        Ns_MutexUnlock(&poolPtr->threads.lock);
+        {
+            Tcl_Obj *interpsObj = Tcl_NewListObj(0, NULL);
+
+            Ns_MutexLock(&poolPtr->threads.lock);
+            Ns_TclPrintfResult(interp,
+                               "min %d max %d current %d idle %d stopping 0 "
+                               "maxinterps %d keptinterps %d",
+                               poolPtr->threads.min, poolPtr->threads.max,
+                               poolPtr->threads.current, poolPtr->threads.idle,
+                               poolPtr->interps.max, poolPtr->interps.current);
+            Ns_MutexUnlock(&poolPtr->threads.lock);
+
+            /*
+             * Add the sampled interp footprints of the connection
+             * threads of this pool.
+             */
+            Tcl_DStringInit(dsPtr);
+            Ns_DStringPrintf(dsPtr, "-conn:%s:%s:*", servPtr->server, NsPoolName(poolPtr->pool));
+            NsTclAppendFootprints(servPtr, dsPtr->string, interpsObj);
+            Tcl_DStringFree(dsPtr);
+            (void) Tcl_ListObjAppendElement(interp, Tcl_GetObjResult(interp), Tcl_NewStringObj("interps", 7));
+            (void) Tcl_ListObjAppendElement(interp, Tcl_GetObjResult(interp), interpsObj);
+        }
         break;
 
     case SActiveIdx:
@@ -1787,13 +1802,26 @@ NsTclServerObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tc
  */
 
 void
-NsStartServer(const NsServer *servPtr)
+NsStartServer(NsServer *servPtr)
 {
     ConnPool *poolPtr;
     int       n;
 
     NS_NONNULL_ASSERT(servPtr != NULL);
 
+    if (nsconf.tcl.warmup) {
+        /*
+         * Count the connection threads, which have to initialize their
+         * interpreters before NsWaitServerWarmup() returns.
+         */
+        Ns_CondInit(&servPtr->pools.warmupcond);
+        Ns_MutexLock(&servPtr->pools.lock);
+        for (poolPtr = servPtr->pools.firstPtr; poolPtr != NULL; poolPtr = poolPtr->nextPtr) {
+            servPtr->pools.warmup += poolPtr->threads.min;
+        }
+        Ns_MutexUnlock(&servPtr->pools.lock);
+    }
+
     poolPtr = servPtr->pools.firstPtr;
     while (poolPtr != NULL) {
         poolPtr->threads.idle = 0;
@@ -1808,6 +1836,51 @@ NsStartServer(const NsServer *servPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsWaitServerWarmup --
+ *
+ *      Wait until the minimum number of connection threads of all pools of
+ *      the server have initialized their Tcl interpreters.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Blocks the caller (the main thread during startup).
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsWaitServerWarmup(NsServer *servPtr)
+{
+    const ConnPool *poolPtr;
+    Ns_Time         start, end, diff;
+    int             nthreads = 0;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+
+    Ns_GetTime(&start);
+    for (poolPtr = servPtr->pools.firstPtr; poolPtr != NULL; poolPtr = poolPtr->nextPtr) {
+        nthreads += poolPtr->threads.min;
+    }
+
+    Ns_MutexLock(&servPtr->pools.lock);
+    while (servPtr->pools.warmup > 0) {
+        Ns_CondWait(&servPtr->pools.warmupcond, &servPtr->pools.lock);
+    }
+    Ns_MutexUnlock(&servPtr->pools.lock);
+
+    Ns_GetTime(&end);
+    Ns_DiffTime(&end, &start, &diff);
+    Ns_Log(Notice, "server [%s]: %d connection thread interpreters initialized ("
+           NS_TIME_FMT " secs)", servPtr->server, nthreads,
+           (int64_t)diff.sec, diff.usec);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2049,19 +2122,16 @@ NsConnThread(void *arg)
      * Initialize the connection thread with the blueprint to avoid
      * the initialization delay when the first connection comes in.
      */
-    {
-        Tcl_Interp *interp;
-        Ns_Time     start, end, diff;
-
-        Ns_GetTime(&start);
-        interp = NsTclAllocateInterp(servPtr);
-        Ns_GetTime(&end);
-        Ns_DiffTime(&end, &start, &diff);
-        Ns_Log(Notice, "thread initialized (" NS_TIME_FMT " secs)",
-               (int64_t)diff.sec, diff.usec);
-        Ns_TclDeAllocateInterp(interp);
-        argPtr->state = connThread_ready;
+    NsTclWarmupInterp(poolPtr);
+    argPtr->state = connThread_ready;
+
+    Ns_MutexLock(&servPtr->pools.lock);
+    if (servPtr->pools.warmup > 0) {
+        if (--servPtr->pools.warmup == 0) {
+            Ns_CondBroadcast(&servPtr->pools.warmupcond);
+        }
     }
+    Ns_MutexUnlock(&servPtr->pools.lock);
 
     wqueueLockPtr  = &poolPtr->wqueue.lock;
 
@@ -2752,6 +2822,15 @@ ConnRun(Conn *connPtr)
 
     Ns_SetTrunc(connPtr->outputheaders, 0);
 
+    if (connPtr->cStreamPtr != NULL) {
+        /*
+         * The compressed response was not finished, return the stream
+         * to the pool.
+         */
+        Ns_CompressStreamRelease(connPtr->cStreamPtr);
+        connPtr->cStreamPtr = NULL;
+    }
+
     if (connPtr->request.line != NULL) {
         /*
          * reqPtr is freed by FreeRequest() in the driver.
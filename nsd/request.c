@@ -1014,11 +1014,11 @@ CompressAllow(double compressQvalue, double identityQvalue, double starQvalue)
  *
  * NsParseAcceptEncoding --
  *
- *      Parse the accept-encoding line and return whether gzip
- *      encoding is accepted or not.
+ *      Parse the accept-encoding line and return whether gzip, brotli
+ *      and zstd encodings are accepted or not.
  *
  * Results:
- *      The result is passed back in the last two arguments.
+ *      The result is passed back in the last three arguments.
  *
  * Side effects:
  *      None.
@@ -1026,25 +1026,30 @@ CompressAllow(double compressQvalue, double identityQvalue, double starQvalue)
  *----------------------------------------------------------------------
  */
 void
-NsParseAcceptEncoding(double version, const char *hdr, bool *gzipAcceptPtr, bool *brotliAcceptPtr)
+NsParseAcceptEncoding(double version, const char *hdr,
+                      bool *gzipAcceptPtr, bool *brotliAcceptPtr, bool *zstdAcceptPtr)
 {
-    double      gzipQvalue = -1.0, brotliQvalue = -1, starQvalue = -1.0, identityQvalue = -1.0;
-    bool        gzipAccept, brotliAccept;
-    const char *gzipFormat, *brotliFormat, *starFormat;
+    double      gzipQvalue = -1.0, brotliQvalue = -1, zstdQvalue = -1.0,
+                starQvalue = -1.0, identityQvalue = -1.0;
+    bool        gzipAccept, brotliAccept, zstdAccept;
+    const char *gzipFormat, *brotliFormat, *zstdFormat, *starFormat;
 
     NS_NONNULL_ASSERT(hdr != NULL);
     NS_NONNULL_ASSERT(gzipAcceptPtr != NULL);
     NS_NONNULL_ASSERT(brotliAcceptPtr != NULL);
+    NS_NONNULL_ASSERT(zstdAcceptPtr != NULL);
 
     gzipFormat    = GetEncodingFormat(hdr, "gzip", &gzipQvalue);
     brotliFormat  = GetEncodingFormat(hdr, "br", &brotliQvalue);
+    zstdFormat    = GetEncodingFormat(hdr, "zstd", &zstdQvalue);
     starFormat    = GetEncodingFormat(hdr, "*", &starQvalue);
     (void)GetEncodingFormat(hdr, "identity", &identityQvalue);
 
     //fprintf(stderr, "hdr line <%s> gzipFormat <%s> brotliFormat <%s>\n", hdr, gzipFormat, brotliFormat);
-    if ((gzipFormat != NULL) || (brotliFormat != NULL)) {
+    if ((gzipFormat != NULL) || (brotliFormat != NULL) || (zstdFormat != NULL)) {
         gzipAccept   = CompressAllow(gzipQvalue, identityQvalue, starQvalue);
         brotliAccept = CompressAllow(brotliQvalue, identityQvalue, starQvalue);
+        zstdAccept   = CompressAllow(zstdQvalue, identityQvalue, starQvalue);
     } else if (starFormat != NULL) {
         /*
          * No compress format was specified, star matches everything, so as
@@ -1069,15 +1074,18 @@ NsParseAcceptEncoding(double version, const char *hdr, bool *gzipAcceptPtr, bool
             gzipAccept = (version >= 1.1);
         }
         /*
-         * The implicit rules are the same for gzip and brotli.
+         * The implicit rules are the same for gzip, brotli and zstd.
          */
         brotliAccept = gzipAccept;
+        zstdAccept   = gzipAccept;
     } else {
         gzipAccept   = NS_FALSE;
         brotliAccept = NS_FALSE;
+        zstdAccept   = NS_FALSE;
     }
     *gzipAcceptPtr   = gzipAccept;
     *brotliAcceptPtr = brotliAccept;
+    *zstdAcceptPtr   = zstdAccept;
 }
 
 /*
@@ -35,6 +35,9 @@ typedef struct ServerInit {
 static void CreatePool(NsServer *servPtr, const char *pool)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+static void ConfigCompression(NsServer *servPtr, const char *path)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
 
 /*
  * Static variables defined in this file.
@@ -112,7 +115,8 @@ NsGetInitServer(void)
  *      None.
  *
  * Side effects:
- *      See NsStartServer.
+ *      See NsStartServer. When configured, waits for the interpreter
+ *      warmup of the connection threads.
  *
  *----------------------------------------------------------------------
  */
@@ -125,11 +129,26 @@ NsStartServers(void)
 
     hPtr = Tcl_FirstHashEntry(&nsconf.servertable, &search);
     while (hPtr != NULL) {
-        const NsServer *servPtr = Tcl_GetHashValue(hPtr);
+        NsServer *servPtr = Tcl_GetHashValue(hPtr);
 
         NsStartServer(servPtr);
         hPtr = Tcl_NextHashEntry(&search);
     }
+
+    /*
+     * When "interpwarmup" is configured, wait until the interpreters of the
+     * minimum connection threads of all servers are initialized, such that
+     * the drivers start accepting requests only on warm servers.
+     */
+    if (nsconf.tcl.warmup) {
+        hPtr = Tcl_FirstHashEntry(&nsconf.servertable, &search);
+        while (hPtr != NULL) {
+            NsServer *servPtr = Tcl_GetHashValue(hPtr);
+
+            NsWaitServerWarmup(servPtr);
+            hPtr = Tcl_NextHashEntry(&search);
+        }
+    }
 }
 
 
@@ -317,6 +336,7 @@ NsInitServer(const char *server, Ns_ServerInitProc *initProc)
     servPtr->compress.level = Ns_ConfigIntRange(path, "compresslevel", 4, 1, 9);
     servPtr->compress.minsize = (int)Ns_ConfigMemUnitRange(path, "compressminsize", NULL, 512, 0, INT_MAX);
     servPtr->compress.preinit = Ns_ConfigBool(path, "compresspreinit", NS_FALSE);
+    ConfigCompression(servPtr, path);
 
     /*
      * Call the static server init proc, if any, which may register
@@ -408,6 +428,153 @@ NsRegisterServerInit(Ns_ServerInitProc *proc)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ConfigCompression --
+ *
+ *      Configure the content encodings used for on-the-fly compression
+ *      in order of preference, their default levels and the levels per
+ *      MIME type from the "compresslevels" section of the server. Each
+ *      entry of this section maps a MIME type pattern to pairs of
+ *      encoding names and levels, e.g.
+ *
+ *          ns_param text/html {br 5 gzip 6}
+ *          ns_param application/json {zstd 0}
+ *
+ *      where level 0 disables an encoding for matching types.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Updates the compress settings of the server.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ConfigCompression(NsServer *servPtr, const char *path)
+{
+    const char *section, *value;
+    Ns_Set     *set;
+    TCL_SIZE_T  argc;
+    const char **argv;
+    size_t      i;
+    int         e;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(path != NULL);
+
+    servPtr->compress.levels[NS_COMPRESS_GZIP] = servPtr->compress.level;
+    servPtr->compress.levels[NS_COMPRESS_BROTLI] =
+        Ns_ConfigIntRange(path, "brotlilevel", 4, 1, 11);
+    servPtr->compress.levels[NS_COMPRESS_ZSTD] =
+        Ns_ConfigIntRange(path, "zstdlevel", 3, 1, 22);
+
+    /*
+     * Encodings in order of preference. Encodings not supported by
+     * this binary are skipped, such that a common configuration file
+     * can be used for builds with and without brotli or zstd.
+     */
+    servPtr->compress.nrEncodings = 0;
+    value = Ns_ConfigString(path, "compressencodings", "gzip");
+    if (Tcl_SplitList(NULL, value, &argc, &argv) != TCL_OK) {
+        Ns_Log(Warning, "server %s: invalid value for compressencodings: '%s'",
+               servPtr->server, value);
+        argc = 0;
+        argv = NULL;
+    }
+    for (e = 0; e < (int)argc; e++) {
+        Ns_CompressEncoding encoding;
+        int                 j;
+        bool                duplicate = NS_FALSE;
+
+        if (!NsCompressEncodingFromName(argv[e], &encoding)) {
+            Ns_Log(Warning, "server %s: ignore unknown compress encoding '%s'",
+                   servPtr->server, argv[e]);
+            continue;
+        }
+        if (!Ns_CompressEncodingAvailable(encoding)) {
+            Ns_Log(Notice, "server %s: compress encoding '%s' is not supported by this binary",
+                   servPtr->server, argv[e]);
+            continue;
+        }
+        for (j = 0; j < servPtr->compress.nrEncodings; j++) {
+            if (servPtr->compress.encodings[j] == encoding) {
+                duplicate = NS_TRUE;
+            }
+        }
+        if (!duplicate) {
+            servPtr->compress.encodings[servPtr->compress.nrEncodings++] = encoding;
+        }
+    }
+    if (argv != NULL) {
+        Tcl_Free((char *)argv);
+    }
+
+    /*
+     * Allocate the compression buffers in advance by filling the pool
+     * of compression streams.
+     */
+    if (servPtr->compress.enable && servPtr->compress.preinit) {
+        for (e = 0; e < servPtr->compress.nrEncodings; e++) {
+            NsCompressPoolFill(servPtr->compress.encodings[e]);
+        }
+    }
+
+    /*
+     * Levels per MIME type pattern.
+     */
+    section = Ns_ConfigSectionPath(NULL, servPtr->server, NULL, "compresslevels", (char *)0L);
+    set = Ns_ConfigGetSection2(section, NS_FALSE);
+    servPtr->compress.nrMimeLevels = 0;
+    servPtr->compress.mimeLevels = NULL;
+
+    if (set != NULL && Ns_SetSize(set) > 0u) {
+        servPtr->compress.mimeLevels = ns_calloc(Ns_SetSize(set), sizeof(NsCompressMimeLevels));
+
+        for (i = 0u; i < Ns_SetSize(set); ++i) {
+            NsCompressMimeLevels *mimePtr;
+            TCL_SIZE_T            j;
+
+            NsConfigMarkAsRead(section, i);
+            value = Ns_SetValue(set, i);
+            if (Tcl_SplitList(NULL, value, &argc, &argv) != TCL_OK) {
+                argv = NULL;
+            } else if ((argc % 2) != 0) {
+                Tcl_Free((char *)argv);
+                argv = NULL;
+            }
+            if (argv == NULL) {
+                Ns_Log(Warning, "server %s: compresslevels %s: invalid value '%s'",
+                       servPtr->server, Ns_SetKey(set, i), value);
+                continue;
+            }
+            mimePtr = &servPtr->compress.mimeLevels[servPtr->compress.nrMimeLevels++];
+            mimePtr->pattern = ns_strdup(Ns_SetKey(set, i));
+            for (e = 0; e < NS_COMPRESS_NR_ENCODINGS; e++) {
+                mimePtr->levels[e] = -1;
+            }
+            for (j = 0; j < argc; j += 2) {
+                Ns_CompressEncoding encoding;
+                int                 level;
+
+                if (!NsCompressEncodingFromName(argv[j], &encoding)
+                    || Ns_StrToInt(argv[j+1], &level) != NS_OK
+                    || level < 0) {
+                    Ns_Log(Warning, "server %s: compresslevels %s: ignore invalid entry '%s %s'",
+                           servPtr->server, mimePtr->pattern, argv[j], argv[j+1]);
+                    continue;
+                }
+                mimePtr->levels[encoding] = level;
+            }
+            Tcl_Free((char *)argv);
+        }
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -492,6 +659,13 @@ CreatePool(NsServer *servPtr, const char *pool)
     poolPtr->threads.min =
         Ns_ConfigIntRange(section, "minthreads", 1, 1, poolPtr->threads.max);
 
+    /*
+     * Setting maxinterps to > 0 limits the number of connection threads
+     * keeping an interp between requests.
+     */
+    poolPtr->interps.max =
+        Ns_ConfigIntRange(section, "maxinterps", 0, 0, poolPtr->threads.max);
+
     Ns_ConfigTimeUnitRange(section, "threadtimeout", "2m", 0, 0, INT_MAX, 0,
                            &poolPtr->threads.timeout);
 
@@ -510,10 +684,6 @@ CreatePool(NsServer *servPtr, const char *pool)
     for (n = 0; n < maxconns - 1; ++n) {
         connPtr = &connBufPtr[n];
         connPtr->nextPtr = &connBufPtr[n+1];
-        if (servPtr->compress.enable
-            && servPtr->compress.preinit) {
-            (void) Ns_CompressInit(&connPtr->cStream);
-        }
         connPtr->rateLimit = poolPtr->rate.defaultConnectionLimit;
     }
 
@@ -28,8 +28,98 @@ typedef struct TclCache {
     Ns_Time     expires;  /* Default time-to-live for cache entries. */
     size_t      maxEntry; /* Maximum size of a single entry in the cache. */
     size_t      maxSize;  /* Maximum size of the entire cache. */
+    bool        readMostly; /* Lookup values via lock-free reads first. */
+    int         nearSize; /* Max. number of entries in the near caches, 0 when disabled. */
 } TclCache;
 
+/*
+ * A near cache keeps the Tcl_Objs of recently read values of a cache in
+ * an interpreter. An entry is valid, as long as the generation of the
+ * partition of the key is unchanged and the value is not expired or
+ * stale. The entries are replaced in FIFO order.
+ */
+
+typedef struct NearCache {
+    Tcl_HashTable   entries;    /* key -> NearEntry */
+    Tcl_HashEntry **slots;      /* entries in insertion order */
+    int             size;
+    int             next;       /* next slot to be replaced */
+} NearCache;
+
+typedef struct NearEntry {
+    Tcl_Obj        *valueObj;
+    const Ns_Cache *cache;      /* cache or partition of the key */
+    uintptr_t       generation;
+    Ns_Time         validUntil; /* zero when no expiry */
+    int             slot;
+} NearEntry;
+
+/*
+ * The following defines the states of the keys in ns_cache_eval_many.
+ */
+
+typedef enum {
+    EVAL_MANY_MISSING,  /* not looked up in the shared cache yet */
+    EVAL_MANY_OWNED,    /* placeholder entry created, value computed here */
+    EVAL_MANY_BUSY,     /* value is computed by some other thread */
+    EVAL_MANY_DONE      /* value determined (or not cacheable) */
+} EvalManyState;
+
+/*
+ * The following defines a pending background refresh of a stale cache
+ * value. The refreshes are processed by a per-server refresher thread.
+ */
+
+typedef struct CacheRefresh {
+    struct CacheRefresh *nextPtr;
+    TclCache            *cPtr;
+    char                *script;     /* Script computing the value */
+    Ns_Time              expires;    /* Value of "-expires" */
+    Ns_Time              staleTtl;   /* Value of "-stale_ttl" */
+    bool                 hasExpires;
+    char                 key[1];
+} CacheRefresh;
+
+/*
+ * The following defines the layout of a cache snapshot file: a header
+ * followed by one record per entry, each record followed by the key and
+ * the value. The numbers are in host byte order, the byteOrder field
+ * is used to detect snapshots of a different architecture.
+ */
+
+#define SNAPSHOT_MAGIC "nscache1"
+
+typedef struct SnapshotHeader {
+    char     magic[8];
+    uint32_t byteOrder;
+    uint32_t count;
+} SnapshotHeader;
+
+typedef struct SnapshotRecord {
+    uint32_t keyLength;
+    uint32_t valueLength;
+    int64_t  expiresSec;
+    int64_t  revalidateSec;
+    int32_t  expiresUsec;
+    int32_t  revalidateUsec;
+    int32_t  cost;
+    int32_t  reserved;
+} SnapshotRecord;
+
+/*
+ * Snapshot loaded in the background on the creation of a cache. The
+ * loads are kept in a list of the server until the loader threads are
+ * joined at shutdown.
+ */
+
+typedef struct SnapshotLoad {
+    struct SnapshotLoad *nextPtr;
+    NsServer            *servPtr;
+    TclCache            *cPtr;
+    Ns_Thread            thread;
+    char                 fileName[1];
+} SnapshotLoad;
+
 
 /*
  * Local functions defined in this file
@@ -37,20 +127,64 @@ typedef struct TclCache {
 
 static int CacheAppendObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv, bool append);
 
-static Ns_Entry *CreateEntry(const NsInterp *itPtr, TclCache *cPtr, const char *key,
+static Ns_Entry *CreateEntry(const NsInterp *itPtr, TclCache *cPtr, Ns_Cache *cache, const char *key,
                              int *newPtr, Ns_Time *timeoutPtr, const Ns_CacheTransactionStack *transactionStackPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5);
+
+static void SetEntry(NsInterp *itPtr, TclCache *cPtr, Ns_Entry *entry, Tcl_Obj *valObj, Ns_Time *expPtr,
+                     const Ns_Time *staleTtlPtr, int cost)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static void QueueRefresh(NsServer *servPtr, TclCache *cPtr, const char *key, Tcl_Obj *scriptObj,
+                         const Ns_Time *expPtr, const Ns_Time *staleTtlPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(6);
+
+static void RefreshEntry(NsServer *servPtr, CacheRefresh *refreshPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static Ns_ThreadProc CacheRefreshThread;
+
+static Ns_ReturnCode CacheSnapshotSave(TclCache *cPtr, const char *fileName, Tcl_DString *errorPtr,
+                                       size_t *countPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
 
-static void SetEntry(NsInterp *itPtr, TclCache *cPtr, Ns_Entry *entry, Tcl_Obj *valObj, Ns_Time *expPtr, int cost)
+static Ns_ReturnCode CacheSnapshotLoad(TclCache *cPtr, const char *fileName, Tcl_DString *errorPtr,
+                                       size_t *countPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
 
+static void CacheSnapshotFileName(const NsServer *servPtr, const char *cacheName, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static Ns_ThreadProc CacheSnapshotLoadThread;
+
+static Tcl_ObjCmdProc CacheSnapshotSaveObjCmd;
+static Tcl_ObjCmdProc CacheSnapshotLoadObjCmd;
+
 static bool noGlobChars(const char *pattern)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
 
-static TclCache *TclCacheCreate(const char *name, size_t maxEntry, size_t maxSize,
+static TclCache *TclCacheCreate(const char *name, size_t maxEntry, size_t maxSize, int npartitions,
+                                Ns_CachePolicy policy, bool readMostly, int nearSize,
                                 const Ns_Time *timeoutPtr, const Ns_Time *expPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
 
+static Tcl_Obj *FindValueLockFree(const NsInterp *itPtr, const TclCache *cPtr, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static Tcl_Obj *NearCacheGet(NsInterp *itPtr, const TclCache *cPtr, const char *key)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void NearCachePut(NsInterp *itPtr, const TclCache *cPtr, const Ns_Cache *cache,
+                         const Ns_Entry *entry, Tcl_Obj *valueObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5);
+
+static Ns_Cache **BatchPartitions(const TclCache *cPtr, TCL_SIZE_T nkeys, Tcl_Obj *const* keyv, TCL_SIZE_T stride)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+
+static int EvalManyKey(Tcl_Interp *interp, TCL_SIZE_T nwords, Tcl_Obj **cmdv, Tcl_Obj *keyObj,
+                       Tcl_Obj **valueObjPtr, int *costPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5) NS_GNUC_NONNULL(6);
+
 static Tcl_Obj*GetCacheNames(NsServer *servPtr, bool withUncommittedEntries)
     NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
 
@@ -123,7 +257,9 @@ GetCacheNames(NsServer *servPtr, bool withUncommittedEntries) {
  *
  * TclCacheCreate --
  *
- *      Create a new Tcl cache.
+ *      Create a new Tcl cache with the given eviction policy, optionally
+ *      with the given number of partitions, lock-free reads and near
+ *      caches.
  *
  * Results:
  *      TclCache *
@@ -135,7 +271,8 @@ GetCacheNames(NsServer *servPtr, bool withUncommittedEntries) {
  */
 
 static TclCache *
-TclCacheCreate(const char *name, size_t maxEntry, size_t maxSize,
+TclCacheCreate(const char *name, size_t maxEntry, size_t maxSize, int npartitions,
+               Ns_CachePolicy policy, bool readMostly, int nearSize,
                const Ns_Time *timeoutPtr, const Ns_Time *expPtr)
 {
     TclCache *cPtr;
@@ -143,7 +280,20 @@ TclCacheCreate(const char *name, size_t maxEntry, size_t maxSize,
     NS_NONNULL_ASSERT(name != NULL);
 
     cPtr = ns_calloc(1u, sizeof(TclCache));
-    cPtr->cache = Ns_CacheCreateSz(name, TCL_STRING_KEYS, maxSize, ns_free);
+    if (npartitions > 1) {
+        cPtr->cache = Ns_CacheCreatePartitioned(name, TCL_STRING_KEYS, maxSize, ns_free, npartitions);
+    } else {
+        cPtr->cache = Ns_CacheCreateSz(name, TCL_STRING_KEYS, maxSize, ns_free);
+    }
+    Ns_CacheSetPolicy(cPtr->cache, policy);
+    if (readMostly) {
+        Ns_CacheEnableLockFreeReads(cPtr->cache);
+        cPtr->readMostly = NS_TRUE;
+    }
+    if (nearSize > 0) {
+        Ns_CacheEnableNearHits(cPtr->cache);
+    }
+    cPtr->nearSize = nearSize;
     cPtr->maxEntry = maxEntry;
     cPtr->maxSize  = maxSize;
     if (timeoutPtr != NULL) {
@@ -177,15 +327,27 @@ int
 NsTclCacheCreateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
     char        *name = NULL;
-    int         result = TCL_OK;
+    int         result = TCL_OK, npartitions = 1, policy = (int)NS_CACHE_LRU, readMostly = 0, nearSize = 0;
     Tcl_WideInt maxSize = 0, maxEntry = 0;
     Ns_Time    *timeoutPtr = NULL, *expPtr = NULL;
+    Ns_ObjvValueRange partitionsRange = {1, 1024}, nearSizeRange = {0, 65536};
+    static Ns_ObjvTable policies[] = {
+        {"lru",     (unsigned int)NS_CACHE_LRU},
+        {"clock",   (unsigned int)NS_CACHE_CLOCK},
+        {"tinylfu", (unsigned int)NS_CACHE_TINYLFU},
+        {"gdsf",    (unsigned int)NS_CACHE_GDSF},
+        {NULL,      0u}
+    };
 
     Ns_ObjvSpec opts[] = {
-        {"-timeout",  Ns_ObjvTime,    &timeoutPtr, NULL},
-        {"-expires",  Ns_ObjvTime,    &expPtr,     NULL},
-        {"-maxentry", Ns_ObjvMemUnit, &maxEntry,   NULL},
-        {"--",        Ns_ObjvBreak,   NULL,        NULL},
+        {"-timeout",    Ns_ObjvTime,    &timeoutPtr,  NULL},
+        {"-expires",    Ns_ObjvTime,    &expPtr,      NULL},
+        {"-maxentry",   Ns_ObjvMemUnit, &maxEntry,    NULL},
+        {"-partitions", Ns_ObjvInt,     &npartitions, &partitionsRange},
+        {"-policy",     Ns_ObjvIndex,   &policy,      policies},
+        {"-readmostly", Ns_ObjvBool,    &readMostly,  INT2PTR(NS_TRUE)},
+        {"-nearcache",  Ns_ObjvInt,     &nearSize,    &nearSizeRange},
+        {"--",          Ns_ObjvBreak,   NULL,         NULL},
         {NULL, NULL,  NULL, NULL}
     };
     Ns_ObjvSpec args[] = {
@@ -209,8 +371,45 @@ NsTclCacheCreateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T obj
         Ns_RWLockWrLock(&servPtr->tcl.cachelock);
         hPtr = Tcl_CreateHashEntry(&servPtr->tcl.caches, name, &isNew);
         if (isNew != 0) {
-            TclCache *cPtr = TclCacheCreate(name, (size_t)maxEntry, (size_t)maxSize, timeoutPtr, expPtr);
+            TclCache   *cPtr = TclCacheCreate(name, (size_t)maxEntry, (size_t)maxSize, npartitions,
+                                              (Ns_CachePolicy)policy, (readMostly != 0), nearSize,
+                                              timeoutPtr, expPtr);
+            TCL_SIZE_T  i;
+
             Tcl_SetHashValue(hPtr, cPtr);
+
+            /*
+             * Warm start: load the snapshot of a configured cache in the
+             * background.
+             */
+            for (i = 0; i < servPtr->tcl.cacheSnapshotc; i++) {
+                if (STREQ(servPtr->tcl.cacheSnapshotv[i], name)) {
+                    SnapshotLoad *loadPtr;
+                    Tcl_DString   ds;
+
+                    Tcl_DStringInit(&ds);
+                    CacheSnapshotFileName(servPtr, name, &ds);
+                    if (access(ds.string, R_OK) == 0) {
+                        loadPtr = ns_malloc(sizeof(SnapshotLoad) + (size_t)ds.length);
+                        loadPtr->servPtr = servPtr;
+                        loadPtr->cPtr = cPtr;
+                        memcpy(loadPtr->fileName, ds.string, (size_t)ds.length + 1u);
+
+                        Ns_MutexLock(&servPtr->tcl.cacheSnapshotLoad.lock);
+                        if (servPtr->tcl.cacheSnapshotLoad.stop) {
+                            ns_free(loadPtr);
+                        } else {
+                            loadPtr->nextPtr = servPtr->tcl.cacheSnapshotLoad.firstPtr;
+                            servPtr->tcl.cacheSnapshotLoad.firstPtr = loadPtr;
+                            servPtr->tcl.cacheSnapshotLoad.running++;
+                            Ns_ThreadCreate(CacheSnapshotLoadThread, loadPtr, 0, &loadPtr->thread);
+                        }
+                        Ns_MutexUnlock(&servPtr->tcl.cacheSnapshotLoad.lock);
+                    }
+                    Tcl_DStringFree(&ds);
+                    break;
+                }
+            }
         }
         Ns_RWLockUnlock(&servPtr->tcl.cachelock);
 
@@ -437,11 +636,17 @@ CacheEval(Tcl_Interp *interp, TCL_SIZE_T nargs, TCL_OBJC_T objc, Tcl_Obj *const*
  *
  *      The -force switch causes an existing valid entry to replaced.
  *
+ *      With -stale_ttl, values remain in the cache for this time after
+ *      they have expired. Such a stale value is returned immediately,
+ *      while a single background refresh recomputes it
+ *      (stale-while-revalidate).
+ *
  * Results:
  *      Tcl result.
  *
  * Side effects:
  *      Other threads may block waiting for this update to complete.
+ *      Stale values are refreshed by the cache refresher thread.
  *
  *----------------------------------------------------------------------
  */
@@ -451,15 +656,17 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
 {
     TclCache   *cPtr = NULL;
     char       *key = NULL;
-    Ns_Time    *timeoutPtr = NULL, *expPtr = NULL;
+    Ns_Time    *timeoutPtr = NULL, *expPtr = NULL, *staleTtlPtr = NULL;
     int         force = (int)NS_FALSE, status;
     TCL_SIZE_T  nargs = 0;
+    Tcl_Obj    *resultObj;
 
     Ns_ObjvSpec opts[] = {
-        {"-timeout", Ns_ObjvTime,  &timeoutPtr, NULL},
-        {"-expires", Ns_ObjvTime,  &expPtr,     NULL},
-        {"-force",   Ns_ObjvBool,  &force,      INT2PTR(NS_TRUE)},
-        {"--",       Ns_ObjvBreak, NULL,        NULL},
+        {"-timeout",   Ns_ObjvTime,  &timeoutPtr,  NULL},
+        {"-expires",   Ns_ObjvTime,  &expPtr,      NULL},
+        {"-stale_ttl", Ns_ObjvTime,  &staleTtlPtr, NULL},
+        {"-force",     Ns_ObjvBool,  &force,       INT2PTR(NS_TRUE)},
+        {"--",         Ns_ObjvBreak, NULL,         NULL},
         {NULL, NULL, NULL, NULL}
     };
     Ns_ObjvSpec args[] = {
@@ -476,11 +683,29 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
         /*Ns_Log(Notice, "nocache: %s %d", Tcl_GetString(objv[objc-nargs]), nargs);*/
         status = CacheEval(interp, nargs, objc, objv);
 
+    } else if (cPtr->nearSize > 0 && force == (int)NS_FALSE
+               && (resultObj = NearCacheGet(clientData, cPtr, key)) != NULL) {
+        /*
+         * Value found in the near cache of the interpreter.
+         */
+        Tcl_SetObjResult(interp, resultObj);
+        status = TCL_OK;
+
+    } else if (cPtr->readMostly && cPtr->nearSize == 0 && force == (int)NS_FALSE
+               && (resultObj = FindValueLockFree(clientData, cPtr, key)) != NULL) {
+        /*
+         * Value found without locking the cache.
+         */
+        Tcl_SetObjResult(interp, resultObj);
+        status = TCL_OK;
+
     } else {
         Ns_Entry                 *entry;
         NsInterp                 *itPtr;
         Ns_CacheTransactionStack *transactionStackPtr;
+        Ns_Cache                 *cache;
         int                       isNew;
+        bool                      refresh = NS_FALSE;
 
         assert(clientData != NULL);
         assert(cPtr != NULL);
@@ -488,6 +713,7 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
 
         itPtr = clientData;
         transactionStackPtr = &itPtr->cacheTransactionStack;
+        cache = Ns_CachePartition(cPtr->cache, key);
 
         /*
          * CreateEntry waits for ongoing transactions. If it succeeds, it
@@ -495,7 +721,28 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
          * provided cache value (isNew == 0) ... which might be from the
          * current transaction.
          */
-        entry = CreateEntry(itPtr, cPtr, key, &isNew, timeoutPtr, transactionStackPtr);
+        entry = CreateEntry(itPtr, cPtr, cache, key, &isNew, timeoutPtr, transactionStackPtr);
+
+        if (entry != NULL && isNew == 0 && force == (int)NS_FALSE) {
+            Ns_Time now;
+
+            Ns_GetTime(&now);
+            if (Ns_CacheIsStale(entry, &now)) {
+                if (staleTtlPtr == NULL || transactionStackPtr->depth > 0u) {
+                    /*
+                     * Without a stale time, or inside a transaction, the
+                     * stale value is recomputed immediately.
+                     */
+                    force = (int)NS_TRUE;
+                } else {
+                    /*
+                     * Return the stale value; only the first caller
+                     * triggers the refresh.
+                     */
+                    refresh = Ns_CacheTryRevalidate(entry);
+                }
+            }
+        }
 
         if (unlikely(entry == NULL)) {
             status = TCL_ERROR;
@@ -507,10 +754,23 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
             /*
              * We have a value for the cache entry, return it.
              */
-            Ns_CacheUnlock(cPtr->cache);
+            if (cPtr->nearSize > 0 && !refresh) {
+                NearCachePut(itPtr, cPtr, cache, entry, resultObj);
+            }
+            Ns_CacheUnlock(cache);
             Tcl_SetObjResult(interp, resultObj);
             status = TCL_OK;
 
+            if (refresh) {
+                Tcl_Obj *scriptObj = (nargs == 1
+                                      ? objv[objc-1]
+                                      : Tcl_NewListObj(nargs, objv + ((TCL_SIZE_T)objc-nargs)));
+
+                Tcl_IncrRefCount(scriptObj);
+                QueueRefresh(itPtr->servPtr, cPtr, key, scriptObj, expPtr, staleTtlPtr);
+                Tcl_DecrRefCount(scriptObj);
+            }
+
         } else {
             Ns_Time start, end, diff;
 
@@ -527,7 +787,7 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
             /*
              * Evaluate the cmd to obtain the cache value.
              */
-            Ns_CacheUnlock(cPtr->cache);
+            Ns_CacheUnlock(cache);
 
             Ns_GetTime(&start);
             status = CacheEval(interp, nargs, objc, objv);
@@ -535,7 +795,7 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
 
             (void)Ns_DiffTime(&end, &start, &diff);
 
-            Ns_CacheLock(cPtr->cache);
+            Ns_CacheLock(cache);
             {
                 /*
                  * This is just a sanity check, hopefully transitional code.
@@ -543,7 +803,7 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
                 Ns_Entry *entry2;
                 int isNew2 = 0;
 
-                entry2 = Ns_CacheCreateEntry(cPtr->cache, key, &isNew2);
+                entry2 = Ns_CacheCreateEntry(cache, key, &isNew2);
                 if (isNew2 != 0) {
                     Ns_Log(Warning, "==== cache %s key %s old entry %p"
                            " different from re-fetched entry %p",
@@ -582,11 +842,11 @@ NsTclCacheEvalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
                 Tcl_Obj *resultObj = Tcl_GetObjResult(interp);
 
                 status = TCL_OK;
-                SetEntry(itPtr, cPtr, entry, resultObj, expPtr,
+                SetEntry(itPtr, cPtr, entry, resultObj, expPtr, staleTtlPtr,
                          (int)(diff.sec * 1000000 + diff.usec));
             }
-            Ns_CacheBroadcast(cPtr->cache);
-            Ns_CacheUnlock(cPtr->cache);
+            Ns_CacheBroadcast(cache);
+            Ns_CacheUnlock(cache);
         }
     }
     return status;
@@ -639,21 +899,22 @@ NsTclCacheIncrObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
         result = TCL_ERROR;
     } else {
         Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
-        Ns_Entry   *entry = CreateEntry(itPtr, cPtr, key, &isNew, timeoutPtr, transactionStackPtr);
+        Ns_Cache   *cache = Ns_CachePartition(cPtr->cache, key);
+        Ns_Entry   *entry = CreateEntry(itPtr, cPtr, cache, key, &isNew, timeoutPtr, transactionStackPtr);
         int         cur = 0;
 
         if (entry == NULL) {
             result = TCL_ERROR;
         } else if ((isNew == 0)
                    && (Tcl_GetInt(interp, Ns_CacheGetValueT(entry, transactionStackPtr), &cur) != TCL_OK)) {
-            Ns_CacheUnlock(cPtr->cache);
+            Ns_CacheUnlock(cache);
             result = TCL_ERROR;
         } else {
             Tcl_Obj *valObj = Tcl_NewIntObj(cur + incr);
 
-            SetEntry(itPtr, cPtr, entry, valObj, expPtr, 0);
+            SetEntry(itPtr, cPtr, entry, valObj, expPtr, NULL, 0);
             Tcl_SetObjResult(interp, valObj);
-            Ns_CacheUnlock(cPtr->cache);
+            Ns_CacheUnlock(cache);
             result = TCL_OK;
         }
     }
@@ -721,12 +982,14 @@ CacheAppendObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tc
     } else {
         int                             isNew;
         Ns_Entry                       *entry;
+        Ns_Cache                       *cache;
         const Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
 
         assert(cPtr != NULL);
         assert(key != NULL);
 
-        entry = CreateEntry(itPtr, cPtr, key, &isNew, timeoutPtr, transactionStackPtr);
+        cache = Ns_CachePartition(cPtr->cache, key);
+        entry = CreateEntry(itPtr, cPtr, cache, key, &isNew, timeoutPtr, transactionStackPtr);
         if (entry == NULL) {
             result = TCL_ERROR;
         } else {
@@ -746,10 +1009,10 @@ CacheAppendObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tc
                 }
             }
             if (result == TCL_OK) {
-                SetEntry(itPtr, cPtr, entry, valObj, expPtr, 0);
+                SetEntry(itPtr, cPtr, entry, valObj, expPtr, NULL, 0);
                 Tcl_SetObjResult(interp, valObj);
             }
-            Ns_CacheUnlock(cPtr->cache);
+            Ns_CacheUnlock(cache);
         }
     }
     return result;
@@ -846,6 +1109,7 @@ NsTclCacheKeysObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
 
     } else if (pattern != NULL && (exact != 0 || noGlobChars(pattern))) {
         Tcl_Obj  *listObj = Tcl_NewListObj(0, NULL);
+        Ns_Cache *cache;
 
         /*
          * If the provided pattern (key) contains no glob characters,
@@ -854,12 +1118,13 @@ NsTclCacheKeysObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
          * lookup is sufficient.
          */
         assert(cPtr != NULL);
-        Ns_CacheLock(cPtr->cache);
-        entry = Ns_CacheFindEntryT(cPtr->cache, pattern, transactionStackPtr);
+        cache = Ns_CachePartition(cPtr->cache, pattern);
+        Ns_CacheLock(cache);
+        entry = Ns_CacheFindEntryT(cache, pattern, transactionStackPtr);
         if (entry != NULL && Ns_CacheGetValueT(entry, transactionStackPtr) != NULL) {
             Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj(pattern, TCL_INDEX_NONE));
         }
-        Ns_CacheUnlock(cPtr->cache);
+        Ns_CacheUnlock(cache);
         Tcl_SetObjResult(interp, listObj);
 
     } else {
@@ -942,7 +1207,6 @@ NsTclCacheFlushObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc
         assert(cPtr != NULL);
         cache = cPtr->cache;
 
-        Ns_CacheLock(cache);
         if (npatterns == 0) {
             /*
              * Flush all cache entries.
@@ -951,32 +1215,42 @@ NsTclCacheFlushObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc
                 /*
                  * No transaction is active.
                  */
+                Ns_CacheLock(cache);
                 nflushed = Ns_CacheFlush(cache);
+                Ns_CacheUnlock(cache);
             } else {
                 Ns_CacheSearch  search;
 
                 /*
                  * flush all in transaction.
                  */
+                Ns_CacheLock(cache);
                 entry = Ns_CacheFirstEntryT(cache, &search, transactionStackPtr);
                 while (entry != NULL) {
                     Ns_CacheFlushEntry(entry);
                     nflushed++;
                     entry = Ns_CacheNextEntryT(&search, transactionStackPtr);
                 }
+                Ns_CacheUnlock(cache);
             }
 
         } else if (glob == (int)NS_FALSE) {
             /*
-             * Flush the provided entries without glob matching.
+             * Flush the provided entries without glob matching. Lock only
+             * the partition responsible for the key.
              */
 
             for (i = npatterns; i > 0; i--) {
-                entry = Ns_CacheFindEntryT(cache, Tcl_GetString(objv[(TCL_SIZE_T)objc-i]), transactionStackPtr);
+                const char *key = Tcl_GetString(objv[(TCL_SIZE_T)objc-i]);
+                Ns_Cache   *partition = Ns_CachePartition(cache, key);
+
+                Ns_CacheLock(partition);
+                entry = Ns_CacheFindEntryT(partition, key, transactionStackPtr);
                 if (entry != NULL && Ns_CacheGetValueT(entry, transactionStackPtr) != NULL) {
                     Ns_CacheFlushEntry(entry);
                     nflushed++;
                 }
+                Ns_CacheUnlock(partition);
             }
 
         } else {
@@ -985,6 +1259,7 @@ NsTclCacheFlushObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc
             /*
              * Flush the provided entries with glob matching.
              */
+            Ns_CacheLock(cache);
             entry = Ns_CacheFirstEntryT(cache, &search, transactionStackPtr);
             while (entry != NULL) {
                 const char *key = Ns_CacheKey(entry);
@@ -1000,8 +1275,8 @@ NsTclCacheFlushObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc
                 }
                 entry = Ns_CacheNextEntryT(&search, transactionStackPtr);
             }
+            Ns_CacheUnlock(cache);
         }
-        Ns_CacheUnlock(cache);
         Tcl_SetObjResult(interp, Tcl_NewIntObj(nflushed));
     }
     return result;
@@ -1048,25 +1323,38 @@ NsTclCacheGetObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
     } else {
         const Ns_Entry  *entry;
         Tcl_Obj         *resultObj;
-        const NsInterp  *itPtr = clientData;
+        NsInterp        *itPtr = clientData;
         const Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
+        Ns_Cache        *cache;
 
         assert(cPtr != NULL);
 
-        Ns_CacheLock(cPtr->cache);
-        entry = Ns_CacheFindEntryT(cPtr->cache, key, transactionStackPtr);
-        if (entry != NULL) {
-            void  *value = Ns_CacheGetValueT(entry, transactionStackPtr);
-
-            if (value != NULL) {
-                resultObj = Tcl_NewStringObj(value, TCL_INDEX_NONE);
-            } else {
-                resultObj = NULL;
-            }
+        if (cPtr->nearSize > 0) {
+            /*
+             * On a miss, the near cache is filled via the locked lookup.
+             */
+            resultObj = NearCacheGet(itPtr, cPtr, key);
+        } else if (cPtr->readMostly) {
+            resultObj = FindValueLockFree(itPtr, cPtr, key);
         } else {
             resultObj = NULL;
         }
-        Ns_CacheUnlock(cPtr->cache);
+        if (resultObj == NULL) {
+            cache = Ns_CachePartition(cPtr->cache, key);
+            Ns_CacheLock(cache);
+            entry = Ns_CacheFindEntryT(cache, key, transactionStackPtr);
+            if (entry != NULL) {
+                void  *value = Ns_CacheGetValueT(entry, transactionStackPtr);
+
+                if (value != NULL) {
+                    resultObj = Tcl_NewStringObj(value, TCL_INDEX_NONE);
+                    if (cPtr->nearSize > 0) {
+                        NearCachePut(itPtr, cPtr, cache, entry, resultObj);
+                    }
+                }
+            }
+            Ns_CacheUnlock(cache);
+        }
 
         if (unlikely(varNameObj != NULL)) {
             Tcl_SetObjResult(interp, Tcl_NewBooleanObj(resultObj != NULL));
@@ -1091,16 +1379,15 @@ NsTclCacheGetObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
 /*
  *----------------------------------------------------------------------
  *
- * NsTclCacheStatsObjCmd --
+ * BatchPartitions --
  *
- *      Implements "ns_ cache stats".  Returns statistics in form of a
- *      dict from the specified cache. When the switch "-contents" is
- *      provided, entries for all cache entries are returned, containing the
- *      key, size, hits and expire time for each entry in the cache. The
- *      switch "-reset" can be used to reset the cache statistics.
+ *      Determine the cache partitions of the keys of a batch command. The
+ *      keys are taken from every stride-th element of keyv. The batch
+ *      commands process the keys grouped by the partitions, such that
+ *      every partition is locked only once per command.
  *
  * Results:
- *      Tcl result.
+ *      Array of partitions, to be freed by the caller via ns_free().
  *
  * Side effects:
  *      None.
@@ -1108,214 +1395,1828 @@ NsTclCacheGetObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
  *----------------------------------------------------------------------
  */
 
+static Ns_Cache **
+BatchPartitions(const TclCache *cPtr, TCL_SIZE_T nkeys, Tcl_Obj *const* keyv, TCL_SIZE_T stride)
+{
+    Ns_Cache  **partitionv;
+    TCL_SIZE_T  i;
+
+    NS_NONNULL_ASSERT(cPtr != NULL);
+
+    partitionv = ns_calloc((size_t)nkeys + 1u, sizeof(Ns_Cache *));
+    for (i = 0; i < nkeys; i++) {
+        partitionv[i] = Ns_CachePartition(cPtr->cache, Tcl_GetString(keyv[i * stride]));
+    }
+    return partitionv;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheGetManyObjCmd --
+ *
+ *      Implements "ns_cache_get_many". Return the values of multiple keys
+ *      from the cache as a dict. Keys without values are omitted from the
+ *      result.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
 int
-NsTclCacheStatsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+NsTclCacheGetManyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
     TclCache   *cPtr = NULL;
-    int         contents = (int)NS_FALSE, reset = (int)NS_FALSE, result = TCL_OK;
-    Ns_ObjvSpec opts[] = {
-        {"-contents", Ns_ObjvBool,  &contents, INT2PTR(NS_TRUE)},
-        {"-reset",    Ns_ObjvBool,  &reset,    INT2PTR(NS_TRUE)},
-        {"--",        Ns_ObjvBreak, NULL,      NULL},
-        {NULL, NULL, NULL, NULL}
-    };
+    Tcl_Obj    *keysObj = NULL, **keyv;
+    TCL_SIZE_T  nkeys;
+    int         result = TCL_OK;
     Ns_ObjvSpec args[] = {
-        {"cache", ObjvCache, &cPtr, clientData},
+        {"cache", ObjvCache,  &cPtr,    clientData},
+        {"keys",  Ns_ObjvObj, &keysObj, NULL},
         {NULL, NULL, NULL, NULL}
     };
     args[0].arg = clientData; /* pass non-constant clientData for "cache" */
 
-    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(NULL, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (Tcl_ListObjGetElements(interp, keysObj, &nkeys, &keyv) != TCL_OK) {
         result = TCL_ERROR;
 
     } else {
-        Ns_DString      ds;
-        Ns_Cache       *cache;
+        NsInterp                       *itPtr = clientData;
+        const Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
+        Ns_Cache                      **partitionv;
+        Tcl_Obj                       **valuev, *dictObj;
+        TCL_SIZE_T                      i, j;
 
         assert(cPtr != NULL);
 
-        cache = cPtr->cache;
-        Ns_DStringInit(&ds);
+        partitionv = BatchPartitions(cPtr, nkeys, keyv, 1);
+        valuev = ns_calloc((size_t)nkeys + 1u, sizeof(Tcl_Obj *));
 
-        Ns_CacheLock(cache);
-        if (contents != 0) {
-            Ns_CacheSearch  search;
-            const Ns_Entry *entry;
+        if (cPtr->nearSize > 0 || cPtr->readMostly) {
+            for (i = 0; i < nkeys; i++) {
+                const char *key = Tcl_GetString(keyv[i]);
 
-            entry = Ns_CacheFirstEntry(cache, &search);
-            while (entry != NULL) {
-                Tcl_DString    entryDs;
-                const char    *key     = Ns_CacheKey(entry);
-                size_t         size    = Ns_CacheGetSize(entry);
-                size_t         reuse   = Ns_CacheGetReuse(entry);
-                const Ns_Time *timePtr = Ns_CacheGetExpirey(entry);
+                valuev[i] = (cPtr->nearSize > 0
+                             ? NearCacheGet(itPtr, cPtr, key)
+                             : FindValueLockFree(itPtr, cPtr, key));
+                if (valuev[i] != NULL) {
+                    partitionv[i] = NULL;
+                }
+            }
+        }
 
-                Ns_DStringInit(&entryDs);
+        for (i = 0; i < nkeys; i++) {
+            Ns_Cache *cache = partitionv[i];
 
-                Tcl_DStringAppendElement(&entryDs, key);
-                if (timePtr->usec == 0) {
-                    Ns_DStringPrintf(&entryDs, " %" PRIdz " %" PRIdz " %" PRId64,
-                                     size, reuse, (int64_t) timePtr->sec);
-                } else {
-                    Ns_DStringPrintf(&entryDs, " %" PRIdz " %" PRIdz " %" PRId64 ":%ld",
-                                     size, reuse, (int64_t) timePtr->sec, timePtr->usec);
+            if (cache == NULL) {
+                continue;
+            }
+            Ns_CacheLock(cache);
+            for (j = i; j < nkeys; j++) {
+                if (partitionv[j] == cache) {
+                    const Ns_Entry *entry;
+
+                    partitionv[j] = NULL;
+                    entry = Ns_CacheFindEntryT(cache, Tcl_GetString(keyv[j]), transactionStackPtr);
+                    if (entry != NULL) {
+                        void *value = Ns_CacheGetValueT(entry, transactionStackPtr);
+
+                        if (value != NULL) {
+                            valuev[j] = Tcl_NewStringObj(value, TCL_INDEX_NONE);
+                            if (cPtr->nearSize > 0) {
+                                NearCachePut(itPtr, cPtr, cache, entry, valuev[j]);
+                            }
+                        }
+                    }
                 }
-                Tcl_DStringAppendElement(&ds, entryDs.string);
-                Ns_DStringFree(&entryDs);
-
-                entry = Ns_CacheNextEntry(&search);
             }
-
-        } else {
-            (void) Ns_CacheStats(cache, &ds);
-        }
-        if (reset != 0) {
-            Ns_CacheResetStats(cache);
+            Ns_CacheUnlock(cache);
         }
-        Ns_CacheUnlock(cache);
 
-        Tcl_DStringResult(interp, &ds);
+        dictObj = Tcl_NewDictObj();
+        for (i = 0; i < nkeys; i++) {
+            if (valuev[i] != NULL) {
+                (void) Tcl_DictObjPut(NULL, dictObj, keyv[i], valuev[i]);
+            }
+        }
+        Tcl_SetObjResult(interp, dictObj);
+        ns_free(valuev);
+        ns_free(partitionv);
     }
-
     return result;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * CreateEntry --
+ * NsTclCacheSetManyObjCmd --
  *
- *      Lock the cache and create a new entry or return existing entry,
- *      waiting up to timeout seconds for another thread to complete
- *      an update.
+ *      Implements "ns_cache_set_many". Set the values of multiple keys
+ *      provided as a dict.
  *
  * Results:
- *      Pointer to entry, or NULL on timeout.
+ *      Tcl result.
  *
  * Side effects:
- *      Cache will be left locked if function returns non-NULL entry.
+ *      Might wait for concurrent updates of the keys.
  *
  *----------------------------------------------------------------------
  */
-
-static Ns_Entry *
-CreateEntry(const NsInterp *itPtr, TclCache *cPtr, const char *key, int *newPtr,
-            Ns_Time *timeoutPtr, const Ns_CacheTransactionStack *transactionStackPtr)
+int
+NsTclCacheSetManyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    Ns_Cache *cache;
-    Ns_Entry *entry;
-    Ns_Time   t;
+    TclCache   *cPtr = NULL;
+    Tcl_Obj    *dictObj = NULL, **elemv;
+    TCL_SIZE_T  nelem, size;
+    int         result = TCL_OK;
+    Ns_Time    *timeoutPtr = NULL, *expPtr = NULL;
 
-    NS_NONNULL_ASSERT(itPtr != NULL);
-    NS_NONNULL_ASSERT(cPtr != NULL);
-    NS_NONNULL_ASSERT(key != NULL);
-    NS_NONNULL_ASSERT(newPtr != NULL);
+    Ns_ObjvSpec opts[] = {
+        {"-timeout", Ns_ObjvTime,  &timeoutPtr, NULL},
+        {"-expires", Ns_ObjvTime,  &expPtr,     NULL},
+        {"--",       Ns_ObjvBreak, NULL,        NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"cache", ObjvCache,  &cPtr,    clientData},
+        {"dict",  Ns_ObjvObj, &dictObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    args[0].arg = clientData; /* pass non-constant clientData for "cache" */
 
-    cache = cPtr->cache;
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (Tcl_DictObjSize(interp, dictObj, &size) != TCL_OK
+               || Tcl_ListObjGetElements(interp, dictObj, &nelem, &elemv) != TCL_OK) {
+        result = TCL_ERROR;
 
-    if (timeoutPtr == NULL
-        && (cPtr->timeout.sec > 0 || cPtr->timeout.usec > 0)) {
-        timeoutPtr = Ns_AbsoluteTime(&t, &cPtr->timeout);
     } else {
-        timeoutPtr = Ns_AbsoluteTime(&t, timeoutPtr);
-    }
-    Ns_CacheLock(cache);
-    entry = Ns_CacheWaitCreateEntryT(cache, key, newPtr, timeoutPtr, transactionStackPtr);
-    if (unlikely(entry == NULL)) {
-        Ns_CacheUnlock(cache);
-        Tcl_SetErrorCode(itPtr->interp, "NS_TIMEOUT", (char *)0L);
-        Ns_Log(Ns_LogTimeoutDebug, "cache entry creation for key '%s' runs into timeout", key);
+        NsInterp                 *itPtr = clientData;
+        Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
+        Ns_Cache                **partitionv;
+        TCL_SIZE_T                i, j, nkeys = nelem / 2;
+        Ns_Time                   t;
 
-        Ns_TclPrintfResult(itPtr->interp, "timeout waiting for concurrent update: %s", key);
+        assert(cPtr != NULL);
+
+        if (timeoutPtr == NULL
+            && (cPtr->timeout.sec > 0 || cPtr->timeout.usec > 0)) {
+            timeoutPtr = Ns_AbsoluteTime(&t, &cPtr->timeout);
+        } else {
+            timeoutPtr = Ns_AbsoluteTime(&t, timeoutPtr);
+        }
+
+        partitionv = BatchPartitions(cPtr, nkeys, elemv, 2);
+        for (i = 0; i < nkeys && result == TCL_OK; i++) {
+            Ns_Cache *cache = partitionv[i];
+
+            if (cache == NULL) {
+                continue;
+            }
+            Ns_CacheLock(cache);
+            for (j = i; j < nkeys; j++) {
+                if (partitionv[j] == cache) {
+                    const char *key = Tcl_GetString(elemv[j * 2]);
+                    Ns_Entry   *entry;
+                    int         isNew;
+
+                    partitionv[j] = NULL;
+                    entry = Ns_CacheWaitCreateEntryT(cache, key, &isNew, timeoutPtr, transactionStackPtr);
+                    if (unlikely(entry == NULL)) {
+                        Tcl_SetErrorCode(interp, "NS_TIMEOUT", (char *)0L);
+                        Ns_TclPrintfResult(interp, "timeout waiting for concurrent update: %s", key);
+                        result = TCL_ERROR;
+                        break;
+                    }
+                    SetEntry(itPtr, cPtr, entry, elemv[j * 2 + 1], expPtr, NULL, 0);
+                }
+            }
+            Ns_CacheUnlock(cache);
+        }
+        ns_free(partitionv);
     }
-    return entry;
+    return result;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * SetEntry --
+ * EvalManyKey --
  *
- *      Set the value of the cache entry if not above max entry size.
+ *      Compute the value for a single key of "ns_cache_eval_many" by
+ *      calling the command with the key appended. cmdv has room for the
+ *      key as its last element.
  *
  * Results:
- *      None.
+ *      Tcl result code. On success, the value is returned in
+ *      valueObjPtr with an incremented reference count; TCL_BREAK and
+ *      TCL_CONTINUE return no value.
  *
  * Side effects:
- *      None.
+ *      Side effects of the called command.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-SetEntry(NsInterp *itPtr, TclCache *cPtr, Ns_Entry *entry, Tcl_Obj *valObj, Ns_Time *expPtr, int cost)
+static int
+EvalManyKey(Tcl_Interp *interp, TCL_SIZE_T nwords, Tcl_Obj **cmdv, Tcl_Obj *keyObj,
+            Tcl_Obj **valueObjPtr, int *costPtr)
 {
-    const char *bytes;
-    TCL_SIZE_T  len;
-    size_t      valueSize;
+    Ns_Time start, end, diff;
+    int     status;
+
+    cmdv[nwords] = keyObj;
+    Ns_GetTime(&start);
+    status = Tcl_EvalObjv(interp, nwords + 1, cmdv, 0);
+    Ns_GetTime(&end);
+    (void)Ns_DiffTime(&end, &start, &diff);
+
+    *valueObjPtr = NULL;
+    *costPtr = (int)(diff.sec * 1000000 + diff.usec);
+    if (status == TCL_OK || status == TCL_RETURN) {
+        *valueObjPtr = Tcl_GetObjResult(interp);
+        Tcl_IncrRefCount(*valueObjPtr);
+        status = TCL_OK;
+    }
+    return status;
+}
 
-    NS_NONNULL_ASSERT(cPtr != NULL);
-    NS_NONNULL_ASSERT(entry != NULL);
-    NS_NONNULL_ASSERT(valObj != NULL);
 
-    bytes = Tcl_GetStringFromObj(valObj, &len);
-    assert(len >= 0);
-    valueSize = (size_t)len;
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheEvalManyObjCmd --
+ *
+ *      Implements "ns_cache_eval_many". Return the values of multiple keys
+ *      as a dict. The values of missing keys are computed by calling the
+ *      command with the key appended and are stored in the cache. When a
+ *      job queue is specified, the missing values are computed in
+ *      parallel via ns_job.
+ *
+ *      The shared cache is consulted once per partition. Placeholder
+ *      entries are created for all missing keys, such that concurrent
+ *      requests for these keys wait for the computation. Keys computed
+ *      concurrently by other threads are handled after the own
+ *      placeholders are resolved to avoid deadlocks between batches.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Other threads may block waiting for the computation. Errors of
+ *      the command are propagated, already computed values are kept.
+ *
+ *----------------------------------------------------------------------
+ */
+int
+NsTclCacheEvalManyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    TclCache   *cPtr = NULL;
+    Tcl_Obj    *keysObj = NULL, *commandObj = NULL, *queueObj = NULL, **keyv;
+    TCL_SIZE_T  nkeys, nargs = 0;
+    Ns_Time    *timeoutPtr = NULL, *expPtr = NULL;
+    int         status = TCL_OK;
+
+    Ns_ObjvSpec opts[] = {
+        {"-timeout", Ns_ObjvTime,  &timeoutPtr, NULL},
+        {"-expires", Ns_ObjvTime,  &expPtr,     NULL},
+        {"-queue",   Ns_ObjvObj,   &queueObj,   NULL},
+        {"--",       Ns_ObjvBreak, NULL,        NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"cache",   ObjvCache,   &cPtr,       clientData},
+        {"keys",    Ns_ObjvObj,  &keysObj,    NULL},
+        {"command", Ns_ObjvObj,  &commandObj, NULL},
+        {"?args",   Ns_ObjvArgs, &nargs,      NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    args[0].arg = clientData; /* pass non-constant clientData for "cache" */
+
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        status = TCL_ERROR;
+
+    } else if (Tcl_ListObjGetElements(interp, keysObj, &nkeys, &keyv) != TCL_OK) {
+        status = TCL_ERROR;
 
-    if (cPtr->maxEntry > 0u && valueSize > cPtr->maxEntry) {
-        Ns_Log(Notice, "ns_cache %s key '%s': "
-               "entry size %" PRIuz " is larger than the configured maxentry %" PRIuz
-               " value (entry is not cached)",
-               Ns_CacheName(cPtr->cache),
-               Ns_CacheKey(entry),
-               valueSize,
-               cPtr->maxEntry);
-        Ns_CacheDeleteEntry(entry);
     } else {
+        NsInterp                 *itPtr = clientData;
         Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
-        char    *value = ns_malloc(valueSize + 1u);
-        Ns_Time  t;
+        TCL_SIZE_T                i, j, nwords = nargs + 1;
+        Ns_Cache                **partitionv;
+        Ns_Entry                **entryv;
+        Tcl_Obj                 **valuev, **cmdv, *dictObj;
+        int                      *costv;
+        EvalManyState            *statev;
+        bool                      noCache = nsconf.nocache;
+        Ns_Time                   now;
 
-        memcpy(value, bytes, valueSize);
-        value[valueSize] = '\0';
-        if (expPtr == NULL
-            && (cPtr->expires.sec > 0 || cPtr->expires.usec > 0)) {
-            expPtr = Ns_AbsoluteTime(&t, &cPtr->expires);
+        assert(cPtr != NULL);
+
+        /*
+         * Use a private copy of the keys, since the called command might
+         * shimmer the list of keys.
+         */
+        keysObj = Tcl_DuplicateObj(keysObj);
+        Tcl_IncrRefCount(keysObj);
+        (void) Tcl_ListObjGetElements(NULL, keysObj, &nkeys, &keyv);
+
+        cmdv = ns_malloc(((size_t)nwords + 1u) * sizeof(Tcl_Obj *));
+        memcpy(cmdv, objv + ((TCL_SIZE_T)objc - nwords), (size_t)nwords * sizeof(Tcl_Obj *));
+        valuev = ns_calloc((size_t)nkeys + 1u, sizeof(Tcl_Obj *));
+        costv = ns_calloc((size_t)nkeys + 1u, sizeof(int));
+        statev = ns_calloc((size_t)nkeys + 1u, sizeof(EvalManyState));
+        entryv = ns_calloc((size_t)nkeys + 1u, sizeof(Ns_Entry *));
+        partitionv = BatchPartitions(cPtr, nkeys, keyv, 1);
+        Ns_GetTime(&now);
+
+        /*
+         * Lookup the values without locks, when possible.
+         */
+        for (i = 0; i < nkeys && !noCache; i++) {
+            const char *key = Tcl_GetString(keyv[i]);
+
+            if (cPtr->nearSize > 0) {
+                valuev[i] = NearCacheGet(itPtr, cPtr, key);
+            } else if (cPtr->readMostly) {
+                valuev[i] = FindValueLockFree(itPtr, cPtr, key);
+            }
+            if (valuev[i] != NULL) {
+                Tcl_IncrRefCount(valuev[i]);
+                statev[i] = EVAL_MANY_DONE;
+            }
+        }
+
+        /*
+         * Lookup the remaining keys in the shared cache, partition by
+         * partition. Missing keys get placeholder entries, which are kept
+         * for storing the computed values.
+         */
+        for (i = 0; i < nkeys; i++) {
+            Ns_Cache *cache = partitionv[i];
+
+            if (noCache) {
+                statev[i] = EVAL_MANY_OWNED;
+                continue;
+            }
+            if (statev[i] != EVAL_MANY_MISSING) {
+                continue;
+            }
+            Ns_CacheLock(cache);
+            for (j = i; j < nkeys; j++) {
+                if (partitionv[j] == cache && statev[j] == EVAL_MANY_MISSING) {
+                    Ns_Entry *entry;
+                    int       isNew;
+
+                    entry = Ns_CacheCreateEntry(cache, Tcl_GetString(keyv[j]), &isNew);
+                    if (isNew != 0) {
+                        entryv[j] = entry;
+                        statev[j] = EVAL_MANY_OWNED;
+                    } else {
+                        const char *value = Ns_CacheGetValueT(entry, transactionStackPtr);
+
+                        if (value == NULL) {
+                            statev[j] = EVAL_MANY_BUSY;
+                        } else if (Ns_CacheIsStale(entry, &now)) {
+                            Ns_CacheUnsetValue(entry);
+                            entryv[j] = entry;
+                            statev[j] = EVAL_MANY_OWNED;
+                        } else {
+                            valuev[j] = Tcl_NewStringObj(value, (TCL_SIZE_T)Ns_CacheGetSize(entry));
+                            Tcl_IncrRefCount(valuev[j]);
+                            if (cPtr->nearSize > 0) {
+                                NearCachePut(itPtr, cPtr, cache, entry, valuev[j]);
+                            }
+                            statev[j] = EVAL_MANY_DONE;
+                        }
+                    }
+                }
+            }
+            Ns_CacheUnlock(cache);
+        }
+
+        /*
+         * Compute the values of the own placeholders, either sequentially
+         * in this interpreter, or in parallel via the job queue.
+         */
+        if (queueObj == NULL) {
+            for (i = 0; i < nkeys && status == TCL_OK; i++) {
+                if (statev[i] == EVAL_MANY_OWNED) {
+                    status = EvalManyKey(interp, nwords, cmdv, keyv[i], &valuev[i], &costv[i]);
+                    if (status == TCL_BREAK || status == TCL_CONTINUE) {
+                        status = TCL_OK;
+                    }
+                }
+            }
         } else {
-            expPtr = Ns_AbsoluteTime(&t, expPtr);
-#ifdef DEBUG_REL_TIME
-            {
-                Ns_Time tr, *trPtr;
-                //fprintf(stderr, "call Ns_RelativeTime with %p (2)\n", (void*)expPtr);
-                if (expPtr != NULL) {
-                    fprintf(stderr, "call Ns_RelativeTime INPUT  " NS_TIME_FMT "\n",  (int64_t)expPtr->sec, expPtr->usec);
+            Tcl_Obj         **jobv = ns_calloc((size_t)nkeys + 1u, sizeof(Tcl_Obj *));
+            Tcl_Obj          *jobCmdv[4];
+            Tcl_InterpState   errorState = NULL;
+            Ns_Time           start, end, diff;
+
+            Ns_GetTime(&start);
+            jobCmdv[0] = Tcl_NewStringObj("ns_job", 6);
+            jobCmdv[2] = queueObj;
+            Tcl_IncrRefCount(jobCmdv[0]);
+
+            jobCmdv[1] = Tcl_NewStringObj("queue", 5);
+            Tcl_IncrRefCount(jobCmdv[1]);
+            for (i = 0; i < nkeys && status == TCL_OK; i++) {
+                if (statev[i] == EVAL_MANY_OWNED) {
+                    Tcl_Obj *scriptObj = Tcl_NewListObj(nwords, cmdv);
+
+                    Tcl_ListObjAppendElement(NULL, scriptObj, keyv[i]);
+                    jobCmdv[3] = scriptObj;
+                    Tcl_IncrRefCount(scriptObj);
+                    status = Tcl_EvalObjv(interp, 4, jobCmdv, 0);
+                    Tcl_DecrRefCount(scriptObj);
+                    if (status == TCL_OK) {
+                        jobv[i] = Tcl_GetObjResult(interp);
+                        Tcl_IncrRefCount(jobv[i]);
+                    } else {
+                        errorState = Tcl_SaveInterpState(interp, status);
+                    }
                 }
-                trPtr =  Ns_RelativeTime(&tr, expPtr);
-                //fprintf(stderr, "call Ns_RelativeTime with %p (2) -> %p\n", (void*)expPtr, (void*)trPtr);
-                if (trPtr != NULL) {
-                    Ns_Log(Notice, "expires specified absolute " NS_TIME_FMT " relative " NS_TIME_FMT,
-                           (int64_t)expPtr->sec, expPtr->usec,
-                           (int64_t)trPtr->sec, trPtr->usec );
+            }
+            Tcl_DecrRefCount(jobCmdv[1]);
+
+            /*
+             * Wait for all queued jobs, also after an error.
+             */
+            jobCmdv[1] = Tcl_NewStringObj("wait", 4);
+            Tcl_IncrRefCount(jobCmdv[1]);
+            for (i = 0; i < nkeys; i++) {
+                if (jobv[i] != NULL) {
+                    int jobStatus;
+
+                    jobCmdv[3] = jobv[i];
+                    jobStatus = Tcl_EvalObjv(interp, 4, jobCmdv, 0);
+                    Tcl_DecrRefCount(jobv[i]);
+                    if (jobStatus == TCL_OK && errorState == NULL) {
+                        Ns_GetTime(&end);
+                        (void)Ns_DiffTime(&end, &start, &diff);
+                        valuev[i] = Tcl_GetObjResult(interp);
+                        Tcl_IncrRefCount(valuev[i]);
+                        costv[i] = (int)(diff.sec * 1000000 + diff.usec);
+                    } else if (jobStatus != TCL_OK && errorState == NULL) {
+                        errorState = Tcl_SaveInterpState(interp, jobStatus);
+                    }
                 }
             }
-#endif
+            Tcl_DecrRefCount(jobCmdv[1]);
+            Tcl_DecrRefCount(jobCmdv[0]);
+            ns_free(jobv);
+
+            if (errorState != NULL) {
+                status = Tcl_RestoreInterpState(interp, errorState);
+            }
         }
-        if (transactionStackPtr->depth > 0) {
-            int uncommitted = Ns_CacheSetValueExpires(entry, value, valueSize,
-                                                      expPtr, cost, cPtr->maxSize,
-                                                      transactionStackPtr->stack[transactionStackPtr->depth - 1]);
-            transactionStackPtr->uncommitted[transactionStackPtr->depth - 1] += uncommitted;
+
+        /*
+         * Store the computed values in the own placeholders, partition by
+         * partition. Placeholders without values are removed.
+         */
+        for (i = 0; i < nkeys && !noCache; i++) {
+            Ns_Cache *cache = partitionv[i];
+
+            if (statev[i] != EVAL_MANY_OWNED) {
+                continue;
+            }
+            Ns_CacheLock(cache);
+            for (j = i; j < nkeys; j++) {
+                if (partitionv[j] == cache && statev[j] == EVAL_MANY_OWNED) {
+                    if (valuev[j] != NULL) {
+                        SetEntry(itPtr, cPtr, entryv[j], valuev[j], expPtr, NULL, costv[j]);
+                    } else {
+                        Ns_CacheDeleteEntry(entryv[j]);
+                    }
+                    statev[j] = EVAL_MANY_DONE;
+                }
+            }
+            Ns_CacheBroadcast(cache);
+            Ns_CacheUnlock(cache);
+        }
+
+        /*
+         * Handle the keys, which were computed by other threads. Since no
+         * placeholders are held anymore, these can be waited for.
+         */
+        for (i = 0; i < nkeys && status == TCL_OK; i++) {
+            if (statev[i] == EVAL_MANY_BUSY) {
+                Ns_Cache   *cache = partitionv[i];
+                const char *key = Tcl_GetString(keyv[i]);
+                Ns_Entry   *entry;
+                int         isNew;
+
+                entry = CreateEntry(itPtr, cPtr, cache, key, &isNew, timeoutPtr, transactionStackPtr);
+                if (entry == NULL) {
+                    status = TCL_ERROR;
+
+                } else if (isNew == 0) {
+                    valuev[i] = Tcl_NewStringObj(Ns_CacheGetValueT(entry, transactionStackPtr),
+                                                 (TCL_SIZE_T)Ns_CacheGetSize(entry));
+                    Tcl_IncrRefCount(valuev[i]);
+                    Ns_CacheUnlock(cache);
+
+                } else {
+                    Ns_CacheUnlock(cache);
+                    status = EvalManyKey(interp, nwords, cmdv, keyv[i], &valuev[i], &costv[i]);
+                    if (status == TCL_BREAK || status == TCL_CONTINUE) {
+                        status = TCL_OK;
+                    }
+                    Ns_CacheLock(cache);
+                    if (valuev[i] != NULL) {
+                        SetEntry(itPtr, cPtr, entry, valuev[i], expPtr, NULL, costv[i]);
+                    } else {
+                        Ns_CacheDeleteEntry(entry);
+                    }
+                    Ns_CacheBroadcast(cache);
+                    Ns_CacheUnlock(cache);
+                }
+                statev[i] = EVAL_MANY_DONE;
+            }
+        }
+
+        dictObj = (status == TCL_OK ? Tcl_NewDictObj() : NULL);
+        for (i = 0; i < nkeys; i++) {
+            if (valuev[i] != NULL) {
+                if (dictObj != NULL) {
+                    (void) Tcl_DictObjPut(NULL, dictObj, keyv[i], valuev[i]);
+                }
+                Tcl_DecrRefCount(valuev[i]);
+            }
+        }
+        if (dictObj != NULL) {
+            Tcl_SetObjResult(interp, dictObj);
+        }
+        ns_free(partitionv);
+        ns_free(statev);
+        ns_free(entryv);
+        ns_free(costv);
+        ns_free(valuev);
+        ns_free(cmdv);
+        Tcl_DecrRefCount(keysObj);
+    }
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheStatsObjCmd --
+ *
+ *      Implements "ns_ cache stats".  Returns statistics in form of a
+ *      dict from the specified cache. When the switch "-contents" is
+ *      provided, entries for all cache entries are returned, containing the
+ *      key, size, hits and expire time for each entry in the cache. The
+ *      switch "-reset" can be used to reset the cache statistics.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclCacheStatsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    TclCache   *cPtr = NULL;
+    int         contents = (int)NS_FALSE, reset = (int)NS_FALSE, result = TCL_OK;
+    Ns_ObjvSpec opts[] = {
+        {"-contents", Ns_ObjvBool,  &contents, INT2PTR(NS_TRUE)},
+        {"-reset",    Ns_ObjvBool,  &reset,    INT2PTR(NS_TRUE)},
+        {"--",        Ns_ObjvBreak, NULL,      NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec args[] = {
+        {"cache", ObjvCache, &cPtr, clientData},
+        {NULL, NULL, NULL, NULL}
+    };
+    args[0].arg = clientData; /* pass non-constant clientData for "cache" */
+
+    if (Ns_ParseObjv(opts, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Ns_DString      ds;
+        Ns_Cache       *cache;
+
+        assert(cPtr != NULL);
+
+        cache = cPtr->cache;
+        Ns_DStringInit(&ds);
+
+        Ns_CacheLock(cache);
+        if (contents != 0) {
+            Ns_CacheSearch  search;
+            const Ns_Entry *entry;
+
+            entry = Ns_CacheFirstEntry(cache, &search);
+            while (entry != NULL) {
+                Tcl_DString    entryDs;
+                const char    *key     = Ns_CacheKey(entry);
+                size_t         size    = Ns_CacheGetSize(entry);
+                size_t         reuse   = Ns_CacheGetReuse(entry);
+                const Ns_Time *timePtr = Ns_CacheGetExpirey(entry);
+
+                Ns_DStringInit(&entryDs);
+
+                Tcl_DStringAppendElement(&entryDs, key);
+                if (timePtr->usec == 0) {
+                    Ns_DStringPrintf(&entryDs, " %" PRIdz " %" PRIdz " %" PRId64,
+                                     size, reuse, (int64_t) timePtr->sec);
+                } else {
+                    Ns_DStringPrintf(&entryDs, " %" PRIdz " %" PRIdz " %" PRId64 ":%ld",
+                                     size, reuse, (int64_t) timePtr->sec, timePtr->usec);
+                }
+                Tcl_DStringAppendElement(&ds, entryDs.string);
+                Ns_DStringFree(&entryDs);
+
+                entry = Ns_CacheNextEntry(&search);
+            }
+
         } else {
-            (void) Ns_CacheSetValueExpires(entry, value, valueSize,
-                                           expPtr, cost, cPtr->maxSize, 0u);
+            (void) Ns_CacheStats(cache, &ds);
+        }
+        if (reset != 0) {
+            Ns_CacheResetStats(cache);
         }
+        Ns_CacheUnlock(cache);
 
+        Tcl_DStringResult(interp, &ds);
     }
+
+    return result;
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindValueLockFree --
+ *
+ *      Lookup a value of a read-mostly cache without locking. Inside a
+ *      cache transaction, the uncommitted values have to be considered,
+ *      so the lock-free lookup is not used.
+ *
+ * Results:
+ *      Tcl_Obj with the value or NULL, when the value has to be looked
+ *      up under the cache lock.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+FindValueLockFree(const NsInterp *itPtr, const TclCache *cPtr, const char *key)
+{
+    Tcl_Obj *resultObj = NULL;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    if (itPtr->cacheTransactionStack.depth == 0u) {
+        Tcl_DString ds;
+
+        Tcl_DStringInit(&ds);
+        if (Ns_CacheFindValueLockFree(cPtr->cache, key, &ds)) {
+            resultObj = Tcl_NewStringObj(ds.string, ds.length);
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return resultObj;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NearCacheGet --
+ *
+ *      Lookup a value in the near cache of the interpreter for the
+ *      specified cache. The lookup needs neither a lock nor memory
+ *      allocations. Near caches are not used inside cache transactions.
+ *
+ * Results:
+ *      Tcl_Obj of the value or NULL, when not found or not valid
+ *      anymore.
+ *
+ * Side effects:
+ *      A hit is recorded in the cache, such that it is visible in the
+ *      statistics and to the eviction policy.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+NearCacheGet(NsInterp *itPtr, const TclCache *cPtr, const char *key)
+{
+    Tcl_Obj             *resultObj = NULL;
+    const Tcl_HashEntry *hPtr;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+
+    if (itPtr->cacheTransactionStack.depth == 0u
+        && (hPtr = Tcl_FindHashEntry(&itPtr->nearCaches, (const char *)cPtr)) != NULL) {
+        NearCache *nearPtr = Tcl_GetHashValue(hPtr);
+
+        hPtr = Tcl_FindHashEntry(&nearPtr->entries, key);
+        if (hPtr != NULL) {
+            const NearEntry *nePtr = Tcl_GetHashValue(hPtr);
+
+            if (nePtr->generation == Ns_CacheGetGeneration(nePtr->cache)) {
+                Ns_Time now;
+
+                if (nePtr->validUntil.sec == 0) {
+                    resultObj = nePtr->valueObj;
+                } else {
+                    Ns_GetTime(&now);
+                    if (Ns_DiffTime(&nePtr->validUntil, &now, NULL) > 0) {
+                        resultObj = nePtr->valueObj;
+                    }
+                }
+                if (resultObj != NULL) {
+                    Ns_CacheRecordNearHit(cPtr->cache, key);
+                }
+            }
+        }
+    }
+    return resultObj;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NearCachePut --
+ *
+ *      Keep the value of a cache entry in the near cache of the
+ *      interpreter. Called with the cache (partition) locked, such that
+ *      the generation of the partition corresponds to the value. The
+ *      value is valid until the entry expires or gets stale.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The near cache is created on first use, the oldest entry might
+ *      be replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+NearCachePut(NsInterp *itPtr, const TclCache *cPtr, const Ns_Cache *cache,
+             const Ns_Entry *entry, Tcl_Obj *valueObj)
+{
+    uintptr_t      generation;
+    const Ns_Time *expiresPtr, *revalidatePtr;
+    Ns_Time        validUntil, now;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(entry != NULL);
+    NS_NONNULL_ASSERT(valueObj != NULL);
+
+    generation = Ns_CacheGetGeneration(cache);
+    expiresPtr = Ns_CacheGetExpirey(entry);
+    revalidatePtr = Ns_CacheGetRevalidate(entry);
+
+    validUntil = *expiresPtr;
+    if (revalidatePtr->sec > 0
+        && (validUntil.sec == 0 || Ns_DiffTime(revalidatePtr, &validUntil, NULL) < 0)) {
+        validUntil = *revalidatePtr;
+    }
+    Ns_GetTime(&now);
+
+    if (itPtr->cacheTransactionStack.depth == 0u
+        && generation != 0u
+        && (validUntil.sec == 0 || Ns_DiffTime(&validUntil, &now, NULL) > 0)) {
+        Tcl_HashEntry *hPtr;
+        NearCache     *nearPtr;
+        NearEntry     *nePtr;
+        int            isNew;
+
+        hPtr = Tcl_CreateHashEntry(&itPtr->nearCaches, (const char *)cPtr, &isNew);
+        if (isNew != 0) {
+            nearPtr = ns_calloc(1u, sizeof(NearCache));
+            nearPtr->size = cPtr->nearSize;
+            nearPtr->slots = ns_calloc((size_t)nearPtr->size, sizeof(Tcl_HashEntry *));
+            Tcl_InitHashTable(&nearPtr->entries, TCL_STRING_KEYS);
+            Tcl_SetHashValue(hPtr, nearPtr);
+        } else {
+            nearPtr = Tcl_GetHashValue(hPtr);
+        }
+
+        hPtr = Tcl_CreateHashEntry(&nearPtr->entries, Ns_CacheKey(entry), &isNew);
+        if (isNew != 0) {
+            Tcl_HashEntry *oldPtr = nearPtr->slots[nearPtr->next];
+
+            if (oldPtr != NULL) {
+                /*
+                 * Replace the oldest entry.
+                 */
+                nePtr = Tcl_GetHashValue(oldPtr);
+                Tcl_DecrRefCount(nePtr->valueObj);
+                Tcl_DeleteHashEntry(oldPtr);
+            } else {
+                nePtr = ns_malloc(sizeof(NearEntry));
+            }
+            nePtr->slot = nearPtr->next;
+            nearPtr->slots[nearPtr->next] = hPtr;
+            nearPtr->next = (nearPtr->next + 1) % nearPtr->size;
+            Tcl_SetHashValue(hPtr, nePtr);
+        } else {
+            nePtr = Tcl_GetHashValue(hPtr);
+            Tcl_DecrRefCount(nePtr->valueObj);
+        }
+        nePtr->valueObj = valueObj;
+        Tcl_IncrRefCount(valueObj);
+        nePtr->cache = cache;
+        nePtr->generation = generation;
+        nePtr->validUntil = validUntil;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheFreeNearCaches --
+ *
+ *      Free the near caches of an interpreter.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Memory freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTclCacheFreeNearCaches(NsInterp *itPtr)
+{
+    Tcl_HashSearch  search;
+    Tcl_HashEntry  *hPtr;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+
+    for (hPtr = Tcl_FirstHashEntry(&itPtr->nearCaches, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        NearCache      *nearPtr = Tcl_GetHashValue(hPtr);
+        Tcl_HashSearch  entrySearch;
+        Tcl_HashEntry  *entryPtr;
+
+        for (entryPtr = Tcl_FirstHashEntry(&nearPtr->entries, &entrySearch);
+             entryPtr != NULL;
+             entryPtr = Tcl_NextHashEntry(&entrySearch)) {
+            NearEntry *nePtr = Tcl_GetHashValue(entryPtr);
+
+            Tcl_DecrRefCount(nePtr->valueObj);
+            ns_free(nePtr);
+        }
+        Tcl_DeleteHashTable(&nearPtr->entries);
+        ns_free(nearPtr->slots);
+        ns_free(nearPtr);
+    }
+    Tcl_DeleteHashTable(&itPtr->nearCaches);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CreateEntry --
+ *
+ *      Lock the cache (or the partition of the cache responsible for the
+ *      key) and create a new entry or return existing entry, waiting up
+ *      to timeout seconds for another thread to complete an update.
+ *
+ * Results:
+ *      Pointer to entry, or NULL on timeout.
+ *
+ * Side effects:
+ *      Cache will be left locked if function returns non-NULL entry.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_Entry *
+CreateEntry(const NsInterp *itPtr, TclCache *cPtr, Ns_Cache *cache, const char *key, int *newPtr,
+            Ns_Time *timeoutPtr, const Ns_CacheTransactionStack *transactionStackPtr)
+{
+    Ns_Entry *entry;
+    Ns_Time   t;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(cache != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(newPtr != NULL);
+
+    if (timeoutPtr == NULL
+        && (cPtr->timeout.sec > 0 || cPtr->timeout.usec > 0)) {
+        timeoutPtr = Ns_AbsoluteTime(&t, &cPtr->timeout);
+    } else {
+        timeoutPtr = Ns_AbsoluteTime(&t, timeoutPtr);
+    }
+    Ns_CacheLock(cache);
+    entry = Ns_CacheWaitCreateEntryT(cache, key, newPtr, timeoutPtr, transactionStackPtr);
+    if (unlikely(entry == NULL)) {
+        Ns_CacheUnlock(cache);
+        Tcl_SetErrorCode(itPtr->interp, "NS_TIMEOUT", (char *)0L);
+        Ns_Log(Ns_LogTimeoutDebug, "cache entry creation for key '%s' runs into timeout", key);
+
+        Ns_TclPrintfResult(itPtr->interp, "timeout waiting for concurrent update: %s", key);
+    }
+    return entry;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetEntry --
+ *
+ *      Set the value of the cache entry if not above max entry size.
+ *      When a stale time is provided, the entry is kept for this time
+ *      after the expiry, but the value is stale.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SetEntry(NsInterp *itPtr, TclCache *cPtr, Ns_Entry *entry, Tcl_Obj *valObj, Ns_Time *expPtr,
+         const Ns_Time *staleTtlPtr, int cost)
+{
+    const char *bytes;
+    TCL_SIZE_T  len;
+    size_t      valueSize;
+
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(entry != NULL);
+    NS_NONNULL_ASSERT(valObj != NULL);
+
+    bytes = Tcl_GetStringFromObj(valObj, &len);
+    assert(len >= 0);
+    valueSize = (size_t)len;
+
+    if (cPtr->maxEntry > 0u && valueSize > cPtr->maxEntry) {
+        Ns_Log(Notice, "ns_cache %s key '%s': "
+               "entry size %" PRIuz " is larger than the configured maxentry %" PRIuz
+               " value (entry is not cached)",
+               Ns_CacheName(cPtr->cache),
+               Ns_CacheKey(entry),
+               valueSize,
+               cPtr->maxEntry);
+        Ns_CacheDeleteEntry(entry);
+    } else {
+        Ns_CacheTransactionStack *transactionStackPtr = &itPtr->cacheTransactionStack;
+        char    *value = ns_malloc(valueSize + 1u);
+        Ns_Time  t, staleExpires, *revalidatePtr = NULL;
+
+        memcpy(value, bytes, valueSize);
+        value[valueSize] = '\0';
+        if (expPtr == NULL
+            && (cPtr->expires.sec > 0 || cPtr->expires.usec > 0)) {
+            expPtr = Ns_AbsoluteTime(&t, &cPtr->expires);
+        } else {
+            expPtr = Ns_AbsoluteTime(&t, expPtr);
+#ifdef DEBUG_REL_TIME
+            {
+                Ns_Time tr, *trPtr;
+                //fprintf(stderr, "call Ns_RelativeTime with %p (2)\n", (void*)expPtr);
+                if (expPtr != NULL) {
+                    fprintf(stderr, "call Ns_RelativeTime INPUT  " NS_TIME_FMT "\n",  (int64_t)expPtr->sec, expPtr->usec);
+                }
+                trPtr =  Ns_RelativeTime(&tr, expPtr);
+                //fprintf(stderr, "call Ns_RelativeTime with %p (2) -> %p\n", (void*)expPtr, (void*)trPtr);
+                if (trPtr != NULL) {
+                    Ns_Log(Notice, "expires specified absolute " NS_TIME_FMT " relative " NS_TIME_FMT,
+                           (int64_t)expPtr->sec, expPtr->usec,
+                           (int64_t)trPtr->sec, trPtr->usec );
+                }
+            }
+#endif
+        }
+        if (staleTtlPtr != NULL && expPtr != NULL) {
+            /*
+             * The entry expires after the stale time, the value gets
+             * stale at the specified expiry.
+             */
+            revalidatePtr = expPtr;
+            staleExpires = *expPtr;
+            Ns_IncrTime(&staleExpires, staleTtlPtr->sec, staleTtlPtr->usec);
+            expPtr = &staleExpires;
+        }
+        if (transactionStackPtr->depth > 0) {
+            int uncommitted = Ns_CacheSetValueExpires(entry, value, valueSize,
+                                                      expPtr, cost, cPtr->maxSize,
+                                                      transactionStackPtr->stack[transactionStackPtr->depth - 1]);
+            transactionStackPtr->uncommitted[transactionStackPtr->depth - 1] += uncommitted;
+        } else {
+            (void) Ns_CacheSetValueExpires(entry, value, valueSize,
+                                           expPtr, cost, cPtr->maxSize, 0u);
+        }
+        if (revalidatePtr != NULL) {
+            Ns_CacheSetRevalidate(entry, revalidatePtr);
+        }
+
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * QueueRefresh --
+ *
+ *      Queue the refresh of a stale cache value and start the refresher
+ *      thread of the server, when it is not running. During shutdown,
+ *      the refresh is dropped and the stale value is kept.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      May create a thread, may join the previous refresher thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+QueueRefresh(NsServer *servPtr, TclCache *cPtr, const char *key, Tcl_Obj *scriptObj,
+             const Ns_Time *expPtr, const Ns_Time *staleTtlPtr)
+{
+    CacheRefresh  *refreshPtr, **nextPtrPtr;
+    const char    *script;
+    TCL_SIZE_T     scriptLength;
+    size_t         keyLength;
+    Ns_Thread      exitedThread = NULL;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(scriptObj != NULL);
+    NS_NONNULL_ASSERT(staleTtlPtr != NULL);
+
+    script = Tcl_GetStringFromObj(scriptObj, &scriptLength);
+    keyLength = strlen(key);
+
+    refreshPtr = ns_calloc(1u, sizeof(CacheRefresh) + keyLength);
+    refreshPtr->cPtr = cPtr;
+    refreshPtr->script = ns_strncopy(script, scriptLength);
+    if (expPtr != NULL) {
+        refreshPtr->expires = *expPtr;
+        refreshPtr->hasExpires = NS_TRUE;
+    }
+    refreshPtr->staleTtl = *staleTtlPtr;
+    memcpy(refreshPtr->key, key, keyLength + 1u);
+
+    Ns_MutexLock(&servPtr->tcl.cacheRefresh.lock);
+    if (servPtr->tcl.cacheRefresh.stop) {
+        Ns_MutexUnlock(&servPtr->tcl.cacheRefresh.lock);
+        ns_free(refreshPtr->script);
+        ns_free(refreshPtr);
+        return;
+    }
+    nextPtrPtr = &servPtr->tcl.cacheRefresh.firstPtr;
+    while (*nextPtrPtr != NULL) {
+        nextPtrPtr = &(*nextPtrPtr)->nextPtr;
+    }
+    *nextPtrPtr = refreshPtr;
+    if (!servPtr->tcl.cacheRefresh.running) {
+        /*
+         * The previous refresher thread has left its loop; it is joined
+         * below, outside of the lock.
+         */
+        exitedThread = servPtr->tcl.cacheRefresh.thread;
+        servPtr->tcl.cacheRefresh.running = NS_TRUE;
+        Ns_ThreadCreate(CacheRefreshThread, servPtr, 0, &servPtr->tcl.cacheRefresh.thread);
+    }
+    Ns_MutexUnlock(&servPtr->tcl.cacheRefresh.lock);
+
+    if (exitedThread != NULL) {
+        Ns_ThreadJoin(&exitedThread, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheRefreshThread --
+ *
+ *      Process the queued refreshes of stale cache values of a
+ *      server. The thread exits, when the queue is empty or the server
+ *      is shutting down; in the latter case, the pending refreshes are
+ *      dropped.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Cache values are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheRefreshThread(void *arg)
+{
+    NsServer     *servPtr = arg;
+    CacheRefresh *refreshPtr;
+
+    Ns_ThreadSetName("-cacherefresh:%s-", servPtr->server);
+
+    Ns_MutexLock(&servPtr->tcl.cacheRefresh.lock);
+    while ((refreshPtr = servPtr->tcl.cacheRefresh.firstPtr) != NULL) {
+        servPtr->tcl.cacheRefresh.firstPtr = refreshPtr->nextPtr;
+        if (!servPtr->tcl.cacheRefresh.stop) {
+            Ns_MutexUnlock(&servPtr->tcl.cacheRefresh.lock);
+            RefreshEntry(servPtr, refreshPtr);
+            Ns_MutexLock(&servPtr->tcl.cacheRefresh.lock);
+        }
+        ns_free(refreshPtr->script);
+        ns_free(refreshPtr);
+    }
+    servPtr->tcl.cacheRefresh.running = NS_FALSE;
+    Ns_CondBroadcast(&servPtr->tcl.cacheRefresh.cond);
+    Ns_MutexUnlock(&servPtr->tcl.cacheRefresh.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheRefreshShutdown --
+ *
+ *      Shutdown callback stopping the refresher thread of a server.
+ *      The first call (toPtr == NULL) tells the thread to stop, the
+ *      second call waits for the thread to finish and joins it.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Pending refreshes are dropped, thread joined.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTclCacheRefreshShutdown(const Ns_Time *toPtr, void *arg)
+{
+    NsServer     *servPtr = arg;
+    Ns_Thread     thread = NULL;
+    Ns_ReturnCode status = NS_OK;
+
+    NS_NONNULL_ASSERT(arg != NULL);
+
+    Ns_MutexLock(&servPtr->tcl.cacheRefresh.lock);
+    if (toPtr == NULL) {
+        servPtr->tcl.cacheRefresh.stop = NS_TRUE;
+    } else {
+        while (status == NS_OK && servPtr->tcl.cacheRefresh.running) {
+            status = Ns_CondTimedWait(&servPtr->tcl.cacheRefresh.cond,
+                                      &servPtr->tcl.cacheRefresh.lock, toPtr);
+        }
+        if (status == NS_OK) {
+            thread = servPtr->tcl.cacheRefresh.thread;
+            servPtr->tcl.cacheRefresh.thread = NULL;
+        }
+    }
+    Ns_MutexUnlock(&servPtr->tcl.cacheRefresh.lock);
+
+    if (status != NS_OK) {
+        Ns_Log(Warning, "ns_cache: timeout waiting for refresher thread of server %s",
+               servPtr->server);
+    } else if (thread != NULL) {
+        Ns_ThreadJoin(&thread, NULL);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RefreshEntry --
+ *
+ *      Recompute a stale cache value by evaluating the script at global
+ *      level in an interpreter of the server. When the script fails,
+ *      the error is logged and the stale value is kept; a later
+ *      request will trigger another refresh.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on the script.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RefreshEntry(NsServer *servPtr, CacheRefresh *refreshPtr)
+{
+    Tcl_Interp *interp;
+    Ns_Cache   *cache;
+    Ns_Entry   *entry;
+    Ns_Time     start, end, diff;
+    int         status;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(refreshPtr != NULL);
+
+    cache = Ns_CachePartition(refreshPtr->cPtr->cache, refreshPtr->key);
+    interp = Ns_TclAllocateInterp(servPtr->server);
+    if (interp == NULL || Ns_InfoShutdownPending()) {
+        status = TCL_ERROR;
+    } else {
+        Ns_GetTime(&start);
+        status = Tcl_EvalEx(interp, refreshPtr->script, TCL_INDEX_NONE, TCL_EVAL_GLOBAL);
+        if (status == TCL_RETURN) {
+            status = TCL_OK;
+        }
+        Ns_GetTime(&end);
+        (void)Ns_DiffTime(&end, &start, &diff);
+    }
+
+    Ns_CacheLock(cache);
+    entry = Ns_CacheFindEntry(cache, refreshPtr->key);
+    if (entry != NULL) {
+        Ns_Time now;
+
+        Ns_GetTime(&now);
+        if (!Ns_CacheIsStale(entry, &now)) {
+            /*
+             * The value was updated or removed in the meantime.
+             */
+        } else if (status == TCL_OK) {
+            SetEntry(NsGetInterpData(interp), refreshPtr->cPtr, entry, Tcl_GetObjResult(interp),
+                     refreshPtr->hasExpires ? &refreshPtr->expires : NULL,
+                     &refreshPtr->staleTtl,
+                     (int)(diff.sec * 1000000 + diff.usec));
+            Ns_CacheBroadcast(cache);
+        } else {
+            /*
+             * Keep the stale value and allow a new refresh.
+             */
+            Ns_CacheSetRevalidate(entry, &now);
+        }
+    }
+    Ns_CacheUnlock(cache);
+
+    if (interp != NULL) {
+        if (status != TCL_OK && status != TCL_BREAK && status != TCL_CONTINUE) {
+            Tcl_DString ds;
+
+            Tcl_DStringInit(&ds);
+            Ns_DStringPrintf(&ds, "\n    (refreshing stale value of ns_cache %s key '%s')",
+                             Ns_CacheName(refreshPtr->cPtr->cache), refreshPtr->key);
+            (void) Ns_TclLogErrorInfo(interp, ds.string);
+            Tcl_DStringFree(&ds);
+        }
+        Ns_TclDeAllocateInterp(interp);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheSnapshotObjCmd --
+ *
+ *      Implements "ns_cache_snapshot save|load". Saves the entries of a
+ *      cache to a snapshot file, or loads the entries from such a
+ *      file.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Depends on subcommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+NsTclCacheSnapshotObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"load", CacheSnapshotLoadObjCmd},
+        {"save", CacheSnapshotSaveObjCmd},
+        {NULL,   NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheSnapshotSaveObjCmd, CacheSnapshotLoadObjCmd --
+ *
+ *      Implements "ns_cache_snapshot save" and "ns_cache_snapshot
+ *      load".
+ *
+ * Results:
+ *      Tcl result, the number of saved or loaded entries.
+ *
+ * Side effects:
+ *      Snapshot file written or cache entries created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CacheSnapshotSaveObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    TclCache   *cPtr = NULL;
+    char       *fileName = NULL;
+    int         result = TCL_OK;
+    Ns_ObjvSpec args[] = {
+        {"cache",    ObjvCache,     &cPtr,     clientData},
+        {"filename", Ns_ObjvString, &fileName, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+    } else {
+        Tcl_DString ds;
+        size_t      count = 0u;
+
+        Tcl_DStringInit(&ds);
+        if (CacheSnapshotSave(cPtr, fileName, &ds, &count) != NS_OK) {
+            Tcl_DStringResult(interp, &ds);
+            result = TCL_ERROR;
+        } else {
+            Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)count));
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
+static int
+CacheSnapshotLoadObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    TclCache   *cPtr = NULL;
+    char       *fileName = NULL;
+    int         result = TCL_OK;
+    Ns_ObjvSpec args[] = {
+        {"cache",    ObjvCache,     &cPtr,     clientData},
+        {"filename", Ns_ObjvString, &fileName, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+    } else {
+        Tcl_DString ds;
+        size_t      count = 0u;
+
+        Tcl_DStringInit(&ds);
+        if (CacheSnapshotLoad(cPtr, fileName, &ds, &count) != NS_OK) {
+            Tcl_DStringResult(interp, &ds);
+            result = TCL_ERROR;
+        } else {
+            Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)count));
+        }
+        Tcl_DStringFree(&ds);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheSnapshotSave --
+ *
+ *      Write the committed and not expired entries of a cache to a
+ *      snapshot file. The entries are collected under the cache lock,
+ *      the file is written afterwards to a temporary file, which is
+ *      renamed to the final name.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, in the latter case with an error message in
+ *      errorPtr.
+ *
+ * Side effects:
+ *      File written.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+CacheSnapshotSave(TclCache *cPtr, const char *fileName, Tcl_DString *errorPtr, size_t *countPtr)
+{
+    Ns_ReturnCode   status = NS_OK;
+    Tcl_DString     ds, tmpDs;
+    SnapshotHeader  header;
+    Ns_CacheSearch  search;
+    const Ns_Entry *entry;
+    int             fd;
+
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(fileName != NULL);
+    NS_NONNULL_ASSERT(errorPtr != NULL);
+    NS_NONNULL_ASSERT(countPtr != NULL);
+
+    Tcl_DStringInit(&ds);
+    Tcl_DStringInit(&tmpDs);
+    Tcl_DStringSetLength(&ds, (TCL_SIZE_T)sizeof(header));
+
+    *countPtr = 0u;
+    Ns_CacheLock(cPtr->cache);
+    for (entry = Ns_CacheFirstEntry(cPtr->cache, &search);
+         entry != NULL;
+         entry = Ns_CacheNextEntry(&search)) {
+        SnapshotRecord  record;
+        const char     *key = Ns_CacheKey(entry);
+        const Ns_Time  *expiresPtr = Ns_CacheGetExpirey(entry);
+        const Ns_Time  *revalidatePtr = Ns_CacheGetRevalidate(entry);
+
+        memset(&record, 0, sizeof(record));
+        record.keyLength = (uint32_t)strlen(key);
+        record.valueLength = (uint32_t)Ns_CacheGetSize(entry);
+        record.expiresSec = (int64_t)expiresPtr->sec;
+        record.expiresUsec = (int32_t)expiresPtr->usec;
+        record.revalidateSec = (int64_t)revalidatePtr->sec;
+        record.revalidateUsec = (int32_t)revalidatePtr->usec;
+        record.cost = (int32_t)Ns_CacheGetCost(entry);
+
+        Tcl_DStringAppend(&ds, (const char *)&record, (TCL_SIZE_T)sizeof(record));
+        Tcl_DStringAppend(&ds, key, (TCL_SIZE_T)record.keyLength);
+        Tcl_DStringAppend(&ds, Ns_CacheGetValue(entry), (TCL_SIZE_T)record.valueLength);
+        ++(*countPtr);
+    }
+    Ns_CacheUnlock(cPtr->cache);
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.byteOrder = 0x01020304u;
+    header.count = (uint32_t)*countPtr;
+    memcpy(ds.string, &header, sizeof(header));
+
+    Tcl_DStringAppend(&tmpDs, fileName, TCL_INDEX_NONE);
+    Tcl_DStringAppend(&tmpDs, ".tmp", 4);
+    fd = ns_open(tmpDs.string, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0644);
+    if (fd == NS_INVALID_FD) {
+        Ns_DStringPrintf(errorPtr, "could not open \"%s\": %s", tmpDs.string, strerror(errno));
+        status = NS_ERROR;
+    } else {
+        ssize_t written = ns_write(fd, ds.string, (size_t)ds.length);
+
+        if (ns_close(fd) != 0 || written != (ssize_t)ds.length) {
+            Ns_DStringPrintf(errorPtr, "could not write \"%s\": %s", tmpDs.string, strerror(errno));
+            (void) unlink(tmpDs.string);
+            status = NS_ERROR;
+        } else if (rename(tmpDs.string, fileName) != 0) {
+            Ns_DStringPrintf(errorPtr, "could not rename \"%s\": %s", tmpDs.string, strerror(errno));
+            (void) unlink(tmpDs.string);
+            status = NS_ERROR;
+        }
+    }
+    Tcl_DStringFree(&tmpDs);
+    Tcl_DStringFree(&ds);
+
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheSnapshotLoad --
+ *
+ *      Load the entries from a snapshot file into a cache. The file is
+ *      mapped into memory. Entries expired in the meantime, values
+ *      larger than the maxentry setting and keys having already a
+ *      value in the cache are skipped.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, in the latter case with an error message in
+ *      errorPtr.
+ *
+ * Side effects:
+ *      Cache entries are created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+CacheSnapshotLoad(TclCache *cPtr, const char *fileName, Tcl_DString *errorPtr, size_t *countPtr)
+{
+    Ns_ReturnCode   status = NS_OK;
+    struct stat     st;
+    FileMap         fmap;
+    SnapshotHeader  header;
+
+    NS_NONNULL_ASSERT(cPtr != NULL);
+    NS_NONNULL_ASSERT(fileName != NULL);
+    NS_NONNULL_ASSERT(errorPtr != NULL);
+    NS_NONNULL_ASSERT(countPtr != NULL);
+
+    *countPtr = 0u;
+    if (stat(fileName, &st) != 0) {
+        Ns_DStringPrintf(errorPtr, "could not access \"%s\": %s", fileName, strerror(errno));
+        status = NS_ERROR;
+
+    } else if ((size_t)st.st_size < sizeof(header)
+               || NsMemMap(fileName, (size_t)st.st_size, NS_MMAP_READ, &fmap) != NS_OK) {
+        Ns_DStringPrintf(errorPtr, "could not read snapshot file \"%s\"", fileName);
+        status = NS_ERROR;
+
+    } else {
+        const char *p = fmap.addr, *end = p + fmap.size;
+        uint32_t    i;
+        Ns_Time     now;
+
+        memcpy(&header, p, sizeof(header));
+        p += sizeof(header);
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0
+            || header.byteOrder != 0x01020304u) {
+            Ns_DStringPrintf(errorPtr, "\"%s\" is not a cache snapshot file of this architecture", fileName);
+            status = NS_ERROR;
+        }
+
+        Ns_GetTime(&now);
+        for (i = 0u; status == NS_OK && i < header.count; i++) {
+            SnapshotRecord record;
+            Tcl_DString    keyDs;
+            Ns_Time        expires;
+
+            if ((size_t)(end - p) < sizeof(record)) {
+                status = NS_ERROR;
+                break;
+            }
+            memcpy(&record, p, sizeof(record));
+            p += sizeof(record);
+            if ((size_t)(end - p) < (size_t)record.keyLength + (size_t)record.valueLength) {
+                status = NS_ERROR;
+                break;
+            }
+            expires.sec = (time_t)record.expiresSec;
+            expires.usec = (long)record.expiresUsec;
+
+            if ((expires.sec > 0 && Ns_DiffTime(&expires, &now, NULL) < 0)
+                || (cPtr->maxEntry > 0u && (size_t)record.valueLength > cPtr->maxEntry)) {
+                /*
+                 * Expired in the meantime, or too large.
+                 */
+            } else {
+                Ns_Cache *cache;
+                Ns_Entry *entry;
+                int       isNew;
+
+                Tcl_DStringInit(&keyDs);
+                Tcl_DStringAppend(&keyDs, p, (TCL_SIZE_T)record.keyLength);
+                cache = Ns_CachePartition(cPtr->cache, keyDs.string);
+
+                Ns_CacheLock(cache);
+                entry = Ns_CacheCreateEntry(cache, keyDs.string, &isNew);
+                if (isNew != 0) {
+                    char *value = ns_malloc((size_t)record.valueLength + 1u);
+
+                    memcpy(value, p + record.keyLength, (size_t)record.valueLength);
+                    value[record.valueLength] = '\0';
+                    (void) Ns_CacheSetValueExpires(entry, value, (size_t)record.valueLength,
+                                                   expires.sec > 0 ? &expires : NULL,
+                                                   (int)record.cost, cPtr->maxSize, 0u);
+                    if (record.revalidateSec > 0) {
+                        Ns_Time revalidate;
+
+                        revalidate.sec = (time_t)record.revalidateSec;
+                        revalidate.usec = (long)record.revalidateUsec;
+                        Ns_CacheSetRevalidate(entry, &revalidate);
+                    }
+                    ++(*countPtr);
+                }
+                Ns_CacheUnlock(cache);
+                Tcl_DStringFree(&keyDs);
+            }
+            p += record.keyLength + record.valueLength;
+        }
+        if (status != NS_OK && errorPtr->length == 0) {
+            Ns_DStringPrintf(errorPtr, "snapshot file \"%s\" is truncated", fileName);
+        }
+        NsMemUmap(&fmap);
+    }
+    return status;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheSnapshotFileName --
+ *
+ *      Determine the name of the snapshot file of a cache in the
+ *      configured snapshot directory. Path separators in the cache
+ *      name are replaced.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      File name appended to dsPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheSnapshotFileName(const NsServer *servPtr, const char *cacheName, Tcl_DString *dsPtr)
+{
+    TCL_SIZE_T i, start;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(cacheName != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    Tcl_DStringAppend(dsPtr, servPtr->tcl.cacheSnapshotDir, TCL_INDEX_NONE);
+    Tcl_DStringAppend(dsPtr, "/", 1);
+    start = dsPtr->length;
+    Tcl_DStringAppend(dsPtr, cacheName, TCL_INDEX_NONE);
+    for (i = start; i < dsPtr->length; i++) {
+        if (dsPtr->string[i] == '/' || dsPtr->string[i] == '\\') {
+            dsPtr->string[i] = '_';
+        }
+    }
+    Tcl_DStringAppend(dsPtr, ".snapshot", 9);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheSnapshotLoadThread --
+ *
+ *      Load the snapshot of a newly created cache in the background.
+ *      The thread is joined by NsTclCacheSnapshotShutdown().
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Cache entries are created.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheSnapshotLoadThread(void *arg)
+{
+    SnapshotLoad *loadPtr = arg;
+    Tcl_DString   ds;
+    size_t        count;
+
+    Ns_ThreadSetName("-cachesnapshot-");
+
+    Tcl_DStringInit(&ds);
+    if (CacheSnapshotLoad(loadPtr->cPtr, loadPtr->fileName, &ds, &count) != NS_OK) {
+        Ns_Log(Warning, "ns_cache %s: %s", Ns_CacheName(loadPtr->cPtr->cache), ds.string);
+    } else {
+        Ns_Log(Notice, "ns_cache %s: loaded %" PRIuz " entries from snapshot \"%s\"",
+               Ns_CacheName(loadPtr->cPtr->cache), count, loadPtr->fileName);
+    }
+    Tcl_DStringFree(&ds);
+
+    Ns_MutexLock(&loadPtr->servPtr->tcl.cacheSnapshotLoad.lock);
+    loadPtr->servPtr->tcl.cacheSnapshotLoad.running--;
+    Ns_CondBroadcast(&loadPtr->servPtr->tcl.cacheSnapshotLoad.cond);
+    Ns_MutexUnlock(&loadPtr->servPtr->tcl.cacheSnapshotLoad.lock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclCacheSnapshotShutdown --
+ *
+ *      Shutdown callback saving the snapshots of the caches configured
+ *      via the "cachesnapshots" parameter of the server. The first call
+ *      (toPtr == NULL) prevents new snapshot loads and saves the
+ *      snapshots, the second call waits for the running loader
+ *      threads and joins these.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Snapshot files written, threads joined.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTclCacheSnapshotShutdown(const Ns_Time *toPtr, void *arg)
+{
+    NsServer     *servPtr = arg;
+    TCL_SIZE_T    i;
+
+    NS_NONNULL_ASSERT(arg != NULL);
+
+    if (toPtr != NULL) {
+        SnapshotLoad *loadPtr = NULL;
+        Ns_ReturnCode status = NS_OK;
+
+        /*
+         * The snapshots were saved already in the first call.
+         */
+        Ns_MutexLock(&servPtr->tcl.cacheSnapshotLoad.lock);
+        while (status == NS_OK && servPtr->tcl.cacheSnapshotLoad.running > 0) {
+            status = Ns_CondTimedWait(&servPtr->tcl.cacheSnapshotLoad.cond,
+                                      &servPtr->tcl.cacheSnapshotLoad.lock, toPtr);
+        }
+        if (status == NS_OK) {
+            loadPtr = servPtr->tcl.cacheSnapshotLoad.firstPtr;
+            servPtr->tcl.cacheSnapshotLoad.firstPtr = NULL;
+        }
+        Ns_MutexUnlock(&servPtr->tcl.cacheSnapshotLoad.lock);
+
+        if (status != NS_OK) {
+            Ns_Log(Warning, "ns_cache: timeout waiting for snapshot loader threads of server %s",
+                   servPtr->server);
+        }
+        while (loadPtr != NULL) {
+            SnapshotLoad *nextPtr = loadPtr->nextPtr;
+
+            Ns_ThreadJoin(&loadPtr->thread, NULL);
+            ns_free(loadPtr);
+            loadPtr = nextPtr;
+        }
+        return;
+    }
+
+    Ns_MutexLock(&servPtr->tcl.cacheSnapshotLoad.lock);
+    servPtr->tcl.cacheSnapshotLoad.stop = NS_TRUE;
+    Ns_MutexUnlock(&servPtr->tcl.cacheSnapshotLoad.lock);
+
+    for (i = 0; i < servPtr->tcl.cacheSnapshotc; i++) {
+        const char          *name = servPtr->tcl.cacheSnapshotv[i];
+        const Tcl_HashEntry *hPtr;
+        TclCache            *cPtr = NULL;
+
+        Ns_RWLockRdLock(&servPtr->tcl.cachelock);
+        hPtr = Tcl_FindHashEntry(&servPtr->tcl.caches, name);
+        if (hPtr != NULL) {
+            cPtr = Tcl_GetHashValue(hPtr);
+        }
+        Ns_RWLockUnlock(&servPtr->tcl.cachelock);
+
+        if (cPtr != NULL) {
+            Tcl_DString ds, errorDs;
+            size_t      count;
+
+            Tcl_DStringInit(&ds);
+            Tcl_DStringInit(&errorDs);
+            CacheSnapshotFileName(servPtr, name, &ds);
+            if (CacheSnapshotSave(cPtr, ds.string, &errorDs, &count) != NS_OK) {
+                Ns_Log(Warning, "ns_cache %s: %s", name, errorDs.string);
+            } else {
+                Ns_Log(Notice, "ns_cache %s: saved %" PRIuz " entries to snapshot \"%s\"",
+                       name, count, ds.string);
+            }
+            Tcl_DStringFree(&errorDs);
+            Tcl_DStringFree(&ds);
+        }
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -55,6 +55,7 @@ static const Cmd basicCmds[] = {
     {"ns_cancel",                NULL, NsTclCancelObjCmd},
     {"ns_certctl",               NULL, NsTclCertCtlObjCmd},
     {"ns_charsets",              NULL, NsTclCharsetsObjCmd},
+    {"ns_compress_stats",        NULL, NsTclCompressStatsObjCmd},
     {"ns_config",                NULL, NsTclConfigObjCmd},
     {"ns_configsection",         NULL, NsTclConfigSectionObjCmd},
     {"ns_configsections",        NULL, NsTclConfigSectionsObjCmd},
@@ -194,13 +195,17 @@ static const Cmd servCmds[] = {
     {"ns_cache_configure",       NULL, NsTclCacheConfigureObjCmd},
     {"ns_cache_create",          NULL, NsTclCacheCreateObjCmd},
     {"ns_cache_eval",            NULL, NsTclCacheEvalObjCmd},
+    {"ns_cache_eval_many",       NULL, NsTclCacheEvalManyObjCmd},
     {"ns_cache_exists",          NULL, NsTclCacheExistsObjCmd},
     {"ns_cache_flush",           NULL, NsTclCacheFlushObjCmd},
     {"ns_cache_get",             NULL, NsTclCacheGetObjCmd},
+    {"ns_cache_get_many",        NULL, NsTclCacheGetManyObjCmd},
     {"ns_cache_incr",            NULL, NsTclCacheIncrObjCmd},
     {"ns_cache_keys",            NULL, NsTclCacheKeysObjCmd},
     {"ns_cache_lappend",         NULL, NsTclCacheLappendObjCmd},
     {"ns_cache_names",           NULL, NsTclCacheNamesObjCmd},
+    {"ns_cache_set_many",        NULL, NsTclCacheSetManyObjCmd},
+    {"ns_cache_snapshot",        NULL, NsTclCacheSnapshotObjCmd},
     {"ns_cache_stats",           NULL, NsTclCacheStatsObjCmd},
     {"ns_cache_transaction_begin", NULL, NsTclCacheTransactionBeginObjCmd},
     {"ns_cache_transaction_commit", NULL, NsTclCacheTransactionCommitObjCmd},
@@ -276,10 +281,14 @@ static const Cmd servCmds[] = {
     {"nsv_array",                NULL, NsTclNsvArrayObjCmd},
     {"nsv_dict",                 NULL, NsTclNsvDictObjCmd},
     {"nsv_bucket",               NULL, NsTclNsvBucketObjCmd},
+    {"nsv_contention",           NULL, NsTclNsvContentionObjCmd},
+    {"nsv_counter",              NULL, NsTclNsvCounterObjCmd},
     {"nsv_exists",               NULL, NsTclNsvExistsObjCmd},
     {"nsv_get",                  NULL, NsTclNsvGetObjCmd},
     {"nsv_incr",                 NULL, NsTclNsvIncrObjCmd},
+    {"nsv_journal",              NULL, NsTclNsvJournalObjCmd},
     {"nsv_lappend",              NULL, NsTclNsvLappendObjCmd},
+    {"nsv_migrate",              NULL, NsTclNsvMigrateObjCmd},
     {"nsv_names",                NULL, NsTclNsvNamesObjCmd},
     {"nsv_set",                  NULL, NsTclNsvSetObjCmd},
     {"nsv_unset",                NULL, NsTclNsvUnsetObjCmd},
@@ -55,6 +55,90 @@ typedef struct AtClose {
     Tcl_Obj        *objPtr;
 } AtClose;
 
+/*
+ * The following structure maintains a named unit of the blueprint (e.g. a
+ * single proc or namespace variable). Units are versioned by the epoch in
+ * which they were changed, such that "ns_ictl update" has to replay only the
+ * units changed since the epoch of an interp. The sequence number preserves
+ * the order of the updates. A unit which is no longer part of the saved
+ * units is kept as removed unit, whose script deletes the proc, variable or
+ * namespace also in the other interps.
+ */
+
+typedef struct BlueprintUnit {
+    char          *script;
+    TCL_SIZE_T     length;
+    uint64_t       epoch;
+    unsigned long  seq;
+    bool           removed;
+} BlueprintUnit;
+
+/*
+ * The following structures maintain the definitions of the procs of the
+ * blueprint, which are shared by all interps of a server. Interps receive
+ * just a stub command (LazyProcStub) for such procs, which defines the
+ * actual proc on its first invocation. The set of definitions saved by
+ * "ns_ictl save -procs" is kept alive by its reference count as long as
+ * stubs refer to it, also when the blueprint is saved again.
+ */
+
+typedef struct LazyProc {
+    char          *args;
+    char          *body;
+    TCL_SIZE_T     argsLength;
+    TCL_SIZE_T     bodyLength;
+} LazyProc;
+
+typedef struct LazyProcs {
+    int            refCount;   /* server reference plus one per stub */
+    Tcl_HashTable  table;      /* definitions by fully qualified name */
+} LazyProcs;
+
+typedef struct LazyProcStub {
+    Tcl_Command    token;
+    LazyProcs     *procsPtr;
+    char           name[1];
+} LazyProcStub;
+
+/*
+ * The following structures maintain the preparsed blueprint script, which
+ * is shared by all interps of a server. Commands consisting only of
+ * literal words are kept as lists of words, such that these can be
+ * evaluated without parsing. The bodies of "namespace eval" commands are
+ * preparsed as well, since these would be otherwise compiled in every
+ * interp just for a single evaluation. Other commands are evaluated from
+ * their script.
+ */
+
+typedef struct PreparsedWord {
+    const char    *string;
+    TCL_SIZE_T     length;
+} PreparsedWord;
+
+typedef struct PreparsedCmd {
+    const char              *script;   /* command text */
+    TCL_SIZE_T               length;   /* length of the command text */
+    int                      nwords;   /* number of literal words or 0 */
+    PreparsedWord           *words;    /* literal words */
+    struct PreparsedScript  *bodyPtr;  /* body of "namespace eval" or NULL */
+} PreparsedCmd;
+
+typedef struct PreparsedScript {
+    int            ncmds;
+    PreparsedCmd  *cmds;
+} PreparsedScript;
+
+typedef struct Blueprint {
+    int              refCount;
+    char            *script;
+    PreparsedScript *parsedPtr;
+} Blueprint;
+
+typedef struct BlueprintEval {
+    const PreparsedScript *bodyPtr;    /* body of the current "namespace eval" */
+    Tcl_Obj               *bodyObj;    /* script invoking the preparsed body */
+} BlueprintEval;
+
 static Ns_ObjvTable traceWhen[] = {
     {"allocate",   (unsigned int)NS_TCL_TRACE_ALLOCATE},
     {"create",     (unsigned int)NS_TCL_TRACE_CREATE},
@@ -90,6 +174,63 @@ static NsInterp *NewInterpData(Tcl_Interp *interp, NsServer *servPtr)
 static int UpdateInterp(NsInterp *itPtr)
     NS_GNUC_NONNULL(1);
 
+static int SaveUnits(NsServer *servPtr, Tcl_Interp *interp, Tcl_HashTable *tablePtr, Tcl_Obj *unitsObj,
+                     bool complete, uint64_t epoch, Tcl_Obj *changedObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static void RemovedUnitScript(const char *key, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void FreeUnits(Tcl_HashTable *tablePtr)
+    NS_GNUC_NONNULL(1);
+
+static void ReplaceUnits(NsServer *servPtr, Tcl_HashTable *tablePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static int AppendChangedUnits(NsServer *servPtr, uint64_t sinceEpoch, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+
+static int CompareUnits(const void *a, const void *b)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static int SaveProcs(NsServer *servPtr, Tcl_Interp *interp, Tcl_Obj *procsObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void ReleaseProcs(LazyProcs *procsPtr, int count)
+    NS_GNUC_NONNULL(1);
+
+static int AppendProcNames(LazyProcs *procsPtr, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void CreateProcStubs(Tcl_Interp *interp, LazyProcs *procsPtr, const char *names, int nprocs)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static TCL_OBJCMDPROC_T LazyProcObjCmd;
+static Tcl_CmdDeleteProc LazyProcDeleteProc;
+
+static Blueprint *NewBlueprint(const char *script, TCL_SIZE_T length)
+    NS_GNUC_NONNULL(1);
+
+static void ReleaseBlueprint(Blueprint *bpPtr)
+    NS_GNUC_NONNULL(1);
+
+static PreparsedScript *PreparseScript(const char *script, TCL_SIZE_T length, int depth)
+    NS_GNUC_NONNULL(1);
+
+static void FreePreparsedScript(PreparsedScript *scriptPtr)
+    NS_GNUC_NONNULL(1);
+
+static int EvalBlueprint(Tcl_Interp *interp, const Blueprint *bpPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static int EvalPreparsedScript(Tcl_Interp *interp, BlueprintEval *ctxPtr, const PreparsedScript *scriptPtr, int flags)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static TCL_OBJCMDPROC_T BlueprintBodyObjCmd;
+
+static uint64_t NextEpoch(const NsServer *servPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_PURE;
+
 static void RunTraces(NsInterp *itPtr, Ns_TclTraceType why)
     NS_GNUC_NONNULL(1);
 
@@ -104,6 +245,21 @@ static Ns_ReturnCode RegisterAt(Ns_TclTraceProc *proc, const void *arg, Ns_TclTr
 
 static const char *GetTraceLabel(unsigned int traceWhy);
 
+static int GetNumberOfCPUs(void);
+
+static void KeepConnInterp(NsInterp *itPtr, ConnPool *poolPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void SampleInterp(NsInterp *itPtr)
+    NS_GNUC_NONNULL(1);
+static void MeasureInterp(NsInterp *itPtr, NsInterpFootprint *fpPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+static Tcl_WideInt GetThreadMemory(void);
+static int CountNamespaces(Tcl_Interp *interp)
+    NS_GNUC_NONNULL(1);
+static Tcl_Obj *FootprintObj(const NsInterpFootprint *fpPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+
 static Tcl_InterpDeleteProc FreeInterpData;
 static Ns_TlsCleanup DeleteInterps;
 static Ns_ServerInitProc ConfigServerTcl;
@@ -113,6 +269,7 @@ static int ICtlAddTrace(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T ob
 static TCL_OBJCMDPROC_T ICtlAddModuleObjCmd;
 static TCL_OBJCMDPROC_T ICtlCleanupObjCmd;
 static TCL_OBJCMDPROC_T ICtlEpochObjCmd;
+static TCL_OBJCMDPROC_T ICtlFootprintObjCmd;
 static TCL_OBJCMDPROC_T ICtlGetModulesObjCmd;
 static TCL_OBJCMDPROC_T ICtlGetObjCmd;
 static TCL_OBJCMDPROC_T ICtlGetTracesObjCmd;
@@ -120,9 +277,12 @@ static TCL_OBJCMDPROC_T ICtlMarkForDeleteObjCmd;
 static TCL_OBJCMDPROC_T ICtlOnCleanupObjCmd;
 static TCL_OBJCMDPROC_T ICtlOnCreateObjCmd;
 static TCL_OBJCMDPROC_T ICtlOnDeleteObjCmd;
+static TCL_OBJCMDPROC_T ICtlProcsObjCmd;
 static TCL_OBJCMDPROC_T ICtlRunTracesObjCmd;
 static TCL_OBJCMDPROC_T ICtlSaveObjCmd;
+static TCL_OBJCMDPROC_T ICtlSaveUnitsObjCmd;
 static TCL_OBJCMDPROC_T ICtlTraceObjCmd;
+static TCL_OBJCMDPROC_T ICtlUnitsObjCmd;
 static TCL_OBJCMDPROC_T ICtlUpdateObjCmd;
 
 /*
@@ -138,6 +298,8 @@ static int maxConcurrentUpdates = 1000;
 static Ns_Mutex interpLock = NULL;
 static bool concurrent_interp_create = NS_FALSE;
 
+static Ns_Sema warmupSema = NULL;  /* Bounds concurrent interp warmups during startup. */
+
 const Tcl_ObjType *NS_intTypePtr = NULL;
 static Ns_Cs popInterpCsLock;
 
@@ -210,6 +372,57 @@ NsConfigTcl(void)
 #endif
                                              );
     maxConcurrentUpdates = Ns_ConfigIntRange(NS_GLOBAL_CONFIG_PARAMETERS, "maxconcurrentupdates", 1000, 1, INT_MAX);
+
+    /*
+     * When "interpwarmup" is activated, the server reports readiness only
+     * after the interpreters of all "minthreads" connection threads are
+     * initialized. The number of blueprints evaluated concurrently during
+     * startup is bounded by "interpwarmupconcurrency", which defaults to the
+     * number of available CPUs.
+     */
+    nsconf.tcl.warmup = Ns_ConfigBool(NS_GLOBAL_CONFIG_PARAMETERS, "interpwarmup", NS_FALSE);
+    nsconf.tcl.warmupconcurrency = Ns_ConfigIntRange(NS_GLOBAL_CONFIG_PARAMETERS, "interpwarmupconcurrency",
+                                                     GetNumberOfCPUs(), 1, INT_MAX);
+    if (nsconf.tcl.warmup) {
+        Ns_SemaInit(&warmupSema, nsconf.tcl.warmupconcurrency);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetNumberOfCPUs --
+ *
+ *      Determine the number of online processors.
+ *
+ * Results:
+ *      Number of CPUs, at least 1.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GetNumberOfCPUs(void)
+{
+    int result = 1;
+
+#ifdef _WIN32
+    SYSTEM_INFO sysInfo;
+
+    GetSystemInfo(&sysInfo);
+    result = (int)sysInfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n > 0 && n < INT_MAX) {
+        result = (int)n;
+    }
+#endif
+    return (result > 0 ? result : 1);
 }
 
 
@@ -304,13 +517,59 @@ ConfigServerTcl(const char *server)
         servPtr->tcl.modules = Tcl_NewObj();
         Tcl_IncrRefCount(servPtr->tcl.modules);
 
+        servPtr->tcl.preparse = Ns_ConfigBool(path, "preparse", NS_FALSE);
+
+        /*
+         * Caches persisted at shutdown and loaded on creation.
+         */
+        p = Ns_ConfigString(path, "cachesnapshotdir", "cache");
+        if (Ns_PathIsAbsolute(p) == NS_FALSE) {
+            Ns_HomePath(&ds, p, (char *)0L);
+            servPtr->tcl.cacheSnapshotDir = Ns_DStringExport(&ds);
+        } else {
+            servPtr->tcl.cacheSnapshotDir = ns_strdup(p);
+        }
+        Ns_MutexInit(&servPtr->tcl.cacheSnapshotLoad.lock);
+        Ns_MutexSetName2(&servPtr->tcl.cacheSnapshotLoad.lock, "ns:tcl.cachesnapshot", server);
+        Ns_CondInit(&servPtr->tcl.cacheSnapshotLoad.cond);
+        /*
+         * The list is split once here, such that the names can be used
+         * by all threads. The strings should be freed with Tcl_Free()
+         * in case the server is reconfigured or deleted.
+         */
+        if (Tcl_SplitList(NULL, Ns_ConfigString(path, "cachesnapshots", NS_EMPTY_STRING),
+                          &servPtr->tcl.cacheSnapshotc, &servPtr->tcl.cacheSnapshotv) != TCL_OK) {
+            Ns_Log(Warning, "%s: invalid list of cachesnapshots ignored", path);
+            servPtr->tcl.cacheSnapshotc = 0;
+            servPtr->tcl.cacheSnapshotv = NULL;
+        } else if (servPtr->tcl.cacheSnapshotc > 0) {
+            (void) Ns_RegisterAtShutdown(NsTclCacheSnapshotShutdown, servPtr);
+        }
+
+        /*
+         * Sampling of the interp footprints and limits for recycling
+         * interps. A value of 0 deactivates the sampling or the limit.
+         */
+        servPtr->tcl.sampleInterval = Ns_ConfigIntRange(path, "interpsampleinterval", 0, 0, INT_MAX);
+        servPtr->tcl.maxMemory = Ns_ConfigMemUnitRange(path, "interpmaxmemory", "0", 0, 0, LLONG_MAX);
+        servPtr->tcl.maxGlobals = Ns_ConfigIntRange(path, "interpmaxglobals", 0, 0, INT_MAX);
+        servPtr->tcl.maxNamespaces = Ns_ConfigIntRange(path, "interpmaxnamespaces", 0, 0, INT_MAX);
+        Ns_MutexInit(&servPtr->tcl.footprintLock);
+        Ns_MutexSetName2(&servPtr->tcl.footprintLock, "ns:tcl.footprint", server);
+        Tcl_InitHashTable(&servPtr->tcl.footprints, TCL_ONE_WORD_KEYS);
+
         Ns_RWLockInit(&servPtr->tcl.lock);
         Ns_RWLockSetName2(&servPtr->tcl.lock, "rw:tcl", server);
 
         Ns_RWLockInit(&servPtr->tcl.cachelock);
         Ns_RWLockSetName2(&servPtr->tcl.cachelock, "ns:tcl.cache", server);
+        Ns_MutexInit(&servPtr->tcl.cacheRefresh.lock);
+        Ns_MutexSetName2(&servPtr->tcl.cacheRefresh.lock, "ns:tcl.cacherefresh", server);
+        Ns_CondInit(&servPtr->tcl.cacheRefresh.cond);
+        (void) Ns_RegisterAtShutdown(NsTclCacheRefreshShutdown, servPtr);
 
         Tcl_InitHashTable(&servPtr->tcl.caches, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&servPtr->tcl.units, TCL_STRING_KEYS);
         Tcl_InitHashTable(&servPtr->tcl.runTable, TCL_STRING_KEYS);
         Tcl_InitHashTable(&servPtr->tcl.synch.mutexTable, TCL_STRING_KEYS);
         Tcl_InitHashTable(&servPtr->tcl.synch.csTable, TCL_STRING_KEYS);
@@ -320,7 +579,10 @@ ConfigServerTcl(const char *server)
 
         servPtr->nsv.rwlocks = Ns_ConfigBool(path, "nsvrwlocks", NS_TRUE);
         servPtr->nsv.nbuckets = Ns_ConfigIntRange(path, "nsvbuckets", 8, 1, INT_MAX);
+        servPtr->nsv.snapshotSize = Ns_ConfigIntRange(path, "nsvsnapshotsize", 1000, 0, INT_MAX);
         servPtr->nsv.buckets = NsTclCreateBuckets(servPtr, servPtr->nsv.nbuckets);
+        NsTclNsvInitJournal(servPtr, path);
+        NsTclNsvInitMigration(servPtr, path);
 
         /*
          * Initialize the list of connection headers to log for Tcl errors.
@@ -570,6 +832,88 @@ NsIdleCallback(NsServer *servPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclWarmupInterp --
+ *
+ *      Initialize the interpreter of a freshly created connection thread to
+ *      avoid the initialization delay when the first connection comes
+ *      in. During startup with "interpwarmup" activated, the number of
+ *      concurrent initializations is bounded by "interpwarmupconcurrency".
+ *      When the pool keeps already "maxinterps" interps, the thread
+ *      starts without an interp.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Interp is allocated, initialized and cached. Timing is logged.
+ *
+ *----------------------------------------------------------------------
+ */
+void
+NsTclWarmupInterp(ConnPool *poolPtr)
+{
+    NsServer   *servPtr;
+    NsInterp   *itPtr;
+    Tcl_Interp *interp;
+    Ns_Time     start, end, diff, waitDiff = {0, 0};
+    bool        bounded, full;
+
+    NS_NONNULL_ASSERT(poolPtr != NULL);
+
+    servPtr = poolPtr->servPtr;
+
+    /*
+     * Reserve the slot for the interp of this thread already here, such
+     * that concurrently starting threads do not exceed "maxinterps".
+     */
+    Ns_MutexLock(&poolPtr->threads.lock);
+    full = (poolPtr->interps.max > 0 && poolPtr->interps.current >= poolPtr->interps.max);
+    if (!full) {
+        poolPtr->interps.current++;
+    }
+    Ns_MutexUnlock(&poolPtr->threads.lock);
+    if (full) {
+        Ns_Log(Notice, "thread initialized without interp (maxinterps %d reached)",
+               poolPtr->interps.max);
+        return;
+    }
+
+    bounded = (warmupSema != NULL && !Ns_InfoStarted());
+
+    Ns_GetTime(&start);
+    if (bounded) {
+        Ns_SemaWait(&warmupSema);
+        Ns_GetTime(&end);
+        Ns_DiffTime(&end, &start, &waitDiff);
+        start = end;
+    }
+    interp = NsTclAllocateInterp(servPtr);
+    Ns_GetTime(&end);
+    Ns_DiffTime(&end, &start, &diff);
+    itPtr = NsGetInterpData(interp);
+    if (itPtr != NULL && itPtr->poolPtr == NULL) {
+        itPtr->poolPtr = poolPtr;
+    } else {
+        Ns_MutexLock(&poolPtr->threads.lock);
+        poolPtr->interps.current--;
+        Ns_MutexUnlock(&poolPtr->threads.lock);
+    }
+    Ns_TclDeAllocateInterp(interp);
+
+    if (bounded) {
+        Ns_SemaPost(&warmupSema, 1);
+        Ns_Log(Notice, "thread initialized (" NS_TIME_FMT " secs, waited " NS_TIME_FMT " secs)",
+               (int64_t)diff.sec, diff.usec, (int64_t)waitDiff.sec, waitDiff.usec);
+    } else {
+        Ns_Log(Notice, "thread initialized (" NS_TIME_FMT " secs)",
+               (int64_t)diff.sec, diff.usec);
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -600,6 +944,7 @@ Ns_GetConnInterp(Ns_Conn *conn)
 
     if (connPtr->itPtr == NULL) {
         itPtr = PopInterp(connPtr->poolPtr->servPtr, NULL);
+        KeepConnInterp(itPtr, connPtr->poolPtr);
         itPtr->conn = conn;
         itPtr->nsconn.flags = 0u;
         connPtr->itPtr = itPtr;
@@ -1245,7 +1590,7 @@ ICtlEpochObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_
 
     } else {
         Ns_RWLockRdLock(&servPtr->tcl.lock);
-        Tcl_SetObjResult(interp, Tcl_NewIntObj(servPtr->tcl.epoch));
+        Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)servPtr->tcl.epoch));
         Ns_RWLockUnlock(&servPtr->tcl.lock);
     }
     return result;
@@ -1336,13 +1681,19 @@ ICtlMarkForDeleteObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T ob
  * ICtlSaveObjCmd - subcommand of NsTclICtlObjCmd --
  *
  *      Implements "ns_ictl save" command.
- *      Save the init script.
+ *      Save the init script. When "-units" is provided, the passed
+ *      dict of unit names and scripts is recorded as the state of the
+ *      units contained in the saved blueprint, such that later
+ *      "ns_ictl saveunits" calls can detect changes. When "-procs"
+ *      is provided, the passed dict of proc names and definitions is
+ *      kept in a shared store, from where the procs are materialized
+ *      in the interps on their first invocation.
  *
  * Results:
  *      Standard Tcl result.
  *
  * Side effects:
- *      Save bluprint.
+ *      Save bluprint, replace the blueprint units and lazy procs.
  *
  *----------------------------------------------------------------------
  */
@@ -1350,13 +1701,19 @@ static int
 ICtlSaveObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
     int          result = TCL_OK;
-    Tcl_Obj     *scriptObj;
+    Tcl_Obj     *scriptObj, *unitsObj = NULL, *procsObj = NULL;
+    Ns_ObjvSpec  opts[] = {
+        {"-procs",     Ns_ObjvObj,  &procsObj, NULL},
+        {"-units",     Ns_ObjvObj,  &unitsObj, NULL},
+        {"--",         Ns_ObjvBreak, NULL,     NULL},
+        {NULL, NULL, NULL, NULL}
+    };
     Ns_ObjvSpec  args[] = {
         {"script",     Ns_ObjvObj,  &scriptObj, NULL},
         {NULL, NULL, NULL, NULL}
     };
 
-    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
     } else {
@@ -1364,135 +1721,404 @@ ICtlSaveObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_O
         NsServer       *servPtr = itPtr->servPtr;
         TCL_SIZE_T      length;
         const char     *script = ns_strdup(Tcl_GetStringFromObj(scriptObj, &length));
+        Blueprint      *bpPtr = NULL;
+        Tcl_HashTable   units;
+        uint64_t        epoch;
+
+        /*
+         * Preparse the script before acquiring the lock.
+         */
+        if (servPtr->tcl.preparse) {
+            bpPtr = NewBlueprint(script, length);
+        }
+        Tcl_InitHashTable(&units, TCL_STRING_KEYS);
 
+        /*
+         * Build the new units in a separate table, such that the saved
+         * units are left untouched on errors.
+         */
         Ns_RWLockWrLock(&servPtr->tcl.lock);
-        ns_free((char *)servPtr->tcl.script);
-        servPtr->tcl.script = script;
-        servPtr->tcl.length = length;
-        if (++servPtr->tcl.epoch == 0) {
-            /*
-             * Epoch zero is reserved for new interps.
-             */
-            ++itPtr->servPtr->tcl.epoch;
+        epoch = NextEpoch(servPtr);
+        if (unitsObj != NULL) {
+            result = SaveUnits(servPtr, interp, &units, unitsObj, NS_FALSE, epoch, NULL);
+        }
+        if (result == TCL_OK) {
+            if (procsObj != NULL) {
+                result = SaveProcs(servPtr, interp, procsObj);
+            } else if (servPtr->tcl.procs != NULL) {
+                ReleaseProcs(servPtr->tcl.procs, 1);
+                servPtr->tcl.procs = NULL;
+            }
+        }
+        if (result == TCL_OK) {
+            ReplaceUnits(servPtr, &units);
+            ns_free((char *)servPtr->tcl.script);
+            servPtr->tcl.script = script;
+            servPtr->tcl.length = length;
+            servPtr->tcl.epoch = epoch;
+            servPtr->tcl.fullEpoch = epoch;
+            if (servPtr->tcl.blueprint != NULL) {
+                ReleaseBlueprint(servPtr->tcl.blueprint);
+            }
+            servPtr->tcl.blueprint = bpPtr;
+        } else {
+            FreeUnits(&units);
+            ns_free((char *)script);
+            if (bpPtr != NULL) {
+                ReleaseBlueprint(bpPtr);
+            }
         }
         Ns_RWLockUnlock(&servPtr->tcl.lock);
+        Tcl_DeleteHashTable(&units);
     }
     return result;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * ICtlUpdateObjCmd - subcommand of NsTclICtlObjCmd --
+ * ICtlSaveUnitsObjCmd - subcommand of NsTclICtlObjCmd --
  *
- *      Implements "ns_ictl update" command.
- *      Check for and process possible change in the init script.
+ *      Implements "ns_ictl saveunits" command.  Update the blueprint
+ *      with the provided dict of unit names and scripts. Only the
+ *      units which are new or have a different script than the saved
+ *      version are recorded. When "-complete" is specified, the dict
+ *      contains the full state of the interp, and the saved units not
+ *      contained in the dict are recorded as removed. When there are
+ *      such units, the epoch is incremented and "ns_ictl update"
+ *      evaluates in other interps just the changed units.
  *
  * Results:
- *      Standard Tcl result.
+ *      Standard Tcl result, list of changed units as result.
  *
  * Side effects:
- *      Update blueprint.
+ *      Update blueprint units, potentially increment epoch.
  *
  *----------------------------------------------------------------------
  */
-
 static int
-ICtlUpdateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+ICtlSaveUnitsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    NsInterp    *itPtr = (NsInterp *)clientData;
-    int          result;
+    int          result = TCL_OK, complete = (int)NS_FALSE;
+    Tcl_Obj     *unitsObj;
+    Ns_ObjvSpec  opts[] = {
+        {"-complete", Ns_ObjvBool,  &complete, INT2PTR(NS_TRUE)},
+        {"--",        Ns_ObjvBreak, NULL,      NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+    Ns_ObjvSpec  args[] = {
+        {"units",     Ns_ObjvObj,  &unitsObj, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
 
-    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(opts, args, interp, 2, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
     } else {
-        result = UpdateInterp(itPtr);
+        const NsInterp *itPtr = (const NsInterp *)clientData;
+        NsServer       *servPtr = itPtr->servPtr;
+        Tcl_Obj        *changedObj = Tcl_NewListObj(0, NULL);
+        uint64_t        epoch;
+
+        Ns_RWLockWrLock(&servPtr->tcl.lock);
+        epoch = NextEpoch(servPtr);
+        result = SaveUnits(servPtr, interp, &servPtr->tcl.units, unitsObj, complete != 0,
+                           epoch, changedObj);
+        if (result == TCL_OK) {
+            TCL_SIZE_T nchanged = 0;
+
+            (void) Tcl_ListObjLength(NULL, changedObj, &nchanged);
+            if (nchanged > 0) {
+                servPtr->tcl.epoch = epoch;
+            }
+        }
+        Ns_RWLockUnlock(&servPtr->tcl.lock);
+
+        if (result == TCL_OK) {
+            Tcl_SetObjResult(interp, changedObj);
+        } else {
+            Tcl_DecrRefCount(changedObj);
+        }
     }
     return result;
 }
 
-
 /*
  *----------------------------------------------------------------------
  *
- * ICtlCleanupObjCmd - subcommand of NsTclICtlObjCmd --
+ * ICtlUnitsObjCmd - subcommand of NsTclICtlObjCmd --
  *
- *      Implements "ns_ictl cleanup" command.
- *      Invoke the legacy defer callbacks.
+ *      Implements "ns_ictl units" command.
+ *      Return a dict of the blueprint unit names and their epochs.
  *
  * Results:
  *      Standard Tcl result.
  *
  * Side effects:
- *      Free memory.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-
 static int
-ICtlCleanupObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+ICtlUnitsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    NsInterp    *itPtr = (NsInterp *)clientData;
     int          result = TCL_OK;
+    char        *patternString = NULL;
+    Ns_ObjvSpec  args[] = {
+        {"?pattern",  Ns_ObjvString,  &patternString, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
 
-    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
         result = TCL_ERROR;
 
-    } else if (itPtr->firstDeferPtr != NULL) {
-        Defer  *deferPtr;
+    } else {
+        const NsInterp      *itPtr = (const NsInterp *)clientData;
+        NsServer            *servPtr = itPtr->servPtr;
+        Tcl_Obj             *resultObj = Tcl_NewListObj(0, NULL);
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
 
-        for (deferPtr = itPtr->firstDeferPtr; deferPtr != NULL; deferPtr = deferPtr->nextPtr) {
-            (*deferPtr->proc)(interp, deferPtr->arg);
-            ns_free(deferPtr);
+        Ns_RWLockRdLock(&servPtr->tcl.lock);
+        for (hPtr = Tcl_FirstHashEntry(&servPtr->tcl.units, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            const char          *key = Tcl_GetHashKey(&servPtr->tcl.units, hPtr);
+            const BlueprintUnit *unitPtr = Tcl_GetHashValue(hPtr);
+
+            if (!unitPtr->removed
+                && (patternString == NULL || Tcl_StringMatch(key, patternString) != 0)) {
+                (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj(key, TCL_INDEX_NONE));
+                (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewWideIntObj((Tcl_WideInt)unitPtr->epoch));
+            }
         }
-        itPtr->firstDeferPtr = NULL;
-        result = UpdateInterp(itPtr);
+        Ns_RWLockUnlock(&servPtr->tcl.lock);
+        Tcl_SetObjResult(interp, resultObj);
     }
     return result;
 }
-
 
 /*
  *----------------------------------------------------------------------
  *
- * ICtlOnInitObjCmd
- * ICtlOnCreateObjCmd
- * ICtlOnCleanupObjCmd
- * ICtlOnDeleteObjCmd
- * ICtlTraceObjCmd
- *        - subcommands of NsTclICtlObjCmd --
- *
- *      Implements various trace commands
- *
- *          "ns_ictl oncleanup"
- *          "ns_ictl oncreate
- *          "ns_ictl ondelete"
- *          "ns_ictl oninit"
- *          "ns_ictl trace"
+ * ICtlFootprintObjCmd - subcommand of NsTclICtlObjCmd --
  *
- *      Register script-level interp traces. "ns_ictl trace" is the new
- *      version, the other ones are deprecated 3-argument variants.
+ *      Implements "ns_ictl footprint ?-all?" command.
+ *      Return the footprint of the current interp, or with "-all"
+ *      the last sampled footprints of all interps of the server.
  *
  * Results:
  *      Standard Tcl result.
  *
  * Side effects:
- *      Adding a trace on success.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-
 static int
-ICtlOnCreateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+ICtlFootprintObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    Ns_LogDeprecated(objv, 2, "ns_ictl trace create ...", NULL);
-    return ICtlAddTrace(clientData, interp, objc, objv, NS_TCL_TRACE_CREATE);
+    int          result = TCL_OK, all = 0;
+    Ns_ObjvSpec  opts[] = {
+        {"-all", Ns_ObjvBool, &all, INT2PTR(NS_TRUE)},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        NsInterp *itPtr = (NsInterp *)clientData;
+
+        if (all != 0) {
+            Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+
+            NsTclAppendFootprints(itPtr->servPtr, NULL, listObj);
+            Tcl_SetObjResult(interp, listObj);
+        } else {
+            NsInterpFootprint footprint;
+
+            MeasureInterp(itPtr, &footprint);
+            Tcl_SetObjResult(interp, FootprintObj(&footprint));
+        }
+    }
+    return result;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ICtlProcsObjCmd - subcommand of NsTclICtlObjCmd --
+ *
+ *      Implements "ns_ictl procs" command.
+ *      Return a dict of the names and definitions of the lazily
+ *      materialized procs of the blueprint.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
 static int
-ICtlOnCleanupObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+ICtlProcsObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    Ns_LogDeprecated(objv, 2, "ns_ictl trace deallocate ...", NULL);
+    int          result = TCL_OK;
+    char        *patternString = NULL;
+    Ns_ObjvSpec  args[] = {
+        {"?pattern",  Ns_ObjvString,  &patternString, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        const NsInterp      *itPtr = (const NsInterp *)clientData;
+        NsServer            *servPtr = itPtr->servPtr;
+        Tcl_Obj             *resultObj = Tcl_NewListObj(0, NULL);
+        LazyProcs           *procsPtr;
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+
+        Ns_RWLockRdLock(&servPtr->tcl.lock);
+        procsPtr = servPtr->tcl.procs;
+        for (hPtr = (procsPtr != NULL ? Tcl_FirstHashEntry(&procsPtr->table, &search) : NULL);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            const char     *key = Tcl_GetHashKey(&procsPtr->table, hPtr);
+            const LazyProc *procPtr = Tcl_GetHashValue(hPtr);
+
+            if (patternString == NULL || Tcl_StringMatch(key, patternString) != 0) {
+                Tcl_Obj *defObjv[2];
+
+                defObjv[0] = Tcl_NewStringObj(procPtr->args, procPtr->argsLength);
+                defObjv[1] = Tcl_NewStringObj(procPtr->body, procPtr->bodyLength);
+                (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj(key, TCL_INDEX_NONE));
+                (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewListObj(2, defObjv));
+            }
+        }
+        Ns_RWLockUnlock(&servPtr->tcl.lock);
+        Tcl_SetObjResult(interp, resultObj);
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ICtlUpdateObjCmd - subcommand of NsTclICtlObjCmd --
+ *
+ *      Implements "ns_ictl update" command.
+ *      Check for and process possible change in the init script.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      Update blueprint.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ICtlUpdateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    NsInterp    *itPtr = (NsInterp *)clientData;
+    int          result;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        result = UpdateInterp(itPtr);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ICtlCleanupObjCmd - subcommand of NsTclICtlObjCmd --
+ *
+ *      Implements "ns_ictl cleanup" command.
+ *      Invoke the legacy defer callbacks.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      Free memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ICtlCleanupObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    NsInterp    *itPtr = (NsInterp *)clientData;
+    int          result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (itPtr->firstDeferPtr != NULL) {
+        Defer  *deferPtr;
+
+        for (deferPtr = itPtr->firstDeferPtr; deferPtr != NULL; deferPtr = deferPtr->nextPtr) {
+            (*deferPtr->proc)(interp, deferPtr->arg);
+            ns_free(deferPtr);
+        }
+        itPtr->firstDeferPtr = NULL;
+        result = UpdateInterp(itPtr);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ICtlOnInitObjCmd
+ * ICtlOnCreateObjCmd
+ * ICtlOnCleanupObjCmd
+ * ICtlOnDeleteObjCmd
+ * ICtlTraceObjCmd
+ *        - subcommands of NsTclICtlObjCmd --
+ *
+ *      Implements various trace commands
+ *
+ *          "ns_ictl oncleanup"
+ *          "ns_ictl oncreate
+ *          "ns_ictl ondelete"
+ *          "ns_ictl oninit"
+ *          "ns_ictl trace"
+ *
+ *      Register script-level interp traces. "ns_ictl trace" is the new
+ *      version, the other ones are deprecated 3-argument variants.
+ *
+ * Results:
+ *      Standard Tcl result.
+ *
+ * Side effects:
+ *      Adding a trace on success.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ICtlOnCreateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    Ns_LogDeprecated(objv, 2, "ns_ictl trace create ...", NULL);
+    return ICtlAddTrace(clientData, interp, objc, objv, NS_TCL_TRACE_CREATE);
+}
+static int
+ICtlOnCleanupObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    Ns_LogDeprecated(objv, 2, "ns_ictl trace deallocate ...", NULL);
     return ICtlAddTrace(clientData, interp, objc, objv, NS_TCL_TRACE_DEALLOCATE);
 }
 static int
@@ -1631,6 +2257,7 @@ NsTclICtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_
         {"addmodule",            ICtlAddModuleObjCmd},
         {"cleanup",              ICtlCleanupObjCmd},
         {"epoch",                ICtlEpochObjCmd},
+        {"footprint",            ICtlFootprintObjCmd},
         {"get",                  ICtlGetObjCmd},
         {"getmodules",           ICtlGetModulesObjCmd},
         {"gettraces",            ICtlGetTracesObjCmd},
@@ -1640,9 +2267,12 @@ NsTclICtlObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_
         {"oncreate",             ICtlOnCreateObjCmd},
         {"ondelete",             ICtlOnDeleteObjCmd},
         {"oninit",               ICtlOnCreateObjCmd},
+        {"procs",                ICtlProcsObjCmd},
         {"runtraces",            ICtlRunTracesObjCmd},
         {"save",                 ICtlSaveObjCmd},
+        {"saveunits",            ICtlSaveUnitsObjCmd},
         {"trace",                ICtlTraceObjCmd},
+        {"units",                ICtlUnitsObjCmd},
         {"update",               ICtlUpdateObjCmd},
         {NULL, NULL}
     };
@@ -1840,6 +2470,38 @@ NsGetInterpData(Tcl_Interp *interp)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * KeepConnInterp --
+ *
+ *      Account the interp of a connection thread in its connection
+ *      pool, unless it is already accounted.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Increments the number of interps kept by the pool.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+KeepConnInterp(NsInterp *itPtr, ConnPool *poolPtr)
+{
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(poolPtr != NULL);
+
+    if (itPtr->poolPtr == NULL) {
+        Ns_MutexLock(&poolPtr->threads.lock);
+        poolPtr->interps.current++;
+        Ns_MutexUnlock(&poolPtr->threads.lock);
+        itPtr->poolPtr = poolPtr;
+    }
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1863,9 +2525,26 @@ NsFreeConnInterp(Conn *connPtr)
     NsInterp *itPtr = connPtr->itPtr;
 
     if (itPtr != NULL) {
+        ConnPool *poolPtr = itPtr->poolPtr;
+
         RunTraces(itPtr, NS_TCL_TRACE_FREECONN);
         itPtr->conn = NULL;
         itPtr->nsconn.flags = 0u;
+
+        /*
+         * When the connection threads of the pool keep more than
+         * "maxinterps" interps, release the interp of this thread
+         * instead of caching it.
+         */
+        if (poolPtr != NULL && poolPtr->interps.max > 0) {
+            Ns_MutexLock(&poolPtr->threads.lock);
+            if (poolPtr->interps.current > poolPtr->interps.max) {
+                poolPtr->interps.current--;
+                itPtr->poolPtr = NULL;
+                itPtr->deleteInterp = NS_TRUE;
+            }
+            Ns_MutexUnlock(&poolPtr->threads.lock);
+        }
         PushInterp(itPtr);
         connPtr->itPtr = NULL;
     }
@@ -2007,6 +2686,12 @@ PushInterp(NsInterp *itPtr)
      */
     if (itPtr->refcnt == 1) {
         RunTraces(itPtr, NS_TCL_TRACE_DEALLOCATE);
+        itPtr->footprint.uses++;
+        if (itPtr->servPtr != NULL
+            && itPtr->servPtr->tcl.sampleInterval > 0
+            && itPtr->footprint.uses % (unsigned long)itPtr->servPtr->tcl.sampleInterval == 0u) {
+            SampleInterp(itPtr);
+        }
         if (itPtr->deleteInterp) {
             Ns_Log(Debug, "ns_markfordelete: true");
             Ns_TclDestroyInterp(interp);
@@ -2230,6 +2915,9 @@ NewInterpData(Tcl_Interp *interp, NsServer *servPtr)
         Tcl_InitHashTable(&itPtr->sets, TCL_STRING_KEYS);
         Tcl_InitHashTable(&itPtr->chans, TCL_STRING_KEYS);
         Tcl_InitHashTable(&itPtr->httpRequests, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&itPtr->nearCaches, TCL_ONE_WORD_KEYS);
+        Tcl_InitHashTable(&itPtr->nsvCache, TCL_STRING_KEYS);
+        Tcl_InitHashTable(&itPtr->nsvCounters, TCL_STRING_KEYS);
         NsAdpInit(itPtr);
 
         /*
@@ -2256,7 +2944,10 @@ NewInterpData(Tcl_Interp *interp, NsServer *servPtr)
  * UpdateInterp --
  *
  *      Update the state of an interp by evaluating the saved script
- *      whenever the epoch changes.
+ *      whenever the epoch changes. Interps which are fresh or older
+ *      than the last full blueprint save evaluate the full blueprint
+ *      script plus the units saved afterwards; other interps evaluate
+ *      only the units changed since their epoch.
  *
  * Results:
  *      Tcl result.
@@ -2271,14 +2962,21 @@ static int
 UpdateInterp(NsInterp *itPtr)
 {
     NsServer   *servPtr;
-    int         result = TCL_OK, epoch;
+    int         result = TCL_OK, nunits = 0, nprocs = 0;
+    uint64_t    epoch;
     TCL_SIZE_T  scriptLength = 0;
     const char *script = NULL;
+    Blueprint  *bpPtr = NULL;
+    LazyProcs  *procsPtr = NULL;
     bool        doUpdateNow = NS_FALSE;
+    Tcl_DString unitsDs, procsDs;
 
     NS_NONNULL_ASSERT(itPtr != NULL);
     servPtr = itPtr->servPtr;
 
+    Tcl_DStringInit(&unitsDs);
+    Tcl_DStringInit(&procsDs);
+
     /*
      * A reader-writer lock is used on the assumption updates are rare and
      * likely expensive to evaluate if the virtual server contains significant
@@ -2286,7 +2984,9 @@ UpdateInterp(NsInterp *itPtr)
      * variables.
      *
      * In the code block below, we want to avoid running the blueprint update
-     * under the lock. Therefore, we copy the blueprint script with ns_strdup.
+     * under the lock. Therefore, we copy the blueprint script with ns_strdup
+     * and the changed units into a DString. Similarly, the names of the
+     * lazily materialized procs are copied for creating the stubs.
      */
     Ns_RWLockRdLock(&servPtr->tcl.lock);
     if (itPtr->epoch != servPtr->tcl.epoch) {
@@ -2296,11 +2996,40 @@ UpdateInterp(NsInterp *itPtr)
          * either (a) the interpreter is fresh, or (b) when the concurrently
          * running updates are below "maxConcurrentUpdates".
          */
-        doUpdateNow = (itPtr->epoch < 1) || (concurrentUpdates < maxConcurrentUpdates);
+        doUpdateNow = (itPtr->epoch == 0u) || (concurrentUpdates < maxConcurrentUpdates);
         if (doUpdateNow) {
+            uint64_t sinceEpoch;
+
             concurrentUpdates++;
-            script = ns_strdup(servPtr->tcl.script);
-            scriptLength = servPtr->tcl.length;
+            if (itPtr->epoch == 0u || itPtr->epoch < servPtr->tcl.fullEpoch) {
+                if (servPtr->tcl.blueprint != NULL) {
+                    /*
+                     * Use the shared preparsed blueprint, which is kept
+                     * alive by its reference count.
+                     */
+                    bpPtr = servPtr->tcl.blueprint;
+                    Ns_MutexLock(&updateLock);
+                    bpPtr->refCount++;
+                    Ns_MutexUnlock(&updateLock);
+                } else if (servPtr->tcl.script != NULL) {
+                    script = ns_strdup(servPtr->tcl.script);
+                    scriptLength = servPtr->tcl.length;
+                }
+                sinceEpoch = servPtr->tcl.fullEpoch;
+                if (servPtr->tcl.procs != NULL) {
+                    /*
+                     * Every stub keeps a reference to the definitions.
+                     */
+                    procsPtr = servPtr->tcl.procs;
+                    nprocs = AppendProcNames(procsPtr, &procsDs);
+                    Ns_MutexLock(&updateLock);
+                    procsPtr->refCount += nprocs;
+                    Ns_MutexUnlock(&updateLock);
+                }
+            } else {
+                sinceEpoch = itPtr->epoch;
+            }
+            nunits = AppendChangedUnits(servPtr, sinceEpoch, &unitsDs);
         }
     } else {
         epoch = itPtr->epoch;
@@ -2311,14 +3040,28 @@ UpdateInterp(NsInterp *itPtr)
         if (doUpdateNow) {
             Ns_Time startTime, now, diffTime;
 
-            Ns_Log(Notice, "start update interpreter %s to epoch %d, concurrent %d",
-                   servPtr->server, epoch, concurrentUpdates);
+            Ns_Log(Notice, "start update interpreter %s to epoch %" PRIu64 " (%s, %d units, %d lazy procs),"
+                   " concurrent %d",
+                   servPtr->server, epoch,
+                   bpPtr != NULL ? "full preparsed" : (script != NULL ? "full" : "incremental"),
+                   nunits, nprocs, concurrentUpdates);
             Ns_GetTime(&startTime);
-            result = Tcl_EvalEx(itPtr->interp, script,
-                                scriptLength, TCL_EVAL_GLOBAL);
+            if (nprocs > 0) {
+                CreateProcStubs(itPtr->interp, procsPtr, procsDs.string, nprocs);
+            }
+            if (bpPtr != NULL) {
+                result = EvalBlueprint(itPtr->interp, bpPtr);
+            } else if (script != NULL) {
+                result = Tcl_EvalEx(itPtr->interp, script,
+                                    scriptLength, TCL_EVAL_GLOBAL);
+            }
+            if (result == TCL_OK && nunits > 0) {
+                result = Tcl_EvalEx(itPtr->interp, unitsDs.string,
+                                    unitsDs.length, TCL_EVAL_GLOBAL);
+            }
             Ns_GetTime(&now);
             Ns_DiffTime(&now, &startTime, &diffTime);
-            Ns_Log(Notice, "update interpreter %s to epoch %d done, trace %s, time "
+            Ns_Log(Notice, "update interpreter %s to epoch %" PRIu64 " done, trace %s, time "
                    NS_TIME_FMT " secs concurrent %d",
                    servPtr->server, epoch,
                    GetTraceLabel(itPtr->currentTrace),
@@ -2327,96 +3070,1007 @@ UpdateInterp(NsInterp *itPtr)
 
             itPtr->epoch = epoch;
             ns_free((char *)script);
+            if (bpPtr != NULL) {
+                ReleaseBlueprint(bpPtr);
+            }
 
             Ns_MutexLock(&updateLock);
             concurrentUpdates--;
             Ns_MutexUnlock(&updateLock);
         } else {
-            Ns_Log(Notice, "postponed update, %s epoch %d interpreter (concurrent %d max %d)",
+            Ns_Log(Notice, "postponed update, %s epoch %" PRIu64 " interpreter (concurrent %d max %d)",
                    servPtr->server, epoch, concurrentUpdates, maxConcurrentUpdates);
         }
     }
+    Tcl_DStringFree(&unitsDs);
+    Tcl_DStringFree(&procsDs);
 
     return result;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * RunTraces, LogTrace --
+ * NextEpoch --
  *
- *      Execute interp trace callbacks.
+ *      Compute the epoch following the current epoch of the server.
+ *      The epoch is a 64-bit counter, which does not wrap in practice,
+ *      so epochs can be compared with plain arithmetic. Must be called
+ *      with the write lock of the blueprint held.
  *
  * Results:
- *      None.
+ *      Next epoch.
  *
  * Side effects:
- *      Depends on callbacks. Event may be logged.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
-static void
-RunTraces(NsInterp *itPtr, Ns_TclTraceType why)
+
+static uint64_t
+NextEpoch(const NsServer *servPtr)
 {
-    const TclTrace *tracePtr;
-    const NsServer *servPtr;
+    NS_NONNULL_ASSERT(servPtr != NULL);
 
-    NS_NONNULL_ASSERT(itPtr != NULL);
+    /*
+     * Epoch zero is reserved for new interps.
+     */
+    return servPtr->tcl.epoch + 1u;
+}
 
-    servPtr = itPtr->servPtr;
-    if (servPtr != NULL) {
 
-        //Ns_Log(Notice, "RunTraces %d", (int)why);
-        itPtr->currentTrace = why;
+/*
+ *----------------------------------------------------------------------
+ *
+ * SaveUnits --
+ *
+ *      Record the units from the provided dict of unit names and
+ *      scripts in the provided table. New units and units with changed
+ *      scripts are stamped with the provided epoch and appended, when
+ *      provided, to the list of changed units. When the dict is
+ *      complete, units of the table which are not contained in the dict
+ *      are marked as removed the same way. Must be called with the
+ *      write lock of the blueprint held.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Update the provided table of blueprint units.
+ *
+ *----------------------------------------------------------------------
+ */
 
-        switch (why) {
-        case NS_TCL_TRACE_FREECONN:   NS_FALL_THROUGH; /* fall through */
-        case NS_TCL_TRACE_DEALLOCATE: NS_FALL_THROUGH; /* fall through */
-        case NS_TCL_TRACE_DELETE:
-            /*
-             * Run finalization traces in LIFO order.
-             */
-            tracePtr = servPtr->tcl.lastTracePtr;
-            while (tracePtr != NULL) {
-                if (tracePtr->when == why) {
-                    LogTrace(itPtr, tracePtr, why);
-                    if ((*tracePtr->proc)(itPtr->interp, tracePtr->arg) != TCL_OK) {
-                        LogErrorInTrace(itPtr, "trace", why);
-                    }
-                }
-                tracePtr = tracePtr->prevPtr;
+static int
+SaveUnits(NsServer *servPtr, Tcl_Interp *interp, Tcl_HashTable *tablePtr, Tcl_Obj *unitsObj,
+          bool complete, uint64_t epoch, Tcl_Obj *changedObj)
+{
+    Tcl_DictSearch search;
+    Tcl_Obj       *keyObj, *valueObj;
+    int            done, result;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+    NS_NONNULL_ASSERT(unitsObj != NULL);
+
+    result = Tcl_DictObjFirst(interp, unitsObj, &search, &keyObj, &valueObj, &done);
+    while (result == TCL_OK && done == 0) {
+        Tcl_HashEntry *hPtr;
+        BlueprintUnit *unitPtr;
+        TCL_SIZE_T     length;
+        const char    *script = Tcl_GetStringFromObj(valueObj, &length);
+        int            isNew;
+
+        hPtr = Tcl_CreateHashEntry(tablePtr, Tcl_GetString(keyObj), &isNew);
+        if (isNew != 0) {
+            unitPtr = ns_calloc(1u, sizeof(BlueprintUnit));
+            Tcl_SetHashValue(hPtr, unitPtr);
+        } else {
+            unitPtr = Tcl_GetHashValue(hPtr);
+        }
+        if (isNew != 0
+            || unitPtr->removed
+            || unitPtr->length != length
+            || memcmp(unitPtr->script, script, (size_t)length) != 0) {
+            ns_free(unitPtr->script);
+            unitPtr->script = ns_strncopy(script, length);
+            unitPtr->length = length;
+            unitPtr->epoch = epoch;
+            unitPtr->seq = ++servPtr->tcl.unitSeq;
+            unitPtr->removed = NS_FALSE;
+            if (changedObj != NULL) {
+                (void) Tcl_ListObjAppendElement(NULL, changedObj, keyObj);
             }
-            break;
+        }
+        Tcl_DictObjNext(&search, &keyObj, &valueObj, &done);
+    }
 
-        case NS_TCL_TRACE_ALLOCATE:  NS_FALL_THROUGH; /* fall through */
-        case NS_TCL_TRACE_CREATE:    NS_FALL_THROUGH; /* fall through */
-        case NS_TCL_TRACE_GETCONN:   NS_FALL_THROUGH; /* fall through */
-        case NS_TCL_TRACE_IDLE:
-            /*
-             * Run initialization traces in FIFO order.
-             */
-            tracePtr = servPtr->tcl.firstTracePtr;
-            while (tracePtr != NULL) {
-                if (tracePtr->when == why) {
-                    LogTrace(itPtr, tracePtr, why);
-                    if ((*tracePtr->proc)(itPtr->interp, tracePtr->arg) != TCL_OK) {
-                        LogErrorInTrace(itPtr, "trace", why);
-                    }
+    if (result == TCL_OK && complete) {
+        Tcl_HashEntry  *hPtr;
+        Tcl_HashSearch  hSearch;
+        Tcl_DString     ds;
+
+        /*
+         * Mark the units, which are not part of the dict anymore, as
+         * removed. Otherwise, fresh interps would recreate them from
+         * the full blueprint script, and existing interps would keep
+         * them.
+         */
+        Tcl_DStringInit(&ds);
+        for (hPtr = Tcl_FirstHashEntry(tablePtr, &hSearch);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&hSearch)) {
+            BlueprintUnit *unitPtr = Tcl_GetHashValue(hPtr);
+            const char    *key = Tcl_GetHashKey(tablePtr, hPtr);
+            Tcl_Obj       *nameObj, *scriptObj = NULL;
+
+            if (unitPtr->removed) {
+                continue;
+            }
+            nameObj = Tcl_NewStringObj(key, TCL_INDEX_NONE);
+            Tcl_IncrRefCount(nameObj);
+            if (Tcl_DictObjGet(NULL, unitsObj, nameObj, &scriptObj) == TCL_OK
+                && scriptObj == NULL) {
+                Tcl_DStringSetLength(&ds, 0);
+                RemovedUnitScript(key, &ds);
+                ns_free(unitPtr->script);
+                unitPtr->script = ns_strncopy(ds.string, ds.length);
+                unitPtr->length = ds.length;
+                unitPtr->epoch = epoch;
+                unitPtr->seq = ++servPtr->tcl.unitSeq;
+                unitPtr->removed = NS_TRUE;
+                if (changedObj != NULL) {
+                    (void) Tcl_ListObjAppendElement(NULL, changedObj, nameObj);
                 }
-                tracePtr = tracePtr->nextPtr;
             }
-            break;
-
-        case NS_TCL_TRACE_NONE:
-            break;
+            Tcl_DecrRefCount(nameObj);
         }
+        Tcl_DStringFree(&ds);
     }
-    itPtr->currentTrace = 0u;
+
+    return result;
 }
 
-static void
-LogTrace(const NsInterp *itPtr, const TclTrace *tracePtr, Ns_TclTraceType why)
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemovedUnitScript --
+ *
+ *      Append the script for deleting the proc, variable or namespace
+ *      of the provided unit name (as returned by nstrace::unitscripts)
+ *      to the DString. For other units, nothing has to be deleted.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Append to the DString.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RemovedUnitScript(const char *key, Tcl_DString *dsPtr)
+{
+    Tcl_DString cmdDs;
+
+    NS_NONNULL_ASSERT(key != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    Tcl_DStringInit(&cmdDs);
+    if (strncmp(key, "proc ", 5u) == 0) {
+        Tcl_DStringAppendElement(&cmdDs, "rename");
+        Tcl_DStringAppendElement(&cmdDs, key + 5);
+        Tcl_DStringAppendElement(&cmdDs, "");
+    } else if (strncmp(key, "variable ", 9u) == 0) {
+        Tcl_DStringAppendElement(&cmdDs, "unset");
+        Tcl_DStringAppendElement(&cmdDs, "-nocomplain");
+        Tcl_DStringAppendElement(&cmdDs, key + 9);
+    } else if (strncmp(key, "namespace ", 10u) == 0 && strcmp(key + 10, "::") != 0) {
+        Tcl_DStringAppendElement(&cmdDs, "namespace");
+        Tcl_DStringAppendElement(&cmdDs, "delete");
+        Tcl_DStringAppendElement(&cmdDs, key + 10);
+    }
+    if (cmdDs.length > 0) {
+        Tcl_DStringAppendElement(dsPtr, "catch");
+        Tcl_DStringAppendElement(dsPtr, cmdDs.string);
+    }
+    Tcl_DStringFree(&cmdDs);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeUnits --
+ *
+ *      Delete all blueprint units of the provided table.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Free memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeUnits(Tcl_HashTable *tablePtr)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    for (hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        BlueprintUnit *unitPtr = Tcl_GetHashValue(hPtr);
+
+        ns_free(unitPtr->script);
+        ns_free(unitPtr);
+        Tcl_DeleteHashEntry(hPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReplaceUnits --
+ *
+ *      Replace the blueprint units of the server by the units of the
+ *      provided table. The units are moved, the provided table is left
+ *      empty. Must be called with the write lock of the blueprint held.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Free the previously saved units.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReplaceUnits(NsServer *servPtr, Tcl_HashTable *tablePtr)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    FreeUnits(&servPtr->tcl.units);
+
+    for (hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        Tcl_HashEntry *newPtr;
+        int            isNew;
+
+        newPtr = Tcl_CreateHashEntry(&servPtr->tcl.units, Tcl_GetHashKey(tablePtr, hPtr), &isNew);
+        Tcl_SetHashValue(newPtr, Tcl_GetHashValue(hPtr));
+        Tcl_DeleteHashEntry(hPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendChangedUnits, CompareUnits --
+ *
+ *      Append the scripts of all units changed after the provided
+ *      epoch in the order of their updates to the DString. Must be
+ *      called with the lock of the blueprint held.
+ *
+ * Results:
+ *      Number of appended units.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompareUnits(const void *a, const void *b)
+{
+    const BlueprintUnit *u1 = *(const BlueprintUnit *const*)a;
+    const BlueprintUnit *u2 = *(const BlueprintUnit *const*)b;
+
+    return (u1->seq < u2->seq) ? -1 : ((u1->seq > u2->seq) ? 1 : 0);
+}
+
+static int
+AppendChangedUnits(NsServer *servPtr, uint64_t sinceEpoch, Tcl_DString *dsPtr)
+{
+    const Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch        search;
+    const BlueprintUnit **units;
+    int                   i, nunits = 0;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    if (servPtr->tcl.units.numEntries > 0) {
+        units = ns_malloc(sizeof(BlueprintUnit *) * (size_t)servPtr->tcl.units.numEntries);
+
+        for (hPtr = Tcl_FirstHashEntry(&servPtr->tcl.units, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            const BlueprintUnit *unitPtr = Tcl_GetHashValue(hPtr);
+
+            if (unitPtr->epoch > sinceEpoch) {
+                units[nunits++] = unitPtr;
+            }
+        }
+        if (nunits > 1) {
+            qsort((void *)units, (size_t)nunits, sizeof(BlueprintUnit *), CompareUnits);
+        }
+        for (i = 0; i < nunits; i++) {
+            Tcl_DStringAppend(dsPtr, units[i]->script, units[i]->length);
+            Tcl_DStringAppend(dsPtr, "\n", 1);
+        }
+        ns_free((void *)units);
+    }
+    return nunits;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SaveProcs --
+ *
+ *      Replace the lazily materialized procs by the proc definitions
+ *      from the provided dict of fully qualified proc names and lists
+ *      containing the argument list and body of the proc. The
+ *      definitions are validated first, such that the saved procs are
+ *      left untouched on errors. The previous definitions are kept
+ *      until the stubs referring to them are gone. Must be called with
+ *      the write lock of the blueprint held.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Replace the set of lazily materialized procs.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SaveProcs(NsServer *servPtr, Tcl_Interp *interp, Tcl_Obj *procsObj)
+{
+    Tcl_DictSearch search;
+    Tcl_Obj       *keyObj, *valueObj;
+    int            done, result;
+    TCL_SIZE_T     oc;
+    Tcl_Obj      **ov;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(procsObj != NULL);
+
+    result = Tcl_DictObjFirst(interp, procsObj, &search, &keyObj, &valueObj, &done);
+    while (result == TCL_OK && done == 0) {
+        if (Tcl_ListObjGetElements(interp, valueObj, &oc, &ov) != TCL_OK) {
+            result = TCL_ERROR;
+        } else if (oc != 2) {
+            Ns_TclPrintfResult(interp, "invalid proc definition for \"%s\": "
+                               "must be a list containing args and body",
+                               Tcl_GetString(keyObj));
+            result = TCL_ERROR;
+        }
+        if (result == TCL_OK) {
+            Tcl_DictObjNext(&search, &keyObj, &valueObj, &done);
+        } else {
+            Tcl_DictObjDone(&search);
+        }
+    }
+
+    if (result == TCL_OK) {
+        LazyProcs *procsPtr = ns_malloc(sizeof(LazyProcs));
+
+        procsPtr->refCount = 1;
+        Tcl_InitHashTable(&procsPtr->table, TCL_STRING_KEYS);
+
+        (void) Tcl_DictObjFirst(NULL, procsObj, &search, &keyObj, &valueObj, &done);
+        while (done == 0) {
+            Tcl_HashEntry *hPtr;
+            LazyProc      *procPtr;
+            const char    *args, *body;
+            TCL_SIZE_T     argsLength, bodyLength;
+            int            isNew;
+
+            (void) Tcl_ListObjGetElements(NULL, valueObj, &oc, &ov);
+            args = Tcl_GetStringFromObj(ov[0], &argsLength);
+            body = Tcl_GetStringFromObj(ov[1], &bodyLength);
+
+            hPtr = Tcl_CreateHashEntry(&procsPtr->table, Tcl_GetString(keyObj), &isNew);
+            if (isNew != 0) {
+                procPtr = ns_calloc(1u, sizeof(LazyProc));
+                Tcl_SetHashValue(hPtr, procPtr);
+            } else {
+                procPtr = Tcl_GetHashValue(hPtr);
+                ns_free(procPtr->args);
+                ns_free(procPtr->body);
+            }
+            procPtr->args = ns_strncopy(args, argsLength);
+            procPtr->argsLength = argsLength;
+            procPtr->body = ns_strncopy(body, bodyLength);
+            procPtr->bodyLength = bodyLength;
+
+            Tcl_DictObjNext(&search, &keyObj, &valueObj, &done);
+        }
+
+        if (servPtr->tcl.procs != NULL) {
+            ReleaseProcs(servPtr->tcl.procs, 1);
+        }
+        servPtr->tcl.procs = procsPtr;
+    }
+
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReleaseProcs --
+ *
+ *      Release the provided number of references to a set of lazily
+ *      materialized procs. The definitions are freed when the last
+ *      reference is released.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Potentially free memory.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReleaseProcs(LazyProcs *procsPtr, int count)
+{
+    int refCount;
+
+    NS_NONNULL_ASSERT(procsPtr != NULL);
+
+    Ns_MutexLock(&updateLock);
+    procsPtr->refCount -= count;
+    refCount = procsPtr->refCount;
+    Ns_MutexUnlock(&updateLock);
+
+    if (refCount == 0) {
+        Tcl_HashEntry  *hPtr;
+        Tcl_HashSearch  search;
+
+        for (hPtr = Tcl_FirstHashEntry(&procsPtr->table, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            LazyProc *procPtr = Tcl_GetHashValue(hPtr);
+
+            ns_free(procPtr->args);
+            ns_free(procPtr->body);
+            ns_free(procPtr);
+        }
+        Tcl_DeleteHashTable(&procsPtr->table);
+        ns_free(procsPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendProcNames, CreateProcStubs --
+ *
+ *      AppendProcNames copies the names of the lazily materialized
+ *      procs as NUL-terminated strings into the DString. It must be
+ *      called with the lock of the blueprint held. CreateProcStubs
+ *      creates for every name a stub command in the interp, which
+ *      defines the actual proc on its first invocation. Every stub
+ *      takes over one reference to the set of definitions. Missing
+ *      namespaces are created as well.
+ *
+ * Results:
+ *      AppendProcNames returns the number of names.
+ *
+ * Side effects:
+ *      CreateProcStubs replaces existing commands with the same
+ *      names.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AppendProcNames(LazyProcs *procsPtr, Tcl_DString *dsPtr)
+{
+    const Tcl_HashEntry *hPtr;
+    Tcl_HashSearch       search;
+    int                  nprocs = 0;
+
+    NS_NONNULL_ASSERT(procsPtr != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    for (hPtr = Tcl_FirstHashEntry(&procsPtr->table, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        const char *name = Tcl_GetHashKey(&procsPtr->table, hPtr);
+
+        Tcl_DStringAppend(dsPtr, name, (TCL_SIZE_T)strlen(name) + 1);
+        nprocs++;
+    }
+    return nprocs;
+}
+
+static void
+CreateProcStubs(Tcl_Interp *interp, LazyProcs *procsPtr, const char *names, int nprocs)
+{
+    int i;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(procsPtr != NULL);
+    NS_NONNULL_ASSERT(names != NULL);
+
+    for (i = 0; i < nprocs; i++) {
+        size_t        length = strlen(names);
+        LazyProcStub *stubPtr = ns_malloc(sizeof(LazyProcStub) + length);
+
+        stubPtr->procsPtr = procsPtr;
+        memcpy(stubPtr->name, names, length + 1u);
+        stubPtr->token = TCL_CREATEOBJCOMMAND(interp, names, LazyProcObjCmd,
+                                              stubPtr, LazyProcDeleteProc);
+        names += length + 1u;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LazyProcObjCmd, LazyProcDeleteProc --
+ *
+ *      Stub command of a lazily materialized proc. On its first
+ *      invocation, the proc is defined from the definition in the
+ *      set of definitions the stub was created from under the current
+ *      name of the stub, which replaces the stub. The original command
+ *      is then invoked again, now calling the actual proc. Deleting
+ *      the stub releases its reference to the set of definitions.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Defines a proc, deletes the stub.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LazyProcObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const LazyProcStub  *stubPtr = clientData;
+    const Tcl_HashEntry *hPtr;
+    Tcl_Obj             *procObjv[4];
+    int                  result = TCL_OK;
+
+    /*
+     * The definitions are not modified after saving, and the reference
+     * of the stub keeps them alive, so no lock is needed.
+     */
+    procObjv[0] = NULL;
+    hPtr = Tcl_FindHashEntry(&stubPtr->procsPtr->table, stubPtr->name);
+    if (hPtr != NULL) {
+        const LazyProc *procPtr = Tcl_GetHashValue(hPtr);
+
+        procObjv[0] = Tcl_NewStringObj("::proc", 6);
+        procObjv[1] = Tcl_NewObj();
+        procObjv[2] = Tcl_NewStringObj(procPtr->args, procPtr->argsLength);
+        procObjv[3] = Tcl_NewStringObj(procPtr->body, procPtr->bodyLength);
+    }
+
+    if (procObjv[0] == NULL) {
+        Ns_TclPrintfResult(interp, "definition of lazy proc \"%s\" is not available",
+                           stubPtr->name);
+        result = TCL_ERROR;
+
+    } else {
+        int i;
+
+        /*
+         * Define the proc under the current name of the stub, which might
+         * have been renamed in the meantime. Defining the proc deletes
+         * the stub, but keeps the namespace imports of the stub.
+         */
+        Tcl_GetCommandFullName(interp, stubPtr->token, procObjv[1]);
+        for (i = 0; i < 4; i++) {
+            Tcl_IncrRefCount(procObjv[i]);
+        }
+        result = Tcl_EvalObjv(interp, 4, procObjv, TCL_EVAL_GLOBAL);
+        for (i = 0; i < 4; i++) {
+            Tcl_DecrRefCount(procObjv[i]);
+        }
+        if (result == TCL_OK) {
+            result = Tcl_EvalObjv(interp, objc, objv, 0);
+        }
+    }
+    return result;
+}
+
+static void
+LazyProcDeleteProc(ClientData clientData)
+{
+    LazyProcStub *stubPtr = clientData;
+
+    ReleaseProcs(stubPtr->procsPtr, 1);
+    ns_free(stubPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewBlueprint, ReleaseBlueprint --
+ *
+ *      Create a preparsed blueprint from a copy of the provided
+ *      script, or release a reference to it. The blueprint is freed
+ *      when the last reference is released.
+ *
+ * Results:
+ *      NewBlueprint returns the blueprint with a reference count of
+ *      one, or NULL, when the script cannot be parsed.
+ *
+ * Side effects:
+ *      Memory allocation/deallocation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Blueprint *
+NewBlueprint(const char *script, TCL_SIZE_T length)
+{
+    Blueprint       *bpPtr = NULL;
+    char            *copy;
+    PreparsedScript *parsedPtr;
+
+    NS_NONNULL_ASSERT(script != NULL);
+
+    copy = ns_strncopy(script, length);
+    parsedPtr = PreparseScript(copy, length, 0);
+    if (parsedPtr == NULL) {
+        Ns_Log(Warning, "blueprint could not be preparsed, using script");
+        ns_free(copy);
+    } else {
+        bpPtr = ns_malloc(sizeof(Blueprint));
+        bpPtr->refCount = 1;
+        bpPtr->script = copy;
+        bpPtr->parsedPtr = parsedPtr;
+    }
+    return bpPtr;
+}
+
+static void
+ReleaseBlueprint(Blueprint *bpPtr)
+{
+    int refCount;
+
+    NS_NONNULL_ASSERT(bpPtr != NULL);
+
+    Ns_MutexLock(&updateLock);
+    refCount = --bpPtr->refCount;
+    Ns_MutexUnlock(&updateLock);
+
+    if (refCount == 0) {
+        FreePreparsedScript(bpPtr->parsedPtr);
+        ns_free(bpPtr->script);
+        ns_free(bpPtr);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PreparseScript, FreePreparsedScript --
+ *
+ *      Split the provided script into commands. For commands with
+ *      only literal words (no substitutions), the words are recorded;
+ *      for "namespace eval" commands with a literal body, the body is
+ *      preparsed recursively. The words refer to the provided script,
+ *      which has to be kept as long as the preparsed script is used.
+ *
+ * Results:
+ *      Preparsed script or NULL on parse errors.
+ *
+ * Side effects:
+ *      Memory allocation/deallocation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static PreparsedScript *
+PreparseScript(const char *script, TCL_SIZE_T length, int depth)
+{
+    PreparsedScript *scriptPtr;
+    const char      *p = script, *end = script + length;
+    int              nalloc = 16;
+    bool             success = NS_TRUE;
+
+    NS_NONNULL_ASSERT(script != NULL);
+
+    scriptPtr = ns_malloc(sizeof(PreparsedScript));
+    scriptPtr->ncmds = 0;
+    scriptPtr->cmds = ns_malloc(sizeof(PreparsedCmd) * (size_t)nalloc);
+
+    while (p < end) {
+        Tcl_Parse     parse;
+        PreparsedCmd *cmdPtr;
+
+        if (Tcl_ParseCommand(NULL, p, (TCL_SIZE_T)(end - p), 0, &parse) != TCL_OK) {
+            success = NS_FALSE;
+            break;
+        }
+        if (parse.numWords > 0) {
+            const Tcl_Token *tokenPtr = parse.tokenPtr;
+            int              i;
+
+            if (scriptPtr->ncmds == nalloc) {
+                nalloc *= 2;
+                scriptPtr->cmds = ns_realloc(scriptPtr->cmds, sizeof(PreparsedCmd) * (size_t)nalloc);
+            }
+            cmdPtr = &scriptPtr->cmds[scriptPtr->ncmds++];
+            cmdPtr->script = parse.commandStart;
+            cmdPtr->length = parse.commandSize;
+            cmdPtr->bodyPtr = NULL;
+            cmdPtr->nwords = (int)parse.numWords;
+            cmdPtr->words = ns_malloc(sizeof(PreparsedWord) * (size_t)parse.numWords);
+
+            for (i = 0; i < cmdPtr->nwords; i++) {
+                if (tokenPtr->type != TCL_TOKEN_SIMPLE_WORD) {
+                    /*
+                     * The word requires substitution, evaluate the command
+                     * from its script.
+                     */
+                    ns_free(cmdPtr->words);
+                    cmdPtr->words = NULL;
+                    cmdPtr->nwords = 0;
+                    break;
+                }
+                cmdPtr->words[i].string = tokenPtr[1].start;
+                cmdPtr->words[i].length = tokenPtr[1].size;
+                tokenPtr += tokenPtr->numComponents + 1;
+            }
+
+            if (cmdPtr->nwords == 4 && depth < 100
+                && ((cmdPtr->words[0].length == 9 && strncmp(cmdPtr->words[0].string, "namespace", 9u) == 0)
+                    || (cmdPtr->words[0].length == 11 && strncmp(cmdPtr->words[0].string, "::namespace", 11u) == 0))
+                && cmdPtr->words[1].length == 4 && strncmp(cmdPtr->words[1].string, "eval", 4u) == 0) {
+                cmdPtr->bodyPtr = PreparseScript(cmdPtr->words[3].string, cmdPtr->words[3].length, depth + 1);
+            }
+        }
+        p = parse.commandStart + parse.commandSize;
+        Tcl_FreeParse(&parse);
+    }
+
+    if (!success) {
+        FreePreparsedScript(scriptPtr);
+        scriptPtr = NULL;
+    }
+    return scriptPtr;
+}
+
+static void
+FreePreparsedScript(PreparsedScript *scriptPtr)
+{
+    int i;
+
+    NS_NONNULL_ASSERT(scriptPtr != NULL);
+
+    for (i = 0; i < scriptPtr->ncmds; i++) {
+        const PreparsedCmd *cmdPtr = &scriptPtr->cmds[i];
+
+        if (cmdPtr->bodyPtr != NULL) {
+            FreePreparsedScript(cmdPtr->bodyPtr);
+        }
+        ns_free(cmdPtr->words);
+    }
+    ns_free(scriptPtr->cmds);
+    ns_free(scriptPtr);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EvalBlueprint, EvalPreparsedScript, BlueprintBodyObjCmd --
+ *
+ *      Evaluate a preparsed blueprint. Commands with literal words are
+ *      invoked directly, other commands are evaluated from their
+ *      script. The "namespace eval" commands with a preparsed body
+ *      are invoked with the body "::ns:blueprintbody", such that the
+ *      namespace eval sets up the namespace and its call frame, and
+ *      the temporary command evaluates the preparsed body in this
+ *      frame without compiling it.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      Depends on the script.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EvalBlueprint(Tcl_Interp *interp, const Blueprint *bpPtr)
+{
+    BlueprintEval ctx;
+    int           result;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(bpPtr != NULL);
+
+    ctx.bodyPtr = NULL;
+    ctx.bodyObj = Tcl_NewStringObj("::ns:blueprintbody", 18);
+    Tcl_IncrRefCount(ctx.bodyObj);
+
+    (void) TCL_CREATEOBJCOMMAND(interp, "::ns:blueprintbody", BlueprintBodyObjCmd, &ctx, NULL);
+    result = EvalPreparsedScript(interp, &ctx, bpPtr->parsedPtr, TCL_EVAL_GLOBAL);
+    (void) Tcl_DeleteCommand(interp, "::ns:blueprintbody");
+
+    Tcl_DecrRefCount(ctx.bodyObj);
+    return result;
+}
+
+static int
+EvalPreparsedScript(Tcl_Interp *interp, BlueprintEval *ctxPtr, const PreparsedScript *scriptPtr, int flags)
+{
+    int i, result = TCL_OK;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(ctxPtr != NULL);
+    NS_NONNULL_ASSERT(scriptPtr != NULL);
+
+    for (i = 0; result == TCL_OK && i < scriptPtr->ncmds; i++) {
+        const PreparsedCmd *cmdPtr = &scriptPtr->cmds[i];
+
+        if (cmdPtr->nwords > 0) {
+            Tcl_Obj  *staticObjv[8], **objv = staticObjv;
+            int       j;
+
+            if (cmdPtr->nwords > 8) {
+                objv = ns_malloc(sizeof(Tcl_Obj *) * (size_t)cmdPtr->nwords);
+            }
+            for (j = 0; j < cmdPtr->nwords; j++) {
+                if (j == 3 && cmdPtr->bodyPtr != NULL) {
+                    objv[j] = ctxPtr->bodyObj;
+                } else {
+                    objv[j] = Tcl_NewStringObj(cmdPtr->words[j].string, cmdPtr->words[j].length);
+                }
+                Tcl_IncrRefCount(objv[j]);
+            }
+            ctxPtr->bodyPtr = cmdPtr->bodyPtr;
+            result = Tcl_EvalObjv(interp, cmdPtr->nwords, objv, flags);
+            ctxPtr->bodyPtr = NULL;
+
+            for (j = 0; j < cmdPtr->nwords; j++) {
+                Tcl_DecrRefCount(objv[j]);
+            }
+            if (objv != staticObjv) {
+                ns_free(objv);
+            }
+
+        } else {
+            result = Tcl_EvalEx(interp, cmdPtr->script, cmdPtr->length, flags);
+        }
+    }
+    return result;
+}
+
+static int
+BlueprintBodyObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* UNUSED(objv))
+{
+    BlueprintEval         *ctxPtr = clientData;
+    const PreparsedScript *bodyPtr = ctxPtr->bodyPtr;
+    int                    result;
+
+    ctxPtr->bodyPtr = NULL;
+    if (bodyPtr == NULL || objc != 1) {
+        Ns_TclPrintfResult(interp, "ns:blueprintbody must be used only as body of a preparsed namespace eval");
+        result = TCL_ERROR;
+    } else {
+        result = EvalPreparsedScript(interp, ctxPtr, bodyPtr, 0);
+    }
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RunTraces, LogTrace --
+ *
+ *      Execute interp trace callbacks.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Depends on callbacks. Event may be logged.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+RunTraces(NsInterp *itPtr, Ns_TclTraceType why)
+{
+    const TclTrace *tracePtr;
+    const NsServer *servPtr;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+
+    servPtr = itPtr->servPtr;
+    if (servPtr != NULL) {
+
+        //Ns_Log(Notice, "RunTraces %d", (int)why);
+        itPtr->currentTrace = why;
+
+        switch (why) {
+        case NS_TCL_TRACE_FREECONN:   NS_FALL_THROUGH; /* fall through */
+        case NS_TCL_TRACE_DEALLOCATE: NS_FALL_THROUGH; /* fall through */
+        case NS_TCL_TRACE_DELETE:
+            /*
+             * Run finalization traces in LIFO order.
+             */
+            tracePtr = servPtr->tcl.lastTracePtr;
+            while (tracePtr != NULL) {
+                if (tracePtr->when == why) {
+                    LogTrace(itPtr, tracePtr, why);
+                    if ((*tracePtr->proc)(itPtr->interp, tracePtr->arg) != TCL_OK) {
+                        LogErrorInTrace(itPtr, "trace", why);
+                    }
+                }
+                tracePtr = tracePtr->prevPtr;
+            }
+            break;
+
+        case NS_TCL_TRACE_ALLOCATE:  NS_FALL_THROUGH; /* fall through */
+        case NS_TCL_TRACE_CREATE:    NS_FALL_THROUGH; /* fall through */
+        case NS_TCL_TRACE_GETCONN:   NS_FALL_THROUGH; /* fall through */
+        case NS_TCL_TRACE_IDLE:
+            /*
+             * Run initialization traces in FIFO order.
+             */
+            tracePtr = servPtr->tcl.firstTracePtr;
+            while (tracePtr != NULL) {
+                if (tracePtr->when == why) {
+                    LogTrace(itPtr, tracePtr, why);
+                    if ((*tracePtr->proc)(itPtr->interp, tracePtr->arg) != TCL_OK) {
+                        LogErrorInTrace(itPtr, "trace", why);
+                    }
+                }
+                tracePtr = tracePtr->nextPtr;
+            }
+            break;
+
+        case NS_TCL_TRACE_NONE:
+            break;
+        }
+    }
+    itPtr->currentTrace = 0u;
+}
+
+static void
+LogTrace(const NsInterp *itPtr, const TclTrace *tracePtr, Ns_TclTraceType why)
 {
     NS_NONNULL_ASSERT(itPtr != NULL);
     NS_NONNULL_ASSERT(tracePtr != NULL);
@@ -2447,6 +4101,333 @@ LogErrorInTrace(const NsInterp *itPtr, const char *context, Ns_TclTraceType why)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SampleInterp --
+ *
+ *      Sample the footprint of an interp on deallocation and register
+ *      it in the server. When one of the configured limits is
+ *      exceeded, the interp is marked for deletion.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Interp might be deleted on this deallocation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SampleInterp(NsInterp *itPtr)
+{
+    NsServer          *servPtr;
+    NsInterpFootprint  footprint;
+    const char        *reason = NULL;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+
+    servPtr = itPtr->servPtr;
+    MeasureInterp(itPtr, &footprint);
+
+    if (servPtr->tcl.maxMemory > 0 && footprint.memory > servPtr->tcl.maxMemory) {
+        reason = "memory";
+    } else if (servPtr->tcl.maxGlobals > 0 && footprint.globals > servPtr->tcl.maxGlobals) {
+        reason = "globals";
+    } else if (servPtr->tcl.maxNamespaces > 0 && footprint.namespaces > servPtr->tcl.maxNamespaces) {
+        reason = "namespaces";
+    }
+    if (reason != NULL) {
+        Ns_Log(Notice, "interp footprint exceeds %s limit "
+               "(memory %" TCL_LL_MODIFIER "d globals %d namespaces %d), recycling interp",
+               reason, footprint.memory, footprint.globals, footprint.namespaces);
+        itPtr->deleteInterp = NS_TRUE;
+    }
+
+    Ns_MutexLock(&servPtr->tcl.footprintLock);
+    itPtr->footprint = footprint;
+    if (!itPtr->footprintRegistered) {
+        int isNew;
+
+        (void) Tcl_CreateHashEntry(&servPtr->tcl.footprints, (char *)itPtr, &isNew);
+        itPtr->footprintRegistered = NS_TRUE;
+    }
+    Ns_MutexUnlock(&servPtr->tcl.footprintLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MeasureInterp --
+ *
+ *      Determine the current footprint of an interp, i.e., the memory
+ *      allocated by the Tcl allocator for the current thread, the
+ *      number of global variables and the number of namespaces.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Fills in the provided footprint structure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MeasureInterp(NsInterp *itPtr, NsInterpFootprint *fpPtr)
+{
+    Tcl_Interp      *interp;
+    Tcl_InterpState  state;
+    Tcl_Obj         *cmdObjv[2];
+    TCL_SIZE_T       length = 0;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+    NS_NONNULL_ASSERT(fpPtr != NULL);
+
+    interp = itPtr->interp;
+    state = Tcl_SaveInterpState(interp, TCL_OK);
+
+    fpPtr->memory = GetThreadMemory();
+
+    cmdObjv[0] = Tcl_NewStringObj("::info", 6);
+    cmdObjv[1] = Tcl_NewStringObj("globals", 7);
+    Tcl_IncrRefCount(cmdObjv[0]);
+    Tcl_IncrRefCount(cmdObjv[1]);
+    if (Tcl_EvalObjv(interp, 2, cmdObjv, TCL_EVAL_GLOBAL) != TCL_OK
+        || Tcl_ListObjLength(NULL, Tcl_GetObjResult(interp), &length) != TCL_OK) {
+        length = 0;
+    }
+    Tcl_DecrRefCount(cmdObjv[0]);
+    Tcl_DecrRefCount(cmdObjv[1]);
+    fpPtr->globals = (int)length;
+    fpPtr->namespaces = CountNamespaces(interp);
+
+    (void) Tcl_RestoreInterpState(interp, state);
+
+    fpPtr->uses = itPtr->footprint.uses;
+    Ns_GetTime(&fpPtr->sampled);
+    strncpy(fpPtr->thread, Ns_ThreadGetName(), NS_THREAD_NAMESIZE - 1u);
+    fpPtr->thread[NS_THREAD_NAMESIZE - 1u] = '\0';
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetThreadMemory --
+ *
+ *      Return the number of bytes currently assigned by the Tcl
+ *      allocator to the current thread, as reported by
+ *      Tcl_GetMemoryInfo().
+ *
+ * Results:
+ *      Number of bytes or -1 when the information is not available.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_WideInt
+GetThreadMemory(void)
+{
+    Tcl_WideInt result = -1;
+#ifdef HAVE_TCL_GETMEMORYINFO
+    Tcl_DString  ds;
+    char         threadName[TCL_INTEGER_SPACE + 8];
+    TCL_SIZE_T   ncaches;
+    const char **caches;
+
+    Tcl_DStringInit(&ds);
+    Tcl_GetMemoryInfo(&ds);
+    snprintf(threadName, sizeof(threadName), "thread%p", (void *)Tcl_GetCurrentThread());
+
+    if (Tcl_SplitList(NULL, ds.string, &ncaches, &caches) == TCL_OK) {
+        TCL_SIZE_T i;
+
+        for (i = 0; i < ncaches && result == -1; i++) {
+            TCL_SIZE_T   nbuckets;
+            const char **buckets;
+
+            if (strncmp(caches[i], threadName, strlen(threadName)) == 0
+                && Tcl_SplitList(NULL, caches[i], &nbuckets, &buckets) == TCL_OK) {
+                TCL_SIZE_T j;
+
+                if (STREQ(buckets[0], threadName)) {
+                    result = 0;
+                    for (j = 1; j < nbuckets; j++) {
+                        Tcl_WideInt blockSize, nfree, nget, nput, assigned;
+
+                        if (sscanf(buckets[j], "%" TCL_LL_MODIFIER "d %" TCL_LL_MODIFIER "d %"
+                                   TCL_LL_MODIFIER "d %" TCL_LL_MODIFIER "d %" TCL_LL_MODIFIER "d",
+                                   &blockSize, &nfree, &nget, &nput, &assigned) == 5) {
+                            result += assigned;
+                        }
+                    }
+                }
+                Tcl_Free((char *)buckets);
+            }
+        }
+        Tcl_Free((char *)caches);
+    }
+    Tcl_DStringFree(&ds);
+#endif
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountNamespaces --
+ *
+ *      Count the namespaces of an interp, including the global
+ *      namespace.
+ *
+ * Results:
+ *      Number of namespaces.
+ *
+ * Side effects:
+ *      Modifies the interp result.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CountNamespaces(Tcl_Interp *interp)
+{
+    Tcl_Obj    *pendingObj, *cmdObjv[3];
+    TCL_SIZE_T  length = 1;
+    int         count = 0;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+
+    pendingObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(pendingObj);
+    (void) Tcl_ListObjAppendElement(NULL, pendingObj, Tcl_NewStringObj("::", 2));
+    cmdObjv[0] = Tcl_NewStringObj("::namespace", 11);
+    cmdObjv[1] = Tcl_NewStringObj("children", 8);
+    Tcl_IncrRefCount(cmdObjv[0]);
+    Tcl_IncrRefCount(cmdObjv[1]);
+
+    /*
+     * Iterate over the pending namespaces instead of recursing, since
+     * namespaces can be nested arbitrarily deep.
+     */
+    while (length > 0) {
+        Tcl_Obj *childrenObj;
+
+        (void) Tcl_ListObjIndex(NULL, pendingObj, length - 1, &cmdObjv[2]);
+        Tcl_IncrRefCount(cmdObjv[2]);
+        (void) Tcl_ListObjReplace(NULL, pendingObj, length - 1, 1, 0, NULL);
+        count++;
+
+        if (Tcl_EvalObjv(interp, 3, cmdObjv, TCL_EVAL_GLOBAL) == TCL_OK) {
+            Tcl_Obj   **elemv;
+            TCL_SIZE_T  elemc;
+
+            childrenObj = Tcl_GetObjResult(interp);
+            if (Tcl_ListObjGetElements(NULL, childrenObj, &elemc, &elemv) == TCL_OK && elemc > 0) {
+                (void) Tcl_ListObjReplace(NULL, pendingObj, length - 1, 0, elemc, elemv);
+            }
+        }
+        Tcl_DecrRefCount(cmdObjv[2]);
+        (void) Tcl_ListObjLength(NULL, pendingObj, &length);
+    }
+
+    Tcl_DecrRefCount(cmdObjv[0]);
+    Tcl_DecrRefCount(cmdObjv[1]);
+    Tcl_DecrRefCount(pendingObj);
+
+    return count;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FootprintObj --
+ *
+ *      Return a dict representing an interp footprint.
+ *
+ * Results:
+ *      Tcl_Obj with refCount 0.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+FootprintObj(const NsInterpFootprint *fpPtr)
+{
+    Tcl_Obj *resultObj = Tcl_NewListObj(0, NULL);
+
+    NS_NONNULL_ASSERT(fpPtr != NULL);
+
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("memory", 6));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewWideIntObj(fpPtr->memory));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("globals", 7));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewIntObj(fpPtr->globals));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("namespaces", 10));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewIntObj(fpPtr->namespaces));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("uses", 4));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewWideIntObj((Tcl_WideInt)fpPtr->uses));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Tcl_NewStringObj("sampled", 7));
+    (void) Tcl_ListObjAppendElement(NULL, resultObj, Ns_TclNewTimeObj(&fpPtr->sampled));
+
+    return resultObj;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsTclAppendFootprints --
+ *
+ *      Append the last sampled footprints of the interps of a server
+ *      as thread name and footprint pairs to the provided list. When a
+ *      pattern is provided, only threads with matching names are
+ *      included.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Modifies the provided list object.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsTclAppendFootprints(NsServer *servPtr, const char *pattern, Tcl_Obj *listObj)
+{
+    const Tcl_HashEntry *hPtr;
+    Tcl_HashSearch       search;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(listObj != NULL);
+
+    Ns_MutexLock(&servPtr->tcl.footprintLock);
+    for (hPtr = Tcl_FirstHashEntry(&servPtr->tcl.footprints, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        const NsInterp *itPtr = (const NsInterp *)Tcl_GetHashKey(&servPtr->tcl.footprints, hPtr);
+
+        if (pattern == NULL || Tcl_StringMatch(itPtr->footprint.thread, pattern) != 0) {
+            (void) Tcl_ListObjAppendElement(NULL, listObj,
+                                            Tcl_NewStringObj(itPtr->footprint.thread, TCL_INDEX_NONE));
+            (void) Tcl_ListObjAppendElement(NULL, listObj, FootprintObj(&itPtr->footprint));
+        }
+    }
+    Ns_MutexUnlock(&servPtr->tcl.footprintLock);
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2469,10 +4450,28 @@ FreeInterpData(ClientData clientData, Tcl_Interp *UNUSED(interp))
 {
     NsInterp *itPtr = (NsInterp *)clientData;
 
+    if (itPtr->poolPtr != NULL) {
+        Ns_MutexLock(&itPtr->poolPtr->threads.lock);
+        itPtr->poolPtr->interps.current--;
+        Ns_MutexUnlock(&itPtr->poolPtr->threads.lock);
+    }
+    if (itPtr->footprintRegistered) {
+        NsServer      *servPtr = itPtr->servPtr;
+        Tcl_HashEntry *hPtr;
+
+        Ns_MutexLock(&servPtr->tcl.footprintLock);
+        hPtr = Tcl_FindHashEntry(&servPtr->tcl.footprints, (char *)itPtr);
+        if (hPtr != NULL) {
+            Tcl_DeleteHashEntry(hPtr);
+        }
+        Ns_MutexUnlock(&servPtr->tcl.footprintLock);
+    }
     NsAdpFree(itPtr);
     Tcl_DeleteHashTable(&itPtr->sets);
     Tcl_DeleteHashTable(&itPtr->chans);
     Tcl_DeleteHashTable(&itPtr->httpRequests);
+    NsTclCacheFreeNearCaches(itPtr);
+    NsTclNsvFreeCache(itPtr);
 
     ns_free(itPtr);
 }
@@ -24,10 +24,15 @@
  */
 
 typedef struct Bucket {
-    Ns_RWLock       rwlock;
-    Ns_Mutex        mlock;
-    Tcl_HashTable   arrays;
-    const NsServer *servPtr;
+    Ns_RWLock        rwlock;
+    Ns_Mutex         mlock;
+    Tcl_HashTable    arrays;
+    const NsServer  *servPtr;
+    uintptr_t        version;      /* Last version assigned to a variable. */
+    struct Snapshot *namesPtr;     /* Snapshot of the array names or NULL. */
+    uintptr_t        contended;    /* Number of contended locks. */
+    uintptr_t        waitTime;     /* Total waiting time for the lock in microseconds. */
+    uintptr_t        lastWaitTime; /* Waiting time at the last migration check. */
 } Bucket;
 
 /*
@@ -36,23 +41,285 @@ typedef struct Bucket {
  */
 
 typedef struct Array {
-    Bucket        *bucketPtr; /* Array bucket. */
-    Tcl_HashEntry *entryPtr;  /* Entry in bucket array table. */
-    Tcl_HashTable  vars;      /* Table of variables. */
-    long           locks;     /* Number of array locks */
+    Bucket          *bucketPtr;   /* Array bucket. */
+    Tcl_HashEntry   *entryPtr;    /* Entry in bucket array table. */
+    Tcl_HashTable    vars;        /* Table of variables. */
+    uintptr_t        locks;       /* Number of array locks */
+    struct Snapshot *snapshotPtr; /* Snapshot of the variables or NULL. */
+    bool             persistent;  /* Modifications are written to the journal. */
+    uintptr_t        journalSeq;  /* Last journal record of the current lock holder. */
+    struct Bucket   *forwardPtr;  /* Forward marker: bucket of the migrated array. */
+    uintptr_t        contended;   /* Number of contended locks. */
+    uintptr_t        waitTime;    /* Total waiting time for the lock in microseconds. */
+    uintptr_t        lastWaitTime; /* Waiting time at the last migration check. */
 } Array;
 
+/*
+ * The following structure defines the journal of the persistent arrays
+ * of a server. Modifications of persistent arrays are appended as
+ * records to a pending buffer, which is written by a background thread
+ * to the journal file (group commit). The thread compacts the journal
+ * periodically into a snapshot file containing the full content of all
+ * persistent arrays. At startup, the snapshot and the journal are
+ * replayed. Counters ("nsv_counter") are updated without the array lock;
+ * modified counters of persistent arrays are queued as dirty, and the
+ * journal thread records their current values on every group commit.
+ */
+
+typedef enum {
+    NSV_SYNC_NONE,    /* Write records, leave flushing to the OS. */
+    NSV_SYNC_BATCH,   /* fsync() after every written batch. */
+    NSV_SYNC_ALWAYS   /* Like batch, modifications wait for the fsync(). */
+} NsvJournalSync;
+
+typedef struct NsvJournal {
+    NsServer       *servPtr;
+    const char     *dir;
+    NsvJournalSync  sync;
+    Ns_Time         compactInterval;
+    Ns_Mutex        lock;
+    Ns_Cond         cond;             /* Wakes up the journal thread. */
+    Ns_Cond         doneCond;         /* Signals written records and compactions. */
+    Ns_Thread       thread;
+    int             fd;               /* File descriptor of the journal file. */
+    Tcl_DString     pending;          /* Records not written yet. */
+    struct DirtyCounter *dirtyPtr;    /* Modified counters not recorded yet. */
+    uintptr_t       pendingSeq;       /* Sequence number of the last pending record. */
+    uintptr_t       writtenSeq;       /* Sequence number of the last written record. */
+    uintptr_t       compactions;      /* Number of finished compactions. */
+    bool            compactRequested;
+    bool            stop;
+    bool            stopped;
+} NsvJournal;
+
+#define NSV_JOURNAL_MAGIC "nsvjournal 1\n"
+
+#ifdef _WIN32
+# define NsvFsync(fd) _commit(fd)
+#else
+# define NsvFsync(fd) fsync(fd)
+#endif
+
+/*
+ * The following structures define an optional structured representation
+ * of a variable value, which is kept next to the string (typed
+ * value). The typed value is immutable and is replaced on every update
+ * of the variable. Interpreters materialize it into Tcl_Objs and cache
+ * these per variable version, such that repeated reads of lists or dicts
+ * do not have to parse the string again.
+ */
+
+typedef enum {
+    NSV_TYPE_STRING,
+    NSV_TYPE_LIST,
+    NSV_TYPE_DICT
+} NsvType;
+
+typedef struct TypedElement {
+    const char  *string;
+    TCL_SIZE_T   length;
+    bool         isInt;      /* Element is an integer in canonical form. */
+    Tcl_WideInt  intValue;
+} TypedElement;
+
+typedef struct TypedValue {
+    NsvType      type;
+    TCL_SIZE_T   nelements;
+    TypedElement elements[1]; /* followed by the element strings */
+} TypedValue;
+
+/*
+ * The following structures define a counter attached to a variable
+ * ("nsv_counter"). Increments are added without the bucket lock to one
+ * of several cache line sized shards, the value of the counter is the sum
+ * of all shards. The counter is reference counted, since interpreters
+ * keep references to it after releasing the bucket lock. When the
+ * variable is updated or unset, the counter is detached from it.
+ */
+
+#if defined(__GNUC__) || defined(__clang__)
+# define NSV_ATOMICS 1
+#endif
+
+#define NSV_COUNTER_SHARDS 16
+#define NSV_INTEGER_SPACE  (TCL_INTEGER_SPACE + 2)
+
+typedef struct CounterShard {
+    Tcl_WideInt value;
+    char        pad[64 - sizeof(Tcl_WideInt)]; /* Avoid false sharing. */
+} CounterShard;
+
+typedef struct NsvCounter {
+    CounterShard shards[NSV_COUNTER_SHARDS];
+    uintptr_t    refCount;  /* References from the variable and interpreters. */
+    int          detached;  /* Counter is not attached to a variable anymore. */
+    int          journaled; /* Counter belongs to a persistent array. */
+    int          dirty;     /* Counter is queued for the journal. */
+} NsvCounter;
+
+/*
+ * The following structure defines an entry in the list of modified
+ * counters of persistent arrays, which are recorded by the journal thread.
+ */
+
+typedef struct DirtyCounter {
+    struct DirtyCounter *nextPtr;
+    NsvCounter          *counterPtr; /* Referenced counter. */
+    const char          *keyString;
+    char                 arrayName[1];
+} DirtyCounter;
+
+/*
+ * The following structure defines a variable, the value of the hash
+ * entries of an array.
+ */
+
+typedef struct Var {
+    TypedValue *typedPtr;   /* Structured representation of the value or NULL. */
+    NsvCounter *counterPtr; /* Attached counter or NULL. */
+    uintptr_t   version;    /* Version of the value, unique per bucket. */
+    char        value[1];   /* String representation of the value. */
+} Var;
+
+/*
+ * The following structures define an immutable copy-on-write snapshot of
+ * the variables of a large array (or of the array names of a
+ * bucket). The snapshot is built on the first full iteration after a
+ * modification and kept until the next modification. Iterations retain
+ * the snapshot and process it after releasing the bucket lock.
+ */
+
+typedef struct SnapshotEntry {
+    const char *key;
+    const char *value;       /* Value string, NULL for array names. */
+    NsvCounter *counterPtr;  /* Attached counter of the variable or NULL. */
+} SnapshotEntry;
+
+typedef struct Snapshot {
+    uintptr_t     refCount;
+    size_t        nentries;
+    SnapshotEntry entries[1]; /* followed by the strings */
+} Snapshot;
+
+/*
+ * The following structure defines the per-interpreter cache entry of a
+ * materialized typed value.
+ */
+
+typedef struct NsvCacheEntry {
+    uintptr_t  version;
+    Tcl_Obj   *valueObj;
+} NsvCacheEntry;
+
+/*
+ * The following structure is used for sorting the contention statistics
+ * of arrays and buckets.
+ */
+
+typedef struct ContentionStat {
+    Tcl_Obj   *nameObj;   /* Array name or NULL for bucket statistics. */
+    int        bucket;    /* Bucket number. */
+    int        narrays;   /* Number of arrays in the bucket. */
+    uintptr_t  locks;     /* Number of array locks. */
+    uintptr_t  contended; /* Number of contended locks. */
+    uintptr_t  waitTime;  /* Total waiting time in microseconds. */
+} ContentionStat;
+
 
 /*
  * Local functions defined in this file.
  */
 
-static void SetVar(Array *arrayPtr, const char *keyString, const char *value, size_t len)
+static void SetVar(Array *arrayPtr, const char *keyString, const char *value, size_t len,
+                   TypedValue *typedPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void SetDictVar(Array *arrayPtr, const char *keyString, Tcl_Obj *dictObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void UpdateVar(Array *arrayPtr, Tcl_HashEntry *hPtr, const char *value, size_t len,
+                      TypedValue *typedPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
 
-static void UpdateVar(Tcl_HashEntry *hPtr, const char *value, size_t len)
+static void FreeVar(Tcl_HashEntry *hPtr)
+    NS_GNUC_NONNULL(1);
+
+static TypedValue *NewTypedValue(Tcl_Interp *interp, Tcl_Obj *valueObj, NsvType type,
+                                 Tcl_Obj **canonicalObjPtr)
+    NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
+
+static Tcl_Obj *TypedValueObj(const TypedValue *typedPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_RETURNS_NONNULL;
+
+static Tcl_Obj *TypedVarObj(Tcl_Interp *interp, const char *arrayName, const char *keyString,
+                            const Var *varPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static const char *VarValue(const Tcl_HashEntry *hPtr, char *buf)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_RETURNS_NONNULL;
+
+static void CounterAdd(NsvCounter *counterPtr, int shard, Tcl_WideInt incr)
+    NS_GNUC_NONNULL(1);
+
+static Tcl_WideInt CounterSum(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static Tcl_WideInt CounterReset(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void CounterRetain(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void CounterRelease(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void CounterDetach(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static bool CounterIsDetached(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void CounterSetJournaled(NsvCounter *counterPtr, bool journaled)
+    NS_GNUC_NONNULL(1);
+
+static bool CounterMarkDirty(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void CounterClearDirty(NsvCounter *counterPtr)
+    NS_GNUC_NONNULL(1);
+
+static void RefCountIncr(uintptr_t *refCountPtr)
+    NS_GNUC_NONNULL(1);
+
+static uintptr_t RefCountDecr(uintptr_t *refCountPtr)
+    NS_GNUC_NONNULL(1);
+
+static Snapshot *GetSnapshot(Snapshot **slotPtr, Tcl_HashTable *tablePtr, bool values)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_RETURNS_NONNULL;
+
+static void DropSnapshot(Snapshot **slotPtr)
+    NS_GNUC_NONNULL(1);
+
+static void SnapshotRelease(Snapshot *snapshotPtr)
+    NS_GNUC_NONNULL(1);
+
+static int SnapshotAppend(Tcl_Interp *interp, const Snapshot *snapshotPtr, const char *pattern,
+                          bool values, Tcl_Obj *listObj)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(5);
+
+static bool UseSnapshot(const Bucket *bucketPtr, const Tcl_HashTable *tablePtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+static int CounterShardIndex(NsInterp *itPtr)
+    NS_GNUC_NONNULL(1);
+
+static NsvCounter *GetCounter(Tcl_Interp *interp, Tcl_Obj *arrayObj, const char *keyString,
+                              bool create)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void CacheKey(Tcl_DString *dsPtr, const char *arrayName, const char *keyString)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
 static int IncrVar(Array *arrayPtr, const char *keyString, int incr, Tcl_WideInt *valuePtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
 
@@ -65,15 +332,112 @@ static void Flush(Array *arrayPtr)
 static Array *LockArray(const NsServer *servPtr, const char *arrayName, bool create, NS_RW rw)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static void UnlockArray(const Array *arrayPtr)
+static void UnlockArray(Array *arrayPtr)
+    NS_GNUC_NONNULL(1);
+
+static void DeleteArray(Array *arrayPtr)
+    NS_GNUC_NONNULL(1);
+
+static void SetPersistent(Array *arrayPtr, bool persistent)
+    NS_GNUC_NONNULL(1);
+
+static void JournalRecord(Array *arrayPtr, char op, const char *keyString,
+                          const char *value, size_t len)
+    NS_GNUC_NONNULL(1);
+
+static void JournalAppend(Tcl_DString *dsPtr, char op, const char *arrayName,
+                          const char *keyString, const char *value, size_t len)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+
+static void JournalWait(NsvJournal *journalPtr, uintptr_t seq)
+    NS_GNUC_NONNULL(1);
+
+static void JournalWrite(NsvJournal *journalPtr)
+    NS_GNUC_NONNULL(1);
+
+static void JournalCounterDirty(NsvJournal *journalPtr, NsvCounter *counterPtr,
+                                const char *arrayName, const char *keyString)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static void JournalCounters(NsvJournal *journalPtr)
+    NS_GNUC_NONNULL(1);
+
+static void JournalCompact(NsvJournal *journalPtr)
+    NS_GNUC_NONNULL(1);
+
+static void JournalFileName(const NsvJournal *journalPtr, const char *suffix, Tcl_DString *dsPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static int JournalOpen(const char *fileName)
     NS_GNUC_NONNULL(1);
 
+static Ns_ReturnCode JournalReplay(const NsServer *servPtr, const char *fileName,
+                                   size_t *countPtr, Tcl_DString *errorPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static void JournalApply(const NsServer *servPtr, char op, const char *arrayName,
+                         const char *keyString, const char *value, size_t len)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5);
+
+static Ns_ThreadProc JournalThread;
+static Ns_ShutdownProc JournalShutdown;
+
+static Tcl_ObjCmdProc JournalCompactObjCmd;
+static Tcl_ObjCmdProc JournalPersistObjCmd;
+static Tcl_ObjCmdProc JournalReplayObjCmd;
+
 static Array *LockArrayObj(Tcl_Interp *interp, Tcl_Obj *arrayObj, bool create, NS_RW rw)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static Array *GetArray(Bucket *bucketPtr, const char *arrayName, bool create)
+static Array *LockBucketArray(const NsServer *servPtr, Bucket *bucketPtr, const char *arrayName,
+                              bool create, NS_RW rw)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static Array *NewArray(Bucket *bucketPtr, const char *arrayName)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static Bucket *HomeBucket(const NsServer *servPtr, const char *arrayName)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static bool LockBucket(Bucket *bucketPtr, NS_RW rw, uintptr_t *waitPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(3);
+
+static void UnlockBucket(Bucket *bucketPtr)
+    NS_GNUC_NONNULL(1);
+
+static void LockBuckets(Bucket *bucketPtrs[], int nbuckets)
+    NS_GNUC_NONNULL(1);
+
+static void UnlockBuckets(Bucket *bucketPtrs[], int nbuckets)
+    NS_GNUC_NONNULL(1);
+
+static void DropForward(Bucket *homePtr, Bucket *bucketPtr, const char *arrayName)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static Ns_ReturnCode MigrateArray(const NsServer *servPtr, const char *arrayName, Bucket *targetPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void MoveArray(Array *arrayPtr, Tcl_HashEntry *homeEntryPtr, Bucket *targetPtr,
+                      const char *arrayName)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(4);
+
+static int LeastContendedBucket(const NsServer *servPtr, int excludeIdx)
+    NS_GNUC_NONNULL(1);
+
+static int ContentionCompare(const void *arg1, const void *arg2)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void StatIncr(uintptr_t *valuePtr)
+    NS_GNUC_NONNULL(1);
+
+static void ContentionAdd(uintptr_t *contendedPtr, uintptr_t *waitTimePtr, uintptr_t waitTime)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+static uintptr_t StatLoad(const uintptr_t *valuePtr)
+    NS_GNUC_NONNULL(1);
+
+static Ns_SchedProc MigrateCheck;
+
 static unsigned int BucketIndex(const char *arrayName)
     NS_GNUC_NONNULL(1) NS_GNUC_PURE;
 
@@ -81,6 +445,16 @@ static int GetArrayAndKey(Tcl_Interp *interp, Tcl_Obj *arrayObj, const char *key
                           NS_RW rw, Array  **arrayPtrPtr, Tcl_Obj **objPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(5) NS_GNUC_NONNULL(6);
 
+/*
+ * Migrations of arrays between buckets are serialized. Iterations over
+ * all buckets, which must not miss an array moving to an already visited
+ * bucket, either hold the migration lock or are repeated when the
+ * migration generation has changed.
+ */
+
+static Ns_Mutex  migrateLock = NULL;
+static uintptr_t migrationGeneration = 0u;
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -120,6 +494,11 @@ NsTclCreateBuckets(const NsServer *servPtr, int nbuckets)
         buckets[nbuckets].rwlock = NULL;
         buckets[nbuckets].mlock = NULL;
         buckets[nbuckets].servPtr = servPtr;
+        buckets[nbuckets].version = 0u;
+        buckets[nbuckets].namesPtr = NULL;
+        buckets[nbuckets].contended = 0u;
+        buckets[nbuckets].waitTime = 0u;
+        buckets[nbuckets].lastWaitTime = 0u;
         if (servPtr->nsv.rwlocks) {
             Ns_RWLockInit(&buckets[nbuckets].rwlock);
             Ns_RWLockSetName2(&buckets[nbuckets].rwlock, buf, servPtr->server);
@@ -138,7 +517,8 @@ NsTclCreateBuckets(const NsServer *servPtr, int nbuckets)
  *
  * NsTclNsvGetObjCmd --
  *
- *      Implements "nsv_get".
+ *      Implements "nsv_get". Typed values are returned from the
+ *      per-interpreter cache of materialized values.
  *
  * Results:
  *      Tcl result.
@@ -171,7 +551,16 @@ NsTclNsvGetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
             const char          *keyString = Tcl_GetString(objv[2]);
 
             hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, NULL);
-            resultObj = likely(hPtr != NULL) ? Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE) : NULL;
+            if (likely(hPtr != NULL)) {
+                const Var *varPtr = Tcl_GetHashValue(hPtr);
+                char       numBuf[NSV_INTEGER_SPACE];
+
+                resultObj = (varPtr->typedPtr != NULL
+                             ? TypedVarObj(interp, Tcl_GetString(objv[1]), keyString, varPtr)
+                             : Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE));
+            } else {
+                resultObj = NULL;
+            }
             UnlockArray(arrayPtr);
 
             if (objc == 3) {
@@ -250,8 +639,10 @@ SetResultToOldValue(Tcl_Interp *interp, Array *arrayPtr, const char *key)
      */
     hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, key, NULL);
     if (likely(hPtr != NULL)) {
+        char numBuf[NSV_INTEGER_SPACE];
+
         result = NS_TRUE;
-        Tcl_SetObjResult(interp, Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE));
+        Tcl_SetObjResult(interp, Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE));
     } else {
         result = NS_FALSE;
         Tcl_SetObjResult(interp, Tcl_NewStringObj("", 0));
@@ -281,14 +672,22 @@ int
 NsTclNsvSetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                   TCL_OBJC_T objc, Tcl_Obj *const* objv)
 {
-    int      result = TCL_OK, doReset = 0, doDefault = 0;
-    Array   *arrayPtr;
-    Tcl_Obj *arrayObj, *valueObj = NULL;
-    char    *keyString;
+    int         result = TCL_OK, doReset = 0, doDefault = 0, type = (int)NSV_TYPE_STRING;
+    Array      *arrayPtr;
+    Tcl_Obj    *arrayObj, *valueObj = NULL;
+    char       *keyString;
+    TypedValue *typedPtr = NULL;
+    static Ns_ObjvTable types[] = {
+        {"string", (unsigned int)NSV_TYPE_STRING},
+        {"list",   (unsigned int)NSV_TYPE_LIST},
+        {"dict",   (unsigned int)NSV_TYPE_DICT},
+        {NULL,     0u}
+    };
 
     Ns_ObjvSpec lopts[] = {
         {"-default", Ns_ObjvBool,   &doDefault, INT2PTR(NS_TRUE)},
         {"-reset",   Ns_ObjvBool,   &doReset,   INT2PTR(NS_TRUE)},
+        {"-type",    Ns_ObjvIndex,  &type,      types},
         {"--",       Ns_ObjvBreak,  NULL,       NULL},
         {NULL, NULL, NULL, NULL}
     };
@@ -306,10 +705,22 @@ NsTclNsvSetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
         Ns_TclPrintfResult(interp, "only '-default' or '-reset' can be used");
         result = TCL_ERROR;
 
+    } else if (valueObj != NULL && type != (int)NSV_TYPE_STRING
+               && (typedPtr = NewTypedValue(interp, valueObj, (NsvType)type, &valueObj)) == NULL) {
+        /*
+         * The typed value is built outside the lock. The value is stored
+         * in its canonical form, which is the string representation of
+         * the materialized value.
+         */
+        result = TCL_ERROR;
+
     } else if (valueObj != NULL) {
         TCL_SIZE_T  len;
         bool        setArrayValue = NS_TRUE, returnNewValue = NS_TRUE;
-        const char *value = Tcl_GetStringFromObj(valueObj, &len);
+        const char *value;
+
+        Tcl_IncrRefCount(valueObj);
+        value = Tcl_GetStringFromObj(valueObj, &len);
 
         arrayPtr = LockArrayObj(interp, arrayObj, NS_TRUE, NS_WRITE);
         assert(arrayPtr != NULL);
@@ -346,13 +757,16 @@ NsTclNsvSetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
          * Set the array to the provided value.
          */
         if (setArrayValue) {
-            SetVar(arrayPtr, keyString, value, (size_t)len);
+            SetVar(arrayPtr, keyString, value, (size_t)len, typedPtr);
+        } else if (typedPtr != NULL) {
+            ns_free(typedPtr);
         }
         UnlockArray(arrayPtr);
 
         if (returnNewValue) {
             Tcl_SetObjResult(interp, valueObj);
         }
+        Tcl_DecrRefCount(valueObj);
 
     } else if (doReset == (int)NS_TRUE) {
 
@@ -389,7 +803,9 @@ NsTclNsvSetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
 
             hPtr = Tcl_FindHashEntry(&arrayPtr->vars, keyString);
             if (likely(hPtr != NULL)) {
-                Tcl_SetObjResult(interp, Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE));
+                char numBuf[NSV_INTEGER_SPACE];
+
+                Tcl_SetObjResult(interp, Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE));
             }
             UnlockArray(arrayPtr);
             if (hPtr == NULL) {
@@ -450,6 +866,92 @@ NsTclNsvIncrObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
     return result;
 }
 
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvCounterObjCmd --
+ *
+ *      Implements "nsv_counter". Counters are incremented without
+ *      locking the bucket of the array; the value is computed as the
+ *      sum of the shards of the counter when it is read.
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      See docs.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+NsTclNsvCounterObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
+                      TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    int                      opt, result = TCL_OK;
+    static const char *const opts[] = {
+        "get", "incr", "reset", NULL
+    };
+    enum ISubCmdIdx {
+        CGetIdx, CIncrIdx, CResetIdx
+    };
+
+    if (objc < 2) {
+        Tcl_WrongNumArgs(interp, 1, objv, "option ...");
+        result = TCL_ERROR;
+
+    } else if (Tcl_GetIndexFromObj(interp, objv[1], opts, "option", 0,
+                                   &opt) != TCL_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_WideInt  incr = 1;
+        NsvCounter  *counterPtr;
+
+        if (opt == CIncrIdx) {
+            if (objc != 4 && objc != 5) {
+                Tcl_WrongNumArgs(interp, 2, objv, "array key ?increment?");
+                result = TCL_ERROR;
+            } else if (objc == 5 && Tcl_GetWideIntFromObj(interp, objv[4], &incr) != TCL_OK) {
+                result = TCL_ERROR;
+            }
+        } else if (objc != 4) {
+            Tcl_WrongNumArgs(interp, 2, objv, "array key");
+            result = TCL_ERROR;
+        }
+
+        if (result == TCL_OK) {
+            counterPtr = GetCounter(interp, objv[2], Tcl_GetString(objv[3]), (opt == CIncrIdx));
+            if (counterPtr == NULL) {
+                result = TCL_ERROR;
+
+            } else {
+                NsInterp *itPtr = NsGetInterpData(interp);
+
+                switch (opt) {
+                case CIncrIdx:
+                    CounterAdd(counterPtr, CounterShardIndex(itPtr), incr);
+                    break;
+
+                case CGetIdx:
+                    Tcl_SetObjResult(interp, Tcl_NewWideIntObj(CounterSum(counterPtr)));
+                    break;
+
+                case CResetIdx:
+                    Tcl_SetObjResult(interp, Tcl_NewWideIntObj(CounterReset(counterPtr)));
+                    break;
+                }
+                if (opt != CGetIdx && CounterMarkDirty(counterPtr)) {
+                    JournalCounterDirty(itPtr->servPtr->nsv.journalPtr, counterPtr,
+                                        Tcl_GetString(objv[2]), Tcl_GetString(objv[3]));
+                }
+            }
+        }
+    }
+    return result;
+}
+
+
 
 /*
  *-----------------------------------------------------------------------------
@@ -490,14 +992,16 @@ NsTclNsvLappendObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
 
         hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, Tcl_GetString(objv[2]), &isNew);
         if (unlikely(isNew == 0)) {
-            Tcl_DStringAppend(&ds, Tcl_GetHashValue(hPtr), TCL_INDEX_NONE);
+            char numBuf[NSV_INTEGER_SPACE];
+
+            Tcl_DStringAppend(&ds, VarValue(hPtr, numBuf), TCL_INDEX_NONE);
         }
 
         for (i = 3; i < objc; ++i) {
             Tcl_DStringAppendElement(&ds, Tcl_GetString(objv[i]));
         }
 
-        UpdateVar(hPtr, ds.string, (size_t)ds.length);
+        UpdateVar(arrayPtr, hPtr, ds.string, (size_t)ds.length, NULL);
         UnlockArray(arrayPtr);
 
         Tcl_DStringResult(interp, &ds);
@@ -545,7 +1049,9 @@ NsTclNsvAppendObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
 
         hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, Tcl_GetString(objv[2]), &isNew);
         if (unlikely(isNew == 0)) {
-            Tcl_DStringAppend(&ds, Tcl_GetHashValue(hPtr), TCL_INDEX_NONE);
+            char numBuf[NSV_INTEGER_SPACE];
+
+            Tcl_DStringAppend(&ds, VarValue(hPtr, numBuf), TCL_INDEX_NONE);
         }
 
         for (i = 3; i < objc; ++i) {
@@ -555,7 +1061,7 @@ NsTclNsvAppendObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
             Tcl_DStringAppend(&ds, value, length);
         }
 
-        UpdateVar(hPtr, ds.string, (size_t)ds.length);
+        UpdateVar(arrayPtr, hPtr, ds.string, (size_t)ds.length, NULL);
         UnlockArray(arrayPtr);
 
         Tcl_DStringResult(interp, &ds);
@@ -627,8 +1133,7 @@ NsTclNsvUnsetObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                  * Delete the hash-table of this array and the entry in the
                  * table of array names.
                  */
-                Tcl_DeleteHashTable(&arrayPtr->vars);
-                Tcl_DeleteHashEntry(arrayPtr->entryPtr);
+                DeleteArray(arrayPtr);
             }
             UnlockArray(arrayPtr);
 
@@ -683,29 +1188,41 @@ NsTclNsvNamesObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
         Tcl_Obj        *resultObj;
         const char     *pattern;
         int             i;
+        uintptr_t       generation;
 
         pattern = (objc < 2) ? NULL : Tcl_GetString(objv[1]);
 
         /*
-         * Walk the bucket list for each array.
+         * Walk the bucket list for each array. When an array was migrated
+         * during the walk, it might be reported twice or not at all, so
+         * the walk is repeated.
          */
-
+    restart:
+        generation = StatLoad(&migrationGeneration);
         resultObj = Tcl_GetObjResult(interp);
         for (i = 0; i < servPtr->nsv.nbuckets; i++) {
             const Tcl_HashEntry *hPtr;
             Tcl_HashSearch       search;
             Bucket              *bucketPtr = &servPtr->nsv.buckets[i];
+            Snapshot            *snapshotPtr = NULL;
+            uintptr_t            waitTime;
 
-            if (servPtr->nsv.rwlocks) {
-                Ns_RWLockRdLock(&bucketPtr->rwlock);
+            (void) LockBucket(bucketPtr, NS_READ, &waitTime);
+            if (UseSnapshot(bucketPtr, &bucketPtr->arrays)) {
+                /*
+                 * Process the snapshot of the names after releasing the lock.
+                 */
+                snapshotPtr = GetSnapshot(&bucketPtr->namesPtr, &bucketPtr->arrays, NS_FALSE);
+                hPtr = NULL;
             } else {
-                Ns_MutexLock(&bucketPtr->mlock);
+                hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
             }
-            hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
             while (hPtr != NULL) {
-                const char *keyString = Tcl_GetHashKey(&bucketPtr->arrays, hPtr);
+                const char  *keyString = Tcl_GetHashKey(&bucketPtr->arrays, hPtr);
+                const Array *arrayPtr = Tcl_GetHashValue(hPtr);
 
-                if ((pattern == NULL) || (Tcl_StringMatch(keyString, pattern) != 0)) {
+                if (arrayPtr->forwardPtr == NULL
+                    && ((pattern == NULL) || (Tcl_StringMatch(keyString, pattern) != 0))) {
                     result = Tcl_ListObjAppendElement(interp, resultObj,
                                                       Tcl_NewStringObj(keyString, TCL_INDEX_NONE));
                     if (unlikely(result != TCL_OK)) {
@@ -714,16 +1231,20 @@ NsTclNsvNamesObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc,
                 }
                 hPtr = Tcl_NextHashEntry(&search);
             }
-            if (servPtr->nsv.rwlocks) {
-                Ns_RWLockUnlock(&bucketPtr->rwlock);
-            } else {
-                Ns_MutexUnlock(&bucketPtr->mlock);
-            }
+            UnlockBucket(bucketPtr);
 
+            if (snapshotPtr != NULL) {
+                result = SnapshotAppend(interp, snapshotPtr, pattern, NS_FALSE, resultObj);
+                SnapshotRelease(snapshotPtr);
+            }
             if (unlikely(result != TCL_OK)) {
                 break;
             }
         }
+        if (result == TCL_OK && generation != StatLoad(&migrationGeneration)) {
+            Tcl_ResetResult(interp);
+            goto restart;
+        }
     }
     return result;
 }
@@ -796,7 +1317,7 @@ NsTclNsvArrayObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                 for (i = 0; i < lobjc; i += 2) {
                     const char *value = Tcl_GetStringFromObj(lobjv[i+1], &size);
 
-                    SetVar(arrayPtr, Tcl_GetString(lobjv[i]), value, (size_t)size);
+                    SetVar(arrayPtr, Tcl_GetString(lobjv[i]), value, (size_t)size, NULL);
                 }
                 UnlockArray(arrayPtr);
             }
@@ -847,7 +1368,21 @@ NsTclNsvArrayObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
 
                 arrayPtr = LockArrayObj(interp, objv[2], NS_FALSE, NS_READ);
                 Tcl_ResetResult(interp);
-                if (arrayPtr != NULL) {
+                if (arrayPtr != NULL && UseSnapshot(arrayPtr->bucketPtr, &arrayPtr->vars)) {
+                    Tcl_Obj    *listObj = Tcl_NewListObj(0, NULL);
+                    const char *pattern = (objc > 3) ? Tcl_GetString(objv[3]) : NULL;
+                    Snapshot   *snapshotPtr;
+
+                    /*
+                     * Iterate over the snapshot without holding the lock.
+                     */
+                    snapshotPtr = GetSnapshot(&arrayPtr->snapshotPtr, &arrayPtr->vars, NS_TRUE);
+                    UnlockArray(arrayPtr);
+                    (void) SnapshotAppend(interp, snapshotPtr, pattern, (opt == (int)CGetIdx), listObj);
+                    SnapshotRelease(snapshotPtr);
+                    Tcl_SetObjResult(interp, listObj);
+
+                } else if (arrayPtr != NULL) {
                     Tcl_Obj             *listObj = Tcl_NewListObj(0, NULL);
                     const Tcl_HashEntry *hPtr    = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
                     const char          *pattern = (objc > 3) ? Tcl_GetString(objv[3]) : NULL;
@@ -858,8 +1393,10 @@ NsTclNsvArrayObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                         if ((pattern == NULL) || (Tcl_StringMatch(keyString, pattern) != 0)) {
                             Tcl_ListObjAppendElement(interp, listObj, Tcl_NewStringObj(keyString, TCL_INDEX_NONE));
                             if (opt == (int)CGetIdx) {
+                                char numBuf[NSV_INTEGER_SPACE];
+
                                 Tcl_ListObjAppendElement(interp, listObj,
-                                                         Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE));
+                                                         Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE));
                             }
                         }
                         hPtr = Tcl_NextHashEntry(&search);
@@ -914,7 +1451,9 @@ GetArrayAndKey(Tcl_Interp *interp, Tcl_Obj *arrayObj, const char *keyString,
             Tcl_SetErrorCode(interp, "TCL", "LOOKUP", "NSV", "KEY", keyString, (char *)0L);
             result = TCL_ERROR;
         } else {
-            obj = Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE);
+            char numBuf[NSV_INTEGER_SPACE];
+
+            obj = Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE);
         }
     } else {
         result = TCL_ERROR;
@@ -1114,10 +1653,7 @@ NsTclNsvDictObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                                                               nargs, &objv[(TCL_SIZE_T)objc-nargs]);
                         }
                         if (result == TCL_OK) {
-                            TCL_SIZE_T dictStringLength;
-                            const char *dictString = Tcl_GetStringFromObj(dictObj, &dictStringLength);
-
-                            SetVar(arrayPtr, Tcl_GetString(keyObj), dictString, (size_t)dictStringLength);
+                            SetDictVar(arrayPtr, Tcl_GetString(keyObj), dictObj);
                             Tcl_SetObjResult(interp, dictObj);
                         }
                     } else {
@@ -1309,7 +1845,9 @@ NsTclNsvDictObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                 keyString = Tcl_GetString(keyObj);
                 hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, NULL);
                 if (likely(hPtr != NULL)) {
-                    dictObj = Tcl_NewStringObj(Tcl_GetHashValue(hPtr), TCL_INDEX_NONE);
+                    char numBuf[NSV_INTEGER_SPACE];
+
+                    dictObj = Tcl_NewStringObj(VarValue(hPtr, numBuf), TCL_INDEX_NONE);
                 } else {
                     dictObj = Tcl_NewDictObj();
                 }
@@ -1379,11 +1917,7 @@ NsTclNsvDictObjCmd(ClientData UNUSED(clientData), Tcl_Interp *interp,
                     }
                 }
                 if (result == TCL_OK) {
-                    const char *dictString;
-                    TCL_SIZE_T  dictStringLength;
-
-                    dictString = Tcl_GetStringFromObj(dictObj, &dictStringLength);
-                    SetVar(arrayPtr, keyString, dictString, (size_t)dictStringLength);
+                    SetDictVar(arrayPtr, keyString, dictObj);
                     Tcl_SetObjResult(interp, dictObj);
                 } else {
                     result = TCL_ERROR;
@@ -1437,7 +1971,9 @@ Ns_VarGet(const char *server, const char *array, const char *keyString, Ns_DStri
         if (likely(arrayPtr != NULL)) {
             const Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, NULL);
             if (likely(hPtr != NULL)) {
-                Ns_DStringAppend(dsPtr, Tcl_GetHashValue(hPtr));
+                char numBuf[NSV_INTEGER_SPACE];
+
+                Ns_DStringAppend(dsPtr, VarValue(hPtr, numBuf));
                 status = NS_OK;
             }
             UnlockArray(arrayPtr);
@@ -1519,7 +2055,7 @@ Ns_VarSet(const char *server, const char *array, const char *keyString,
         Array *arrayPtr = LockArray(servPtr, array, NS_TRUE, NS_WRITE);
 
         if (likely(arrayPtr != NULL)) {
-            SetVar(arrayPtr, keyString, value, (len > -1) ? (size_t)len : strlen(value));
+            SetVar(arrayPtr, keyString, value, (len > -1) ? (size_t)len : strlen(value), NULL);
             UnlockArray(arrayPtr);
             status = NS_OK;
         }
@@ -1599,19 +2135,19 @@ Ns_VarAppend(const char *server, const char *array, const char *keyString,
         Array  *arrayPtr = LockArray(servPtr, array, NS_TRUE, NS_WRITE);
         if (likely(arrayPtr != NULL)) {
             Tcl_HashEntry *hPtr;
-            size_t         oldLen, newLen;
-            char          *oldString, *newString;
+            Tcl_DString    ds;
 
             hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
 
-            oldString = Tcl_GetHashValue(hPtr);
-            oldLen = (oldString != NULL) ? strlen(oldString) : 0u;
+            Tcl_DStringInit(&ds);
+            if (isNew == 0) {
+                char numBuf[NSV_INTEGER_SPACE];
 
-            newLen = oldLen + ((len > -1) ? (size_t)len : strlen(value)) + 1u;
-            newString = ns_realloc(oldString, newLen + 1u);
-            memcpy(newString + oldLen, value, newLen + 1u);
-
-            Tcl_SetHashValue(hPtr, newString);
+                Tcl_DStringAppend(&ds, VarValue(hPtr, numBuf), TCL_INDEX_NONE);
+            }
+            Tcl_DStringAppend(&ds, value, (len > -1) ? (TCL_SIZE_T)len : TCL_INDEX_NONE);
+            UpdateVar(arrayPtr, hPtr, ds.string, (size_t)ds.length, NULL);
+            Tcl_DStringFree(&ds);
 
             UnlockArray(arrayPtr);
             status = NS_OK;
@@ -1658,8 +2194,7 @@ Ns_VarUnset(const char *server, const char *array, const char *keyString)
                 /* Error, no such key. */
             } else if (status == NS_OK && keyString == NULL) {
                 /* Finish deleting the entire array, same as in NsTclNsvUnsetObjCmd(). */
-                Tcl_DeleteHashTable(&arrayPtr->vars);
-                Tcl_DeleteHashEntry(arrayPtr->entryPtr);
+                DeleteArray(arrayPtr);
             }
             UnlockArray(arrayPtr);
         }
@@ -1703,299 +2238,395 @@ BucketIndex(const char *arrayName) {
 /*
  *-----------------------------------------------------------------------------
  *
- * GetArray --
+ * HomeBucket --
  *
- *      Lookup the array from the provided bucket. The function is assumed to
- *      be called when the mutex of the bucket is already locked.
+ *      Return the bucket determined by the name of the array. Arrays are
+ *      created in their home bucket. When an array was migrated to a
+ *      different bucket, the home bucket keeps a forward marker pointing
+ *      to the bucket containing the array.
  *
  * Results:
- *      Pointer to Array or NULL.
+ *      Bucket.
  *
  * Side effects;
- *      Array is created if it does not exist and 'create' is NS_TRUE.
+ *      None.
  *
  *-----------------------------------------------------------------------------
  */
 
-static Array *
-GetArray(Bucket *bucketPtr, const char *arrayName, bool create) {
-    Tcl_HashEntry *hPtr;
-    Array         *arrayPtr;
-
-    NS_NONNULL_ASSERT(bucketPtr != NULL);
+static Bucket *
+HomeBucket(const NsServer *servPtr, const char *arrayName)
+{
+    NS_NONNULL_ASSERT(servPtr != NULL);
     NS_NONNULL_ASSERT(arrayName != NULL);
 
-    if (unlikely(create)) {
-        int isNew;
+    return &servPtr->nsv.buckets[BucketIndex(arrayName) % (unsigned int)servPtr->nsv.nbuckets];
+}
 
-        hPtr = Tcl_CreateHashEntry(&bucketPtr->arrays, arrayName, &isNew);
-        if (isNew == 0) {
-            arrayPtr = Tcl_GetHashValue(hPtr);
-        } else {
-            arrayPtr = ns_malloc(sizeof(Array));
-            arrayPtr->locks = 0;
-            arrayPtr->bucketPtr = bucketPtr;
-            arrayPtr->entryPtr = hPtr;
-            Tcl_InitHashTable(&arrayPtr->vars, TCL_STRING_KEYS);
-            Tcl_SetHashValue(hPtr, arrayPtr);
-        }
-    } else {
-        hPtr = Tcl_CreateHashEntry(&bucketPtr->arrays, arrayName, NULL);
-        if (unlikely(hPtr == NULL)) {
-            if (bucketPtr->servPtr->nsv.rwlocks) {
-                Ns_RWLockUnlock(&bucketPtr->rwlock);
-            } else {
-                Ns_MutexUnlock(&bucketPtr->mlock);
-            }
-            return NULL;
-        }
-        arrayPtr = Tcl_GetHashValue(hPtr);
-    }
-    arrayPtr->locks++;
 
-    return arrayPtr;
-}
-
-
 /*
  *-----------------------------------------------------------------------------
  *
- * LockArray, UnlockArray --
+ * LockBucket, UnlockBucket --
  *
- *      Lock the array of the given name.
- *      Array structure must be later unlocked with UnlockArray.
+ *      Lock or unlock a bucket. The lock is first tried without waiting;
+ *      only when the lock is busy, the time spent waiting for the lock is
+ *      measured and added to the contention statistics of the bucket.
  *
  * Results:
- *      Pointer to Array or NULL.
+ *      LockBucket returns true, when the lock was contended. In this
+ *      case, the waiting time in microseconds is returned in waitPtr.
  *
  * Side effects;
- *      Array is created if 'create' is 1.
+ *      Thread might wait for the lock.
  *
  *-----------------------------------------------------------------------------
  */
-static Array *
-LockArray(const NsServer *servPtr, const char *arrayName, bool create, NS_RW rw)
+
+static bool
+LockBucket(Bucket *bucketPtr, NS_RW rw, uintptr_t *waitPtr)
 {
-    Bucket        *bucketPtr;
-    unsigned int   idx;
+    const NsServer *servPtr;
+    Ns_ReturnCode   status;
+    bool            contended = NS_FALSE;
 
-    NS_NONNULL_ASSERT(servPtr != NULL);
-    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
+    NS_NONNULL_ASSERT(waitPtr != NULL);
 
-    idx = BucketIndex(arrayName);
-    bucketPtr = &servPtr->nsv.buckets[idx % (unsigned int)servPtr->nsv.nbuckets];
+    servPtr = bucketPtr->servPtr;
     if (servPtr->nsv.rwlocks) {
-        if (rw == NS_READ) {
-            Ns_RWLockRdLock(&bucketPtr->rwlock);
-        } else {
-            Ns_RWLockWrLock(&bucketPtr->rwlock);
-        }
+        status = (rw == NS_READ)
+            ? Ns_RWLockTryRdLock(&bucketPtr->rwlock)
+            : Ns_RWLockTryWrLock(&bucketPtr->rwlock);
     } else {
-        Ns_MutexLock(&bucketPtr->mlock);
+        status = Ns_MutexTryLock(&bucketPtr->mlock);
     }
 
-    return GetArray(bucketPtr, arrayName, create);
+    if (unlikely(status != NS_OK)) {
+        Ns_Time startTime, endTime, diff;
+
+        Ns_GetTime(&startTime);
+        if (servPtr->nsv.rwlocks) {
+            if (rw == NS_READ) {
+                Ns_RWLockRdLock(&bucketPtr->rwlock);
+            } else {
+                Ns_RWLockWrLock(&bucketPtr->rwlock);
+            }
+        } else {
+            Ns_MutexLock(&bucketPtr->mlock);
+        }
+        Ns_GetTime(&endTime);
+        (void) Ns_DiffTime(&endTime, &startTime, &diff);
+
+        *waitPtr = (uintptr_t)diff.sec * 1000000u + (uintptr_t)diff.usec;
+        ContentionAdd(&bucketPtr->contended, &bucketPtr->waitTime, *waitPtr);
+        contended = NS_TRUE;
+    }
+    return contended;
 }
 
 static void
-UnlockArray(const Array *arrayPtr)
+UnlockBucket(Bucket *bucketPtr)
 {
-    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
 
-    if (arrayPtr->bucketPtr->servPtr->nsv.rwlocks) {
-        Ns_RWLockUnlock(&((arrayPtr)->bucketPtr->rwlock));
+    if (bucketPtr->servPtr->nsv.rwlocks) {
+        Ns_RWLockUnlock(&bucketPtr->rwlock);
     } else {
-        Ns_MutexUnlock(&((arrayPtr)->bucketPtr->mlock));
+        Ns_MutexUnlock(&bucketPtr->mlock);
     }
 }
 
-
+
 /*
  *-----------------------------------------------------------------------------
  *
- * UpdateVar --
+ * LockBuckets, UnlockBuckets --
  *
- *      Update a variable entry.
+ *      Lock or unlock up to three (not necessarily distinct) buckets for
+ *      writing. To avoid deadlocks, multiple buckets are always locked in
+ *      the order of the bucket numbers.
  *
  * Results:
  *      None.
  *
  * Side effects;
- *      New value is set.
+ *      Thread might wait for the locks.
  *
  *-----------------------------------------------------------------------------
  */
 
 static void
-UpdateVar(Tcl_HashEntry *hPtr, const char *value, size_t len)
+LockBuckets(Bucket *bucketPtrs[], int nbuckets)
 {
-    char *oldString, *newString;
+    uintptr_t waitTime;
+    int       i, j;
 
-    NS_NONNULL_ASSERT(hPtr != NULL);
-    NS_NONNULL_ASSERT(value != NULL);
+    NS_NONNULL_ASSERT(bucketPtrs != NULL);
+
+    /*
+     * Sort the few buckets by their position in the bucket vector.
+     */
+    for (i = 1; i < nbuckets; i++) {
+        for (j = i; j > 0 && bucketPtrs[j - 1] > bucketPtrs[j]; j--) {
+            Bucket *bucketPtr = bucketPtrs[j];
 
-    oldString = Tcl_GetHashValue(hPtr);
-    newString = ns_realloc(oldString, len + 1u);
-    memcpy(newString, value, len + 1u);
-    Tcl_SetHashValue(hPtr, newString);
+            bucketPtrs[j] = bucketPtrs[j - 1];
+            bucketPtrs[j - 1] = bucketPtr;
+        }
+    }
+    for (i = 0; i < nbuckets; i++) {
+        if (i == 0 || bucketPtrs[i] != bucketPtrs[i - 1]) {
+            (void) LockBucket(bucketPtrs[i], NS_WRITE, &waitTime);
+        }
+    }
 }
 
-
+static void
+UnlockBuckets(Bucket *bucketPtrs[], int nbuckets)
+{
+    int i;
+
+    NS_NONNULL_ASSERT(bucketPtrs != NULL);
+
+    for (i = 0; i < nbuckets; i++) {
+        if (i == 0 || bucketPtrs[i] != bucketPtrs[i - 1]) {
+            UnlockBucket(bucketPtrs[i]);
+        }
+    }
+}
+
+
 /*
  *-----------------------------------------------------------------------------
  *
- * SetVar --
+ * NewArray --
  *
- *      Set (or reset) an array entry.
+ *      Create a new array in its home bucket. The function is assumed to
+ *      be called when the bucket is already locked.
  *
  * Results:
- *      None.
+ *      Pointer to Array.
  *
  * Side effects;
- *      New entry is created and updated.
+ *      Array is created.
  *
  *-----------------------------------------------------------------------------
  */
 
-static void
-SetVar(Array *arrayPtr, const char *keyString, const char *value, size_t len)
-{
+static Array *
+NewArray(Bucket *bucketPtr, const char *arrayName) {
     Tcl_HashEntry *hPtr;
+    Array         *arrayPtr;
     int            isNew;
 
-    NS_NONNULL_ASSERT(arrayPtr != NULL);
-    NS_NONNULL_ASSERT(keyString != NULL);
-    NS_NONNULL_ASSERT(value != NULL);
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
 
-    hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
-    UpdateVar(hPtr, value, len);
+    hPtr = Tcl_CreateHashEntry(&bucketPtr->arrays, arrayName, &isNew);
+    arrayPtr = ns_calloc(1u, sizeof(Array));
+    arrayPtr->bucketPtr = bucketPtr;
+    arrayPtr->entryPtr = hPtr;
+    DropSnapshot(&bucketPtr->namesPtr);
+    Tcl_InitHashTable(&arrayPtr->vars, TCL_STRING_KEYS);
+    Tcl_SetHashValue(hPtr, arrayPtr);
+
+    return arrayPtr;
 }
 
-
+
 /*
  *-----------------------------------------------------------------------------
  *
- * IncrVar --
+ * LockBucketArray --
  *
- *      Increment the value of the variable.
+ *      Lookup and lock the array starting from the provided bucket, which
+ *      is either the home bucket of the array or the bucket where the
+ *      array was found before. Forward markers of migrated arrays are
+ *      followed; when the array is not found in a bucket different from
+ *      its home bucket (it was moved away or deleted in the meantime), the
+ *      lookup continues in the home bucket. The waiting times for the
+ *      locks are added to the contention statistics of the array.
  *
  * Results:
- *      TCL_OK, or TCL_ERROR if existing value is not an integer.
- *      The new value is returned in valuePtr.
+ *      Pointer to the locked Array or NULL (and no lock is held).
  *
  * Side effects;
- *      New entry is created and updated.
+ *      Array is created if it does not exist and 'create' is NS_TRUE.
+ *      Stale forward markers are removed.
  *
  *-----------------------------------------------------------------------------
  */
 
-static int
-IncrVar(Array *arrayPtr, const char *keyString, int incr, Tcl_WideInt *valuePtr)
+static Array *
+LockBucketArray(const NsServer *servPtr, Bucket *bucketPtr, const char *arrayName, bool create, NS_RW rw)
 {
-    Tcl_HashEntry *hPtr;
-    int            isNew, status;
-    Tcl_WideInt    counter = -1;
+    Array     *arrayPtr = NULL;
+    Bucket    *homePtr = NULL, *forwardPtr = NULL;
+    uintptr_t  waitTime = 0u;
+    bool       contended = NS_FALSE;
 
-    NS_NONNULL_ASSERT(arrayPtr != NULL);
-    NS_NONNULL_ASSERT(keyString != NULL);
-    NS_NONNULL_ASSERT(valuePtr != NULL);
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
 
-    hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
+    for (;;) {
+        const Tcl_HashEntry *hPtr;
+        uintptr_t            waited;
 
-    if (isNew != 0) {
-        counter = 0;
-        status = TCL_OK;
-    } else {
-        const char *oldString;
+        if (unlikely(LockBucket(bucketPtr, rw, &waited))) {
+            contended = NS_TRUE;
+            waitTime += waited;
+        }
 
-        oldString = Tcl_GetHashValue(hPtr);
-        status = (Ns_StrToWideInt(oldString, &counter) == NS_OK)
-            ? TCL_OK
-            : TCL_ERROR;
-    }
+        hPtr = Tcl_FindHashEntry(&bucketPtr->arrays, arrayName);
+        if (likely(hPtr != NULL)) {
+            arrayPtr = Tcl_GetHashValue(hPtr);
+            if (likely(arrayPtr->forwardPtr == NULL)) {
+                break;
+            }
+            /*
+             * Follow the forward marker of a migrated array.
+             */
+            forwardPtr = arrayPtr->forwardPtr;
+            arrayPtr = NULL;
+            UnlockBucket(bucketPtr);
+            bucketPtr = forwardPtr;
+            continue;
+        }
 
-    if (status == TCL_OK) {
-        char buf[TCL_INTEGER_SPACE+2];
+        if (homePtr == NULL) {
+            homePtr = HomeBucket(servPtr, arrayName);
+        }
+        if (bucketPtr == homePtr) {
+            if (create) {
+                arrayPtr = NewArray(bucketPtr, arrayName);
+            } else {
+                UnlockBucket(bucketPtr);
+            }
+            break;
+        }
 
-        counter += incr;
-        snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", counter);
-        UpdateVar(hPtr, buf, strlen(buf));
+        /*
+         * The array was moved away or deleted. Continue in the home
+         * bucket, after removing the forward marker leading here.
+         */
+        UnlockBucket(bucketPtr);
+        if (forwardPtr == bucketPtr) {
+            DropForward(homePtr, bucketPtr, arrayName);
+        }
+        forwardPtr = NULL;
+        bucketPtr = homePtr;
     }
-    *valuePtr = counter;
 
-    return status;
+    if (arrayPtr != NULL) {
+        StatIncr(&arrayPtr->locks);
+        if (unlikely(contended)) {
+            ContentionAdd(&arrayPtr->contended, &arrayPtr->waitTime, waitTime);
+        }
+    }
+    return arrayPtr;
 }
 
-
+
 /*
  *-----------------------------------------------------------------------------
  *
- * Unset --
+ * DropForward --
  *
- *      Unset the given key. If no key given flush the entire array.
+ *      Remove the forward marker of an array from its home bucket, when
+ *      the array does not exist anymore in the bucket the marker points
+ *      to. Since the array will be created again in the home bucket, the
+ *      version counter of the home bucket is advanced beyond the versions
+ *      assigned in the other bucket.
  *
  * Results:
- *      NS_ERROR if key requested but not present.
+ *      None.
  *
  * Side effects;
- *      None.
+ *      Forward marker might be freed.
  *
  *-----------------------------------------------------------------------------
  */
 
-static Ns_ReturnCode
-Unset(Array *arrayPtr, const char *keyString)
+static void
+DropForward(Bucket *homePtr, Bucket *bucketPtr, const char *arrayName)
 {
-    Ns_ReturnCode status = NS_ERROR;
+    Bucket        *bucketPtrs[2];
+    Tcl_HashEntry *hPtr;
 
-    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(homePtr != NULL);
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
 
-    if (keyString != NULL) {
-        Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, NULL);
+    bucketPtrs[0] = homePtr;
+    bucketPtrs[1] = bucketPtr;
+    LockBuckets(bucketPtrs, 2);
 
-        if (hPtr != NULL) {
-            ns_free(Tcl_GetHashValue(hPtr));
+    hPtr = Tcl_FindHashEntry(&homePtr->arrays, arrayName);
+    if (hPtr != NULL) {
+        Array *markerPtr = Tcl_GetHashValue(hPtr);
+
+        if (markerPtr->forwardPtr == bucketPtr
+            && Tcl_FindHashEntry(&bucketPtr->arrays, arrayName) == NULL) {
             Tcl_DeleteHashEntry(hPtr);
-            status = NS_OK;
+            ns_free(markerPtr);
+            if (homePtr->version < bucketPtr->version) {
+                homePtr->version = bucketPtr->version;
+            }
         }
-    } else {
-        Flush(arrayPtr);
-        status = NS_OK;
     }
-
-    return status;
+    UnlockBuckets(bucketPtrs, 2);
 }
 
-
+
 /*
  *-----------------------------------------------------------------------------
  *
- * Flush --
+ * LockArray, UnlockArray --
  *
- *      Unset all keys in an array.
+ *      Lock the array of the given name.
+ *      Array structure must be later unlocked with UnlockArray.
  *
  * Results:
- *      None.
+ *      Pointer to Array or NULL.
  *
  * Side effects;
- *      New entry is created and updated.
+ *      Array is created if 'create' is 1.
  *
  *-----------------------------------------------------------------------------
  */
+static Array *
+LockArray(const NsServer *servPtr, const char *arrayName, bool create, NS_RW rw)
+{
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+
+    return LockBucketArray(servPtr, HomeBucket(servPtr, arrayName), arrayName, create, rw);
+}
 
 static void
-Flush(Array *arrayPtr)
+UnlockArray(Array *arrayPtr)
 {
-    Tcl_HashEntry  *hPtr;
-    Tcl_HashSearch  search;
+    const NsServer *servPtr;
+    uintptr_t       journalSeq;
 
     NS_NONNULL_ASSERT(arrayPtr != NULL);
 
-    hPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
-    while (hPtr != NULL) {
-        ns_free(Tcl_GetHashValue(hPtr));
-        Tcl_DeleteHashEntry(hPtr);
-        hPtr = Tcl_NextHashEntry(&search);
+    /*
+     * Remember the journal records written by the current lock holder,
+     * which might have to wait for these after the lock was released.
+     */
+    servPtr = arrayPtr->bucketPtr->servPtr;
+    journalSeq = arrayPtr->journalSeq;
+    if (journalSeq != 0u) {
+        arrayPtr->journalSeq = 0u;
+    }
+
+    UnlockBucket(arrayPtr->bucketPtr);
+
+    if (journalSeq != 0u && servPtr->nsv.journalPtr->sync == NSV_SYNC_ALWAYS) {
+        JournalWait(servPtr->nsv.journalPtr, journalSeq);
     }
 }
 
@@ -2003,159 +2634,3267 @@ Flush(Array *arrayPtr)
 /*
  *-----------------------------------------------------------------------------
  *
- * LockArrayObj --
+ * UpdateVar --
  *
- *      Lock the array of the given name.
- *      Array structure must be later unlocked with UnlockArray.
+ *      Update a variable entry. The provided typed value (might be NULL)
+ *      replaces the previous one and is owned by the variable
+ *      afterwards. Every update assigns a new version to the variable
+ *      and detaches an attached counter.
  *
  * Results:
- *      Pointer to locked array or NULL.
+ *      None.
  *
  * Side effects;
- *      Array is created if it does not exists and 'create' is true.
+ *      New value is set.
  *
  *-----------------------------------------------------------------------------
  */
 
-static Array *
-LockArrayObj(Tcl_Interp *interp, Tcl_Obj *arrayObj, bool create, NS_RW rw)
+static void
+UpdateVar(Array *arrayPtr, Tcl_HashEntry *hPtr, const char *value, size_t len, TypedValue *typedPtr)
 {
-    Array              *arrayPtr;
-    Bucket             *bucketPtr;
-    static const char  *const arrayType = "nsv:array";
-    const char         *arrayName;
-
-    NS_NONNULL_ASSERT(interp != NULL);
-    NS_NONNULL_ASSERT(arrayObj != NULL);
+    Var *varPtr;
 
-    arrayName = Tcl_GetString(arrayObj);
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(hPtr != NULL);
+    NS_NONNULL_ASSERT(value != NULL);
 
-    if (likely(Ns_TclGetOpaqueFromObj(arrayObj, arrayType, (void **) &bucketPtr) == TCL_OK)
-        && bucketPtr != NULL) {
-        if (bucketPtr->servPtr->nsv.rwlocks) {
-            if (rw == NS_READ) {
-                Ns_RWLockRdLock(&bucketPtr->rwlock);
-            } else {
-                Ns_RWLockWrLock(&bucketPtr->rwlock);
-            }
-        } else {
-            Ns_MutexLock(&bucketPtr->mlock);
+    varPtr = Tcl_GetHashValue(hPtr);
+    if (varPtr != NULL) {
+        if (varPtr->typedPtr != NULL) {
+            ns_free(varPtr->typedPtr);
         }
-        arrayPtr = GetArray(bucketPtr, arrayName, create);
-    } else {
-        const NsInterp *itPtr = NsGetInterpData(interp);
-
-        arrayPtr = LockArray(itPtr->servPtr, arrayName, create, rw);
-        if (arrayPtr != NULL) {
-            Ns_TclSetOpaqueObj(arrayObj, arrayType, arrayPtr->bucketPtr);
+        if (varPtr->counterPtr != NULL) {
+            CounterDetach(varPtr->counterPtr);
         }
     }
-
-    /*
-     * Both, GetArray() and LockArray() can return NULL.
-     */
-    if (arrayPtr == NULL && !create) {
-        Ns_TclPrintfResult(interp, "no such array: %s", arrayName);
-        Tcl_SetErrorCode(interp, "TCL", "LOOKUP", "NSV", "ARRAY", arrayName, (char *)0L);
+    varPtr = ns_realloc(varPtr, sizeof(Var) + len);
+    memcpy(varPtr->value, value, len);
+    varPtr->value[len] = '\0';
+    varPtr->typedPtr = typedPtr;
+    varPtr->counterPtr = NULL;
+    varPtr->version = ++arrayPtr->bucketPtr->version;
+    Tcl_SetHashValue(hPtr, varPtr);
+    DropSnapshot(&arrayPtr->snapshotPtr);
+    if (arrayPtr->persistent) {
+        JournalRecord(arrayPtr, 'S', Tcl_GetHashKey(&arrayPtr->vars, hPtr), varPtr->value, len);
     }
-
-    return arrayPtr;
 }
 
 
-
 /*
  *-----------------------------------------------------------------------------
  *
- * NsTclNsvBucketObjCmd --
- *
- *      Implements "nsv_bucket".
+ * FreeVar --
  *
- *      Returns the names of the arrays kept in various buckets of the current
- *      interp.  If called a bucket number it returns a list array kept in
- *      that bucket. If called with no arguments, it returns a list of every
- *      bucket (list of lists).
+ *      Free the variable of a hash entry.
  *
  * Results:
- *      Tcl result code.
+ *      None.
  *
  * Side effects;
- *      None.
+ *      Memory is freed.
  *
  *-----------------------------------------------------------------------------
  */
 
-int
-NsTclNsvBucketObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+static void
+FreeVar(Tcl_HashEntry *hPtr)
 {
-    const NsInterp   *itPtr = clientData;
-    const NsServer   *servPtr = itPtr->servPtr;
-    int               bucketNr = -1, result = TCL_OK;
-    Ns_ObjvValueRange bucketRange = {0, servPtr->nsv.nbuckets};
-    Ns_ObjvSpec       args[] = {
-        {"?bucket-number", Ns_ObjvInt,  &bucketNr, &bucketRange},
-        {NULL, NULL, NULL, NULL}
-    };
+    Var *varPtr;
 
-    if (Ns_ParseObjv(NULL, args, interp, 1, objc, objv) != NS_OK) {
-        result = TCL_ERROR;
+    NS_NONNULL_ASSERT(hPtr != NULL);
 
-    } else {
-        Tcl_Obj *resultObj;
-        int      i;
+    varPtr = Tcl_GetHashValue(hPtr);
+    if (varPtr->typedPtr != NULL) {
+        ns_free(varPtr->typedPtr);
+    }
+    if (varPtr->counterPtr != NULL) {
+        CounterDetach(varPtr->counterPtr);
+    }
+    ns_free(varPtr);
+}
 
-        /*
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * VarValue --
+ *
+ *      Return the string representation of a variable. For variables
+ *      with an attached counter, the current sum of the counter is
+ *      formatted into the provided buffer of at least NSV_INTEGER_SPACE
+ *      bytes. Must be called with the array locked.
+ *
+ * Results:
+ *      String value.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static const char *
+VarValue(const Tcl_HashEntry *hPtr, char *buf)
+{
+    Var        *varPtr;
+    const char *result;
+
+    NS_NONNULL_ASSERT(hPtr != NULL);
+    NS_NONNULL_ASSERT(buf != NULL);
+
+    varPtr = Tcl_GetHashValue(hPtr);
+    if (varPtr->counterPtr != NULL) {
+        snprintf(buf, NSV_INTEGER_SPACE, "%" TCL_LL_MODIFIER "d", CounterSum(varPtr->counterPtr));
+        result = buf;
+    } else {
+        result = varPtr->value;
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SetVar --
+ *
+ *      Set (or reset) an array entry.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      New entry is created and updated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SetVar(Array *arrayPtr, const char *keyString, const char *value, size_t len, TypedValue *typedPtr)
+{
+    Tcl_HashEntry *hPtr;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+    NS_NONNULL_ASSERT(value != NULL);
+
+    hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
+    UpdateVar(arrayPtr, hPtr, value, len, typedPtr);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SetDictVar --
+ *
+ *      Set an array entry to the value of a modified dict. When the
+ *      previous value was a typed dict, the new value is typed as well.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      New entry is created and updated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SetDictVar(Array *arrayPtr, const char *keyString, Tcl_Obj *dictObj)
+{
+    const Tcl_HashEntry *hPtr;
+    TypedValue          *typedPtr = NULL;
+    Tcl_Obj             *canonicalObj = NULL;
+    const char          *dictString;
+    TCL_SIZE_T           dictStringLength;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+    NS_NONNULL_ASSERT(dictObj != NULL);
+
+    hPtr = Tcl_FindHashEntry(&arrayPtr->vars, keyString);
+    if (hPtr != NULL) {
+        const Var *varPtr = Tcl_GetHashValue(hPtr);
+
+        if (varPtr->typedPtr != NULL && varPtr->typedPtr->type == NSV_TYPE_DICT) {
+            typedPtr = NewTypedValue(NULL, dictObj, NSV_TYPE_DICT, &canonicalObj);
+        }
+    }
+    if (canonicalObj != NULL) {
+        Tcl_IncrRefCount(canonicalObj);
+        dictString = Tcl_GetStringFromObj(canonicalObj, &dictStringLength);
+        SetVar(arrayPtr, keyString, dictString, (size_t)dictStringLength, typedPtr);
+        Tcl_DecrRefCount(canonicalObj);
+    } else {
+        dictString = Tcl_GetStringFromObj(dictObj, &dictStringLength);
+        SetVar(arrayPtr, keyString, dictString, (size_t)dictStringLength, NULL);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NewTypedValue --
+ *
+ *      Create a typed value from a Tcl list or dict. Elements, which are
+ *      integers in canonical form, are kept as integers.
+ *
+ * Results:
+ *      Typed value or NULL, when the value is not a valid list or
+ *      dict. On success, the canonical form of the value (a list of the
+ *      elements, or of the key/value pairs) is returned in
+ *      canonicalObjPtr.
+ *
+ * Side effects;
+ *      Error message is left in the interp, when provided.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static TypedValue *
+NewTypedValue(Tcl_Interp *interp, Tcl_Obj *valueObj, NsvType type, Tcl_Obj **canonicalObjPtr)
+{
+    TypedValue *typedPtr = NULL;
+    Tcl_Obj    *listObj = NULL, **elemv;
+    TCL_SIZE_T  nelements, i;
+
+    NS_NONNULL_ASSERT(valueObj != NULL);
+    NS_NONNULL_ASSERT(canonicalObjPtr != NULL);
+
+    if (type == NSV_TYPE_DICT) {
+        TCL_SIZE_T size;
+
+        if (Tcl_DictObjSize(interp, valueObj, &size) == TCL_OK) {
+            Tcl_DictSearch search;
+            Tcl_Obj       *keyObj, *elemObj;
+            int            done = 0;
+
+            listObj = Tcl_NewListObj(0, NULL);
+            (void) Tcl_DictObjFirst(NULL, valueObj, &search, &keyObj, &elemObj, &done);
+            for (; done == 0; Tcl_DictObjNext(&search, &keyObj, &elemObj, &done)) {
+                (void) Tcl_ListObjAppendElement(NULL, listObj, keyObj);
+                (void) Tcl_ListObjAppendElement(NULL, listObj, elemObj);
+            }
+            Tcl_DictObjDone(&search);
+        }
+    } else if (Tcl_ListObjGetElements(interp, valueObj, &nelements, &elemv) == TCL_OK) {
+        listObj = Tcl_NewListObj(nelements, elemv);
+    }
+
+    if (listObj != NULL) {
+        size_t  size;
+        char   *p;
+
+        (void) Tcl_ListObjGetElements(NULL, listObj, &nelements, &elemv);
+        size = sizeof(TypedValue) + (size_t)nelements * sizeof(TypedElement);
+        for (i = 0; i < nelements; i++) {
+            TCL_SIZE_T length;
+
+            (void) Tcl_GetStringFromObj(elemv[i], &length);
+            size += (size_t)length + 1u;
+        }
+        typedPtr = ns_malloc(size);
+        typedPtr->type = type;
+        typedPtr->nelements = nelements;
+        p = (char *)&typedPtr->elements[nelements];
+
+        for (i = 0; i < nelements; i++) {
+            TypedElement *elementPtr = &typedPtr->elements[i];
+            TCL_SIZE_T    length;
+            const char   *string = Tcl_GetStringFromObj(elemv[i], &length);
+
+            memcpy(p, string, (size_t)length + 1u);
+            elementPtr->string = p;
+            elementPtr->length = length;
+            elementPtr->isInt = NS_FALSE;
+            if (length > 0 && length < TCL_INTEGER_SPACE
+                && Ns_StrToWideInt(p, &elementPtr->intValue) == NS_OK) {
+                char buf[TCL_INTEGER_SPACE + 2];
+
+                snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", elementPtr->intValue);
+                elementPtr->isInt = (strcmp(buf, p) == 0);
+            }
+            p += length + 1;
+        }
+        *canonicalObjPtr = listObj;
+    }
+    return typedPtr;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TypedValueObj --
+ *
+ *      Materialize a typed value as a Tcl list or dict without parsing
+ *      its string representation.
+ *
+ * Results:
+ *      Tcl_Obj with a reference count of 0.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+TypedValueObj(const TypedValue *typedPtr)
+{
+    Tcl_Obj    *resultObj, *staticObjv[32], **objv;
+    TCL_SIZE_T  i;
+
+    NS_NONNULL_ASSERT(typedPtr != NULL);
+
+    objv = (typedPtr->nelements <= (TCL_SIZE_T)Ns_NrElements(staticObjv)
+            ? staticObjv
+            : ns_malloc((size_t)typedPtr->nelements * sizeof(Tcl_Obj *)));
+
+    for (i = 0; i < typedPtr->nelements; i++) {
+        const TypedElement *elementPtr = &typedPtr->elements[i];
+
+        objv[i] = (elementPtr->isInt
+                   ? Tcl_NewWideIntObj(elementPtr->intValue)
+                   : Tcl_NewStringObj(elementPtr->string, elementPtr->length));
+    }
+    if (typedPtr->type == NSV_TYPE_DICT) {
+        resultObj = Tcl_NewDictObj();
+        for (i = 0; i + 1 < typedPtr->nelements; i += 2) {
+            (void) Tcl_DictObjPut(NULL, resultObj, objv[i], objv[i + 1]);
+        }
+    } else {
+        resultObj = Tcl_NewListObj(typedPtr->nelements, objv);
+    }
+    if (objv != staticObjv) {
+        ns_free(objv);
+    }
+    return resultObj;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * TypedVarObj --
+ *
+ *      Return the materialized typed value of a variable. The Tcl_Obj is
+ *      cached per interpreter and reused, as long as the version of the
+ *      variable is unchanged. Must be called with the array locked.
+ *
+ * Results:
+ *      Tcl_Obj of the value.
+ *
+ * Side effects;
+ *      Updates the cache of the interpreter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Tcl_Obj *
+TypedVarObj(Tcl_Interp *interp, const char *arrayName, const char *keyString, const Var *varPtr)
+{
+    NsInterp      *itPtr = NsGetInterpData(interp);
+    Tcl_Obj       *resultObj;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+    NS_NONNULL_ASSERT(varPtr != NULL);
+
+    if (itPtr == NULL) {
+        resultObj = TypedValueObj(varPtr->typedPtr);
+    } else {
+        Tcl_DString    ds;
+        Tcl_HashEntry *hPtr;
+        NsvCacheEntry *cachePtr;
+        int            isNew;
+
+        CacheKey(&ds, arrayName, keyString);
+        hPtr = Tcl_CreateHashEntry(&itPtr->nsvCache, ds.string, &isNew);
+        Tcl_DStringFree(&ds);
+
+        if (isNew != 0) {
+            cachePtr = ns_calloc(1u, sizeof(NsvCacheEntry));
+            Tcl_SetHashValue(hPtr, cachePtr);
+        } else {
+            cachePtr = Tcl_GetHashValue(hPtr);
+        }
+        if (cachePtr->valueObj == NULL || cachePtr->version != varPtr->version) {
+            if (cachePtr->valueObj != NULL) {
+                Tcl_DecrRefCount(cachePtr->valueObj);
+            }
+            cachePtr->valueObj = TypedValueObj(varPtr->typedPtr);
+            Tcl_IncrRefCount(cachePtr->valueObj);
+            cachePtr->version = varPtr->version;
+        }
+        resultObj = cachePtr->valueObj;
+    }
+    return resultObj;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CacheKey --
+ *
+ *      Build the key of a variable in the per-interpreter caches. The
+ *      key is the length of the array name followed by the array name
+ *      and the key.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Initializes and fills the provided Tcl_DString.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CacheKey(Tcl_DString *dsPtr, const char *arrayName, const char *keyString)
+{
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+
+    Tcl_DStringInit(dsPtr);
+    Ns_DStringPrintf(dsPtr, "%" PRIuz ":%s%s", strlen(arrayName), arrayName, keyString);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvFreeCache --
+ *
+ *      Free the cache of materialized typed values and the counter
+ *      references of an interpreter.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Memory is freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+NsTclNsvFreeCache(NsInterp *itPtr)
+{
+    Tcl_HashSearch  search;
+    Tcl_HashEntry  *hPtr;
+
+    NS_NONNULL_ASSERT(itPtr != NULL);
+
+    for (hPtr = Tcl_FirstHashEntry(&itPtr->nsvCache, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        NsvCacheEntry *cachePtr = Tcl_GetHashValue(hPtr);
+
+        if (cachePtr->valueObj != NULL) {
+            Tcl_DecrRefCount(cachePtr->valueObj);
+        }
+        ns_free(cachePtr);
+    }
+    Tcl_DeleteHashTable(&itPtr->nsvCache);
+
+    for (hPtr = Tcl_FirstHashEntry(&itPtr->nsvCounters, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        CounterRelease(Tcl_GetHashValue(hPtr));
+    }
+    Tcl_DeleteHashTable(&itPtr->nsvCounters);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * IncrVar --
+ *
+ *      Increment the value of the variable. Variables with an attached
+ *      counter are incremented via the counter.
+ *
+ * Results:
+ *      TCL_OK, or TCL_ERROR if existing value is not an integer.
+ *      The new value is returned in valuePtr.
+ *
+ * Side effects;
+ *      New entry is created and updated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+IncrVar(Array *arrayPtr, const char *keyString, int incr, Tcl_WideInt *valuePtr)
+{
+    Tcl_HashEntry *hPtr;
+    NsvCounter    *counterPtr = NULL;
+    int            isNew, status;
+    Tcl_WideInt    counter = -1;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+    NS_NONNULL_ASSERT(valuePtr != NULL);
+
+    hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
+
+    if (isNew != 0) {
+        counter = 0;
+        status = TCL_OK;
+    } else {
+        const Var *varPtr = Tcl_GetHashValue(hPtr);
+
+        counterPtr = varPtr->counterPtr;
+        status = (counterPtr != NULL || Ns_StrToWideInt(varPtr->value, &counter) == NS_OK)
+            ? TCL_OK
+            : TCL_ERROR;
+    }
+
+    if (status == TCL_OK) {
+        if (counterPtr != NULL) {
+            CounterAdd(counterPtr, 0, (Tcl_WideInt)incr);
+            counter = CounterSum(counterPtr);
+            if (arrayPtr->persistent) {
+                char buf[TCL_INTEGER_SPACE+2];
+
+                snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", counter);
+                JournalRecord(arrayPtr, 'S', keyString, buf, strlen(buf));
+            }
+        } else {
+            char buf[TCL_INTEGER_SPACE+2];
+
+            counter += incr;
+            snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", counter);
+            UpdateVar(arrayPtr, hPtr, buf, strlen(buf), NULL);
+        }
+    }
+    *valuePtr = counter;
+
+    return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CounterAdd, CounterSum, CounterReset --
+ *
+ *      Operations on the shards of a counter. Additions go to a single
+ *      shard, the value of the counter is the sum of all shards. Reset
+ *      sets all shards to zero and returns the previous sum. Without
+ *      compiler support for atomic operations, the shards are protected
+ *      by a global mutex.
+ *
+ * Results:
+ *      Sum of the counter (CounterSum, CounterReset).
+ *
+ * Side effects;
+ *      Updates the shards.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef NSV_ATOMICS
+static Ns_Mutex atomicLock = NULL;
+#endif
+
+static void
+CounterAdd(NsvCounter *counterPtr, int shard, Tcl_WideInt incr)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    (void) __atomic_fetch_add(&counterPtr->shards[shard].value, incr, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    counterPtr->shards[shard].value += incr;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+static Tcl_WideInt
+CounterSum(NsvCounter *counterPtr)
+{
+    Tcl_WideInt sum = 0;
+    int         i;
+
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifndef NSV_ATOMICS
+    Ns_MutexLock(&atomicLock);
+#endif
+    for (i = 0; i < NSV_COUNTER_SHARDS; i++) {
+#ifdef NSV_ATOMICS
+        sum += __atomic_load_n(&counterPtr->shards[i].value, __ATOMIC_RELAXED);
+#else
+        sum += counterPtr->shards[i].value;
+#endif
+    }
+#ifndef NSV_ATOMICS
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return sum;
+}
+
+static Tcl_WideInt
+CounterReset(NsvCounter *counterPtr)
+{
+    Tcl_WideInt sum = 0;
+    int         i;
+
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifndef NSV_ATOMICS
+    Ns_MutexLock(&atomicLock);
+#endif
+    for (i = 0; i < NSV_COUNTER_SHARDS; i++) {
+#ifdef NSV_ATOMICS
+        sum += __atomic_exchange_n(&counterPtr->shards[i].value, (Tcl_WideInt)0, __ATOMIC_RELAXED);
+#else
+        sum += counterPtr->shards[i].value;
+        counterPtr->shards[i].value = 0;
+#endif
+    }
+#ifndef NSV_ATOMICS
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return sum;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * RefCountIncr, RefCountDecr --
+ *
+ *      Increment or decrement a reference count shared between threads.
+ *
+ * Results:
+ *      RefCountDecr returns the new reference count.
+ *
+ * Side effects;
+ *      Updates the reference count.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+RefCountIncr(uintptr_t *refCountPtr)
+{
+    NS_NONNULL_ASSERT(refCountPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    (void) __atomic_fetch_add(refCountPtr, 1u, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    (*refCountPtr)++;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+static uintptr_t
+RefCountDecr(uintptr_t *refCountPtr)
+{
+    uintptr_t refCount;
+
+    NS_NONNULL_ASSERT(refCountPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    refCount = __atomic_sub_fetch(refCountPtr, 1u, __ATOMIC_ACQ_REL);
+#else
+    Ns_MutexLock(&atomicLock);
+    refCount = --(*refCountPtr);
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return refCount;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * StatIncr, ContentionAdd, StatLoad --
+ *
+ *      Update and read the lock and contention statistics of buckets and
+ *      arrays. The statistics are updated while holding the bucket lock,
+ *      which might be a read lock shared with other threads.
+ *
+ * Results:
+ *      StatLoad returns the current value.
+ *
+ * Side effects;
+ *      StatIncr and ContentionAdd update the provided counters.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+StatIncr(uintptr_t *valuePtr)
+{
+    NS_NONNULL_ASSERT(valuePtr != NULL);
+
+#ifdef NSV_ATOMICS
+    (void) __atomic_fetch_add(valuePtr, 1u, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    (*valuePtr)++;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+static void
+ContentionAdd(uintptr_t *contendedPtr, uintptr_t *waitTimePtr, uintptr_t waitTime)
+{
+    NS_NONNULL_ASSERT(contendedPtr != NULL);
+    NS_NONNULL_ASSERT(waitTimePtr != NULL);
+
+#ifdef NSV_ATOMICS
+    (void) __atomic_fetch_add(contendedPtr, 1u, __ATOMIC_RELAXED);
+    (void) __atomic_fetch_add(waitTimePtr, waitTime, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    (*contendedPtr)++;
+    *waitTimePtr += waitTime;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+static uintptr_t
+StatLoad(const uintptr_t *valuePtr)
+{
+    uintptr_t value;
+
+    NS_NONNULL_ASSERT(valuePtr != NULL);
+
+#ifdef NSV_ATOMICS
+    value = __atomic_load_n(valuePtr, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    value = *valuePtr;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return value;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CounterRetain, CounterRelease, CounterDetach, CounterIsDetached --
+ *
+ *      Manage the lifetime of a counter. The variable holds one
+ *      reference, which is released when the counter is detached from
+ *      the variable. Interpreters holding further references notice
+ *      the detached state and drop their references.
+ *
+ * Results:
+ *      CounterIsDetached returns true, when the counter is detached.
+ *
+ * Side effects;
+ *      Counter might be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CounterRetain(NsvCounter *counterPtr)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+    RefCountIncr(&counterPtr->refCount);
+}
+
+static void
+CounterRelease(NsvCounter *counterPtr)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+    if (RefCountDecr(&counterPtr->refCount) == 0u) {
+        ns_free(counterPtr);
+    }
+}
+
+static void
+CounterDetach(NsvCounter *counterPtr)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    __atomic_store_n(&counterPtr->detached, 1, __ATOMIC_RELEASE);
+#else
+    Ns_MutexLock(&atomicLock);
+    counterPtr->detached = 1;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    CounterRelease(counterPtr);
+}
+
+static bool
+CounterIsDetached(NsvCounter *counterPtr)
+{
+    int detached;
+
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    detached = __atomic_load_n(&counterPtr->detached, __ATOMIC_ACQUIRE);
+#else
+    Ns_MutexLock(&atomicLock);
+    detached = counterPtr->detached;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return (detached != 0);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CounterSetJournaled, CounterMarkDirty, CounterClearDirty --
+ *
+ *      Maintain the journal state of a counter. Counters of persistent
+ *      arrays are journaled; the first modification after the counter
+ *      was recorded marks it dirty, such that it is queued only once
+ *      per group commit.
+ *
+ * Results:
+ *      CounterMarkDirty returns true, when a journaled counter became
+ *      dirty and has to be queued for the journal.
+ *
+ * Side effects;
+ *      Updates the flags of the counter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+CounterSetJournaled(NsvCounter *counterPtr, bool journaled)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    __atomic_store_n(&counterPtr->journaled, journaled ? 1 : 0, __ATOMIC_RELAXED);
+#else
+    Ns_MutexLock(&atomicLock);
+    counterPtr->journaled = journaled ? 1 : 0;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+static bool
+CounterMarkDirty(NsvCounter *counterPtr)
+{
+    bool marked = NS_FALSE;
+
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    if (__atomic_load_n(&counterPtr->journaled, __ATOMIC_RELAXED) != 0) {
+        marked = (__atomic_exchange_n(&counterPtr->dirty, 1, __ATOMIC_ACQ_REL) == 0);
+    }
+#else
+    Ns_MutexLock(&atomicLock);
+    if (counterPtr->journaled != 0 && counterPtr->dirty == 0) {
+        counterPtr->dirty = 1;
+        marked = NS_TRUE;
+    }
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    return marked;
+}
+
+static void
+CounterClearDirty(NsvCounter *counterPtr)
+{
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    (void) __atomic_exchange_n(&counterPtr->dirty, 0, __ATOMIC_ACQ_REL);
+#else
+    Ns_MutexLock(&atomicLock);
+    counterPtr->dirty = 0;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * CounterShardIndex --
+ *
+ *      Return the counter shard used by an interpreter. Shards are
+ *      assigned round robin when an interpreter uses a counter for the
+ *      first time, such that concurrent threads update different cache
+ *      lines.
+ *
+ * Results:
+ *      Shard index.
+ *
+ * Side effects;
+ *      Assigns a shard to the interpreter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+CounterShardIndex(NsInterp *itPtr)
+{
+    NS_NONNULL_ASSERT(itPtr != NULL);
+
+    if (itPtr->nsvCounterShard == 0) {
+        static unsigned int nextShard = 0u;
+        unsigned int        shard;
+
+#ifdef NSV_ATOMICS
+        shard = __atomic_fetch_add(&nextShard, 1u, __ATOMIC_RELAXED);
+#else
+        Ns_MutexLock(&atomicLock);
+        shard = nextShard++;
+        Ns_MutexUnlock(&atomicLock);
+#endif
+        itPtr->nsvCounterShard = (int)(shard % NSV_COUNTER_SHARDS) + 1;
+    }
+    return itPtr->nsvCounterShard - 1;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetCounter --
+ *
+ *      Return the counter attached to a variable. The counter is looked
+ *      up in the per-interpreter table of counter references first,
+ *      such that incrementing a counter requires no bucket lock. On a
+ *      miss, the counter is attached to the variable under the bucket
+ *      lock. An existing integer value of the variable becomes the
+ *      initial value of the counter. When "create" is true, missing
+ *      arrays and variables are created with the value 0.
+ *
+ * Results:
+ *      Counter or NULL on error (interp result is set). The returned
+ *      counter is referenced by the interpreter.
+ *
+ * Side effects;
+ *      Might attach a counter to the variable.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static NsvCounter *
+GetCounter(Tcl_Interp *interp, Tcl_Obj *arrayObj, const char *keyString, bool create)
+{
+    NsInterp      *itPtr = NsGetInterpData(interp);
+    NsvCounter    *counterPtr = NULL;
+    Tcl_DString    ds;
+    Tcl_HashEntry *cacheEntryPtr;
+    int            isNew;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(arrayObj != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+
+    CacheKey(&ds, Tcl_GetString(arrayObj), keyString);
+    cacheEntryPtr = Tcl_CreateHashEntry(&itPtr->nsvCounters, ds.string, &isNew);
+    Tcl_DStringFree(&ds);
+
+    if (isNew == 0) {
+        counterPtr = Tcl_GetHashValue(cacheEntryPtr);
+        if (CounterIsDetached(counterPtr)) {
+            CounterRelease(counterPtr);
+            counterPtr = NULL;
+        }
+    }
+
+    if (counterPtr == NULL) {
+        Array *arrayPtr = LockArrayObj(interp, arrayObj, create, NS_WRITE);
+
+        if (arrayPtr != NULL) {
+            Tcl_HashEntry *hPtr;
+
+            if (create) {
+                hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, &isNew);
+                if (isNew != 0) {
+                    UpdateVar(arrayPtr, hPtr, "0", 1u, NULL);
+                }
+            } else {
+                hPtr = Tcl_FindHashEntry(&arrayPtr->vars, keyString);
+            }
+
+            if (hPtr == NULL) {
+                Ns_TclPrintfResult(interp, "no such key: %s", keyString);
+            } else {
+                Var *varPtr = Tcl_GetHashValue(hPtr);
+
+                if (varPtr->counterPtr == NULL) {
+                    Tcl_WideInt value;
+
+                    if (Ns_StrToWideInt(varPtr->value, &value) != NS_OK) {
+                        Ns_TclPrintfResult(interp, "array variable is not an integer");
+                    } else {
+                        if (varPtr->typedPtr != NULL) {
+                            ns_free(varPtr->typedPtr);
+                            varPtr->typedPtr = NULL;
+                        }
+                        varPtr->counterPtr = ns_calloc(1u, sizeof(NsvCounter));
+                        varPtr->counterPtr->shards[0].value = value;
+                        varPtr->counterPtr->refCount = 1u;
+                        varPtr->counterPtr->journaled = (arrayPtr->persistent
+                                                         && itPtr->servPtr->nsv.journalPtr != NULL) ? 1 : 0;
+                        varPtr->version = ++arrayPtr->bucketPtr->version;
+                        DropSnapshot(&arrayPtr->snapshotPtr);
+                    }
+                }
+                counterPtr = varPtr->counterPtr;
+                if (counterPtr != NULL) {
+                    CounterRetain(counterPtr);
+                }
+            }
+            UnlockArray(arrayPtr);
+        }
+
+        if (counterPtr != NULL) {
+            Tcl_SetHashValue(cacheEntryPtr, counterPtr);
+        } else {
+            Tcl_DeleteHashEntry(cacheEntryPtr);
+        }
+    }
+    return counterPtr;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * UseSnapshot --
+ *
+ *      Check, whether a full iteration over the provided table (variables
+ *      of an array or arrays of a bucket) should be performed on a
+ *      snapshot. This is the case for tables with at least
+ *      "nsvsnapshotsize" entries.
+ *
+ * Results:
+ *      Boolean value.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static bool
+UseSnapshot(const Bucket *bucketPtr, const Tcl_HashTable *tablePtr)
+{
+    int snapshotSize;
+
+    NS_NONNULL_ASSERT(bucketPtr != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+    snapshotSize = bucketPtr->servPtr->nsv.snapshotSize;
+    return (snapshotSize > 0 && tablePtr->numEntries >= snapshotSize);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * GetSnapshot --
+ *
+ *      Return the snapshot of the provided table stored in the provided
+ *      slot. When there is no snapshot, it is built from the table and
+ *      installed in the slot. When "values" is true, the values of the
+ *      table are variables, which are included in the snapshot. Must be
+ *      called with the bucket locked (at least for reading), the
+ *      snapshot can be used after the lock is released.
+ *
+ * Results:
+ *      Snapshot, which has to be released with SnapshotRelease().
+ *
+ * Side effects;
+ *      Might allocate and install a new snapshot.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Snapshot *
+GetSnapshot(Snapshot **slotPtr, Tcl_HashTable *tablePtr, bool values)
+{
+    Snapshot *snapshotPtr;
+
+    NS_NONNULL_ASSERT(slotPtr != NULL);
+    NS_NONNULL_ASSERT(tablePtr != NULL);
+
+#ifdef NSV_ATOMICS
+    snapshotPtr = __atomic_load_n(slotPtr, __ATOMIC_ACQUIRE);
+#else
+    Ns_MutexLock(&atomicLock);
+    snapshotPtr = *slotPtr;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+
+    if (snapshotPtr == NULL) {
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+        Snapshot            *installedPtr = NULL;
+        size_t               nentries = (size_t)tablePtr->numEntries, size = 0u, i = 0u;
+        char                *p;
+
+        /*
+         * Compute the size of all strings first, such that the snapshot
+         * can be allocated in a single chunk.
+         */
+        for (hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            size += strlen(Tcl_GetHashKey(tablePtr, hPtr)) + 1u;
+            if (values) {
+                const Var *varPtr = Tcl_GetHashValue(hPtr);
+
+                size += strlen(varPtr->value) + 1u;
+            }
+        }
+
+        snapshotPtr = ns_malloc(sizeof(Snapshot) + nentries * sizeof(SnapshotEntry) + size);
+        snapshotPtr->refCount = 1u;
+        snapshotPtr->nentries = nentries;
+        p = (char *)&snapshotPtr->entries[nentries];
+
+        for (hPtr = Tcl_FirstHashEntry(tablePtr, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            SnapshotEntry *entryPtr;
+            const char    *key;
+            size_t         len;
+
+            if (!values && ((const Array *)Tcl_GetHashValue(hPtr))->forwardPtr != NULL) {
+                /*
+                 * Skip forward markers of migrated arrays.
+                 */
+                continue;
+            }
+            entryPtr = &snapshotPtr->entries[i++];
+            key = Tcl_GetHashKey(tablePtr, hPtr);
+            len = strlen(key) + 1u;
+
+            entryPtr->key = memcpy(p, key, len);
+            p += len;
+            entryPtr->value = NULL;
+            entryPtr->counterPtr = NULL;
+            if (values) {
+                const Var *varPtr = Tcl_GetHashValue(hPtr);
+
+                len = strlen(varPtr->value) + 1u;
+                entryPtr->value = memcpy(p, varPtr->value, len);
+                p += len;
+                if (varPtr->counterPtr != NULL) {
+                    entryPtr->counterPtr = varPtr->counterPtr;
+                    CounterRetain(entryPtr->counterPtr);
+                }
+            }
+        }
+        snapshotPtr->nentries = i;
+
+        /*
+         * Several readers might have built the snapshot concurrently, only
+         * the first one is installed.
+         */
+#ifdef NSV_ATOMICS
+        if (!__atomic_compare_exchange_n(slotPtr, &installedPtr, snapshotPtr, NS_FALSE,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            SnapshotRelease(snapshotPtr);
+            snapshotPtr = installedPtr;
+        }
+#else
+        Ns_MutexLock(&atomicLock);
+        installedPtr = *slotPtr;
+        if (installedPtr == NULL) {
+            *slotPtr = snapshotPtr;
+        }
+        Ns_MutexUnlock(&atomicLock);
+        if (installedPtr != NULL) {
+            SnapshotRelease(snapshotPtr);
+            snapshotPtr = installedPtr;
+        }
+#endif
+    }
+
+    /*
+     * The reference of the slot keeps the snapshot alive while the bucket
+     * is locked.
+     */
+    RefCountIncr(&snapshotPtr->refCount);
+
+    return snapshotPtr;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DropSnapshot --
+ *
+ *      Remove the snapshot from the provided slot, since the underlying
+ *      table was modified. Must be called with the bucket locked for
+ *      writing.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Snapshot might be freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DropSnapshot(Snapshot **slotPtr)
+{
+    Snapshot *snapshotPtr;
+
+    NS_NONNULL_ASSERT(slotPtr != NULL);
+
+#ifdef NSV_ATOMICS
+    snapshotPtr = __atomic_exchange_n(slotPtr, NULL, __ATOMIC_ACQ_REL);
+#else
+    Ns_MutexLock(&atomicLock);
+    snapshotPtr = *slotPtr;
+    *slotPtr = NULL;
+    Ns_MutexUnlock(&atomicLock);
+#endif
+    if (snapshotPtr != NULL) {
+        SnapshotRelease(snapshotPtr);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SnapshotRelease --
+ *
+ *      Release a reference to a snapshot.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Frees the snapshot and releases the counters referenced by it,
+ *      when the last reference is gone.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SnapshotRelease(Snapshot *snapshotPtr)
+{
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+
+    if (RefCountDecr(&snapshotPtr->refCount) == 0u) {
+        size_t i;
+
+        for (i = 0u; i < snapshotPtr->nentries; i++) {
+            if (snapshotPtr->entries[i].counterPtr != NULL) {
+                CounterRelease(snapshotPtr->entries[i].counterPtr);
+            }
+        }
+        ns_free(snapshotPtr);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SnapshotAppend --
+ *
+ *      Append the keys (and the values, when "values" is true) of the
+ *      snapshot matching the optional pattern to the provided list.
+ *      Values of counters are the current sums.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects;
+ *      Modifies the list.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+SnapshotAppend(Tcl_Interp *interp, const Snapshot *snapshotPtr, const char *pattern,
+               bool values, Tcl_Obj *listObj)
+{
+    int    result = TCL_OK;
+    size_t i;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+    NS_NONNULL_ASSERT(listObj != NULL);
+
+    for (i = 0u; i < snapshotPtr->nentries && result == TCL_OK; i++) {
+        const SnapshotEntry *entryPtr = &snapshotPtr->entries[i];
+
+        if ((pattern == NULL) || (Tcl_StringMatch(entryPtr->key, pattern) != 0)) {
+            result = Tcl_ListObjAppendElement(interp, listObj,
+                                              Tcl_NewStringObj(entryPtr->key, TCL_INDEX_NONE));
+            if (values && result == TCL_OK) {
+                Tcl_Obj *valueObj;
+
+                if (entryPtr->counterPtr != NULL) {
+                    valueObj = Tcl_NewWideIntObj(CounterSum(entryPtr->counterPtr));
+                } else {
+                    valueObj = Tcl_NewStringObj(entryPtr->value, TCL_INDEX_NONE);
+                }
+                result = Tcl_ListObjAppendElement(interp, listObj, valueObj);
+            }
+        }
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Unset --
+ *
+ *      Unset the given key. If no key given flush the entire array.
+ *
+ * Results:
+ *      NS_ERROR if key requested but not present.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+Unset(Array *arrayPtr, const char *keyString)
+{
+    Ns_ReturnCode status = NS_ERROR;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+
+    if (keyString != NULL) {
+        Tcl_HashEntry *hPtr = Tcl_CreateHashEntry(&arrayPtr->vars, keyString, NULL);
+
+        if (hPtr != NULL) {
+            FreeVar(hPtr);
+            Tcl_DeleteHashEntry(hPtr);
+            DropSnapshot(&arrayPtr->snapshotPtr);
+            if (arrayPtr->persistent) {
+                JournalRecord(arrayPtr, 'U', keyString, NULL, 0u);
+            }
+            status = NS_OK;
+        }
+    } else {
+        Flush(arrayPtr);
+        status = NS_OK;
+    }
+
+    return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * Flush --
+ *
+ *      Unset all keys in an array.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      New entry is created and updated.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+Flush(Array *arrayPtr)
+{
+    Tcl_HashEntry  *hPtr;
+    Tcl_HashSearch  search;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+
+    hPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
+    while (hPtr != NULL) {
+        FreeVar(hPtr);
+        Tcl_DeleteHashEntry(hPtr);
+        hPtr = Tcl_NextHashEntry(&search);
+    }
+    DropSnapshot(&arrayPtr->snapshotPtr);
+    if (arrayPtr->persistent) {
+        JournalRecord(arrayPtr, 'F', NULL, NULL, 0u);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LockArrayObj --
+ *
+ *      Lock the array of the given name.
+ *      Array structure must be later unlocked with UnlockArray.
+ *
+ * Results:
+ *      Pointer to locked array or NULL.
+ *
+ * Side effects;
+ *      Array is created if it does not exists and 'create' is true.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Array *
+LockArrayObj(Tcl_Interp *interp, Tcl_Obj *arrayObj, bool create, NS_RW rw)
+{
+    Array              *arrayPtr;
+    Bucket             *bucketPtr;
+    static const char  *const arrayType = "nsv:array";
+    const char         *arrayName;
+
+    NS_NONNULL_ASSERT(interp != NULL);
+    NS_NONNULL_ASSERT(arrayObj != NULL);
+
+    arrayName = Tcl_GetString(arrayObj);
+
+    if (likely(Ns_TclGetOpaqueFromObj(arrayObj, arrayType, (void **) &bucketPtr) == TCL_OK)
+        && bucketPtr != NULL) {
+        /*
+         * Start with the bucket where the array was found the last time.
+         */
+        arrayPtr = LockBucketArray(bucketPtr->servPtr, bucketPtr, arrayName, create, rw);
+        if (arrayPtr != NULL && arrayPtr->bucketPtr != bucketPtr) {
+            Ns_TclSetOpaqueObj(arrayObj, arrayType, arrayPtr->bucketPtr);
+        }
+    } else {
+        const NsInterp *itPtr = NsGetInterpData(interp);
+
+        arrayPtr = LockArray(itPtr->servPtr, arrayName, create, rw);
+        if (arrayPtr != NULL) {
+            Ns_TclSetOpaqueObj(arrayObj, arrayType, arrayPtr->bucketPtr);
+        }
+    }
+
+    /*
+     * Both, LockBucketArray() and LockArray() can return NULL.
+     */
+    if (arrayPtr == NULL && !create) {
+        Ns_TclPrintfResult(interp, "no such array: %s", arrayName);
+        Tcl_SetErrorCode(interp, "TCL", "LOOKUP", "NSV", "ARRAY", arrayName, (char *)0L);
+    }
+
+    return arrayPtr;
+}
+
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvBucketObjCmd --
+ *
+ *      Implements "nsv_bucket".
+ *
+ *      Returns the names of the arrays kept in various buckets of the current
+ *      interp.  If called a bucket number it returns a list array kept in
+ *      that bucket. If called with no arguments, it returns a list of every
+ *      bucket (list of lists).
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+NsTclNsvBucketObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    const NsServer   *servPtr = itPtr->servPtr;
+    int               bucketNr = -1, result = TCL_OK;
+    Ns_ObjvValueRange bucketRange = {0, servPtr->nsv.nbuckets};
+    Ns_ObjvSpec       args[] = {
+        {"?bucket-number", Ns_ObjvInt,  &bucketNr, &bucketRange},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_Obj *resultObj;
+        int      i;
+
+        /*
          * LOCK for servPtr->nsv ?
          */
-        resultObj = Tcl_GetObjResult(interp);
-        for (i = 0; i < servPtr->nsv.nbuckets; i++) {
+        resultObj = Tcl_GetObjResult(interp);
+        for (i = 0; i < servPtr->nsv.nbuckets; i++) {
+            const Tcl_HashEntry *hPtr;
+            Tcl_Obj             *listObj;
+            Tcl_HashSearch       search;
+            Bucket              *bucketPtr;
+            uintptr_t            waitTime;
+
+            if (bucketNr > -1 && i != bucketNr) {
+                continue;
+            }
+            listObj = Tcl_NewListObj(0, NULL);
+            bucketPtr = &servPtr->nsv.buckets[i];
+            (void) LockBucket(bucketPtr, NS_READ, &waitTime);
+
+            hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
+            while (hPtr != NULL) {
+                const char  *keyString = Tcl_GetHashKey(&bucketPtr->arrays, hPtr);
+                const Array *arrayPtr  = Tcl_GetHashValue(hPtr);
+                Tcl_Obj     *elemObj;
+
+                if (arrayPtr->forwardPtr != NULL) {
+                    hPtr = Tcl_NextHashEntry(&search);
+                    continue;
+                }
+                elemObj = Tcl_NewListObj(0, NULL);
+                result = Tcl_ListObjAppendElement(interp, elemObj, Tcl_NewStringObj(keyString, TCL_INDEX_NONE));
+                if (likely(result == TCL_OK)) {
+                    result = Tcl_ListObjAppendElement(interp, elemObj, Tcl_NewWideIntObj((Tcl_WideInt)StatLoad(&arrayPtr->locks)));
+                }
+                if (likely(result == TCL_OK)) {
+                    result = Tcl_ListObjAppendElement(interp, listObj, elemObj);
+                }
+                if (unlikely(result != TCL_OK)) {
+                    break;
+                }
+                hPtr = Tcl_NextHashEntry(&search);
+            }
+            UnlockBucket(bucketPtr);
+
+            if (likely(result == TCL_OK)) {
+                result = Tcl_ListObjAppendElement(interp, resultObj, listObj);
+            }
+            if (unlikely(result != TCL_OK)) {
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvContentionObjCmd --
+ *
+ *      Implements "nsv_contention". Returns the contention statistics of
+ *      the arrays (or the buckets with "-buckets") as a list of dicts,
+ *      sorted by the total time spent waiting for the bucket locks.
+ *
+ * Results:
+ *      Tcl result code.
+ *
+ * Side effects;
+ *      Statistics are reset with "-reset".
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+NsTclNsvContentionObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    const NsServer   *servPtr = itPtr->servPtr;
+    int               buckets = (int)NS_FALSE, reset = (int)NS_FALSE, top = 0, result = TCL_OK;
+    Ns_ObjvValueRange topRange = {0, INT_MAX};
+    Ns_ObjvSpec       opts[] = {
+        {"-buckets", Ns_ObjvBool,  &buckets, INT2PTR(NS_TRUE)},
+        {"-reset",   Ns_ObjvBool,  &reset,   INT2PTR(NS_TRUE)},
+        {"-top",     Ns_ObjvInt,   &top,     &topRange},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(opts, NULL, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        ContentionStat *stats;
+        Tcl_Obj        *resultObj;
+        size_t          nstats = 0u, size = (size_t)servPtr->nsv.nbuckets, i;
+        int             b;
+
+        stats = ns_malloc(size * sizeof(ContentionStat));
+
+        for (b = 0; b < servPtr->nsv.nbuckets; b++) {
+            const Tcl_HashEntry *hPtr;
+            Tcl_HashSearch       search;
+            Bucket              *bucketPtr = &servPtr->nsv.buckets[b];
+            ContentionStat      *bucketStatPtr = NULL;
+            uintptr_t            waitTime;
+
+            (void) LockBucket(bucketPtr, (reset != 0) ? NS_WRITE : NS_READ, &waitTime);
+            if (buckets != 0) {
+                bucketStatPtr = &stats[nstats++];
+                bucketStatPtr->nameObj = NULL;
+                bucketStatPtr->bucket = b;
+                bucketStatPtr->narrays = 0;
+                bucketStatPtr->locks = 0u;
+                bucketStatPtr->contended = StatLoad(&bucketPtr->contended);
+                bucketStatPtr->waitTime = StatLoad(&bucketPtr->waitTime);
+            }
+            for (hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
+                 hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                Array *arrayPtr = Tcl_GetHashValue(hPtr);
+
+                if (arrayPtr->forwardPtr != NULL) {
+                    continue;
+                }
+                if (bucketStatPtr != NULL) {
+                    bucketStatPtr->narrays++;
+                    bucketStatPtr->locks += StatLoad(&arrayPtr->locks);
+                } else {
+                    ContentionStat *statPtr;
+
+                    if (nstats == size) {
+                        size *= 2u;
+                        stats = ns_realloc(stats, size * sizeof(ContentionStat));
+                    }
+                    statPtr = &stats[nstats++];
+                    statPtr->nameObj = Tcl_NewStringObj(Tcl_GetHashKey(&bucketPtr->arrays, hPtr),
+                                                        TCL_INDEX_NONE);
+                    Tcl_IncrRefCount(statPtr->nameObj);
+                    statPtr->bucket = b;
+                    statPtr->narrays = 1;
+                    statPtr->locks = StatLoad(&arrayPtr->locks);
+                    statPtr->contended = StatLoad(&arrayPtr->contended);
+                    statPtr->waitTime = StatLoad(&arrayPtr->waitTime);
+                }
+                if (reset != 0) {
+                    arrayPtr->locks = 0u;
+                    arrayPtr->contended = 0u;
+                    arrayPtr->waitTime = 0u;
+                    arrayPtr->lastWaitTime = 0u;
+                }
+            }
+            if (reset != 0) {
+                bucketPtr->contended = 0u;
+                bucketPtr->waitTime = 0u;
+                bucketPtr->lastWaitTime = 0u;
+            }
+            UnlockBucket(bucketPtr);
+        }
+
+        qsort(stats, nstats, sizeof(ContentionStat), ContentionCompare);
+
+        resultObj = Tcl_NewListObj(0, NULL);
+        for (i = 0u; i < nstats; i++) {
+            const ContentionStat *statPtr = &stats[i];
+
+            if (top == 0 || i < (size_t)top) {
+                Tcl_Obj *dictObj = Tcl_NewDictObj();
+
+                if (statPtr->nameObj != NULL) {
+                    (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("array", 5), statPtr->nameObj);
+                }
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("bucket", 6),
+                                      Tcl_NewIntObj(statPtr->bucket));
+                if (statPtr->nameObj == NULL) {
+                    (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("arrays", 6),
+                                          Tcl_NewIntObj(statPtr->narrays));
+                }
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("locks", 5),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)statPtr->locks));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("contended", 9),
+                                      Tcl_NewWideIntObj((Tcl_WideInt)statPtr->contended));
+                (void) Tcl_DictObjPut(NULL, dictObj, Tcl_NewStringObj("waittime", 8),
+                                      Tcl_NewDoubleObj((double)statPtr->waitTime / 1000000.0));
+                (void) Tcl_ListObjAppendElement(NULL, resultObj, dictObj);
+            }
+            if (statPtr->nameObj != NULL) {
+                Tcl_DecrRefCount(statPtr->nameObj);
+            }
+        }
+        ns_free(stats);
+        Tcl_SetObjResult(interp, resultObj);
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * ContentionCompare --
+ *
+ *      qsort() callback ordering the contention statistics by decreasing
+ *      waiting time, number of contended locks and number of locks.
+ *
+ * Results:
+ *      Negative, zero or positive value.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+ContentionCompare(const void *arg1, const void *arg2)
+{
+    const ContentionStat *stat1Ptr = arg1, *stat2Ptr = arg2;
+    int                   result;
+
+    if (stat1Ptr->waitTime != stat2Ptr->waitTime) {
+        result = (stat1Ptr->waitTime < stat2Ptr->waitTime) ? 1 : -1;
+    } else if (stat1Ptr->contended != stat2Ptr->contended) {
+        result = (stat1Ptr->contended < stat2Ptr->contended) ? 1 : -1;
+    } else if (stat1Ptr->locks != stat2Ptr->locks) {
+        result = (stat1Ptr->locks < stat2Ptr->locks) ? 1 : -1;
+    } else {
+        result = stat1Ptr->bucket - stat2Ptr->bucket;
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvMigrateObjCmd --
+ *
+ *      Implements "nsv_migrate". Moves an array to the specified bucket
+ *      or, when no bucket is specified, to the bucket with the least lock
+ *      contention.
+ *
+ * Results:
+ *      Tcl result code, the result is the bucket number of the array.
+ *
+ * Side effects;
+ *      Array is moved to a different bucket.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+NsTclNsvMigrateObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp   *itPtr = clientData;
+    const NsServer   *servPtr = itPtr->servPtr;
+    char             *arrayName = NULL;
+    int               bucketNr = -1, result = TCL_OK;
+    Ns_ObjvValueRange bucketRange = {0, servPtr->nsv.nbuckets - 1};
+    Ns_ObjvSpec       args[] = {
+        {"array",          Ns_ObjvString, &arrayName, NULL},
+        {"?bucket-number", Ns_ObjvInt,    &bucketNr,  &bucketRange},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 1, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Array *arrayPtr = LockArray(servPtr, arrayName, NS_FALSE, NS_READ);
+
+        if (arrayPtr != NULL) {
+            int currentNr = (int)(arrayPtr->bucketPtr - servPtr->nsv.buckets);
+
+            UnlockArray(arrayPtr);
+            if (bucketNr == -1) {
+                bucketNr = LeastContendedBucket(servPtr, currentNr);
+            }
+            if (MigrateArray(servPtr, arrayName, &servPtr->nsv.buckets[bucketNr]) != NS_OK) {
+                arrayPtr = NULL;
+            }
+        }
+        if (arrayPtr == NULL) {
+            Ns_TclPrintfResult(interp, "no such array: %s", arrayName);
+            Tcl_SetErrorCode(interp, "TCL", "LOOKUP", "NSV", "ARRAY", arrayName, (char *)0L);
+            result = TCL_ERROR;
+        } else {
+            Tcl_SetObjResult(interp, Tcl_NewIntObj(bucketNr));
+        }
+    }
+    return result;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * LeastContendedBucket --
+ *
+ *      Determine the bucket with the smallest total lock waiting time,
+ *      and among these, the bucket with the fewest arrays.
+ *
+ * Results:
+ *      Bucket number, or excludeIdx, when there is no other bucket.
+ *
+ * Side effects;
+ *      None.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+LeastContendedBucket(const NsServer *servPtr, int excludeIdx)
+{
+    uintptr_t bestWaitTime = 0u;
+    int       i, bestIdx = excludeIdx, bestSize = 0;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+
+    for (i = 0; i < servPtr->nsv.nbuckets; i++) {
+        Bucket   *bucketPtr = &servPtr->nsv.buckets[i];
+        uintptr_t waitTime;
+        int       size;
+
+        if (i == excludeIdx) {
+            continue;
+        }
+        (void) LockBucket(bucketPtr, NS_READ, &waitTime);
+        waitTime = StatLoad(&bucketPtr->waitTime);
+        size = bucketPtr->arrays.numEntries;
+        UnlockBucket(bucketPtr);
+
+        if (bestIdx == excludeIdx
+            || waitTime < bestWaitTime
+            || (waitTime == bestWaitTime && size < bestSize)) {
+            bestIdx = i;
+            bestWaitTime = waitTime;
+            bestSize = size;
+        }
+    }
+    return bestIdx;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MigrateArray --
+ *
+ *      Move an array to the provided bucket. The home bucket, the bucket
+ *      currently containing the array and the target bucket are locked
+ *      for writing during the move.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, when the array does not exist.
+ *
+ * Side effects;
+ *      Array is moved, the migration generation is incremented.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+MigrateArray(const NsServer *servPtr, const char *arrayName, Bucket *targetPtr)
+{
+    Bucket              *homePtr, *sourcePtr = NULL;
+    const Tcl_HashEntry *hPtr;
+    uintptr_t            waitTime;
+    Ns_ReturnCode        status = NS_ERROR;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(targetPtr != NULL);
+
+    homePtr = HomeBucket(servPtr, arrayName);
+
+    Ns_MutexLock(&migrateLock);
+
+    /*
+     * Determine the bucket currently containing the array. Since
+     * migrations are serialized, the array cannot move until all buckets
+     * are locked below, but it might be deleted.
+     */
+    (void) LockBucket(homePtr, NS_READ, &waitTime);
+    hPtr = Tcl_FindHashEntry(&homePtr->arrays, arrayName);
+    if (hPtr != NULL) {
+        const Array *arrayPtr = Tcl_GetHashValue(hPtr);
+
+        sourcePtr = (arrayPtr->forwardPtr != NULL) ? arrayPtr->forwardPtr : homePtr;
+    }
+    UnlockBucket(homePtr);
+
+    if (sourcePtr != NULL) {
+        Tcl_HashEntry *homeEntryPtr;
+        Bucket        *bucketPtrs[3];
+
+        bucketPtrs[0] = homePtr;
+        bucketPtrs[1] = sourcePtr;
+        bucketPtrs[2] = targetPtr;
+        LockBuckets(bucketPtrs, 3);
+
+        homeEntryPtr = Tcl_FindHashEntry(&homePtr->arrays, arrayName);
+        hPtr = Tcl_FindHashEntry(&sourcePtr->arrays, arrayName);
+        if (homeEntryPtr != NULL && hPtr != NULL) {
+            Array *arrayPtr = Tcl_GetHashValue(hPtr);
+
+            if (arrayPtr->forwardPtr == NULL) {
+                if (sourcePtr != targetPtr) {
+                    MoveArray(arrayPtr, homeEntryPtr, targetPtr, arrayName);
+#ifdef NSV_ATOMICS
+                    (void) __atomic_fetch_add(&migrationGeneration, 1u, __ATOMIC_RELEASE);
+#else
+                    Ns_MutexLock(&atomicLock);
+                    migrationGeneration++;
+                    Ns_MutexUnlock(&atomicLock);
+#endif
+                }
+                status = NS_OK;
+            }
+        }
+        UnlockBuckets(bucketPtrs, 3);
+    }
+    Ns_MutexUnlock(&migrateLock);
+
+    return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MoveArray --
+ *
+ *      Move the array to the target bucket and maintain the forward
+ *      marker in the home bucket. The variables receive new versions from
+ *      the target bucket, which is advanced beyond the versions of the
+ *      source bucket, such that cached values are never confused. Must be
+ *      called with all involved buckets locked for writing.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Array is moved, forward marker is created, updated or freed.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MoveArray(Array *arrayPtr, Tcl_HashEntry *homeEntryPtr, Bucket *targetPtr, const char *arrayName)
+{
+    Bucket              *sourcePtr;
+    Array               *markerPtr;
+    const Tcl_HashEntry *hPtr;
+    Tcl_HashSearch       search;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+    NS_NONNULL_ASSERT(homeEntryPtr != NULL);
+    NS_NONNULL_ASSERT(targetPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+
+    sourcePtr = arrayPtr->bucketPtr;
+
+    if (arrayPtr->entryPtr == homeEntryPtr) {
+        /*
+         * The array leaves its home bucket, leave a forward marker.
+         */
+        markerPtr = ns_calloc(1u, sizeof(Array));
+        markerPtr->bucketPtr = sourcePtr;
+        markerPtr->entryPtr = homeEntryPtr;
+        markerPtr->forwardPtr = targetPtr;
+        Tcl_SetHashValue(homeEntryPtr, markerPtr);
+    } else {
+        Tcl_DeleteHashEntry(arrayPtr->entryPtr);
+        markerPtr = Tcl_GetHashValue(homeEntryPtr);
+        markerPtr->forwardPtr = targetPtr;
+    }
+
+    if (markerPtr->bucketPtr == targetPtr) {
+        /*
+         * The array returns to its home bucket, the marker is not needed
+         * anymore.
+         */
+        ns_free(markerPtr);
+        Tcl_SetHashValue(homeEntryPtr, arrayPtr);
+        arrayPtr->entryPtr = homeEntryPtr;
+    } else {
+        int isNew;
+
+        arrayPtr->entryPtr = Tcl_CreateHashEntry(&targetPtr->arrays, arrayName, &isNew);
+        Tcl_SetHashValue(arrayPtr->entryPtr, arrayPtr);
+    }
+    arrayPtr->bucketPtr = targetPtr;
+
+    if (targetPtr->version < sourcePtr->version) {
+        targetPtr->version = sourcePtr->version;
+    }
+    for (hPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
+         hPtr != NULL;
+         hPtr = Tcl_NextHashEntry(&search)) {
+        Var *varPtr = Tcl_GetHashValue(hPtr);
+
+        varPtr->version = ++targetPtr->version;
+    }
+
+    DropSnapshot(&sourcePtr->namesPtr);
+    DropSnapshot(&targetPtr->namesPtr);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * MigrateCheck --
+ *
+ *      Scheduled procedure for the automatic migration of arrays. When
+ *      the lock waiting time of the most contended bucket since the last
+ *      check exceeds the configured threshold, the array of this bucket
+ *      with the highest waiting time is moved to the bucket with the
+ *      lowest waiting time, provided this relieves the other arrays of
+ *      the bucket without making the target bucket worse than the source
+ *      bucket was.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Array might be moved to a different bucket.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+MigrateCheck(void *arg, int UNUSED(id))
+{
+    const NsServer *servPtr = arg;
+    uintptr_t      *deltas, threshold, sourceDelta = 0u, arrayDelta = 0u;
+    int             i, sourceIdx = -1, targetIdx = -1;
+    Tcl_DString     ds;
+
+    threshold = (uintptr_t)servPtr->nsv.migrateThreshold.sec * 1000000u
+        + (uintptr_t)servPtr->nsv.migrateThreshold.usec;
+    deltas = ns_calloc((size_t)servPtr->nsv.nbuckets, sizeof(uintptr_t));
+    Tcl_DStringInit(&ds);
+
+    for (i = 0; i < servPtr->nsv.nbuckets; i++) {
+        const Tcl_HashEntry *hPtr, *hottestPtr = NULL;
+        Tcl_HashSearch       search;
+        Bucket              *bucketPtr = &servPtr->nsv.buckets[i];
+        uintptr_t            waitTime, hottestDelta = 0u;
+        int                  narrays = 0;
+
+        (void) LockBucket(bucketPtr, NS_READ, &waitTime);
+        waitTime = StatLoad(&bucketPtr->waitTime);
+        deltas[i] = waitTime - bucketPtr->lastWaitTime;
+        bucketPtr->lastWaitTime = waitTime;
+
+        for (hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            Array    *arrayPtr = Tcl_GetHashValue(hPtr);
+            uintptr_t delta;
+
+            if (arrayPtr->forwardPtr != NULL) {
+                continue;
+            }
+            waitTime = StatLoad(&arrayPtr->waitTime);
+            delta = waitTime - arrayPtr->lastWaitTime;
+            arrayPtr->lastWaitTime = waitTime;
+            if (hottestPtr == NULL || delta > hottestDelta) {
+                hottestPtr = hPtr;
+                hottestDelta = delta;
+            }
+            narrays++;
+        }
+        if (narrays > 1 && deltas[i] >= threshold && deltas[i] > sourceDelta) {
+            sourceIdx = i;
+            sourceDelta = deltas[i];
+            arrayDelta = hottestDelta;
+            Tcl_DStringSetLength(&ds, 0);
+            Tcl_DStringAppend(&ds, Tcl_GetHashKey(&bucketPtr->arrays, hottestPtr), TCL_INDEX_NONE);
+        }
+        UnlockBucket(bucketPtr);
+    }
+
+    if (sourceIdx != -1) {
+        for (i = 0; i < servPtr->nsv.nbuckets; i++) {
+            if (i != sourceIdx && (targetIdx == -1 || deltas[i] < deltas[targetIdx])) {
+                targetIdx = i;
+            }
+        }
+        if (targetIdx != -1
+            && deltas[targetIdx] + arrayDelta < sourceDelta
+            && MigrateArray(servPtr, ds.string, &servPtr->nsv.buckets[targetIdx]) == NS_OK) {
+            Ns_Log(Notice, "nsv: migrated array \"%s\" from bucket %d to bucket %d"
+                   " (lock waiting time %.6fs, array %.6fs)",
+                   ds.string, sourceIdx, targetIdx,
+                   (double)sourceDelta / 1000000.0, (double)arrayDelta / 1000000.0);
+        }
+    }
+
+    Tcl_DStringFree(&ds);
+    ns_free(deltas);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvInitMigration --
+ *
+ *      Configure the automatic migration of contended arrays of a server.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Schedules the migration check, when configured.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+NsTclNsvInitMigration(NsServer *servPtr, const char *section)
+{
+    Ns_Time interval;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(section != NULL);
+
+    Ns_ConfigTimeUnitRange(section, "nsvmigrateinterval", "0s", 0, 0, INT_MAX, 0, &interval);
+    Ns_ConfigTimeUnitRange(section, "nsvmigratethreshold", "10ms", 0, 0, INT_MAX, 0,
+                           &servPtr->nsv.migrateThreshold);
+
+    if (interval.sec > 0 || interval.usec > 0) {
+        (void) Ns_ScheduleProcEx(MigrateCheck, servPtr, NS_SCHED_THREAD, &interval, NULL);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * DeleteArray --
+ *
+ *      Delete a flushed array from the table of its bucket. Must be
+ *      called with the array locked for writing; the caller has to free
+ *      the array structure after unlocking.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Array is removed, persistent arrays are removed from the journal.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+DeleteArray(Array *arrayPtr)
+{
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+
+    SetPersistent(arrayPtr, NS_FALSE);
+    Tcl_DeleteHashTable(&arrayPtr->vars);
+    Tcl_DeleteHashEntry(arrayPtr->entryPtr);
+    DropSnapshot(&arrayPtr->bucketPtr->namesPtr);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * SetPersistent --
+ *
+ *      Make an array persistent or not. When an array becomes
+ *      persistent, its current content is written to the journal. The
+ *      counters of the array are journaled as long the array is
+ *      persistent. Must be called with the array locked for writing.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Journal records are written.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+SetPersistent(Array *arrayPtr, bool persistent)
+{
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+
+    if (persistent && !arrayPtr->persistent) {
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+
+        arrayPtr->persistent = NS_TRUE;
+        JournalRecord(arrayPtr, 'P', NULL, NULL, 0u);
+        for (hPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            char        numBuf[NSV_INTEGER_SPACE];
+            const char *value = VarValue(hPtr, numBuf);
+            Var        *varPtr = Tcl_GetHashValue(hPtr);
+
+            if (varPtr->counterPtr != NULL && arrayPtr->bucketPtr->servPtr->nsv.journalPtr != NULL) {
+                CounterSetJournaled(varPtr->counterPtr, NS_TRUE);
+            }
+            JournalRecord(arrayPtr, 'S', Tcl_GetHashKey(&arrayPtr->vars, hPtr), value, strlen(value));
+        }
+
+    } else if (!persistent && arrayPtr->persistent) {
+        const Tcl_HashEntry *hPtr;
+        Tcl_HashSearch       search;
+
+        JournalRecord(arrayPtr, 'D', NULL, NULL, 0u);
+        arrayPtr->persistent = NS_FALSE;
+        for (hPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &search);
+             hPtr != NULL;
+             hPtr = Tcl_NextHashEntry(&search)) {
+            Var *varPtr = Tcl_GetHashValue(hPtr);
+
+            if (varPtr->counterPtr != NULL) {
+                CounterSetJournaled(varPtr->counterPtr, NS_FALSE);
+            }
+        }
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalRecord --
+ *
+ *      Add a record about the modification of a persistent array to the
+ *      pending records of the journal and wake up the journal thread.
+ *      The operations are "P" (array becomes persistent), "S" (set
+ *      variable), "U" (unset variable), "F" (flush array) and "D"
+ *      (array is deleted or not persistent anymore). Must be called
+ *      with the array locked for writing.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Updates the sequence number of the lock holder in the array.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalRecord(Array *arrayPtr, char op, const char *keyString, const char *value, size_t len)
+{
+    NsvJournal *journalPtr;
+
+    NS_NONNULL_ASSERT(arrayPtr != NULL);
+
+    journalPtr = arrayPtr->bucketPtr->servPtr->nsv.journalPtr;
+    if (journalPtr != NULL) {
+        const char *arrayName = Tcl_GetHashKey(&arrayPtr->bucketPtr->arrays, arrayPtr->entryPtr);
+
+        Ns_MutexLock(&journalPtr->lock);
+        JournalAppend(&journalPtr->pending, op, arrayName, keyString, value, len);
+        arrayPtr->journalSeq = ++journalPtr->pendingSeq;
+        Ns_CondSignal(&journalPtr->cond);
+        Ns_MutexUnlock(&journalPtr->lock);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalAppend --
+ *
+ *      Append a record to a Tcl_DString. A record consists of a header
+ *      line with the operation and the lengths of the array name, the
+ *      key and the value, followed by the array name, the key and the
+ *      value and a newline character.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Modifies the Tcl_DString.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalAppend(Tcl_DString *dsPtr, char op, const char *arrayName, const char *keyString,
+              const char *value, size_t len)
+{
+    size_t arrayLength, keyLength;
+
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+
+    arrayLength = strlen(arrayName);
+    keyLength = (keyString != NULL) ? strlen(keyString) : 0u;
+
+    Ns_DStringPrintf(dsPtr, "%c %" PRIuz " %" PRIuz " %" PRIuz "\n",
+                     op, arrayLength, keyLength, len);
+    Tcl_DStringAppend(dsPtr, arrayName, (TCL_SIZE_T)arrayLength);
+    if (keyLength > 0u) {
+        Tcl_DStringAppend(dsPtr, keyString, (TCL_SIZE_T)keyLength);
+    }
+    if (len > 0u) {
+        Tcl_DStringAppend(dsPtr, value, (TCL_SIZE_T)len);
+    }
+    Tcl_DStringAppend(dsPtr, "\n", 1);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalWait --
+ *
+ *      Wait until the journal record with the provided sequence number
+ *      was written (and synced) by the journal thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Might block.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalWait(NsvJournal *journalPtr, uintptr_t seq)
+{
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+
+    Ns_MutexLock(&journalPtr->lock);
+    while (journalPtr->writtenSeq < seq && !journalPtr->stopped) {
+        Ns_CondWait(&journalPtr->doneCond, &journalPtr->lock);
+    }
+    Ns_MutexUnlock(&journalPtr->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalWrite --
+ *
+ *      Write all pending records as one batch to the journal file and
+ *      sync the file depending on the configured policy. Must be called
+ *      with the journal locked; the lock is released during the I/O.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Writes to the journal file, wakes up waiting threads.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalWrite(NsvJournal *journalPtr)
+{
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+
+    if (journalPtr->pending.length > 0) {
+        Tcl_DString ds;
+        uintptr_t   seq = journalPtr->pendingSeq;
+
+        Tcl_DStringInit(&ds);
+        Tcl_DStringAppend(&ds, journalPtr->pending.string, journalPtr->pending.length);
+        Tcl_DStringSetLength(&journalPtr->pending, 0);
+        Ns_MutexUnlock(&journalPtr->lock);
+
+        if (ns_write(journalPtr->fd, ds.string, (size_t)ds.length) != (ssize_t)ds.length) {
+            Ns_Log(Error, "nsv journal: could not write to journal: %s", strerror(errno));
+        } else if (journalPtr->sync != NSV_SYNC_NONE && NsvFsync(journalPtr->fd) != 0) {
+            Ns_Log(Error, "nsv journal: could not sync journal: %s", strerror(errno));
+        }
+        Tcl_DStringFree(&ds);
+
+        Ns_MutexLock(&journalPtr->lock);
+        journalPtr->writtenSeq = seq;
+        Ns_CondBroadcast(&journalPtr->doneCond);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalCounterDirty --
+ *
+ *      Queue a modified counter of a persistent array for the journal
+ *      and wake up the journal thread.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Retains the counter.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalCounterDirty(NsvJournal *journalPtr, NsvCounter *counterPtr,
+                    const char *arrayName, const char *keyString)
+{
+    DirtyCounter *dirtyPtr;
+    size_t        arrayLength, keyLength;
+
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+    NS_NONNULL_ASSERT(counterPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+
+    arrayLength = strlen(arrayName);
+    keyLength = strlen(keyString);
+    dirtyPtr = ns_malloc(sizeof(DirtyCounter) + arrayLength + keyLength + 1u);
+    memcpy(dirtyPtr->arrayName, arrayName, arrayLength + 1u);
+    dirtyPtr->keyString = dirtyPtr->arrayName + arrayLength + 1u;
+    memcpy((char *)dirtyPtr->keyString, keyString, keyLength + 1u);
+    dirtyPtr->counterPtr = counterPtr;
+    CounterRetain(counterPtr);
+
+    Ns_MutexLock(&journalPtr->lock);
+    dirtyPtr->nextPtr = journalPtr->dirtyPtr;
+    journalPtr->dirtyPtr = dirtyPtr;
+    Ns_CondSignal(&journalPtr->cond);
+    Ns_MutexUnlock(&journalPtr->lock);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalCounters --
+ *
+ *      Record the current values of the queued counters as "S" records.
+ *      Counters which were detached from their variable in the meantime
+ *      or belong to arrays which are not persistent anymore are
+ *      skipped. Must be called with the journal locked; the lock is
+ *      released while the arrays are locked.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Adds pending records, releases the queued counters.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalCounters(NsvJournal *journalPtr)
+{
+    DirtyCounter *dirtyPtr;
+
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+
+    dirtyPtr = journalPtr->dirtyPtr;
+    if (dirtyPtr != NULL) {
+        journalPtr->dirtyPtr = NULL;
+        Ns_MutexUnlock(&journalPtr->lock);
+
+        while (dirtyPtr != NULL) {
+            DirtyCounter *nextPtr = dirtyPtr->nextPtr;
+            Array        *arrayPtr;
+
+            /*
+             * Clear the flag before reading the value, such that later
+             * modifications queue the counter again.
+             */
+            CounterClearDirty(dirtyPtr->counterPtr);
+            arrayPtr = LockArray(journalPtr->servPtr, dirtyPtr->arrayName, NS_FALSE, NS_WRITE);
+            if (arrayPtr != NULL) {
+                const Tcl_HashEntry *hPtr = Tcl_FindHashEntry(&arrayPtr->vars, dirtyPtr->keyString);
+
+                if (arrayPtr->persistent
+                    && hPtr != NULL
+                    && ((const Var *)Tcl_GetHashValue(hPtr))->counterPtr == dirtyPtr->counterPtr) {
+                    char buf[NSV_INTEGER_SPACE];
+
+                    snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", CounterSum(dirtyPtr->counterPtr));
+                    JournalRecord(arrayPtr, 'S', dirtyPtr->keyString, buf, strlen(buf));
+                    /*
+                     * The journal thread must not wait for its own records.
+                     */
+                    arrayPtr->journalSeq = 0u;
+                }
+                UnlockArray(arrayPtr);
+            }
+            CounterRelease(dirtyPtr->counterPtr);
+            ns_free(dirtyPtr);
+            dirtyPtr = nextPtr;
+        }
+        Ns_MutexLock(&journalPtr->lock);
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalCompact --
+ *
+ *      Compact the journal into a snapshot of all persistent arrays.
+ *      The journal file is first renamed to "nsv.journal.prev", new
+ *      records go to a fresh journal file. Then, the snapshot is written
+ *      bucket by bucket without blocking writers of other buckets.
+ *      Since the records are idempotent, replaying records older than
+ *      the snapshot is harmless; therefore, the previous journal is
+ *      removed only after the snapshot was written successfully.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Writes and renames files in the journal directory.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalCompact(NsvJournal *journalPtr)
+{
+    const NsServer *servPtr;
+    Tcl_DString     journalDs, prevDs, snapshotDs, tmpDs, ds;
+    size_t          narrays = 0u;
+    int             fd, i;
+    bool            success = NS_TRUE;
+
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+
+    servPtr = journalPtr->servPtr;
+    JournalFileName(journalPtr, "journal", &journalDs);
+    JournalFileName(journalPtr, "journal.prev", &prevDs);
+    JournalFileName(journalPtr, "snapshot", &snapshotDs);
+    JournalFileName(journalPtr, "snapshot.tmp", &tmpDs);
+
+    /*
+     * Cut the journal. When the previous journal exists still (the last
+     * compaction failed), keep writing to the current journal.
+     */
+    Ns_MutexLock(&journalPtr->lock);
+    JournalWrite(journalPtr);
+    if (access(prevDs.string, F_OK) != 0) {
+        if (rename(journalDs.string, prevDs.string) != 0) {
+            Ns_Log(Error, "nsv journal: could not rename \"%s\": %s", journalDs.string, strerror(errno));
+        } else {
+            fd = JournalOpen(journalDs.string);
+            if (fd == NS_INVALID_FD) {
+                Ns_Log(Error, "nsv journal: could not open \"%s\": %s", journalDs.string, strerror(errno));
+                (void) rename(prevDs.string, journalDs.string);
+            } else {
+                (void) ns_close(journalPtr->fd);
+                journalPtr->fd = fd;
+            }
+        }
+    }
+    Ns_MutexUnlock(&journalPtr->lock);
+
+    fd = ns_open(tmpDs.string, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY | O_CLOEXEC, 0644);
+    if (fd == NS_INVALID_FD) {
+        Ns_Log(Error, "nsv journal: could not open \"%s\": %s", tmpDs.string, strerror(errno));
+        success = NS_FALSE;
+    } else {
+        Tcl_DStringInit(&ds);
+        Tcl_DStringAppend(&ds, NSV_JOURNAL_MAGIC, TCL_INDEX_NONE);
+
+        /*
+         * No array must escape the walk by a migration to an already
+         * visited bucket.
+         */
+        Ns_MutexLock(&migrateLock);
+        for (i = 0; i < servPtr->nsv.nbuckets && success; i++) {
             const Tcl_HashEntry *hPtr;
-            Tcl_Obj             *listObj;
             Tcl_HashSearch       search;
-            Bucket              *bucketPtr;
+            Bucket              *bucketPtr = &servPtr->nsv.buckets[i];
+            uintptr_t            waitTime;
+
+            (void) LockBucket(bucketPtr, NS_READ, &waitTime);
+            for (hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
+                 hPtr != NULL;
+                 hPtr = Tcl_NextHashEntry(&search)) {
+                Array *arrayPtr = Tcl_GetHashValue(hPtr);
+
+                if (arrayPtr->persistent) {
+                    const char          *arrayName = Tcl_GetHashKey(&bucketPtr->arrays, hPtr);
+                    const Tcl_HashEntry *varEntryPtr;
+                    Tcl_HashSearch       varSearch;
+
+                    JournalAppend(&ds, 'P', arrayName, NULL, NULL, 0u);
+                    for (varEntryPtr = Tcl_FirstHashEntry(&arrayPtr->vars, &varSearch);
+                         varEntryPtr != NULL;
+                         varEntryPtr = Tcl_NextHashEntry(&varSearch)) {
+                        char        numBuf[NSV_INTEGER_SPACE];
+                        const char *value = VarValue(varEntryPtr, numBuf);
+
+                        JournalAppend(&ds, 'S', arrayName, Tcl_GetHashKey(&arrayPtr->vars, varEntryPtr),
+                                      value, strlen(value));
+                    }
+                    narrays++;
+                }
+            }
+            UnlockBucket(bucketPtr);
+
+            if (ds.length > 0 && ns_write(fd, ds.string, (size_t)ds.length) != (ssize_t)ds.length) {
+                Ns_Log(Error, "nsv journal: could not write \"%s\": %s", tmpDs.string, strerror(errno));
+                success = NS_FALSE;
+            }
+            Tcl_DStringSetLength(&ds, 0);
+        }
+        Ns_MutexUnlock(&migrateLock);
+        Tcl_DStringFree(&ds);
+
+        if (success && NsvFsync(fd) != 0) {
+            Ns_Log(Error, "nsv journal: could not sync \"%s\": %s", tmpDs.string, strerror(errno));
+            success = NS_FALSE;
+        }
+        if (ns_close(fd) != 0) {
+            success = NS_FALSE;
+        }
+        if (success && rename(tmpDs.string, snapshotDs.string) != 0) {
+            Ns_Log(Error, "nsv journal: could not rename \"%s\": %s", tmpDs.string, strerror(errno));
+            success = NS_FALSE;
+        }
+    }
+
+    if (success) {
+        (void) unlink(prevDs.string);
+        Ns_Log(Notice, "nsv journal: compacted %" PRIuz " persistent arrays into \"%s\"",
+               narrays, snapshotDs.string);
+    } else {
+        (void) unlink(tmpDs.string);
+    }
+
+    Tcl_DStringFree(&journalDs);
+    Tcl_DStringFree(&prevDs);
+    Tcl_DStringFree(&snapshotDs);
+    Tcl_DStringFree(&tmpDs);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalFileName --
+ *
+ *      Build the name of a file in the journal directory.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Initializes and fills the provided Tcl_DString.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalFileName(const NsvJournal *journalPtr, const char *suffix, Tcl_DString *dsPtr)
+{
+    NS_NONNULL_ASSERT(journalPtr != NULL);
+    NS_NONNULL_ASSERT(suffix != NULL);
+    NS_NONNULL_ASSERT(dsPtr != NULL);
+
+    Tcl_DStringInit(dsPtr);
+    Ns_DStringPrintf(dsPtr, "%s/nsv.%s", journalPtr->dir, suffix);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalOpen --
+ *
+ *      Open a journal file for appending. New files start with the
+ *      magic line.
+ *
+ * Results:
+ *      File descriptor or NS_INVALID_FD.
+ *
+ * Side effects;
+ *      File might be created.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+JournalOpen(const char *fileName)
+{
+    int fd;
+
+    NS_NONNULL_ASSERT(fileName != NULL);
+
+    fd = ns_open(fileName, O_WRONLY | O_APPEND | O_CREAT | O_BINARY | O_CLOEXEC, 0644);
+    if (fd != NS_INVALID_FD && ns_lseek(fd, 0, SEEK_END) == 0) {
+        size_t length = strlen(NSV_JOURNAL_MAGIC);
+
+        if (ns_write(fd, NSV_JOURNAL_MAGIC, length) != (ssize_t)length) {
+            (void) ns_close(fd);
+            fd = NS_INVALID_FD;
+        }
+    }
+    return fd;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalReplay --
+ *
+ *      Apply the records of a journal or snapshot file. Replay stops at
+ *      the first incomplete record (e.g. the last record of a crashed
+ *      server), in which case the file is truncated to the complete
+ *      records.
+ *
+ * Results:
+ *      NS_OK or NS_ERROR, when the file could not be read or is not a
+ *      journal file. The number of applied records is returned in
+ *      countPtr.
+ *
+ * Side effects;
+ *      Modifies nsv arrays, might truncate the file.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static Ns_ReturnCode
+JournalReplay(const NsServer *servPtr, const char *fileName, size_t *countPtr, Tcl_DString *errorPtr)
+{
+    Ns_ReturnCode status = NS_OK;
+    Tcl_DString   buffer;
+    struct stat   st;
+    size_t        magicLength = strlen(NSV_JOURNAL_MAGIC);
+    int           fd;
 
-            if (bucketNr > -1 && i != bucketNr) {
-                continue;
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(fileName != NULL);
+    NS_NONNULL_ASSERT(countPtr != NULL);
+    NS_NONNULL_ASSERT(errorPtr != NULL);
+
+    *countPtr = 0u;
+    Tcl_DStringInit(&buffer);
+
+    fd = ns_open(fileName, O_RDWR | O_BINARY | O_CLOEXEC, 0);
+    if (fd == NS_INVALID_FD || fstat(fd, &st) != 0) {
+        Ns_DStringPrintf(errorPtr, "could not open \"%s\": %s", fileName, strerror(errno));
+        status = NS_ERROR;
+    } else {
+        Tcl_DStringSetLength(&buffer, (TCL_SIZE_T)st.st_size);
+        if (ns_read(fd, buffer.string, (size_t)st.st_size) != (ssize_t)st.st_size) {
+            Ns_DStringPrintf(errorPtr, "could not read \"%s\": %s", fileName, strerror(errno));
+            status = NS_ERROR;
+        } else if ((size_t)st.st_size < magicLength
+                   || memcmp(buffer.string, NSV_JOURNAL_MAGIC, magicLength) != 0) {
+            Ns_DStringPrintf(errorPtr, "file \"%s\" is not an nsv journal", fileName);
+            status = NS_ERROR;
+        }
+    }
+
+    if (status == NS_OK) {
+        const char  *p = buffer.string + magicLength, *end = buffer.string + buffer.length;
+        Tcl_DString  arrayDs, keyDs;
+
+        Tcl_DStringInit(&arrayDs);
+        Tcl_DStringInit(&keyDs);
+
+        while (p < end) {
+            const char *nl = memchr(p, INTCHAR('\n'), (size_t)(end - p)), *data;
+            char       *q;
+            size_t      arrayLength, keyLength, valueLength, available;
+            char        op = *p;
+
+            if (nl == NULL || op == '\0' || strchr("PSUFD", op) == NULL) {
+                break;
             }
-            listObj = Tcl_NewListObj(0, NULL);
-            bucketPtr = &servPtr->nsv.buckets[i];
-            if (servPtr->nsv.rwlocks) {
-                Ns_RWLockRdLock(&bucketPtr->rwlock);
-            } else {
-                Ns_MutexLock(&bucketPtr->mlock);
+            arrayLength = (size_t)strtoull(p + 1, &q, 10);
+            keyLength = (size_t)strtoull(q, &q, 10);
+            valueLength = (size_t)strtoull(q, &q, 10);
+            data = nl + 1;
+            available = (size_t)(end - data);
+            if (q != nl
+                || arrayLength == 0u
+                || arrayLength >= available || keyLength >= available || valueLength >= available
+                || arrayLength + keyLength + valueLength >= available
+                || data[arrayLength + keyLength + valueLength] != '\n') {
+                break;
             }
+            Tcl_DStringSetLength(&arrayDs, 0);
+            Tcl_DStringAppend(&arrayDs, data, (TCL_SIZE_T)arrayLength);
+            Tcl_DStringSetLength(&keyDs, 0);
+            Tcl_DStringAppend(&keyDs, data + arrayLength, (TCL_SIZE_T)keyLength);
+
+            JournalApply(servPtr, op, arrayDs.string, keyDs.string,
+                         data + arrayLength + keyLength, valueLength);
+            (*countPtr)++;
+            p = data + arrayLength + keyLength + valueLength + 1;
+        }
 
-            hPtr = Tcl_FirstHashEntry(&bucketPtr->arrays, &search);
-            while (hPtr != NULL) {
-                const char  *keyString = Tcl_GetHashKey(&bucketPtr->arrays, hPtr);
-                const Array *arrayPtr  = Tcl_GetHashValue(hPtr);
-                Tcl_Obj     *elemObj   = Tcl_NewListObj(0, NULL);
+        if (p < end) {
+            off_t length = (off_t)(p - buffer.string);
 
-                result = Tcl_ListObjAppendElement(interp, elemObj, Tcl_NewStringObj(keyString, TCL_INDEX_NONE));
-                if (likely(result == TCL_OK)) {
-                    result = Tcl_ListObjAppendElement(interp, elemObj, Tcl_NewLongObj(arrayPtr->locks));
-                }
-                if (likely(result == TCL_OK)) {
-                    result = Tcl_ListObjAppendElement(interp, listObj, elemObj);
-                }
-                if (unlikely(result != TCL_OK)) {
-                    break;
-                }
-                hPtr = Tcl_NextHashEntry(&search);
+            Ns_Log(Warning, "nsv journal: incomplete record in \"%s\" at offset %" PROTd
+                   ", truncating file", fileName, length);
+            if (ftruncate(fd, length) != 0) {
+                Ns_Log(Error, "nsv journal: could not truncate \"%s\": %s", fileName, strerror(errno));
             }
-            if (servPtr->nsv.rwlocks) {
-                Ns_RWLockUnlock(&bucketPtr->rwlock);
-            } else {
-                Ns_MutexUnlock(&bucketPtr->mlock);
+        }
+        Tcl_DStringFree(&arrayDs);
+        Tcl_DStringFree(&keyDs);
+    }
+
+    if (fd != NS_INVALID_FD) {
+        (void) ns_close(fd);
+    }
+    Tcl_DStringFree(&buffer);
+
+    return status;
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalApply --
+ *
+ *      Apply a single journal record.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Modifies nsv arrays.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalApply(const NsServer *servPtr, char op, const char *arrayName, const char *keyString,
+             const char *value, size_t len)
+{
+    Array *arrayPtr;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(arrayName != NULL);
+    NS_NONNULL_ASSERT(keyString != NULL);
+    NS_NONNULL_ASSERT(value != NULL);
+
+    arrayPtr = LockArray(servPtr, arrayName, (op == 'P' || op == 'S'), NS_WRITE);
+    if (arrayPtr != NULL) {
+        switch (op) {
+        case 'P':
+            SetPersistent(arrayPtr, NS_TRUE);
+            break;
+        case 'S':
+            SetVar(arrayPtr, keyString, value, len, NULL);
+            break;
+        case 'U':
+            (void) Unset(arrayPtr, keyString);
+            break;
+        case 'F':
+            Flush(arrayPtr);
+            break;
+        case 'D':
+            Flush(arrayPtr);
+            DeleteArray(arrayPtr);
+            break;
+        default:
+            /* unexpected value */
+            assert(op && 0);
+            break;
+        }
+        UnlockArray(arrayPtr);
+        if (op == 'D') {
+            ns_free(arrayPtr);
+        }
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalThread --
+ *
+ *      Background thread writing the pending journal records in batches
+ *      and compacting the journal periodically, on request, and at
+ *      shutdown.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Writes journal files.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalThread(void *arg)
+{
+    NsvJournal *journalPtr = arg;
+    Ns_Time     compactTime;
+
+    Ns_ThreadSetName("-nsvjournal:%s-", journalPtr->servPtr->server);
+    Ns_GetTime(&compactTime);
+    Ns_IncrTime(&compactTime, journalPtr->compactInterval.sec, journalPtr->compactInterval.usec);
+
+    Ns_MutexLock(&journalPtr->lock);
+    for (;;) {
+        while (journalPtr->pending.length == 0
+               && journalPtr->dirtyPtr == NULL
+               && !journalPtr->stop
+               && !journalPtr->compactRequested) {
+            if (Ns_CondTimedWait(&journalPtr->cond, &journalPtr->lock, &compactTime) == NS_TIMEOUT) {
+                journalPtr->compactRequested = NS_TRUE;
             }
+        }
+        JournalCounters(journalPtr);
+        JournalWrite(journalPtr);
+
+        if (journalPtr->compactRequested || journalPtr->stop) {
+            journalPtr->compactRequested = NS_FALSE;
+            Ns_MutexUnlock(&journalPtr->lock);
+            JournalCompact(journalPtr);
+            Ns_MutexLock(&journalPtr->lock);
+
+            journalPtr->compactions++;
+            Ns_CondBroadcast(&journalPtr->doneCond);
+            Ns_GetTime(&compactTime);
+            Ns_IncrTime(&compactTime, journalPtr->compactInterval.sec, journalPtr->compactInterval.usec);
+        }
+        if (journalPtr->stop && journalPtr->pending.length == 0 && journalPtr->dirtyPtr == NULL) {
+            break;
+        }
+    }
+    journalPtr->stopped = NS_TRUE;
+    Ns_CondBroadcast(&journalPtr->doneCond);
+    Ns_MutexUnlock(&journalPtr->lock);
+}
 
-            if (likely(result == TCL_OK)) {
-                result = Tcl_ListObjAppendElement(interp, resultObj, listObj);
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalShutdown --
+ *
+ *      Shutdown callback stopping the journal thread after writing the
+ *      pending records and a final snapshot.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Waits for the journal thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static void
+JournalShutdown(const Ns_Time *toPtr, void *arg)
+{
+    NsvJournal   *journalPtr = arg;
+    Ns_ReturnCode status = NS_OK;
+
+    Ns_MutexLock(&journalPtr->lock);
+    if (toPtr == NULL) {
+        journalPtr->stop = NS_TRUE;
+        Ns_CondSignal(&journalPtr->cond);
+    } else {
+        while (!journalPtr->stopped && status == NS_OK) {
+            status = Ns_CondTimedWait(&journalPtr->doneCond, &journalPtr->lock, toPtr);
+        }
+    }
+    Ns_MutexUnlock(&journalPtr->lock);
+
+    if (toPtr != NULL) {
+        if (status != NS_OK) {
+            Ns_Log(Warning, "nsv journal: timeout waiting for journal thread");
+        } else {
+            Ns_ThreadJoin(&journalPtr->thread, NULL);
+        }
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvInitJournal --
+ *
+ *      Initialize the journal of persistent nsv arrays of a server, when
+ *      the parameter "nsvjournaldir" is configured. The snapshot and the
+ *      journal files are replayed, before the journal thread is started.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects;
+ *      Restores persistent arrays, starts the journal thread.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+void
+NsTclNsvInitJournal(NsServer *servPtr, const char *section)
+{
+    const char *dir;
+
+    NS_NONNULL_ASSERT(servPtr != NULL);
+    NS_NONNULL_ASSERT(section != NULL);
+
+    servPtr->nsv.journalPtr = NULL;
+    dir = Ns_ConfigString(section, "nsvjournaldir", NS_EMPTY_STRING);
+
+    if (*dir != '\0') {
+        static const char *const fileSuffixes[] = {"snapshot", "journal.prev", "journal", NULL};
+        NsvJournal *journalPtr;
+        const char *syncString;
+        Tcl_DString ds;
+        int         i;
+
+        journalPtr = ns_calloc(1u, sizeof(NsvJournal));
+        journalPtr->servPtr = servPtr;
+        journalPtr->fd = NS_INVALID_FD;
+        Tcl_DStringInit(&journalPtr->pending);
+
+        if (Ns_PathIsAbsolute(dir) == NS_FALSE) {
+            Tcl_DStringInit(&ds);
+            Ns_HomePath(&ds, dir, (char *)0L);
+            journalPtr->dir = Ns_DStringExport(&ds);
+        } else {
+            journalPtr->dir = ns_strdup(dir);
+        }
+
+        syncString = Ns_ConfigString(section, "nsvjournalsync", "batch");
+        if (STREQ(syncString, "none")) {
+            journalPtr->sync = NSV_SYNC_NONE;
+        } else if (STREQ(syncString, "always")) {
+            journalPtr->sync = NSV_SYNC_ALWAYS;
+        } else {
+            if (!STREQ(syncString, "batch")) {
+                Ns_Log(Warning, "%s: invalid value \"%s\" for nsvjournalsync, using \"batch\"",
+                       section, syncString);
             }
-            if (unlikely(result != TCL_OK)) {
-                break;
+            journalPtr->sync = NSV_SYNC_BATCH;
+        }
+        Ns_ConfigTimeUnitRange(section, "nsvjournalcompactinterval", "1h", 1, 0, INT_MAX, 0,
+                               &journalPtr->compactInterval);
+
+        if (mkdir(journalPtr->dir, 0755) != 0 && errno != EEXIST) {
+            Ns_Log(Error, "nsv journal: could not create directory \"%s\": %s",
+                   journalPtr->dir, strerror(errno));
+        } else {
+            /*
+             * Replay the files in the order of their creation.
+             */
+            for (i = 0; fileSuffixes[i] != NULL; i++) {
+                Tcl_DString fileDs, errorDs;
+                size_t      count;
+
+                JournalFileName(journalPtr, fileSuffixes[i], &fileDs);
+                if (access(fileDs.string, F_OK) == 0) {
+                    Tcl_DStringInit(&errorDs);
+                    if (JournalReplay(servPtr, fileDs.string, &count, &errorDs) != NS_OK) {
+                        Ns_Log(Error, "nsv journal: %s", errorDs.string);
+                    } else {
+                        Ns_Log(Notice, "nsv journal: replayed %" PRIuz " records from \"%s\"",
+                               count, fileDs.string);
+                    }
+                    Tcl_DStringFree(&errorDs);
+                }
+                if (fileSuffixes[i + 1] == NULL) {
+                    journalPtr->fd = JournalOpen(fileDs.string);
+                    if (journalPtr->fd == NS_INVALID_FD) {
+                        Ns_Log(Error, "nsv journal: could not open \"%s\": %s",
+                               fileDs.string, strerror(errno));
+                    }
+                }
+                Tcl_DStringFree(&fileDs);
+            }
+        }
+
+        if (journalPtr->fd == NS_INVALID_FD) {
+            Ns_Log(Error, "nsv journal: persistence of nsv arrays is deactivated");
+            Tcl_DStringFree(&journalPtr->pending);
+            ns_free((char *)journalPtr->dir);
+            ns_free(journalPtr);
+        } else {
+            Ns_MutexInit(&journalPtr->lock);
+            Ns_MutexSetName2(&journalPtr->lock, "nsv:journal", servPtr->server);
+            Ns_CondInit(&journalPtr->cond);
+            Ns_CondInit(&journalPtr->doneCond);
+            servPtr->nsv.journalPtr = journalPtr;
+            Ns_ThreadCreate(JournalThread, journalPtr, 0, &journalPtr->thread);
+            (void) Ns_RegisterAtShutdown(JournalShutdown, journalPtr);
+        }
+    }
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * NsTclNsvJournalObjCmd --
+ *
+ *      Implements "nsv_journal".
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      See docs.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+int
+NsTclNsvJournalObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const Ns_SubCmdSpec subcmds[] = {
+        {"compact", JournalCompactObjCmd},
+        {"persist", JournalPersistObjCmd},
+        {"replay",  JournalReplayObjCmd},
+        {NULL,      NULL}
+    };
+
+    return Ns_SubcmdObjv(subcmds, clientData, interp, objc, objv);
+}
+
+
+/*
+ *-----------------------------------------------------------------------------
+ *
+ * JournalCompactObjCmd, JournalPersistObjCmd, JournalReplayObjCmd --
+ *
+ *      Implements "nsv_journal compact", "nsv_journal persist" and
+ *      "nsv_journal replay".
+ *
+ * Results:
+ *      Tcl result.
+ *
+ * Side effects:
+ *      See docs.
+ *
+ *-----------------------------------------------------------------------------
+ */
+
+static int
+JournalCompactObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    NsvJournal     *journalPtr = itPtr->servPtr->nsv.journalPtr;
+    int             result = TCL_OK;
+
+    if (Ns_ParseObjv(NULL, NULL, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (journalPtr == NULL) {
+        Ns_TclPrintfResult(interp, "nsv journal is not configured");
+        result = TCL_ERROR;
+
+    } else {
+        uintptr_t compactions;
+
+        Ns_MutexLock(&journalPtr->lock);
+        compactions = journalPtr->compactions;
+        journalPtr->compactRequested = NS_TRUE;
+        Ns_CondSignal(&journalPtr->cond);
+        while (journalPtr->compactions == compactions && !journalPtr->stopped) {
+            Ns_CondWait(&journalPtr->doneCond, &journalPtr->lock);
+        }
+        Ns_MutexUnlock(&journalPtr->lock);
+    }
+    return result;
+}
+
+static int
+JournalPersistObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    Tcl_Obj        *arrayObj = NULL;
+    int             persistent = -1, result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"array",       Ns_ObjvObj,  &arrayObj,   NULL},
+        {"?persistent", Ns_ObjvBool, &persistent, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else if (persistent == (int)NS_TRUE && itPtr->servPtr->nsv.journalPtr == NULL) {
+        Ns_TclPrintfResult(interp, "nsv journal is not configured");
+        result = TCL_ERROR;
+
+    } else {
+        Array *arrayPtr;
+
+        if (persistent == -1) {
+            arrayPtr = LockArrayObj(interp, arrayObj, NS_FALSE, NS_READ);
+        } else {
+            arrayPtr = LockArrayObj(interp, arrayObj, (persistent == (int)NS_TRUE), NS_WRITE);
+        }
+        if (arrayPtr == NULL) {
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(0));
+        } else {
+            if (persistent != -1) {
+                SetPersistent(arrayPtr, (persistent == (int)NS_TRUE));
             }
+            Tcl_SetObjResult(interp, Tcl_NewBooleanObj(arrayPtr->persistent));
+            UnlockArray(arrayPtr);
+        }
+    }
+    return result;
+}
+
+static int
+JournalReplayObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tcl_Obj *const* objv)
+{
+    const NsInterp *itPtr = clientData;
+    char           *fileName = NULL;
+    int             result = TCL_OK;
+    Ns_ObjvSpec     args[] = {
+        {"filename", Ns_ObjvString, &fileName, NULL},
+        {NULL, NULL, NULL, NULL}
+    };
+
+    if (Ns_ParseObjv(NULL, args, interp, 2, objc, objv) != NS_OK) {
+        result = TCL_ERROR;
+
+    } else {
+        Tcl_DString ds;
+        size_t      count = 0u;
+
+        Tcl_DStringInit(&ds);
+        if (JournalReplay(itPtr->servPtr, fileName, &count, &ds) != NS_OK) {
+            Tcl_DStringResult(interp, &ds);
+            result = TCL_ERROR;
+        } else {
+            Tcl_SetObjResult(interp, Tcl_NewWideIntObj((Tcl_WideInt)count));
         }
+        Tcl_DStringFree(&ds);
     }
     return result;
 }
@@ -107,12 +107,27 @@
  *    deletefuncInherit:   void (*)(void*)   MyDeleteProc
  *    deletefuncNoInherit: void (*)(void*)   (NULL)
  *
+ * Lookups do not traverse this structure. After every change, the
+ * channels of a junction are compiled into an immutable snapshot (see
+ * below), which is published via an atomic pointer. Lookups operate
+ * on the current snapshot without locking; replaced snapshots are
+ * freed, when no lookup can use them anymore. Every thread memoizes
+ * the results of its recent lookups per snapshot generation.
  */
 
 #include "nsd.h"
 
 #define STACK_SIZE      512 /* Max depth of URL hierarchy. */
 
+/*
+ * Lock-free lookups require atomic operations, which are provided by GCC
+ * and clang via builtins. For other compilers, the snapshots are guarded
+ * by a global read-write lock.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+# define URLSPACE_LOCKFREE 1
+#endif
+
 /*
 #define DEBUG 1
 */
@@ -250,6 +265,7 @@ typedef struct Junction {
 #ifndef __URLSPACE_OPTIMIZE__
     Ns_Index byuse;
 #endif
+    struct Snapshot *snapshotPtr;  /* Compiled channels used for lookups */
 } Junction;
 
 /*
@@ -271,6 +287,105 @@ typedef struct UrlSpaceContextSpec {
     bool          hasPattern;
 } UrlSpaceContextSpec;
 
+/*
+ * A Snapshot is the compiled, immutable form of a junction. The
+ * channels are stored in the order in which they are checked during
+ * lookups. All tries, branches and context specs of the channels are
+ * stored in contiguous arrays, the branches of a trie are adjacent and
+ * sorted, such that the next word of a sequence is located via binary
+ * search. The strings are copied into the snapshot, which is allocated
+ * as a single block of memory. Only the user data is shared with the
+ * mutable trie.
+ */
+
+typedef struct SnapshotTrie {
+    void         *dataInherit;      /* User's data */
+    void         *dataNoInherit;    /* User's data */
+    size_t        firstBranch;      /* Index of first branch in branches[] */
+    size_t        nbranches;
+    size_t        firstSpec;        /* Index of first context spec in specs[] */
+    size_t        nspecs;
+    bool          hasNode;
+} SnapshotTrie;
+
+typedef struct SnapshotBranch {
+    const char   *word;
+    size_t        trie;             /* Index of the sub-trie in tries[] */
+} SnapshotBranch;
+
+typedef struct SnapshotChannel {
+    const char   *filter;
+    size_t        trie;             /* Index of the trie in tries[] */
+    unsigned int  flags;
+    bool          noFilter;         /* Filter is "*" */
+} SnapshotChannel;
+
+typedef struct Snapshot {
+    struct Snapshot     *nextPtr;        /* Next retired snapshot */
+    uintptr_t            retireEpoch;    /* Epoch when snapshot was replaced */
+    uintptr_t            generation;     /* Unique over all snapshots */
+    size_t               nchannels;
+    size_t               nspecs;         /* Total number of context specs */
+    SnapshotChannel     *channels;
+    SnapshotTrie        *tries;
+    SnapshotBranch      *branches;
+    UrlSpaceContextSpec *specs;
+} Snapshot;
+
+/*
+ * Temporary state while compiling a snapshot.
+ */
+
+typedef struct SnapshotBuilder {
+    Snapshot *snapshotPtr;
+    size_t    ntries;
+    size_t    nbranches;
+    size_t    nspecs;
+    size_t    nbytes;
+    char     *stringPtr;
+} SnapshotBuilder;
+
+#define SNAPSHOT_ALIGN(size) (((size) + 15u) & ~(size_t)15u)
+
+/*
+ * Every thread keeps a small direct-mapped memo of the results of its
+ * recent lookups. An entry is only valid for the snapshot with the same
+ * generation, so publishing a new snapshot invalidates all memoized
+ * results of the junction at once. Results of lookups, which depend on
+ * context filters, are not memoized.
+ */
+
+#define MEMO_SLOTS 256u
+
+typedef struct MemoEntry {
+    uintptr_t            generation;     /* Generation of the snapshot, 0 when unused */
+    char                *key;            /* Copy of the sequence */
+    size_t               keyLength;
+    size_t               keySize;        /* Allocated size of key */
+    unsigned int         hash;
+    unsigned int         flags;
+    NsUrlSpaceOp         op;
+    void                *data;
+    Ns_UrlSpaceMatchInfo matchInfo;
+} MemoEntry;
+
+typedef struct Memo {
+    MemoEntry entries[MEMO_SLOTS];
+} Memo;
+
+#ifdef URLSPACE_LOCKFREE
+/*
+ * Every thread performing lookups is registered as a reader. The epoch
+ * of a reader is the global epoch at the begin of its current lookup or
+ * 0, when the reader is not active.
+ */
+
+typedef struct Reader {
+    struct Reader *nextPtr;
+    uintptr_t      epoch;
+} Reader;
+#endif
+
 /*
  * Local functions defined in this file
  */
@@ -335,11 +450,6 @@ static void  TrieAdd(Trie *triePtr, char *seq, void *data, unsigned int flags,
                      Ns_FreeProc deleteProc, void *contextSpec)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
 
-static void *TrieFind(const Trie *triePtr, char *seq,
-                      NsUrlSpaceContextFilterProc proc, void *context,
-                      int *depthPtr)
-    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(5);
-
 static void *TrieFindExact(const Trie *triePtr, char *seq, unsigned int flags, Node **nodePtrPtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(4);
 
@@ -372,20 +482,69 @@ static void JunctionAdd(Junction *juncPtr, char *seq, void *data,
                         void *contextSpec)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static void *JunctionFind(const Junction *juncPtr, char *seq,
-                          Ns_UrlSpaceMatchInfo *matchInfoPtr,
-                          NsUrlSpaceContextFilterProc proc, void *context)
+static void JunctionPublish(Junction *juncPtr)
+    NS_GNUC_NONNULL(1);
+
+static void *JunctionDeleteNode(const Junction *juncPtr, char *seq, unsigned int flags)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static void *JunctionFindExact(const Junction *juncPtr, char *seq, unsigned int flags)
+static void JunctionTruncBranch(const Junction *juncPtr, char *seq)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static void *JunctionDeleteNode(const Junction *juncPtr, char *seq, unsigned int flags)
+/*
+ * Snapshot functions
+ */
+
+static Snapshot *SnapshotCreate(const Junction *juncPtr)
+    NS_GNUC_NONNULL(1);
+
+static void SnapshotCount(SnapshotBuilder *builderPtr, const Trie *triePtr)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
-static void JunctionTruncBranch(const Junction *juncPtr, char *seq)
+static size_t SnapshotAddTrie(SnapshotBuilder *builderPtr, const Trie *triePtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static const char *SnapshotString(SnapshotBuilder *builderPtr, const char *string)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_RETURNS_NONNULL;
+
+static const SnapshotTrie *SnapshotBranchFind(const Snapshot *snapshotPtr,
+                                              const SnapshotTrie *triePtr,
+                                              const char *word)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void *SnapshotTrieFind(const Snapshot *snapshotPtr, const SnapshotTrie *triePtr,
+                              const char *seq, NsUrlSpaceContextFilterProc proc,
+                              void *context, int *depthPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3) NS_GNUC_NONNULL(6);
+
+static void *SnapshotTrieFindExact(const Snapshot *snapshotPtr, const SnapshotTrie *triePtr,
+                                   const char *seq, unsigned int flags)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2) NS_GNUC_NONNULL(3);
+
+static void *SnapshotFind(const Snapshot *snapshotPtr, char *seq,
+                          Ns_UrlSpaceMatchInfo *matchInfoPtr,
+                          NsUrlSpaceContextFilterProc proc, void *context)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
+
+static void *SnapshotFindExact(const Snapshot *snapshotPtr, char *seq, unsigned int flags)
     NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(2);
 
+static MemoEntry *MemoGet(const Snapshot *snapshotPtr, NsUrlSpaceOp op, unsigned int flags,
+                          const Ns_DString *dsPtr, bool *hitPtr)
+    NS_GNUC_NONNULL(1) NS_GNUC_NONNULL(4) NS_GNUC_NONNULL(5) NS_GNUC_RETURNS_NONNULL;
+
+static Ns_TlsCleanup FreeMemo;
+
+#ifdef URLSPACE_LOCKFREE
+static void Retire(Snapshot *snapshotPtr)
+    NS_GNUC_NONNULL(1);
+
+static Reader *GetReader(void)
+    NS_GNUC_RETURNS_NONNULL;
+
+static Ns_TlsCleanup FreeReader;
+#endif
+
 /*
  * Functions for ns_urlspace
  */
@@ -406,6 +565,51 @@ static int nextid = 0, defaultTclUrlSpaceId = -1;
 static bool tclUrlSpaces[MAX_URLSPACES] = {NS_FALSE};
 static Ns_ObjvValueRange idRange = {-1, MAX_URLSPACES};
 
+static Ns_Tls     memoTls;
+static uintptr_t  snapshotGeneration = 0u;
+
+#ifdef URLSPACE_LOCKFREE
+static Ns_Tls     readerTls;
+static Ns_Mutex   readersLock = NULL;
+static Reader    *firstReaderPtr = NULL;
+static Snapshot  *retiredPtr = NULL;
+static uintptr_t  globalEpoch = 1u;
+#else
+static Ns_RWLock  snapshotLock = NULL;
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NsInitUrlSpace --
+ *
+ *      Initialize the registry of urlspace readers and the
+ *      thread-local lookup memo.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+NsInitUrlSpace(void)
+{
+    Ns_TlsAlloc(&memoTls, FreeMemo);
+#ifdef URLSPACE_LOCKFREE
+    Ns_MutexInit(&readersLock);
+    Ns_MutexSetName(&readersLock, "ns:urlspace:readers");
+    Ns_TlsAlloc(&readerTls, FreeReader);
+#else
+    Ns_RWLockInit(&snapshotLock);
+    Ns_RWLockSetName(&snapshotLock, "ns:urlspace:snapshots");
+#endif
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -682,6 +886,7 @@ Ns_UrlSpecificSet2(const char *server, const char *method, const char *url, int
 
     if (likely(servPtr != NULL)) {
         Ns_DString  ds;
+        Junction   *juncPtr;
 
         Ns_DStringInit(&ds);
         MkSeq(&ds, method, url);
@@ -690,7 +895,9 @@ Ns_UrlSpecificSet2(const char *server, const char *method, const char *url, int
         PrintSeq(ds.string);
 #endif
 
-        JunctionAdd(JunctionGet(servPtr, id), ds.string, data, flags, freeProc, contextSpec);
+        juncPtr = JunctionGet(servPtr, id);
+        JunctionAdd(juncPtr, ds.string, data, flags, freeProc, contextSpec);
+        JunctionPublish(juncPtr);
         Ns_DStringFree(&ds);
     }
 }
@@ -773,14 +980,18 @@ Ns_UrlSpecificGetExact(const char *server, const char *method, const char *url,
  *      Lower level function, receives NsServer instead of string base
  *      server name.  "flags" are just used, when NS_URLSPACE_EXACT is
  *      specified. In this case, the flags are passed to
- *      TrieFindExact(), which returns data only, which was set with
+ *      SnapshotFindExact(), which returns data only, which was set with
  *      this flag.
  *
+ *      The lookup operates on the current snapshot of the junction
+ *      and requires no lock. The caller is responsible for the
+ *      lifetime of the returned user data.
+ *
  * Results:
  *      A pointer to user data, set with Ns_UrlSpecificSet.
  *
  * Side effects:
- *      None.
+ *      Thread is registered as a urlspace reader on first use.
  *
  *----------------------------------------------------------------------
  */
@@ -793,13 +1004,28 @@ NsUrlSpecificGet(NsServer *servPtr, const char *method, const char *url, int id,
 {
     Ns_DString      ds, *dsPtr = &ds;
     void           *data = NULL; /* Just to make compiler silent, we have a complete enumeration of switch values */
-    const Junction *junction;
+    const Junction *juncPtr;
+    const Snapshot *snapshotPtr;
+#ifdef URLSPACE_LOCKFREE
+    Reader         *readerPtr;
+#endif
 
     NS_NONNULL_ASSERT(servPtr != NULL);
     NS_NONNULL_ASSERT(method != NULL);
     NS_NONNULL_ASSERT(url != NULL);
 
-    junction = JunctionGet(servPtr, id);
+    /*
+     * Don't create the junction here, lookups must not modify the
+     * urlspace.
+     */
+#ifdef URLSPACE_LOCKFREE
+    juncPtr = __atomic_load_n(&servPtr->urlspace.junction[id], __ATOMIC_ACQUIRE);
+#else
+    juncPtr = servPtr->urlspace.junction[id];
+#endif
+    if (juncPtr == NULL) {
+        return NULL;
+    }
 
     Ns_DStringInit(dsPtr);
     MkSeq(dsPtr, method, url);
@@ -809,25 +1035,74 @@ NsUrlSpecificGet(NsServer *servPtr, const char *method, const char *url, int id,
     PrintSeq(dsPtr->string);
 #endif
 
-    switch (op) {
-
-    case NS_URLSPACE_DEFAULT:
-        data = JunctionFind(junction, dsPtr->string, matchInfoPtr, proc, context);
-        break;
+    /*
+     * Announce the current epoch before loading the snapshot; snapshots
+     * retired in this or a later epoch are not freed until the epoch of
+     * the reader is reset.
+     */
+#ifdef URLSPACE_LOCKFREE
+    readerPtr = GetReader();
+    __atomic_store_n(&readerPtr->epoch, __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+    snapshotPtr = __atomic_load_n(&juncPtr->snapshotPtr, __ATOMIC_SEQ_CST);
+#else
+    Ns_RWLockRdLock(&snapshotLock);
+    snapshotPtr = juncPtr->snapshotPtr;
+#endif
 
-    case NS_URLSPACE_EXACT:
-        data = JunctionFindExact(junction, dsPtr->string, flags);
-        break;
+    if (snapshotPtr != NULL) {
+        MemoEntry           *entryPtr = NULL;
+        bool                 hit = NS_FALSE;
+        Ns_UrlSpaceMatchInfo matchInfo = {0, 0u, NS_FALSE};
 
-    case NS_URLSPACE_FAST:
         /*
-         * Deprecated branch.
+         * The result depends on the context, when the snapshot has
+         * context filters.
          */
-        data = JunctionFind(junction, dsPtr->string, matchInfoPtr, proc, context);
-        break;
+        if (context == NULL || snapshotPtr->nspecs == 0u) {
+            entryPtr = MemoGet(snapshotPtr, op, flags, dsPtr, &hit);
+        }
+
+        if (hit) {
+            data = entryPtr->data;
+            matchInfo = entryPtr->matchInfo;
+
+        } else {
+            switch (op) {
+
+            case NS_URLSPACE_DEFAULT:
+                data = SnapshotFind(snapshotPtr, dsPtr->string, &matchInfo, proc, context);
+                break;
+
+            case NS_URLSPACE_EXACT:
+                data = SnapshotFindExact(snapshotPtr, dsPtr->string, flags);
+                break;
+
+            case NS_URLSPACE_FAST:
+                /*
+                 * Deprecated branch.
+                 */
+                data = SnapshotFind(snapshotPtr, dsPtr->string, &matchInfo, proc, context);
+                break;
 
+            }
+            if (entryPtr != NULL) {
+                entryPtr->data = data;
+                entryPtr->matchInfo = matchInfo;
+                entryPtr->generation = snapshotPtr->generation;
+            }
+        }
+        if (matchInfoPtr != NULL && data != NULL && op != NS_URLSPACE_EXACT) {
+            *matchInfoPtr = matchInfo;
+        }
     }
 
+#ifdef URLSPACE_LOCKFREE
+    __atomic_store_n(&readerPtr->epoch, 0u, __ATOMIC_RELEASE);
+#else
+    Ns_RWLockUnlock(&snapshotLock);
+#endif
+
     Ns_DStringFree(dsPtr);
 
     return data;
@@ -867,16 +1142,18 @@ Ns_UrlSpecificDestroy(const char *server, const char *method, const char *url,
 
     if (likely(servPtr != NULL)) {
         Ns_DString ds;
+        Junction  *juncPtr = JunctionGet(servPtr, id);
 
         Ns_DStringInit(&ds);
         MkSeq(&ds, method, url);
         if ((flags & NS_OP_RECURSE) != 0u) {
             //Ns_Log(Ns_LogUrlspaceDebug, "JunctionTruncBranch %s 0x%.6x", url, flags);
-            JunctionTruncBranch(JunctionGet(servPtr, id), ds.string);
+            JunctionTruncBranch(juncPtr, ds.string);
         } else {
             //Ns_Log(Ns_LogUrlspaceDebug, "JunctionDeleteNode %s 0x%.6x", url, flags);
-            data = JunctionDeleteNode(JunctionGet(servPtr, id), ds.string, flags);
+            data = JunctionDeleteNode(juncPtr, ds.string, flags);
         }
+        JunctionPublish(juncPtr);
         Ns_DStringFree(&ds);
     }
 
@@ -1611,122 +1888,19 @@ TrieDestroy(Trie *triePtr)
     }
 }
 
-
-/*
- *----------------------------------------------------------------------
- *
- * TrieFind --
- *
- *      Find a node in a trie matching a sequence.
- *
- * Results:
- *      Return the appropriate node's data.
- *
- * Side effects:
- *      The depth variable will be set-by-reference to the depth of
- *      the returned node. If no node is set, it will not be changed.
- *
- *----------------------------------------------------------------------
- */
-
-static void *
-TrieFind(const Trie *triePtr, char *seq, NsUrlSpaceContextFilterProc proc, void *context, int *depthPtr)
-{
-    const Node   *nodePtr;
-    const Branch *branchPtr;
-    void         *data = NULL;
-    int           ldepth;
-
-    NS_NONNULL_ASSERT(triePtr != NULL);
-    NS_NONNULL_ASSERT(seq != NULL);
-    NS_NONNULL_ASSERT(depthPtr != NULL);
-
-    nodePtr = triePtr->node;
-    ldepth = *depthPtr;
-
-#ifdef DEBUG
-    fprintf(stderr, "...    TrieFind seq '%s' nodePtr %p ldepth %d\n", seq, (void*)nodePtr, ldepth);
-#endif
-
-    if (nodePtr != NULL) {
-        if (
-            (*seq == '\0') /* this makes "set -noinherit /x/ *.html foo" + "get /x/a.html" fail */
-            && (nodePtr->dataNoInherit != NULL)
-            ) {
-            data = nodePtr->dataNoInherit;
-        } else {
-            data = nodePtr->dataInherit;
-#ifdef CONTEXT_FILTER
-            if (nodePtr->data.n != 0) {
-                /*
-                 * We have context filters
-                 */
-                if (context != NULL) {
-                    size_t i;
-#ifdef DEBUG
-                    fprintf(stderr, "...    TrieFind seq '%s' nodePtr %p context %p context specs %ld\n",
-                            seq, (void*)nodePtr, context, nodePtr->data.n);
-#endif
-                    for (i = 0u; i < nodePtr->data.n; i++) {
-                        Ns_IndexContextSpec *spec = Ns_IndexEl(&nodePtr->data, i);
-                        bool success;
-
-                        assert(proc != NULL);
-                        success = (proc)(spec, context);
-#ifdef DEBUG
-                        fprintf(stderr, ".......[%ld]    TrieFind seq '%s' nodePtr %p => success %d\n",
-                                i, seq, (void*)nodePtr, success);
-#endif
-                        if (success) {
-                            data = spec->data;
-                            break;
-                        }
-                    }
-                }
-            }
-#endif
-        }
-#ifdef DEBUG
-        fprintf(stderr, "...    TrieFind seq '%s' nodePtr %p -> data %p\n", seq, (void*)nodePtr, data);
-#endif
-    }
-    if (*seq != '\0') {
-
-        /*
-         * We have not yet reached the end of the sequence, so
-         * recurse if there are any sub-branches
-         */
-
-        branchPtr = Ns_IndexFind(&triePtr->branches, seq);
-        ldepth += 1;
-#ifdef DEBUG
-        fprintf(stderr, "...    TrieFind seq '%s' recurse on branch %p\n", seq, (void*)branchPtr);
-#endif
-        if (branchPtr != NULL) {
-            void *p = TrieFind(&branchPtr->trie, seq + NS_strlen(seq) + 1u, proc, context, &ldepth);
-            if (p != NULL) {
-                data = p;
-                *depthPtr = ldepth;
-            }
-        }
-    }
-
-    return data;
-}
-
 
 /*
  *----------------------------------------------------------------------
  *
  * TrieFindExact --
  *
- *      Similar to TrieFind, but will not do inheritance.  If (flags &
+ *      Find a node in a trie without inheritance.  If (flags &
  *      NS_OP_NOINHERIT) then data set with that flag will be
  *      returned; otherwise only data set without that flag will be
- *      returned.
+ *      returned. Used for deleting nodes.
  *
  * Results:
- *      See TrieFind.
+ *      The appropriate node's data.
  *
  * Side effects:
  *      None.
@@ -2078,7 +2252,15 @@ JunctionGet(NsServer *servPtr, int id)
 #endif
         Ns_IndexInit(&juncPtr->byname, 5u,
                      CmpChannelsAsStrings, CmpKeyWithChannelAsStrings);
+        juncPtr->snapshotPtr = NULL;
+        /*
+         * Lookups access the junction without a lock.
+         */
+#ifdef URLSPACE_LOCKFREE
+        __atomic_store_n(&servPtr->urlspace.junction[id], juncPtr, __ATOMIC_RELEASE);
+#else
         servPtr->urlspace.junction[id] = juncPtr;
+#endif
     }
 
     assert(juncPtr != NULL);
@@ -2254,14 +2436,14 @@ JunctionAdd(Junction *juncPtr, char *seq, void *data, unsigned int flags,
 /*
  *----------------------------------------------------------------------
  *
- * JunctionFind --
+ * SnapshotFind --
  *
- *      Locate a node for a given sequence in a junction.
- *      As usual sequence is "method\0urltoken\0...\0\0".
+ *      Locate the data for a given sequence in the snapshot of a
+ *      junction. As usual sequence is "method\0urltoken\0...\0\0".
  *
- *      The "fast" boolean switch makes it do NS_strcmp instead of
- *      Tcl string matches on the filters. Not useful for wildcard
- *      matching.
+ *      The channels are checked in the order of the snapshot, from
+ *      most restrictive to least restrictive filter. The data of the
+ *      deepest matching node wins.
  *
  * Results:
  *      User data.
@@ -2272,17 +2454,16 @@ JunctionAdd(Junction *juncPtr, char *seq, void *data, unsigned int flags,
  *----------------------------------------------------------------------
  */
 static void *
-JunctionFind(const Junction *juncPtr, char *seq,
+SnapshotFind(const Snapshot *snapshotPtr, char *seq,
              Ns_UrlSpaceMatchInfo *matchInfoPtr,
              NsUrlSpaceContextFilterProc proc, void *context)
 {
-    const Channel *channelPtr;
     const char    *p;
     size_t         i, l, nrSegments;
     int            depth = 0;
-    void          *data;
+    void          *data = NULL;
 
-    NS_NONNULL_ASSERT(juncPtr != NULL);
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
     NS_NONNULL_ASSERT(seq != NULL);
 
     /*
@@ -2297,74 +2478,26 @@ JunctionFind(const Junction *juncPtr, char *seq,
         }
     }
 
-    /*
-     * Check filters from most restrictive to least restrictive
-     */
-
-    data = NULL;
-#ifndef __URLSPACE_OPTIMIZE__
-    l = Ns_IndexCount(&juncPtr->byuse);
-#else
-    l = Ns_IndexCount(&juncPtr->byname);
-#endif
-
-    if (l == 0u) {
-        return NULL;
-    }
-
-    //Ns_Log(Notice, "JunctionFind: index count %ld", l);
-
-    /*
-     * For __URLSPACE_OPTIMIZE__
-     * Basically if we use the optimize, let's reverse the order
-     * by which we search because the byname is in "almost" exact
-     * reverse lexicographical order.
-     *
-     * Loop over all the channels in the index.
-     */
-
-#ifndef __URLSPACE_OPTIMIZE__
-    for (i = 0u; i < l; i++) {
-        bool    match, noFilter, candidateIsSegmentMatch;
-        void   *candidateData = NULL;
-        int     candidateDepth = 0;
-        ssize_t candidateOffset = 0;
-        size_t  candidateSegmentLength = 0u;
-
-        channelPtr = Ns_IndexEl(&juncPtr->byuse, i);
-#else
-    for (i = l; i > 0u; i--) {
-        bool    match, noFilter, candidateIsSegmentMatch;
-        void   *candidateData = NULL;
-        int     candidateDepth = 0;
-        ssize_t candidateOffset = 0;
-        size_t  candidateSegmentLength = 0u;
-
-        channelPtr = Ns_IndexEl(&juncPtr->byname, i - 1u);
-#endif
+    for (i = 0u; i < snapshotPtr->nchannels; i++) {
+        const SnapshotChannel *channelPtr = &snapshotPtr->channels[i];
+        const SnapshotTrie    *triePtr = &snapshotPtr->tries[channelPtr->trie];
+        bool                   candidateIsSegmentMatch = NS_FALSE;
+        void                  *candidateData = NULL;
+        int                    candidateDepth = 0;
+        ssize_t                candidateOffset = 0;
+        size_t                 candidateSegmentLength = 0u;
 
-        noFilter = (*(channelPtr->filter) == '*' && *(channelPtr->filter + 1) == '\0');
-        match = (noFilter || (NS_Tcl_StringMatch(p, channelPtr->filter) == 1));
-
-        //Ns_Log(Notice, "Junction Filter tail <%s> match with <%s>", p, channelPtr->filter);
-#ifdef DEBUG
-        fprintf(stderr, "JunctionFind: compare filter '%s' with channel filter '%s' => %d\n",
-                p, channelPtr->filter, doit);
-#endif
-        if (match) {
+        if (channelPtr->noFilter || (NS_Tcl_StringMatch(p, channelPtr->filter) == 1)) {
             /*
              * We got here because this URL matches the filter
              * (for example, "*.adp").
              */
-            candidateData = TrieFind(&channelPtr->trie, seq, proc, context, &candidateDepth);
-            candidateOffset = 0;
-            candidateSegmentLength = 0u;
-            candidateIsSegmentMatch = NS_FALSE;
+            candidateData = SnapshotTrieFind(snapshotPtr, triePtr, seq, proc, context, &candidateDepth);
 
-        } else if (!noFilter && (channelPtr->flags & NS_OP_SEGMENT_MATCH) != 0u) {
-            size_t  n;
-            char   *segment;
-            ssize_t segmentOffset;
+        } else if ((channelPtr->flags & NS_OP_SEGMENT_MATCH) != 0u) {
+            size_t      n;
+            const char *segment;
+            ssize_t     segmentOffset;
 
             /*
              * If we have a filter, but it did not match in the last
@@ -2378,24 +2511,16 @@ JunctionFind(const Junction *juncPtr, char *seq,
                  segment = seq + segmentOffset, ++n) {
                 size_t segmentLength = NS_strlen(segment);
 
-                //Ns_Log(Notice, "... segment[%ld/%ld] <%s> offset %ld depth %d",
-                //       n, nrSegments, segment, segmentOffset, depth);
-
                 if (NS_Tcl_StringMatch(segment, channelPtr->filter)) {
                     candidateDepth = 0;
-                    candidateData = TrieFind(&channelPtr->trie, seq, proc, context, &candidateDepth);
+                    candidateData = SnapshotTrieFind(snapshotPtr, triePtr, seq, proc, context,
+                                                     &candidateDepth);
                     candidateOffset = segmentOffset;
                     candidateSegmentLength = segmentLength;
                     candidateIsSegmentMatch = NS_TRUE;
-
-                    //Ns_Log(Notice, "JunctionFind: ===> path segment <%s> match with <%s>"
-                    //       " candidate depth %d candidate data %p channelPtr->flags %.4x",
-                    //       segment, channelPtr->filter, candidateDepth,(void*)candidateData,
-                    //       channelPtr->flags);
                 }
                 segmentOffset += (ssize_t)segmentLength + 1;
             }
-            //Ns_Log(Notice, "JunctionFind: ... found cdepth %d data %p", p);
         }
 
         /*
@@ -2407,8 +2532,6 @@ JunctionFind(const Junction *juncPtr, char *seq,
         if (candidateData != NULL
             && (data == NULL || candidateDepth > depth)
             ) {
-            //Ns_Log(Notice, "... take candidate data %p, old data %p, candidate depth %d old depth %d",
-            //       (void*)candidateData, data, candidateDepth, depth);
             depth = candidateDepth;
             data = candidateData;
             if (matchInfoPtr != NULL) {
@@ -2418,10 +2541,6 @@ JunctionFind(const Junction *juncPtr, char *seq,
             }
         }
 
-        //Ns_Log(Notice, "JunctionFind: doit %d, depth %d compare tail '%s' with channel filter '%s' => %d (%p)",
-        //               doit, depth,
-        //       p, channelPtr->filter, doit, (void*)data);
-
 #ifdef DEBUG
         if (depth > 0) {
             if (data == NULL) {
@@ -2434,42 +2553,35 @@ JunctionFind(const Junction *juncPtr, char *seq,
 #endif
     }
 
-#ifdef DEBUG
-    if (depth > 0) {
-        fprintf(stderr, "Done.\n");
-    }
-#endif
-
     return data;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * JunctionFindExact --
+ * SnapshotFindExact --
  *
- *      Find a node in a junction that exactly matches a sequence.
+ *      Find the data for a given sequence in the snapshot of a
+ *      junction without inheritance.
  *
  * Results:
  *      User data.
  *
  * Side effects:
- *      None.
+ *      Seq will be modified.
  *
  *----------------------------------------------------------------------
  */
 
 static void *
-JunctionFindExact(const Junction *juncPtr, char *seq, unsigned int flags)
+SnapshotFindExact(const Snapshot *snapshotPtr, char *seq, unsigned int flags)
 {
-    const Channel *channelPtr;
-    char          *p;
-    size_t         l, i;
-    void          *data = NULL;
-    Node          *nodePtr;
+    char   *p;
+    size_t  i, l;
+    void   *data = NULL;
 
-    NS_NONNULL_ASSERT(juncPtr != NULL);
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
     NS_NONNULL_ASSERT(seq != NULL);
 
     /*
@@ -2485,33 +2597,20 @@ JunctionFindExact(const Junction *juncPtr, char *seq, unsigned int flags)
      * filters looking for an exact match
      */
 
-#ifndef __URLSPACE_OPTIMIZE__
-    l = Ns_IndexCount(&juncPtr->byuse);
-#else
-    l = Ns_IndexCount(&juncPtr->byname);
-#endif
-    if (l == 0u) {
-        goto done;
-    }
+    for (i = 0u; i < snapshotPtr->nchannels; i++) {
+        const SnapshotChannel *channelPtr = &snapshotPtr->channels[i];
 
-#ifndef __URLSPACE_OPTIMIZE__
-    for (i = 0u; i < l; i++) {
-        channelPtr = Ns_IndexEl(&juncPtr->byuse, i);
-#else
-    for (i = l; i > 0u; i--) {
-        channelPtr = Ns_IndexEl(&juncPtr->byname, i - 1u);
-#endif
         if (STREQ(p, channelPtr->filter)) {
 
             /*
              * The last element of the sequence exactly matches the
              * filter, so this is the one. Wipe out the last word and
-             * return whatever node comes out of TrieFindExact.
+             * return whatever node comes out of SnapshotTrieFindExact.
              */
 
             *p = '\0';
-            data = TrieFindExact(&channelPtr->trie, seq, flags, &nodePtr);
-            goto done;
+            return SnapshotTrieFindExact(snapshotPtr, &snapshotPtr->tries[channelPtr->trie],
+                                         seq, flags);
         }
     }
 
@@ -2520,55 +2619,666 @@ JunctionFindExact(const Junction *juncPtr, char *seq, unsigned int flags)
      * an exact match:
      */
 
-#ifndef __URLSPACE_OPTIMIZE__
-    for (i = 0u; i < l; i++) {
-      channelPtr = Ns_IndexEl(&juncPtr->byuse, i);
-#else
-    for (i = l; i > 0u; i--) {
-      channelPtr = Ns_IndexEl(&juncPtr->byname, i - 1u);
-#endif
-      if (*(channelPtr->filter) == '*' && *(channelPtr->filter + 1) == '\0') {
-          data = TrieFindExact(&channelPtr->trie, seq, flags, &nodePtr);
+    for (i = 0u; i < snapshotPtr->nchannels; i++) {
+        const SnapshotChannel *channelPtr = &snapshotPtr->channels[i];
+
+        if (channelPtr->noFilter) {
+            data = SnapshotTrieFindExact(snapshotPtr, &snapshotPtr->tries[channelPtr->trie],
+                                         seq, flags);
             break;
         }
     }
 
-    done:
-
     return data;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * JunctionDeleteNode --
+ * SnapshotBranchFind --
  *
- *      Delete a node from a junction matching a sequence
+ *      Find the sub-trie for the given word via binary search over the
+ *      sorted branches of a snapshot trie.
  *
  * Results:
- *      A pointer to the deleted node
+ *      Sub-trie or NULL, when there is no branch for the word.
  *
  * Side effects:
- *      Seq will be modified.
- *      The node will be deleted if NS_OP_NODELETE isn't set in flags.
+ *      None.
  *
  *----------------------------------------------------------------------
  */
 
-static void *
-JunctionDeleteNode(const Junction *juncPtr, char *seq, unsigned int flags)
+static const SnapshotTrie *
+SnapshotBranchFind(const Snapshot *snapshotPtr, const SnapshotTrie *triePtr, const char *word)
 {
-    const Channel *channelPtr;
-    char          *p;
-    size_t         i, l;
-    /*int          depth = 0;*/
-    void          *data = NULL;
+    size_t low, high;
 
-    NS_NONNULL_ASSERT(juncPtr != NULL);
-    NS_NONNULL_ASSERT(seq != NULL);
-
-    /*
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+    NS_NONNULL_ASSERT(triePtr != NULL);
+    NS_NONNULL_ASSERT(word != NULL);
+
+    low = triePtr->firstBranch;
+    high = low + triePtr->nbranches;
+    while (low < high) {
+        size_t                mid = low + (high - low) / 2u;
+        const SnapshotBranch *branchPtr = &snapshotPtr->branches[mid];
+        int                   cmp = NS_strcmp(word, branchPtr->word);
+
+        if (cmp == 0) {
+            return &snapshotPtr->tries[branchPtr->trie];
+        } else if (cmp < 0) {
+            high = mid;
+        } else {
+            low = mid + 1u;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SnapshotTrieFind --
+ *
+ *      Find a node in a snapshot trie matching a sequence. The data
+ *      of the deepest node with data along the sequence is returned.
+ *
+ * Results:
+ *      Return the appropriate node's data.
+ *
+ * Side effects:
+ *      The depth variable will be set-by-reference to the depth of
+ *      the returned node. If no node is set, it will not be changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+SnapshotTrieFind(const Snapshot *snapshotPtr, const SnapshotTrie *triePtr, const char *seq,
+                 NsUrlSpaceContextFilterProc proc, void *context, int *depthPtr)
+{
+    void *data = NULL;
+    int   depth = 0;
+
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+    NS_NONNULL_ASSERT(triePtr != NULL);
+    NS_NONNULL_ASSERT(seq != NULL);
+    NS_NONNULL_ASSERT(depthPtr != NULL);
+
+    for (;;) {
+        if (triePtr->hasNode) {
+            void *nodeData;
+
+            if (
+                (*seq == '\0') /* this makes "set -noinherit /x/ *.html foo" + "get /x/a.html" fail */
+                && (triePtr->dataNoInherit != NULL)
+                ) {
+                nodeData = triePtr->dataNoInherit;
+            } else {
+                nodeData = triePtr->dataInherit;
+                if (triePtr->nspecs != 0u && context != NULL) {
+                    size_t i;
+
+                    /*
+                     * We have context filters
+                     */
+                    assert(proc != NULL);
+                    for (i = 0u; i < triePtr->nspecs; i++) {
+                        UrlSpaceContextSpec *spec = &snapshotPtr->specs[triePtr->firstSpec + i];
+
+                        if ((proc)(spec, context)) {
+                            nodeData = spec->data;
+                            break;
+                        }
+                    }
+                }
+            }
+            if (nodeData != NULL) {
+                data = nodeData;
+                *depthPtr = depth;
+            }
+        }
+
+        /*
+         * Continue with the sub-trie of the next word, until the end
+         * of the sequence is reached.
+         */
+        if (*seq == '\0') {
+            break;
+        }
+        triePtr = SnapshotBranchFind(snapshotPtr, triePtr, seq);
+        if (triePtr == NULL) {
+            break;
+        }
+        seq += NS_strlen(seq) + 1u;
+        depth++;
+    }
+
+    return data;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SnapshotTrieFindExact --
+ *
+ *      Similar to SnapshotTrieFind, but will not do inheritance.  If
+ *      (flags & NS_OP_NOINHERIT) then data set with that flag will be
+ *      returned; otherwise only data set without that flag will be
+ *      returned.
+ *
+ * Results:
+ *      See SnapshotTrieFind.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+SnapshotTrieFindExact(const Snapshot *snapshotPtr, const SnapshotTrie *triePtr, const char *seq,
+                      unsigned int flags)
+{
+    void *data = NULL;
+
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+    NS_NONNULL_ASSERT(triePtr != NULL);
+    NS_NONNULL_ASSERT(seq != NULL);
+
+    while (*seq != '\0' && triePtr != NULL) {
+        triePtr = SnapshotBranchFind(snapshotPtr, triePtr, seq);
+        seq += NS_strlen(seq) + 1u;
+    }
+    if (triePtr != NULL && triePtr->hasNode) {
+        data = ((flags & NS_OP_NOINHERIT) != 0u) ? triePtr->dataNoInherit : triePtr->dataInherit;
+    }
+
+    return data;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JunctionPublish --
+ *
+ *      Compile the current state of a junction into a new snapshot
+ *      and make it visible to lookups. Must be called after every
+ *      modification of the junction. Modifications of a junction are
+ *      serialized by the caller.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      The previous snapshot is retired and freed, as soon as no
+ *      lookup is using it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+JunctionPublish(Junction *juncPtr)
+{
+    Snapshot *snapshotPtr, *oldPtr;
+
+    NS_NONNULL_ASSERT(juncPtr != NULL);
+
+    snapshotPtr = SnapshotCreate(juncPtr);
+
+#ifdef URLSPACE_LOCKFREE
+    oldPtr = __atomic_exchange_n(&juncPtr->snapshotPtr, snapshotPtr, __ATOMIC_SEQ_CST);
+    if (oldPtr != NULL) {
+        Retire(oldPtr);
+    }
+#else
+    Ns_RWLockWrLock(&snapshotLock);
+    oldPtr = juncPtr->snapshotPtr;
+    juncPtr->snapshotPtr = snapshotPtr;
+    Ns_RWLockUnlock(&snapshotLock);
+    if (oldPtr != NULL) {
+        ns_free(oldPtr);
+    }
+#endif
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SnapshotCreate --
+ *
+ *      Compile the channels of a junction into a snapshot. The sizes
+ *      of all parts are computed in a first pass, such that the
+ *      snapshot can be allocated as a single block.
+ *
+ * Results:
+ *      New snapshot or NULL, when the junction has no channels.
+ *
+ * Side effects:
+ *      Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Snapshot *
+SnapshotCreate(const Junction *juncPtr)
+{
+    SnapshotBuilder builder;
+    Snapshot       *snapshotPtr;
+    const Channel  *channelPtr;
+    size_t          i, n, channelsOffset, triesOffset, branchesOffset, specsOffset, stringsOffset;
+    char           *block;
+
+    NS_NONNULL_ASSERT(juncPtr != NULL);
+
+#ifndef __URLSPACE_OPTIMIZE__
+    n = Ns_IndexCount(&juncPtr->byuse);
+#else
+    n = Ns_IndexCount(&juncPtr->byname);
+#endif
+    if (n == 0u) {
+        return NULL;
+    }
+
+    memset(&builder, 0, sizeof(builder));
+    for (i = 0u; i < n; i++) {
+#ifndef __URLSPACE_OPTIMIZE__
+        channelPtr = Ns_IndexEl(&juncPtr->byuse, i);
+#else
+        channelPtr = Ns_IndexEl(&juncPtr->byname, n - 1u - i);
+#endif
+        builder.nbytes += NS_strlen(channelPtr->filter) + 1u;
+        SnapshotCount(&builder, &channelPtr->trie);
+    }
+
+    channelsOffset = SNAPSHOT_ALIGN(sizeof(Snapshot));
+    triesOffset    = channelsOffset + SNAPSHOT_ALIGN(n * sizeof(SnapshotChannel));
+    branchesOffset = triesOffset + SNAPSHOT_ALIGN(builder.ntries * sizeof(SnapshotTrie));
+    specsOffset    = branchesOffset + SNAPSHOT_ALIGN(builder.nbranches * sizeof(SnapshotBranch));
+    stringsOffset  = specsOffset + SNAPSHOT_ALIGN(builder.nspecs * sizeof(UrlSpaceContextSpec));
+
+    block = ns_calloc(1u, stringsOffset + builder.nbytes);
+    snapshotPtr = (Snapshot *)(void *)block;
+#ifdef URLSPACE_LOCKFREE
+    snapshotPtr->generation = __atomic_add_fetch(&snapshotGeneration, 1u, __ATOMIC_RELAXED);
+#else
+    Ns_RWLockWrLock(&snapshotLock);
+    snapshotPtr->generation = ++snapshotGeneration;
+    Ns_RWLockUnlock(&snapshotLock);
+#endif
+    snapshotPtr->nchannels = n;
+    snapshotPtr->nspecs = builder.nspecs;
+    snapshotPtr->channels = (SnapshotChannel *)(void *)(block + channelsOffset);
+    snapshotPtr->tries    = (SnapshotTrie *)(void *)(block + triesOffset);
+    snapshotPtr->branches = (SnapshotBranch *)(void *)(block + branchesOffset);
+    snapshotPtr->specs    = (UrlSpaceContextSpec *)(void *)(block + specsOffset);
+
+    builder.snapshotPtr = snapshotPtr;
+    builder.ntries = 0u;
+    builder.nbranches = 0u;
+    builder.nspecs = 0u;
+    builder.stringPtr = block + stringsOffset;
+
+    for (i = 0u; i < n; i++) {
+        SnapshotChannel *snapshotChannelPtr = &snapshotPtr->channels[i];
+
+#ifndef __URLSPACE_OPTIMIZE__
+        channelPtr = Ns_IndexEl(&juncPtr->byuse, i);
+#else
+        channelPtr = Ns_IndexEl(&juncPtr->byname, n - 1u - i);
+#endif
+        snapshotChannelPtr->filter = SnapshotString(&builder, channelPtr->filter);
+        snapshotChannelPtr->flags = channelPtr->flags;
+        snapshotChannelPtr->noFilter = (channelPtr->filter[0] == '*' && channelPtr->filter[1] == '\0');
+        snapshotChannelPtr->trie = SnapshotAddTrie(&builder, &channelPtr->trie);
+    }
+
+    return snapshotPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SnapshotCount, SnapshotAddTrie, SnapshotString --
+ *
+ *      Helpers for SnapshotCreate(). SnapshotCount() accumulates the
+ *      sizes of a trie in the builder, SnapshotAddTrie() copies a
+ *      trie recursively into the snapshot, where the branches of a
+ *      trie are reserved before descending into the sub-tries, and
+ *      SnapshotString() copies a string into the snapshot.
+ *
+ * Results:
+ *      SnapshotAddTrie() returns the index of the added trie,
+ *      SnapshotString() the copied string.
+ *
+ * Side effects:
+ *      Updating the builder.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SnapshotCount(SnapshotBuilder *builderPtr, const Trie *triePtr)
+{
+    size_t i;
+
+    NS_NONNULL_ASSERT(builderPtr != NULL);
+    NS_NONNULL_ASSERT(triePtr != NULL);
+
+    builderPtr->ntries++;
+    if (triePtr->node != NULL) {
+        const Ns_Index *indexPtr = &triePtr->node->data;
+
+        for (i = 0u; i < indexPtr->n; i++) {
+            const UrlSpaceContextSpec *spec = Ns_IndexEl(indexPtr, i);
+
+            builderPtr->nbytes += NS_strlen(spec->field) + NS_strlen(spec->patternString) + 2u;
+        }
+        builderPtr->nspecs += indexPtr->n;
+    }
+    builderPtr->nbranches += triePtr->branches.n;
+    for (i = 0u; i < triePtr->branches.n; i++) {
+        const Branch *branchPtr = Ns_IndexEl(&triePtr->branches, i);
+
+        builderPtr->nbytes += NS_strlen(branchPtr->word) + 1u;
+        SnapshotCount(builderPtr, &branchPtr->trie);
+    }
+}
+
+static size_t
+SnapshotAddTrie(SnapshotBuilder *builderPtr, const Trie *triePtr)
+{
+    Snapshot     *snapshotPtr;
+    SnapshotTrie *snapshotTriePtr;
+    size_t        i, idx;
+
+    NS_NONNULL_ASSERT(builderPtr != NULL);
+    NS_NONNULL_ASSERT(triePtr != NULL);
+
+    snapshotPtr = builderPtr->snapshotPtr;
+    idx = builderPtr->ntries++;
+    snapshotTriePtr = &snapshotPtr->tries[idx];
+
+    if (triePtr->node != NULL) {
+        const Node *nodePtr = triePtr->node;
+
+        snapshotTriePtr->hasNode = NS_TRUE;
+        snapshotTriePtr->dataInherit = nodePtr->dataInherit;
+        snapshotTriePtr->dataNoInherit = nodePtr->dataNoInherit;
+        snapshotTriePtr->firstSpec = builderPtr->nspecs;
+        snapshotTriePtr->nspecs = nodePtr->data.n;
+
+        /*
+         * Context specs are always created via NsUrlSpaceContextSpecNew().
+         * The copies in the snapshot own nothing.
+         */
+        for (i = 0u; i < nodePtr->data.n; i++) {
+            UrlSpaceContextSpec *specPtr = &snapshotPtr->specs[builderPtr->nspecs++];
+
+            *specPtr = *(const UrlSpaceContextSpec *)Ns_IndexEl(&nodePtr->data, i);
+            specPtr->freeProc = NULL;
+            specPtr->dataFreeProc = NULL;
+            specPtr->field = SnapshotString(builderPtr, specPtr->field);
+            specPtr->patternString = SnapshotString(builderPtr, specPtr->patternString);
+        }
+    }
+
+    snapshotTriePtr->firstBranch = builderPtr->nbranches;
+    snapshotTriePtr->nbranches = triePtr->branches.n;
+    builderPtr->nbranches += triePtr->branches.n;
+
+    for (i = 0u; i < triePtr->branches.n; i++) {
+        const Branch   *branchPtr = Ns_IndexEl(&triePtr->branches, i);
+        SnapshotBranch *snapshotBranchPtr = &snapshotPtr->branches[snapshotTriePtr->firstBranch + i];
+
+        snapshotBranchPtr->word = SnapshotString(builderPtr, branchPtr->word);
+        snapshotBranchPtr->trie = SnapshotAddTrie(builderPtr, &branchPtr->trie);
+    }
+
+    return idx;
+}
+
+static const char *
+SnapshotString(SnapshotBuilder *builderPtr, const char *string)
+{
+    char   *result = builderPtr->stringPtr;
+    size_t  length = NS_strlen(string) + 1u;
+
+    memcpy(result, string, length);
+    builderPtr->stringPtr += length;
+
+    return result;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MemoGet, FreeMemo --
+ *
+ *      Get the memo entry of the current thread for a lookup of the
+ *      sequence in dsPtr with the given op and flags, and free the
+ *      memo on thread exit. When the entry does not hold the result
+ *      for this snapshot, it is prepared for storing the result of
+ *      the lookup: the key is copied and the generation is reset
+ *      until the caller fills in the result.
+ *
+ * Results:
+ *      MemoGet() returns the entry; hitPtr is set to NS_TRUE, when the
+ *      entry holds the result of the lookup.
+ *
+ * Side effects:
+ *      Memo allocated on first use.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static MemoEntry *
+MemoGet(const Snapshot *snapshotPtr, NsUrlSpaceOp op, unsigned int flags,
+        const Ns_DString *dsPtr, bool *hitPtr)
+{
+    Memo                *memoPtr = Ns_TlsGet(&memoTls);
+    MemoEntry           *entryPtr;
+    const unsigned char *p;
+    size_t               keyLength = (size_t)dsPtr->length;
+    unsigned int         hash = (unsigned int)op * 31u + flags;
+
+    if (unlikely(memoPtr == NULL)) {
+        memoPtr = ns_calloc(1u, sizeof(Memo));
+        Ns_TlsSet(&memoTls, memoPtr);
+    }
+
+    for (p = (const unsigned char *)dsPtr->string; p < (const unsigned char *)dsPtr->string + keyLength; p++) {
+        hash += (hash << 3) + *p;
+    }
+    hash ^= hash >> 16;
+    hash *= 0x45d9f3bu;
+    hash ^= hash >> 16;
+
+    entryPtr = &memoPtr->entries[hash & (MEMO_SLOTS - 1u)];
+    if (entryPtr->generation == snapshotPtr->generation
+        && entryPtr->hash == hash
+        && entryPtr->op == op
+        && entryPtr->flags == flags
+        && entryPtr->keyLength == keyLength
+        && memcmp(entryPtr->key, dsPtr->string, keyLength) == 0
+        ) {
+        *hitPtr = NS_TRUE;
+    } else {
+        if (entryPtr->keySize < keyLength) {
+            entryPtr->keySize = keyLength;
+            entryPtr->key = ns_realloc(entryPtr->key, keyLength);
+        }
+        memcpy(entryPtr->key, dsPtr->string, keyLength);
+        entryPtr->keyLength = keyLength;
+        entryPtr->hash = hash;
+        entryPtr->op = op;
+        entryPtr->flags = flags;
+        entryPtr->generation = 0u;
+        *hitPtr = NS_FALSE;
+    }
+
+    return entryPtr;
+}
+
+static void
+FreeMemo(void *arg)
+{
+    Memo   *memoPtr = arg;
+    size_t  i;
+
+    for (i = 0u; i < MEMO_SLOTS; i++) {
+        ns_free(memoPtr->entries[i].key);
+    }
+    ns_free(memoPtr);
+}
+
+
+#ifdef URLSPACE_LOCKFREE
+/*
+ *----------------------------------------------------------------------
+ *
+ * Retire --
+ *
+ *      Retire a snapshot, which is not accessible via its junction
+ *      anymore, and free the retired snapshots, which are not used by
+ *      any reader. A snapshot retired in epoch E might be used by
+ *      readers which announced an epoch less or equal E.
+ *
+ * Results:
+ *      None.
+ *
+ * Side effects:
+ *      Global epoch advanced, memory freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Retire(Snapshot *snapshotPtr)
+{
+    uintptr_t     minEpoch = UINTPTR_MAX;
+    const Reader *readerPtr;
+    Snapshot    **snapshotPtrPtr;
+
+    NS_NONNULL_ASSERT(snapshotPtr != NULL);
+
+    snapshotPtr->retireEpoch = __atomic_fetch_add(&globalEpoch, 1u, __ATOMIC_SEQ_CST);
+
+    Ns_MutexLock(&readersLock);
+    snapshotPtr->nextPtr = retiredPtr;
+    retiredPtr = snapshotPtr;
+
+    for (readerPtr = firstReaderPtr; readerPtr != NULL; readerPtr = readerPtr->nextPtr) {
+        uintptr_t epoch = __atomic_load_n(&readerPtr->epoch, __ATOMIC_SEQ_CST);
+
+        if (epoch != 0u && epoch < minEpoch) {
+            minEpoch = epoch;
+        }
+    }
+
+    snapshotPtrPtr = &retiredPtr;
+    while (*snapshotPtrPtr != NULL) {
+        snapshotPtr = *snapshotPtrPtr;
+        if (snapshotPtr->retireEpoch < minEpoch) {
+            *snapshotPtrPtr = snapshotPtr->nextPtr;
+            ns_free(snapshotPtr);
+        } else {
+            snapshotPtrPtr = &snapshotPtr->nextPtr;
+        }
+    }
+    Ns_MutexUnlock(&readersLock);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetReader, FreeReader --
+ *
+ *      Get the reader structure of the current thread, registering it on
+ *      first use, and unregister it on thread exit.
+ *
+ * Results:
+ *      GetReader() returns the reader.
+ *
+ * Side effects:
+ *      Reader registry updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Reader *
+GetReader(void)
+{
+    Reader *readerPtr = Ns_TlsGet(&readerTls);
+
+    if (unlikely(readerPtr == NULL)) {
+        readerPtr = ns_calloc(1u, sizeof(Reader));
+        Ns_MutexLock(&readersLock);
+        readerPtr->nextPtr = firstReaderPtr;
+        firstReaderPtr = readerPtr;
+        Ns_MutexUnlock(&readersLock);
+        Ns_TlsSet(&readerTls, readerPtr);
+    }
+    return readerPtr;
+}
+
+static void
+FreeReader(void *arg)
+{
+    Reader  *readerPtr = arg;
+    Reader **readerPtrPtr;
+
+    Ns_MutexLock(&readersLock);
+    for (readerPtrPtr = &firstReaderPtr; *readerPtrPtr != NULL; readerPtrPtr = &(*readerPtrPtr)->nextPtr) {
+        if (*readerPtrPtr == readerPtr) {
+            *readerPtrPtr = readerPtr->nextPtr;
+            break;
+        }
+    }
+    Ns_MutexUnlock(&readersLock);
+    ns_free(readerPtr);
+}
+#endif
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * JunctionDeleteNode --
+ *
+ *      Delete a node from a junction matching a sequence
+ *
+ * Results:
+ *      A pointer to the deleted node
+ *
+ * Side effects:
+ *      Seq will be modified.
+ *      The node will be deleted if NS_OP_NODELETE isn't set in flags.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+JunctionDeleteNode(const Junction *juncPtr, char *seq, unsigned int flags)
+{
+    const Channel *channelPtr;
+    char          *p;
+    size_t         i, l;
+    /*int          depth = 0;*/
+    void          *data = NULL;
+
+    NS_NONNULL_ASSERT(juncPtr != NULL);
+    NS_NONNULL_ASSERT(seq != NULL);
+
+    /*
      * Set p to the last element of the sequence, and
      * depth to the number of elements in the sequence.
      */
@@ -2951,11 +3661,14 @@ UrlSpaceGetObjCmd(ClientData clientData, Tcl_Interp *interp, TCL_OBJC_T objc, Tc
             fprintf(stderr, "=== GET id %d key %s url %s op %d\n", id, key, url, op);
 #endif
             //Ns_Log(Notice, "UrlSpaceGetObjCmd context %p context %p", (void*)context, (void*)ctxPtr);
+            /*
+             * The data string is freed on unset, so copy it while
+             * holding the lock.
+             */
             Ns_RWLockRdLock(&servPtr->urlspace.idlocks[id]);
             data = NsUrlSpecificGet(servPtr, key, url, id, flags, op, NULL, NsUrlSpaceContextFilter, ctxPtr);
-            Ns_RWLockUnlock(&servPtr->urlspace.idlocks[id]);
-
             Tcl_SetObjResult(interp, Tcl_NewStringObj(data, TCL_INDEX_NONE));
+            Ns_RWLockUnlock(&servPtr->urlspace.idlocks[id]);
         }
     }
     return result;
@@ -418,6 +418,70 @@ Ns_RWLockWrLock(Ns_RWLock *rwPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_RWLockTryRdLock, Ns_RWLockTryWrLock --
+ *
+ *      Attempt to acquire a read or write lock without waiting.
+ *
+ * Results:
+ *      NS_OK if locked, NS_TIMEOUT if the lock is currently held in a
+ *      conflicting mode.
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_RWLockTryRdLock(Ns_RWLock *rwPtr)
+{
+    RwLock *lockPtr;
+    int     err;
+
+    NS_NONNULL_ASSERT(rwPtr != NULL);
+
+    lockPtr = GetRwLock(rwPtr, "Ns_RWLockTryRdLock");
+
+    err = pthread_rwlock_tryrdlock(&lockPtr->rwlock);
+    if (err == EBUSY) {
+        return NS_TIMEOUT;
+    } else if (unlikely(err != 0)) {
+        NsThreadFatal("Ns_RWLockTryRdLock", "pthread_rwlock_tryrdlock", err);
+    }
+    lockPtr->nlock++;
+    lockPtr->nrlock++;
+    return NS_OK;
+}
+
+Ns_ReturnCode
+Ns_RWLockTryWrLock(Ns_RWLock *rwPtr)
+{
+    RwLock *lockPtr;
+    int     err;
+
+    NS_NONNULL_ASSERT(rwPtr != NULL);
+
+    lockPtr = GetRwLock(rwPtr, "Ns_RWLockTryWrLock");
+
+    err = pthread_rwlock_trywrlock(&lockPtr->rwlock);
+    if (err == EBUSY) {
+        return NS_TIMEOUT;
+    } else if (unlikely(err != 0)) {
+        NsThreadFatal("Ns_RWLockTryWrLock", "pthread_rwlock_trywrlock", err);
+    }
+#ifndef NS_NO_MUTEX_TIMING
+    lockPtr->rw = NS_WRITE;
+    Ns_GetTime(&lockPtr->start_time);
+#endif
+    lockPtr->nlock++;
+    lockPtr->nwlock++;
+    return NS_OK;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -724,6 +788,60 @@ Ns_RWLockWrLock(Ns_RWLock *rwPtr)
 }
 
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Ns_RWLockTryRdLock, Ns_RWLockTryWrLock --
+ *
+ *      Attempt to acquire a read or write lock without waiting.
+ *
+ * Results:
+ *      NS_OK if locked, NS_TIMEOUT if the lock is currently held in a
+ *      conflicting mode (or, for readers, a writer is waiting).
+ *
+ * Side effects:
+ *      None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Ns_ReturnCode
+Ns_RWLockTryRdLock(Ns_RWLock *rwPtr)
+{
+    RwLock       *lockPtr;
+    Ns_ReturnCode status = NS_TIMEOUT;
+
+    NS_NONNULL_ASSERT(rwPtr != NULL);
+
+    lockPtr = GetRwLock(rwPtr, "Ns_RWLockTryRdLock");
+    Ns_MutexLock(&lockPtr->mutex);
+    if (lockPtr->lockcnt >= 0 && lockPtr->nwriters == 0) {
+        lockPtr->lockcnt++;
+        status = NS_OK;
+    }
+    Ns_MutexUnlock(&lockPtr->mutex);
+    return status;
+}
+
+Ns_ReturnCode
+Ns_RWLockTryWrLock(Ns_RWLock *rwPtr)
+{
+    RwLock       *lockPtr;
+    Ns_ReturnCode status = NS_TIMEOUT;
+
+    NS_NONNULL_ASSERT(rwPtr != NULL);
+
+    lockPtr = GetRwLock(rwPtr, "Ns_RWLockTryWrLock");
+    Ns_MutexLock(&lockPtr->mutex);
+    if (lockPtr->lockcnt == 0) {
+        lockPtr->lockcnt = -1;
+        status = NS_OK;
+    }
+    Ns_MutexUnlock(&lockPtr->mutex);
+    return status;
+}
+
+
 /*
  *----------------------------------------------------------------------
  *
@@ -265,6 +265,14 @@ ns_section ns/parameters {
     # crashes or for debugging with valgrind.
     # ns_param	tclinitlock	true           ;# default: false
 
+    # Initialize the interpreters of the "minthreads" connection
+    # threads before the server reports readiness and the drivers
+    # start to accept requests. The number of concurrent blueprint
+    # evaluations during startup is bounded by
+    # "interpwarmupconcurrency" (default: number of CPUs).
+    #ns_param        interpwarmup   true            ;# default: false
+    #ns_param        interpwarmupconcurrency 4      ;# default: number of CPUs
+
     #
     # Encoding settings
     #
@@ -545,6 +553,7 @@ ns_section ns/server/$server {
 
     # ns_param	maxthreads	10       ;# 10; maximal number of connection threads
     ns_param	minthreads	2        ;# 1; minimal number of connection threads
+    #ns_param	maxinterps	5        ;# 0; maximal number of threads keeping an interp
 
     #ns_param	connsperthread	1000     ;# 10000; number of connections (requests) handled per thread
     ;# Setting connsperthread to > 0 will cause the thread to
@@ -720,6 +729,9 @@ ns_section ns/server/$server/tcl {
     ns_param	debug		$debug
     # ns_param	nsvbuckets	16       ;# default: 8
     # ns_param	nsvrwlocks      false    ;# default: true
+    # ns_param	preparse	true     ;# default: false
+    # ns_param	interpsampleinterval 100 ;# default: 0
+    # ns_param	interpmaxmemory	200MB    ;# default: 0
 }
 
 ns_section ns/server/$server/fastpath {
@@ -64,6 +64,8 @@
 #   nstrace::enablestate   activates generation of the state script
 #   nstrace::disablestate  terminates generation of the state script
 #   nstrace::statescript   returns a script for initializing interps
+#   nstrace::unitscripts   returns the state as dict of named units
+#   nstrace::procdefs      returns the proc definitions as dict
 #
 #   nstrace::isactive      returns true if tracing Tcl commands is on
 #   nstrace::config        setup some configuration options
@@ -318,10 +320,12 @@ ns_runonce {
 
         #
         # This one generates full-blown script with entire
-        # interpreter state.
+        # interpreter state. When "withprocs" is false, the proc
+        # definitions are omitted from the script; these are then
+        # provided via [nstrace::procdefs] and materialized lazily.
         #
 
-        proc statescript {{file ""}} {
+        proc statescript {{file ""} {withprocs 1}} {
             variable scripts
 
             set script {}
@@ -355,40 +359,13 @@ ns_runonce {
             # some of the existing namespaces.
             #
 
-            # Filter nsf namespaces from the list of all namespaces,
-            # except the one from XOTcl or from the next Scripting
-            # Framework. The filter clauses are designed to work with
-            # XOTcl 1.* and the Next Scripting Framework (i.e. XOTcl
-            # 2.0 and NX).
-            #
-            set nsps [list]
-            if {[info commands ::nsf::object::exists] ne ""} {
-                # NX, XOTcl 2
-                set xotcl 2
-                foreach n [namespaces] {
-                    if {$n eq "::nsf"
-                        || [string match "::nsf::*" $n]
-                        || [::nsf::object::exists $n]} { continue }
-                    lappend nsps $n
-                }
-            } elseif {[info commands ::xotcl::Object] ne ""} {
-                # XOTcl 1
-                set xotcl 1
-                foreach n [namespaces] {
-                    if {[string match "::xotcl*" $n]
-                        || [::xotcl::Object isobject $n]} { continue}
-                    lappend nsps $n
-                }
-            } else {
-                set xotcl 0
-                set nsps [namespaces]
-            }
+            lassign [_blueprintnamespaces] xotcl nsps
 
             #puts stderr "remaining namespaces [join [lsort $nsps] \n]"
 
             # Serialize the remaining namespaces
             foreach n $nsps {
-                foreach {s i} [_serializensp $n] {
+                foreach {s i} [_serializensp $n 0 [expr {!$withprocs}]] {
                     if {[string length $s]} {
                         append script "namespace eval [list $n] {" \n
                         append script $s  \n
@@ -412,34 +389,12 @@ ns_runonce {
                 }
             }
 
-            if {$xotcl > 0} {
-                #
-                # Serialize XOTcl/NX content
-                #
-                if {[catch {::Serializer all} objects]} {
-                    ns_log warning "NX/XOTcl extension not loaded; classes an objects will not be included in blueprint\
-                      (error: $objects; $::errorInfo)."
-                    set objects ""
-                } else {
-                    #
-                    # Add the serialized objects after the namespace
-                    # imports and ensemble recreators, such that calls
-                    # from their constructors can use it.
-                    #
-                    append import \
-                        \n "namespace import -force ::xotcl::*" \n $objects \n
-
-                    if {$xotcl > 1} {
-                        #
-                        # The serialization of the objects redefines
-                        # the Serializer object, therefore, we have to
-                        # repeat the namespace import.
-                        #
-                        append import \
-                            "namespace import -force ::nx::serializer::Serializer" \n
-                    }
-                }
-            }
+            #
+            # Add the serialized XOTcl/NX objects after the namespace
+            # imports and ensemble recreators, such that calls from
+            # their constructors can use it.
+            #
+            append import [_objectscript $xotcl]
 
             #
             # Import commands from other namespaces
@@ -475,6 +430,99 @@ ns_runonce {
             }
         }
 
+        #
+        # This one returns the interpreter state as a dict of named
+        # units, which is used for incremental blueprint updates via
+        # [ns_ictl saveunits]. Every proc and namespace variable is a
+        # unit on its own, the remaining namespace definitions (exports
+        # and aliases) are one unit per namespace. The output of the
+        # script generators, the imports, ensembles and XOTcl/NX
+        # objects are kept in a few coarse-grained units. When the
+        # units are saved, only the changed ones have to be evaluated
+        # in other interpreters.
+        #
+
+        proc unitscripts {} {
+            variable scripts
+
+            set units [dict create]
+            set import {}
+
+            foreach cmd $scripts {
+                if {$cmd eq {load}} {
+                    dict set units "script $cmd" [script::_$cmd]
+                }
+            }
+            foreach cmd $scripts {
+                if {$cmd ne {load} && $cmd ne {rename}} {
+                    dict set units "script $cmd" [script::_$cmd]
+                }
+            }
+
+            lassign [_blueprintnamespaces] xotcl nsps
+
+            foreach n $nsps {
+                foreach {s i} [_serializensp $n 1] {
+                    dict set units "namespace $n" \
+                        "namespace eval [list $n] {\n$s\n}"
+                    if {$n ne "::"} {
+                        foreach vn [info vars ${n}::*] {
+                            set v [_varscript $vn]
+                            if {$v ne ""} {
+                                dict set units "variable $vn" \
+                                    "namespace eval [list $n] {\n$v}"
+                            }
+                        }
+                    }
+                    foreach pn [info procs ${n}::*] {
+                        if {[::namespace origin $pn] eq [::namespace which -command $pn]} {
+                            dict set units "proc $pn" \
+                                "namespace eval [list $n] [list [_procscript $pn]]"
+                        }
+                    }
+                    if {[string length $i]} {
+                        append import "namespace eval [list $n] {" \n $i \n "}" \n
+                    }
+                }
+            }
+
+            foreach cmd $scripts {
+                if {$cmd eq {rename}} {
+                    dict set units "script $cmd" [script::_$cmd]
+                }
+            }
+
+            append import [_objectscript $xotcl]
+            dict set units "import" $import
+
+            return $units
+        }
+
+        #
+        # This one returns the definitions of all procs of the
+        # blueprint namespaces as a dict, where the keys are the
+        # fully qualified proc names and the values are lists
+        # containing the argument list and the body. This is used
+        # for the lazy materialization of procs via
+        # [ns_ictl save -procs].
+        #
+
+        proc procdefs {} {
+            set procs [dict create]
+            lassign [_blueprintnamespaces] xotcl nsps
+            foreach n $nsps {
+                if {[_excludednsp $n]} {
+                    continue
+                }
+                foreach pn [info procs ${n}::*] {
+                    if {[::namespace origin $pn] eq [::namespace which -command $pn]} {
+                        dict set procs $pn [list [_procargs $pn] [info body $pn]]
+                    }
+                }
+            }
+            return $procs
+        }
+
         #
         # This is used to exclude Tcl namespace definition from the
         # inclusion in the blueprint script. Some Tcl extensions
@@ -705,12 +753,9 @@ ns_runonce {
         # where commands are/will-be imported from.
         #
 
-        proc _serializensp {nsp} {
-            variable exclnsp
-            foreach nn $exclnsp {
-                if {[string match $nn $nsp]} {
-                    return
-                }
+        proc _serializensp {nsp {skipvarsandprocs 0} {skipprocs 0}} {
+            if {[_excludednsp $nsp]} {
+                return
             }
             set script {}
             set import {}
@@ -724,7 +769,7 @@ ns_runonce {
             #
             # Keep the variables of all namespaces except these of "::"
             #
-            if {$nsp ne "::"} {
+            if {$nsp ne "::" && !$skipvarsandprocs} {
                 foreach vn [info vars ${nsp}::*] {
                     append script [_varscript $vn]
                 }
@@ -739,7 +784,7 @@ ns_runonce {
                     $orig ne [::namespace which -command $pn]
                 } {
                     append import "::namespace import -force [list $orig]" \n
-                } else {
+                } elseif {!$skipvarsandprocs && !$skipprocs} {
                     append script [_procscript $pn]
                 }
             }
@@ -774,6 +819,89 @@ ns_runonce {
             return [list $script $import]
         }
 
+        #
+        # Helper to check, whether a namespace is excluded from
+        # serialization via [nstrace::excludensp].
+        #
+
+        proc _excludednsp {nsp} {
+            variable exclnsp
+            foreach nn $exclnsp {
+                if {[string match $nn $nsp]} {
+                    return 1
+                }
+            }
+            return 0
+        }
+
+        #
+        # Helper to return the namespaces to be serialized in the
+        # blueprint. Filter nsf namespaces from the list of all
+        # namespaces, except the one from XOTcl or from the next
+        # Scripting Framework. The filter clauses are designed to
+        # work with XOTcl 1.* and the Next Scripting Framework
+        # (i.e. XOTcl 2.0 and NX). Returns a list containing the
+        # XOTcl flavor and the namespaces.
+        #
+
+        proc _blueprintnamespaces {} {
+            set nsps [list]
+            if {[info commands ::nsf::object::exists] ne ""} {
+                # NX, XOTcl 2
+                set xotcl 2
+                foreach n [namespaces] {
+                    if {$n eq "::nsf"
+                        || [string match "::nsf::*" $n]
+                        || [::nsf::object::exists $n]} { continue }
+                    lappend nsps $n
+                }
+            } elseif {[info commands ::xotcl::Object] ne ""} {
+                # XOTcl 1
+                set xotcl 1
+                foreach n [namespaces] {
+                    if {[string match "::xotcl*" $n]
+                        || [::xotcl::Object isobject $n]} { continue}
+                    lappend nsps $n
+                }
+            } else {
+                set xotcl 0
+                set nsps [namespaces]
+            }
+            return [list $xotcl $nsps]
+        }
+
+        #
+        # Helper to return a script to re-generate the XOTcl/NX
+        # classes and objects.
+        #
+
+        proc _objectscript {xotcl} {
+            set script {}
+            if {$xotcl > 0} {
+                #
+                # Serialize XOTcl/NX content
+                #
+                if {[catch {::Serializer all} objects]} {
+                    ns_log warning "NX/XOTcl extension not loaded; classes an objects will not be included in blueprint\
+                      (error: $objects; $::errorInfo)."
+                } else {
+                    append script \
+                        \n "namespace import -force ::xotcl::*" \n $objects \n
+
+                    if {$xotcl > 1} {
+                        #
+                        # The serialization of the objects redefines
+                        # the Serializer object, therefore, we have to
+                        # repeat the namespace import.
+                        #
+                        append script \
+                            "namespace import -force ::nx::serializer::Serializer" \n
+                    }
+                }
+            }
+            return $script
+        }
+
         #
         # Helper to return a script to re-generate Tcl procedure.
         # Caller must wrap this script into [::namespace eval]
@@ -782,6 +910,17 @@ ns_runonce {
         #
 
         proc _procscript {cmd} {
+            set pname [::namespace tail $cmd]
+            set pbody [info body $cmd]
+            append script "proc [list $pname] [list [_procargs $cmd]] [list $pbody]" \n
+        }
+
+        #
+        # Helper to return the argument list of a Tcl procedure
+        # including the default values.
+        #
+
+        proc _procargs {cmd} {
             set pargs {}
             foreach arg [info args $cmd] {
                 if {![info default $cmd $arg def]} {
@@ -790,9 +929,7 @@ ns_runonce {
                     lappend pargs [list $arg $def]
                 }
             }
-            set pname [::namespace tail $cmd]
-            set pbody [info body $cmd]
-            append script "proc [list $pname] [list $pargs] [list $pbody]" \n
+            return $pargs
         }
 
         #